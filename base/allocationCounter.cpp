@@ -0,0 +1,62 @@
+/*
+* Heap allocation counter
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "allocationCounter.hpp"
+
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+
+namespace {
+    std::atomic<uint64_t> allocationCount{ 0 };
+}
+
+namespace vkx {
+    namespace allocations {
+        bool counting() {
+#if defined(VKX_COUNT_ALLOCATIONS)
+            return true;
+#else
+            return false;
+#endif
+        }
+
+        uint64_t count() {
+            return allocationCount.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+#if defined(VKX_COUNT_ALLOCATIONS)
+// The remaining forms (nothrow, array, sized delete) forward to these
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* result = malloc(size ? size : 1)) {
+        return result;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    free(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    free(pointer);
+}
+#endif
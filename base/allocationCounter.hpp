@@ -0,0 +1,23 @@
+/*
+* Heap allocation counter
+*
+* Built with VKX_COUNT_ALLOCATIONS (cmake -DENABLE_ALLOCATION_COUNTER=ON) the global operator new
+* counts every allocation, on all threads.  ExampleBase uses it to warn about frames that allocate
+* once the loop has settled.  Otherwise operator new is left alone and the count stays 0.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+namespace vkx {
+    namespace allocations {
+        // True if operator new is being counted
+        bool counting();
+
+        // Allocations through operator new since the process started
+        uint64_t count();
+    }
+}
@@ -0,0 +1,357 @@
+/*
+* Coroutine based asynchronous asset pipeline
+*
+* Loaders are written as straight line coroutines that await a file read, CPU decoding on the
+* work stealing pool and GPU uploads signalled by a fence.  Many loaders run at once, so disk,
+* CPU and GPU work overlaps across assets instead of running one step at a time.
+*
+*     vkx::async::Task<> loadThing(vkx::async::AssetPipeline& assets, std::string filename) {
+*         auto bytes = co_await assets.readFile(filename);                  // on a worker
+*         auto decoded = co_await assets.decode([&] { return parse(bytes); }); // on a worker
+*         thing = co_await assets.uploadBuffer(usage, decoded);            // main thread, fenced
+*     }
+*
+* Requires C++20 coroutines, VKX_ASYNC_ASSETS is defined when they are available.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine) || (defined(_MSVC_LANG) && _MSVC_LANG > 201703L)
+#define VKX_ASYNC_ASSETS 1
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <type_traits>
+
+#include "vulkanContext.hpp"
+#include "vulkanFencePoller.hpp"
+#include "workStealingPool.hpp"
+
+namespace vkx { namespace async {
+
+    template <typename T = void>
+    class Task;
+
+    namespace detail {
+        struct PromiseBase {
+            std::coroutine_handle<> continuation;
+            std::exception_ptr exception;
+
+            // Resume whoever awaited the task, if anyone
+            struct FinalAwaiter {
+                bool await_ready() noexcept { return false; }
+                template <typename Promise>
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+                    auto continuation = handle.promise().continuation;
+                    return continuation ? continuation : std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            FinalAwaiter final_suspend() noexcept { return {}; }
+            void unhandled_exception() { exception = std::current_exception(); }
+
+            void rethrow() {
+                if (exception) {
+                    std::rethrow_exception(exception);
+                }
+            }
+        };
+
+        template <typename T>
+        struct Promise : PromiseBase {
+            std::optional<T> value;
+
+            Task<T> get_return_object() noexcept;
+            void return_value(T result) { value.emplace(std::move(result)); }
+            T result() {
+                rethrow();
+                return std::move(*value);
+            }
+        };
+
+        template <>
+        struct Promise<void> : PromiseBase {
+            Task<void> get_return_object() noexcept;
+            void return_void() noexcept {}
+            void result() { rethrow(); }
+        };
+    }
+
+    // Lazily started coroutine.  Awaiting the task starts it and resumes the awaiting
+    // coroutine with its result (or exception) once it has finished.
+    template <typename T>
+    class Task {
+    public:
+        using promise_type = detail::Promise<T>;
+        using Handle = std::coroutine_handle<promise_type>;
+
+        Task() = default;
+        explicit Task(Handle handle) : handle(handle) {}
+        Task(Task&& other) noexcept : handle(other.handle) { other.handle = nullptr; }
+        Task& operator=(Task&& other) noexcept {
+            if (this != &other) {
+                reset();
+                handle = other.handle;
+                other.handle = nullptr;
+            }
+            return *this;
+        }
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+        ~Task() { reset(); }
+
+        bool done() const {
+            return !handle || handle.done();
+        }
+
+        auto operator co_await() noexcept {
+            struct Awaiter {
+                Handle handle;
+                bool await_ready() noexcept { return !handle || handle.done(); }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                    handle.promise().continuation = awaiting;
+                    return handle;
+                }
+                T await_resume() { return handle.promise().result(); }
+            };
+            return Awaiter{ handle };
+        }
+
+    private:
+        friend class AssetPipeline;
+        Handle handle;
+
+        void reset() {
+            if (handle) {
+                handle.destroy();
+                handle = nullptr;
+            }
+        }
+    };
+
+    namespace detail {
+        template <typename T>
+        inline Task<T> Promise<T>::get_return_object() noexcept {
+            return Task<T>{ std::coroutine_handle<Promise<T>>::from_promise(*this) };
+        }
+
+        inline Task<void> Promise<void>::get_return_object() noexcept {
+            return Task<void>{ std::coroutine_handle<Promise<void>>::from_promise(*this) };
+        }
+    }
+
+    // Resumes the awaiting coroutine on the rendering thread, during the next poll
+    struct MainThread {
+        FencePoller& poller;
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            poller.post([handle] { handle.resume(); });
+        }
+        void await_resume() noexcept {}
+    };
+
+    // Resumes the awaiting coroutine on the rendering thread once the fence is signalled
+    struct FenceSignalled {
+        FencePoller& poller;
+        vk::Fence fence;
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            poller.add(fence, [handle] { handle.resume(); });
+        }
+        void await_resume() noexcept {}
+    };
+
+    // Reads a whole file on a worker thread and resumes there with its contents
+    struct FileRead {
+        WorkStealingPool& pool;
+        std::string filename;
+        std::vector<uint8_t> data;
+        std::exception_ptr exception;
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            pool.submit([this, handle] {
+                try {
+                    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+                    if (!file) {
+                        throw std::runtime_error("Unable to open " + filename);
+                    }
+                    data.resize((size_t)file.tellg());
+                    file.seekg(0);
+                    file.read((char*)data.data(), data.size());
+                } catch (...) {
+                    exception = std::current_exception();
+                }
+                handle.resume();
+            });
+        }
+        std::vector<uint8_t> await_resume() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            return std::move(data);
+        }
+    };
+
+    // Runs function on a worker thread and resumes there with its result
+    template <typename F>
+    struct Decode {
+        using Result = std::invoke_result_t<F&>;
+        using Storage = std::conditional_t<std::is_void<Result>::value, bool, Result>;
+
+        WorkStealingPool& pool;
+        F function;
+        std::optional<Storage> result;
+        std::exception_ptr exception;
+
+        bool await_ready() noexcept { return false; }
+        void await_suspend(std::coroutine_handle<> handle) {
+            pool.submit([this, handle] {
+                try {
+                    if constexpr (std::is_void<Result>::value) {
+                        function();
+                        result.emplace(true);
+                    } else {
+                        result.emplace(function());
+                    }
+                } catch (...) {
+                    exception = std::current_exception();
+                }
+                handle.resume();
+            });
+        }
+        Result await_resume() {
+            if (exception) {
+                std::rethrow_exception(exception);
+            }
+            if constexpr (!std::is_void<Result>::value) {
+                return std::move(*result);
+            }
+        }
+    };
+
+    class AssetPipeline {
+    public:
+        // The poller must be polled regularly from the thread that owns the context's queue, the
+        // example base does this once per frame.
+        AssetPipeline(const Context& context, WorkStealingPool& pool, FencePoller& poller)
+            : context(context), pool(pool), poller(poller) {}
+
+        ~AssetPipeline() {
+            assert(tasks.empty() || outstanding == 0);
+        }
+
+        FileRead readFile(const std::string& filename) {
+            return FileRead{ pool, filename };
+        }
+
+        template <typename F>
+        Decode<std::decay_t<F>> decode(F&& function) {
+            return Decode<std::decay_t<F>>{ pool, std::forward<F>(function) };
+        }
+
+        MainThread mainThread() {
+            return MainThread{ poller };
+        }
+
+        FenceSignalled fence(const vk::Fence& fence) {
+            return FenceSignalled{ poller, fence };
+        }
+
+        // Copy data into a new device local buffer.  The copy is submitted from the rendering thread
+        // and the task finishes once its fence is signalled, without waiting for the queue to idle.
+        // data must stay valid until the returned task has completed.
+        Task<CreateBufferResult> uploadBuffer(vk::BufferUsageFlags usage, vk::DeviceSize size, const void* data) {
+            co_await mainThread();
+            CreateBufferResult staging = context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible, size, data);
+            CreateBufferResult result = context.createBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, size);
+
+            vk::CommandBuffer copyCmd = context.createCommandBuffer(vk::CommandBufferLevel::ePrimary, true);
+            copyCmd.copyBuffer(staging.buffer, result.buffer, vk::BufferCopy(0, 0, size));
+            copyCmd.end();
+
+            vk::Fence uploaded = context.device.createFence(vk::FenceCreateInfo());
+            vk::SubmitInfo submitInfo;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &copyCmd;
+            context.queue.submit(submitInfo, uploaded);
+
+            co_await fence(uploaded);
+            context.device.destroyFence(uploaded);
+            context.device.freeCommandBuffers(context.getCommandPool(), copyCmd);
+            staging.destroy();
+            co_return result;
+        }
+
+        template <typename T>
+        Task<CreateBufferResult> uploadBuffer(vk::BufferUsageFlags usage, const std::vector<T>& data) {
+            return uploadBuffer(usage, data.size() * sizeof(T), data.data());
+        }
+
+        // Start a loader without awaiting it.  Must be called from the rendering thread.
+        void spawn(Task<> task) {
+            collect();
+            ++outstanding;
+            tasks.push_back(track(std::move(task)));
+            tasks.back().handle.resume();
+        }
+
+        // Number of spawned loaders that have not finished yet
+        uint32_t pending() const {
+            return outstanding;
+        }
+
+        // Polls until every spawned loader has finished, rethrowing the first failure.  Meant for
+        // prepare(), where nothing can be drawn until the assets are in place.
+        void waitAll() {
+            while (outstanding) {
+                poller.poll(context.device);
+                if (outstanding) {
+                    std::this_thread::yield();
+                }
+            }
+            collect();
+        }
+
+    private:
+        const Context& context;
+        WorkStealingPool& pool;
+        FencePoller& poller;
+        std::vector<Task<>> tasks;
+        // Only touched on the rendering thread
+        uint32_t outstanding{ 0 };
+        std::exception_ptr failure;
+
+        // Loaders can finish on any thread, so the wrapper returns to the rendering thread before
+        // completing.  That way the frames are only inspected and destroyed where they finish.
+        Task<> track(Task<> task) {
+            std::exception_ptr exception;
+            try {
+                co_await task;
+            } catch (...) {
+                exception = std::current_exception();
+            }
+            co_await mainThread();
+            if (exception && !failure) {
+                failure = exception;
+            }
+            --outstanding;
+        }
+
+        void collect() {
+            tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [](const Task<>& task) { return task.done(); }), tasks.end());
+            if (failure) {
+                std::exception_ptr exception = failure;
+                failure = nullptr;
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+} }
+
+#endif
@@ -0,0 +1,184 @@
+/*
+* Timing statistics shared by the benchmarks and the examples' benchmark mode
+*
+* Samples are summarized as percentiles and can be written as JSON, so runs of different builds
+* can be compared by scripts.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vkx {
+    namespace benchmark {
+        using Clock = std::chrono::high_resolution_clock;
+
+        struct Stats {
+            size_t samples{ 0 };
+            double min{ 0 };
+            double median{ 0 };
+            double mean{ 0 };
+            double p95{ 0 };
+            double p99{ 0 };
+            double max{ 0 };
+        };
+
+        // Percentile of an already sorted list of samples
+        inline double percentile(const std::vector<double>& sorted, double fraction) {
+            if (sorted.empty()) {
+                return 0.0;
+            }
+            size_t index = std::min(sorted.size() - 1, (size_t)(fraction * (sorted.size() - 1) + 0.5));
+            return sorted[index];
+        }
+
+        inline Stats summarize(std::vector<double> samples) {
+            Stats result;
+            result.samples = samples.size();
+            if (samples.empty()) {
+                return result;
+            }
+            std::sort(samples.begin(), samples.end());
+            result.min = samples.front();
+            result.max = samples.back();
+            result.median = percentile(samples, 0.5);
+            result.p95 = percentile(samples, 0.95);
+            result.p99 = percentile(samples, 0.99);
+            result.mean = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+            return result;
+        }
+
+        inline double seconds(const Clock::time_point& start, const Clock::time_point& end) {
+            return std::chrono::duration<double>(end - start).count();
+        }
+
+        // Runs f warmup times without recording, then returns the duration of each of the
+        // following iterations in seconds
+        template <typename F>
+        std::vector<double> sample(size_t iterations, size_t warmup, F f) {
+            for (size_t i = 0; i < warmup; ++i) {
+                f();
+            }
+            std::vector<double> result;
+            result.reserve(iterations);
+            for (size_t i = 0; i < iterations; ++i) {
+                auto start = Clock::now();
+                f();
+                result.push_back(seconds(start, Clock::now()));
+            }
+            return result;
+        }
+
+        // Drops samples outside the Tukey fences, 1.5 interquartile ranges beyond the quartiles, which
+        // removes the occasional preempted or interrupted sample without touching a wide distribution
+        inline std::vector<double> rejectOutliers(std::vector<double> samples, size_t* rejected = nullptr) {
+            std::sort(samples.begin(), samples.end());
+            const double q1 = percentile(samples, 0.25);
+            const double q3 = percentile(samples, 0.75);
+            const double low = q1 - 1.5 * (q3 - q1);
+            const double high = q3 + 1.5 * (q3 - q1);
+            std::vector<double> result;
+            result.reserve(samples.size());
+            for (double sample : samples) {
+                if (sample >= low && sample <= high) {
+                    result.push_back(sample);
+                }
+            }
+            if (rejected) {
+                *rejected = samples.size() - result.size();
+            }
+            return result;
+        }
+
+        struct Measurement {
+            // Seconds per call, of the samples left after rejecting outliers
+            Stats stats;
+            // Calls timed together in each sample
+            size_t batch{ 1 };
+            size_t outliers{ 0 };
+            // Relative standard deviation of the kept samples
+            double variation{ 0 };
+        };
+
+        // Times f in batches long enough for the clock's resolution not to matter.  f runs for at least
+        // warmupTime seconds first, which also settles the batch size, then samples batches are timed.
+        template <typename F>
+        Measurement measure(F f, size_t samples = 50, double minSampleTime = 1e-3, double warmupTime = 0.05) {
+            Measurement result;
+            auto warmupEnd = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(warmupTime));
+            double elapsed = 0;
+            do {
+                auto start = Clock::now();
+                for (size_t i = 0; i < result.batch; ++i) {
+                    f();
+                }
+                elapsed = seconds(start, Clock::now());
+                if (elapsed < minSampleTime) {
+                    result.batch *= 2;
+                }
+            } while (elapsed < minSampleTime || Clock::now() < warmupEnd);
+
+            std::vector<double> times;
+            times.reserve(samples);
+            for (size_t s = 0; s < samples; ++s) {
+                auto start = Clock::now();
+                for (size_t i = 0; i < result.batch; ++i) {
+                    f();
+                }
+                times.push_back(seconds(start, Clock::now()) / result.batch);
+            }
+            times = rejectOutliers(times, &result.outliers);
+            result.stats = summarize(times);
+            double variance = 0;
+            for (double time : times) {
+                variance += (time - result.stats.mean) * (time - result.stats.mean);
+            }
+            if (times.size() > 1 && result.stats.mean > 0) {
+                result.variation = sqrt(variance / (times.size() - 1)) / result.stats.mean;
+            }
+            return result;
+        }
+
+        // Quoted and escaped JSON string
+        inline std::string quote(const std::string& value) {
+            std::string result{ "\"" };
+            for (char c : value) {
+                switch (c) {
+                case '"': result += "\\\""; break;
+                case '\\': result += "\\\\"; break;
+                case '\n': result += "\\n"; break;
+                case '\t': result += "\\t"; break;
+                default:
+                    if ((unsigned char)c < 0x20) {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        result += escaped;
+                    } else {
+                        result += c;
+                    }
+                }
+            }
+            return result + "\"";
+        }
+
+        inline void writeJson(std::ostream& out, const Stats& stats) {
+            out << "{ \"samples\": " << stats.samples
+                << ", \"mean\": " << stats.mean
+                << ", \"min\": " << stats.min
+                << ", \"p50\": " << stats.median
+                << ", \"p95\": " << stats.p95
+                << ", \"p99\": " << stats.p99
+                << ", \"max\": " << stats.max << " }";
+        }
+    }
+}
@@ -0,0 +1,381 @@
+/*
+* CPU block compression (BC1 / BC3) for uncompressed RGBA8 texture data
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "blockCompression.h"
+#include "workStealingPool.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VKX_BC_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace vkx {
+    namespace bc {
+
+        namespace {
+            // Expand a 5 or 6 bit channel back to 8 bits the same way the hardware does
+            inline uint8_t expand5(uint32_t v) { return (uint8_t)((v << 3) | (v >> 2)); }
+            inline uint8_t expand6(uint32_t v) { return (uint8_t)((v << 2) | (v >> 4)); }
+
+            inline uint16_t packColor565(float r, float g, float b) {
+                uint32_t r5 = (uint32_t)(std::min(std::max(r, 0.0f), 255.0f) * (31.0f / 255.0f) + 0.5f);
+                uint32_t g6 = (uint32_t)(std::min(std::max(g, 0.0f), 255.0f) * (63.0f / 255.0f) + 0.5f);
+                uint32_t b5 = (uint32_t)(std::min(std::max(b, 0.0f), 255.0f) * (31.0f / 255.0f) + 0.5f);
+                return (uint16_t)((r5 << 11) | (g6 << 5) | b5);
+            }
+
+            inline void unpackColor565(uint16_t c, uint8_t* rgb) {
+                rgb[0] = expand5((c >> 11) & 0x1F);
+                rgb[1] = expand6((c >> 5) & 0x3F);
+                rgb[2] = expand5(c & 0x1F);
+            }
+
+            // Quantized position along a segment, mapped to the BC1 index order
+            // (endpoint 0, endpoint 1, 2/3 * e0 + 1/3 * e1, 1/3 * e0 + 2/3 * e1)
+            const uint32_t COLOR_INDEX_MAP[4] = { 0, 2, 3, 1 };
+
+            // dr, dg and db are the segment scaled by 3 / its squared length
+            void selectColorIndicesScalar(const float* r, const float* g, const float* b, const uint8_t* p0, float dr, float dg, float db, uint32_t* quantized) {
+                const float r0 = (float)p0[0];
+                const float g0 = (float)p0[1];
+                const float b0 = (float)p0[2];
+                for (uint32_t i = 0; i < 16; ++i) {
+                    float t = (r[i] - r0) * dr;
+                    t = t + (g[i] - g0) * dg;
+                    t = t + (b[i] - b0) * db;
+                    t = std::min(std::max(t, 0.0f), 3.0f);
+                    // Like _mm_cvtps_epi32 in the default rounding mode
+                    quantized[i] = (uint32_t)nearbyintf(t);
+                }
+            }
+
+            // Computes the 16 palette indices for the segment p0 -> p1 by projecting each pixel onto it.
+            // Both paths do the same float operations in the same order and round half to even, so
+            // they select the same indices.
+            void selectColorIndices(const float* r, const float* g, const float* b, const uint8_t* p0, const uint8_t* p1, uint32_t* quantized, bool simd) {
+                float dr = (float)p1[0] - (float)p0[0];
+                float dg = (float)p1[1] - (float)p0[1];
+                float db = (float)p1[2] - (float)p0[2];
+                float len2 = dr * dr + dg * dg + db * db;
+                float scale = len2 > 0.0f ? 3.0f / len2 : 0.0f;
+                dr *= scale;
+                dg *= scale;
+                db *= scale;
+#if defined(VKX_BC_SSE2)
+                if (!simd) {
+                    selectColorIndicesScalar(r, g, b, p0, dr, dg, db, quantized);
+                    return;
+                }
+                const __m128 vdr = _mm_set1_ps(dr);
+                const __m128 vdg = _mm_set1_ps(dg);
+                const __m128 vdb = _mm_set1_ps(db);
+                const __m128 vr0 = _mm_set1_ps((float)p0[0]);
+                const __m128 vg0 = _mm_set1_ps((float)p0[1]);
+                const __m128 vb0 = _mm_set1_ps((float)p0[2]);
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 three = _mm_set1_ps(3.0f);
+                for (uint32_t i = 0; i < 16; i += 4) {
+                    __m128 t = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(r + i), vr0), vdr);
+                    t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(g + i), vg0), vdg));
+                    t = _mm_add_ps(t, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + i), vb0), vdb));
+                    t = _mm_min_ps(_mm_max_ps(t, zero), three);
+                    // Default MXCSR rounding mode is round to nearest
+                    _mm_storeu_si128((__m128i*)(quantized + i), _mm_cvtps_epi32(t));
+                }
+#else
+                selectColorIndicesScalar(r, g, b, p0, dr, dg, db, quantized);
+#endif
+            }
+
+            void encodeColorBlock(const uint8_t* rgba, uint8_t* output, bool simd) {
+                float r[16], g[16], b[16];
+                float mean[3] = { 0, 0, 0 };
+                for (uint32_t i = 0; i < 16; ++i) {
+                    r[i] = rgba[i * 4 + 0];
+                    g[i] = rgba[i * 4 + 1];
+                    b[i] = rgba[i * 4 + 2];
+                    mean[0] += r[i];
+                    mean[1] += g[i];
+                    mean[2] += b[i];
+                }
+                mean[0] /= 16.0f;
+                mean[1] /= 16.0f;
+                mean[2] /= 16.0f;
+
+                // Covariance matrix of the block colors
+                float cov[6] = { 0, 0, 0, 0, 0, 0 };
+                for (uint32_t i = 0; i < 16; ++i) {
+                    float dr = r[i] - mean[0];
+                    float dg = g[i] - mean[1];
+                    float db = b[i] - mean[2];
+                    cov[0] += dr * dr;
+                    cov[1] += dr * dg;
+                    cov[2] += dr * db;
+                    cov[3] += dg * dg;
+                    cov[4] += dg * db;
+                    cov[5] += db * db;
+                }
+
+                // Principal axis by power iteration, seeded with the luminance direction
+                float axis[3] = { 1.0f, 1.0f, 1.0f };
+                for (uint32_t iteration = 0; iteration < 4; ++iteration) {
+                    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+                    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+                    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+                    float norm = std::max(std::max(fabsf(x), fabsf(y)), fabsf(z));
+                    if (norm <= 0.0f) {
+                        break;
+                    }
+                    axis[0] = x / norm;
+                    axis[1] = y / norm;
+                    axis[2] = z / norm;
+                }
+                float axisLen2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+                float tMin = std::numeric_limits<float>::max();
+                float tMax = -std::numeric_limits<float>::max();
+                for (uint32_t i = 0; i < 16; ++i) {
+                    float t = ((r[i] - mean[0]) * axis[0] + (g[i] - mean[1]) * axis[1] + (b[i] - mean[2]) * axis[2]) / axisLen2;
+                    tMin = std::min(tMin, t);
+                    tMax = std::max(tMax, t);
+                }
+                // Inset the endpoints slightly, the extremes are rarely the best choice after quantization
+                float inset = (tMax - tMin) / 16.0f;
+                tMin += inset;
+                tMax -= inset;
+
+                uint16_t c0 = packColor565(mean[0] + axis[0] * tMax, mean[1] + axis[1] * tMax, mean[2] + axis[2] * tMax);
+                uint16_t c1 = packColor565(mean[0] + axis[0] * tMin, mean[1] + axis[1] * tMin, mean[2] + axis[2] * tMin);
+                // Four color mode requires c0 > c1
+                if (c0 < c1) {
+                    std::swap(c0, c1);
+                }
+
+                uint32_t indices = 0;
+                if (c0 != c1) {
+                    uint8_t p0[3], p1[3];
+                    unpackColor565(c0, p0);
+                    unpackColor565(c1, p1);
+                    uint32_t quantized[16];
+                    selectColorIndices(r, g, b, p0, p1, quantized, simd);
+                    for (uint32_t i = 0; i < 16; ++i) {
+                        indices |= COLOR_INDEX_MAP[quantized[i]] << (i * 2);
+                    }
+                }
+
+                output[0] = (uint8_t)(c0 & 0xFF);
+                output[1] = (uint8_t)(c0 >> 8);
+                output[2] = (uint8_t)(c1 & 0xFF);
+                output[3] = (uint8_t)(c1 >> 8);
+                memcpy(output + 4, &indices, sizeof(uint32_t));
+            }
+
+            void encodeAlphaBlock(const uint8_t* rgba, uint8_t* output) {
+                uint8_t aMin = 255, aMax = 0;
+                for (uint32_t i = 0; i < 16; ++i) {
+                    aMin = std::min(aMin, rgba[i * 4 + 3]);
+                    aMax = std::max(aMax, rgba[i * 4 + 3]);
+                }
+
+                // Eight value interpolation mode, a0 > a1
+                uint64_t indices = 0;
+                if (aMax != aMin) {
+                    float scale = 7.0f / (float)(aMax - aMin);
+                    for (uint32_t i = 0; i < 16; ++i) {
+                        uint32_t q = (uint32_t)((float)(aMax - rgba[i * 4 + 3]) * scale + 0.5f);
+                        uint64_t index = (q == 0) ? 0 : (q == 7) ? 1 : q + 1;
+                        indices |= index << (i * 3);
+                    }
+                }
+
+                output[0] = aMax;
+                output[1] = aMin;
+                for (uint32_t i = 0; i < 6; ++i) {
+                    output[2 + i] = (uint8_t)((indices >> (i * 8)) & 0xFF);
+                }
+            }
+
+            void decodeColorBlock(const uint8_t* block, uint8_t* rgba, bool forceFourColor) {
+                uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+                uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+                uint8_t palette[4][4];
+                unpackColor565(c0, palette[0]);
+                unpackColor565(c1, palette[1]);
+                palette[0][3] = palette[1][3] = 255;
+                if (forceFourColor || c0 > c1) {
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        palette[2][c] = (uint8_t)((2 * palette[0][c] + palette[1][c]) / 3);
+                        palette[3][c] = (uint8_t)((palette[0][c] + 2 * palette[1][c]) / 3);
+                    }
+                    palette[2][3] = palette[3][3] = 255;
+                } else {
+                    for (uint32_t c = 0; c < 3; ++c) {
+                        palette[2][c] = (uint8_t)((palette[0][c] + palette[1][c]) / 2);
+                        palette[3][c] = 0;
+                    }
+                    palette[2][3] = 255;
+                    palette[3][3] = 0;
+                }
+                uint32_t indices;
+                memcpy(&indices, block + 4, sizeof(uint32_t));
+                for (uint32_t i = 0; i < 16; ++i) {
+                    memcpy(rgba + i * 4, palette[(indices >> (i * 2)) & 0x3], 4);
+                }
+            }
+
+            void decodeAlphaBlock(const uint8_t* block, uint8_t* rgba) {
+                uint32_t a0 = block[0], a1 = block[1];
+                uint8_t palette[8];
+                palette[0] = (uint8_t)a0;
+                palette[1] = (uint8_t)a1;
+                if (a0 > a1) {
+                    for (uint32_t i = 2; i < 8; ++i) {
+                        palette[i] = (uint8_t)(((8 - i) * a0 + (i - 1) * a1) / 7);
+                    }
+                } else {
+                    for (uint32_t i = 2; i < 6; ++i) {
+                        palette[i] = (uint8_t)(((6 - i) * a0 + (i - 1) * a1) / 5);
+                    }
+                    palette[6] = 0;
+                    palette[7] = 255;
+                }
+                uint64_t indices = 0;
+                for (uint32_t i = 0; i < 6; ++i) {
+                    indices |= (uint64_t)block[2 + i] << (i * 8);
+                }
+                for (uint32_t i = 0; i < 16; ++i) {
+                    rgba[i * 4 + 3] = palette[(indices >> (i * 3)) & 0x7];
+                }
+            }
+
+            inline uint32_t blocksFor(uint32_t pixels) {
+                return std::max<uint32_t>(1, (pixels + 3) / 4);
+            }
+
+            // Encode the block rows [firstRow, lastRow) of an image
+            void encodeRows(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* output, uint32_t firstRow, uint32_t lastRow, bool simd) {
+                const uint32_t blocksX = blocksFor(width);
+                const uint32_t size = blockSize(format);
+                uint8_t block[64];
+                for (uint32_t by = firstRow; by < lastRow; ++by) {
+                    uint8_t* rowOutput = output + (size_t)by * blocksX * size;
+                    for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                        // Gather the block, replicating edge pixels for partial blocks
+                        for (uint32_t y = 0; y < 4; ++y) {
+                            uint32_t sy = std::min(by * 4 + y, height - 1);
+                            for (uint32_t x = 0; x < 4; ++x) {
+                                uint32_t sx = std::min(bx * 4 + x, width - 1);
+                                memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                            }
+                        }
+                        if (format == Format::BC1) {
+                            encodeBlockBC1(block, rowOutput + bx * size, simd);
+                        } else {
+                            encodeBlockBC3(block, rowOutput + bx * size, simd);
+                        }
+                    }
+                }
+            }
+        }
+
+        uint32_t blockSize(Format format) {
+            return format == Format::BC1 ? 8 : 16;
+        }
+
+        size_t imageSize(Format format, uint32_t width, uint32_t height) {
+            return (size_t)blocksFor(width) * blocksFor(height) * blockSize(format);
+        }
+
+        void encodeBlockBC1(const uint8_t* rgba, uint8_t* output, bool simd) {
+            encodeColorBlock(rgba, output, simd);
+        }
+
+        void encodeBlockBC3(const uint8_t* rgba, uint8_t* output, bool simd) {
+            encodeAlphaBlock(rgba, output);
+            encodeColorBlock(rgba, output + 8, simd);
+        }
+
+        void decodeBlockBC1(const uint8_t* block, uint8_t* rgba) {
+            decodeColorBlock(block, rgba, false);
+        }
+
+        void decodeBlockBC3(const uint8_t* block, uint8_t* rgba) {
+            decodeColorBlock(block + 8, rgba, true);
+            decodeAlphaBlock(block, rgba);
+        }
+
+        void encodeImage(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* output, WorkStealingPool* threadPool, bool simd) {
+            const uint32_t blocksY = blocksFor(height);
+            if (!threadPool || blocksY < 2) {
+                encodeRows(format, rgba, width, height, output, 0, blocksY, simd);
+                return;
+            }
+
+            // Split the block rows into a few jobs per thread so uneven rows still balance out
+            const uint32_t threadCount = threadPool->threadCount();
+            const uint32_t jobCount = std::min(blocksY, threadCount * 4);
+            const uint32_t rowsPerJob = (blocksY + jobCount - 1) / jobCount;
+            for (uint32_t row = 0; row < blocksY; row += rowsPerJob) {
+                uint32_t lastRow = std::min(row + rowsPerJob, blocksY);
+                threadPool->submit([=] {
+                    encodeRows(format, rgba, width, height, output, row, lastRow, simd);
+                });
+            }
+            threadPool->wait();
+        }
+
+        std::vector<uint8_t> encodeImage(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, WorkStealingPool* threadPool, bool simd) {
+            std::vector<uint8_t> result(imageSize(format, width, height));
+            encodeImage(format, rgba, width, height, result.data(), threadPool, simd);
+            return result;
+        }
+
+        std::vector<uint8_t> decodeImage(Format format, const uint8_t* blocks, uint32_t width, uint32_t height) {
+            std::vector<uint8_t> result((size_t)width * height * 4);
+            const uint32_t blocksX = blocksFor(width);
+            const uint32_t blocksY = blocksFor(height);
+            const uint32_t size = blockSize(format);
+            uint8_t block[64];
+            for (uint32_t by = 0; by < blocksY; ++by) {
+                for (uint32_t bx = 0; bx < blocksX; ++bx) {
+                    const uint8_t* input = blocks + ((size_t)by * blocksX + bx) * size;
+                    if (format == Format::BC1) {
+                        decodeBlockBC1(input, block);
+                    } else {
+                        decodeBlockBC3(input, block);
+                    }
+                    for (uint32_t y = 0; y < 4 && by * 4 + y < height; ++y) {
+                        for (uint32_t x = 0; x < 4 && bx * 4 + x < width; ++x) {
+                            memcpy(result.data() + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, block + (y * 4 + x) * 4, 4);
+                        }
+                    }
+                }
+            }
+            return result;
+        }
+
+        double psnr(const uint8_t* a, const uint8_t* b, size_t pixelCount, bool includeAlpha) {
+            const uint32_t channels = includeAlpha ? 4 : 3;
+            double sum = 0.0;
+            for (size_t i = 0; i < pixelCount; ++i) {
+                for (uint32_t c = 0; c < channels; ++c) {
+                    double d = (double)a[i * 4 + c] - (double)b[i * 4 + c];
+                    sum += d * d;
+                }
+            }
+            double mse = sum / (double)(pixelCount * channels);
+            if (mse <= 0.0) {
+                return std::numeric_limits<double>::infinity();
+            }
+            return 10.0 * log10((255.0 * 255.0) / mse);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+/*
+* CPU block compression (BC1 / BC3) for uncompressed RGBA8 texture data
+*
+* Endpoints are chosen along the principal axis of each 4x4 block and the
+* per-pixel palette indices are selected by projecting onto that axis, which
+* is done four pixels at a time with SSE2 when available (scalar otherwise).
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace vkx {
+    class WorkStealingPool;
+
+    namespace bc {
+        enum class Format {
+            // 4 bits per pixel, RGB plus 1 bit alpha (unused by the encoder)
+            BC1,
+            // 8 bits per pixel, RGB plus interpolated alpha
+            BC3,
+        };
+
+        // Size in bytes of a single compressed 4x4 block
+        uint32_t blockSize(Format format);
+
+        // Size in bytes of a compressed image with the given dimensions
+        size_t imageSize(Format format, uint32_t width, uint32_t height);
+
+        // Encode a single 4x4 block of RGBA8 pixels (row major, 64 bytes).  simd selects the SSE2
+        // path where it is available, the scalar path produces identical blocks.
+        void encodeBlockBC1(const uint8_t* rgba, uint8_t* output, bool simd = true);
+        void encodeBlockBC3(const uint8_t* rgba, uint8_t* output, bool simd = true);
+
+        // Decode a single block back to 4x4 RGBA8 pixels, used for measuring encoder quality
+        void decodeBlockBC1(const uint8_t* block, uint8_t* rgba);
+        void decodeBlockBC3(const uint8_t* block, uint8_t* rgba);
+
+        // Encode a full RGBA8 image.  Partial blocks at the right and bottom edges are padded
+        // by replicating the edge pixels.  If a thread pool is provided, the block rows are
+        // distributed across its threads and the call blocks until they have all completed.
+        void encodeImage(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* output, WorkStealingPool* threadPool = nullptr, bool simd = true);
+        std::vector<uint8_t> encodeImage(Format format, const uint8_t* rgba, uint32_t width, uint32_t height, WorkStealingPool* threadPool = nullptr, bool simd = true);
+
+        // Decode a full compressed image back to RGBA8
+        std::vector<uint8_t> decodeImage(Format format, const uint8_t* blocks, uint32_t width, uint32_t height);
+
+        // Peak signal to noise ratio in dB between two RGBA8 images of pixelCount pixels.
+        // Alpha is only taken into account if includeAlpha is set.
+        double psnr(const uint8_t* a, const uint8_t* b, size_t pixelCount, bool includeAlpha = false);
+    }
+}
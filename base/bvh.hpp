@@ -0,0 +1,417 @@
+/*
+* Bounding volume hierarchy
+*
+* Built over a list of axis aligned boxes with a binned surface area heuristic.  Nodes are
+* stored depth first in a flat array: the left child of an interior node directly follows it,
+* and the entries of any subtree are one contiguous range of the index list.  That lets the
+* frustum query hand whole subtrees to the caller once they are fully inside, and lets refit
+* update moving objects with one backwards pass over the nodes.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+namespace vkx {
+    struct Aabb {
+        glm::vec3 min{ FLT_MAX };
+        glm::vec3 max{ -FLT_MAX };
+
+        Aabb() {}
+        Aabb(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+        bool valid() const {
+            return min.x <= max.x && min.y <= max.y && min.z <= max.z;
+        }
+
+        glm::vec3 center() const {
+            return (min + max) * 0.5f;
+        }
+
+        glm::vec3 extent() const {
+            return (max - min) * 0.5f;
+        }
+
+        float surfaceArea() const {
+            if (!valid()) {
+                return 0.0f;
+            }
+            glm::vec3 size = max - min;
+            return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+        }
+
+        void expand(const glm::vec3& point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        void expand(const Aabb& other) {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+
+        // Box enclosing this box after transforming it by matrix
+        Aabb transformed(const glm::mat4& matrix) const {
+            glm::vec3 c = glm::vec3(matrix * glm::vec4(center(), 1.0f));
+            glm::vec3 e = extent();
+            glm::mat3 absolute(glm::abs(glm::vec3(matrix[0])), glm::abs(glm::vec3(matrix[1])), glm::abs(glm::vec3(matrix[2])));
+            glm::vec3 transformedExtent = absolute * e;
+            return Aabb(c - transformedExtent, c + transformedExtent);
+        }
+    };
+
+    class Bvh {
+    public:
+        struct Node {
+            glm::vec3 min;
+            // First entry of the subtree in indices
+            uint32_t first;
+            glm::vec3 max;
+            // Number of entries in the subtree
+            uint32_t count;
+            // Right child of an interior node, 0 for leaves
+            uint32_t right;
+
+            bool isLeaf() const {
+                return right == 0;
+            }
+        };
+
+        // Deeper subtrees are turned into leaves, which bounds the traversal stack
+        static const uint32_t MAX_DEPTH = 64;
+        static const uint32_t BIN_COUNT = 16;
+
+        std::vector<Node> nodes;
+        // Entry indices, leaves and subtrees reference ranges of this list
+        std::vector<uint32_t> indices;
+        std::vector<Aabb> bounds;
+
+        bool empty() const {
+            return nodes.empty();
+        }
+
+        // Builds the hierarchy over bounds.  Entry i of the queries is bounds[i].
+        void build(const std::vector<Aabb>& entryBounds, uint32_t maxLeafSize = 4) {
+            bounds = entryBounds;
+            this->maxLeafSize = std::max(1u, maxLeafSize);
+            const uint32_t count = (uint32_t)bounds.size();
+            indices.resize(count);
+            centers.resize(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                indices[i] = i;
+                centers[i] = bounds[i].center();
+            }
+            nodes.clear();
+            if (!count) {
+                return;
+            }
+            nodes.reserve(2 * count);
+            buildNode(0, count, 0);
+        }
+
+        // Updates the node bounds after entries have moved, keeping the tree topology.  Much cheaper than
+        // a rebuild, but the tree quality degrades as entries move far from where they were at build time.
+        void refit(const std::vector<Aabb>& entryBounds) {
+            assert(entryBounds.size() == bounds.size());
+            bounds = entryBounds;
+            // Children always come after their parent
+            for (size_t i = nodes.size(); i-- > 0;) {
+                Node& node = nodes[i];
+                Aabb box;
+                if (node.isLeaf()) {
+                    for (uint32_t e = node.first; e < node.first + node.count; ++e) {
+                        box.expand(bounds[indices[e]]);
+                    }
+                } else {
+                    box = nodeBounds(nodes[i + 1]);
+                    box.expand(nodeBounds(nodes[node.right]));
+                }
+                node.min = box.min;
+                node.max = box.max;
+            }
+        }
+
+        // Calls visit(entry) for every entry whose box is not outside the frustum.  Subtrees that are fully
+        // inside are emitted without testing any further boxes.
+        template <typename F>
+        void queryFrustum(const vkTools::Frustum& frustum, F visit) const {
+            if (nodes.empty()) {
+                return;
+            }
+            struct Item {
+                uint32_t node;
+                // Planes the node's parent was not yet fully inside of
+                uint32_t planes;
+            };
+            std::array<Item, MAX_DEPTH + 1> stack;
+            uint32_t size = 0;
+            stack[size++] = { 0, 0x3f };
+            while (size) {
+                Item item = stack[--size];
+                const Node& node = nodes[item.node];
+                uint32_t planes = item.planes;
+                if (!classify(frustum, node.min, node.max, planes)) {
+                    continue;
+                }
+                if (!planes) {
+                    for (uint32_t e = node.first; e < node.first + node.count; ++e) {
+                        visit(indices[e]);
+                    }
+                } else if (node.isLeaf()) {
+                    for (uint32_t e = node.first; e < node.first + node.count; ++e) {
+                        uint32_t entryPlanes = planes;
+                        if (classify(frustum, bounds[indices[e]].min, bounds[indices[e]].max, entryPlanes)) {
+                            visit(indices[e]);
+                        }
+                    }
+                } else {
+                    stack[size++] = { node.right, planes };
+                    stack[size++] = { item.node + 1, planes };
+                }
+            }
+        }
+
+        // Calls visit(entry, distance) for every entry whose box the ray enters within maxDistance.
+        // Nearer children are visited first, but entries are not sorted by distance.
+        template <typename F>
+        void queryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, F visit) const {
+            if (nodes.empty()) {
+                return;
+            }
+            const glm::vec3 inverse = 1.0f / direction;
+            float distance;
+            if (!intersect(origin, inverse, maxDistance, nodes[0].min, nodes[0].max, distance)) {
+                return;
+            }
+            // Nodes are only pushed once the ray is known to hit them
+            std::array<uint32_t, MAX_DEPTH + 1> stack;
+            uint32_t size = 0;
+            stack[size++] = 0;
+            while (size) {
+                const Node& node = nodes[stack[--size]];
+                if (node.isLeaf()) {
+                    for (uint32_t e = node.first; e < node.first + node.count; ++e) {
+                        const Aabb& box = bounds[indices[e]];
+                        if (intersect(origin, inverse, maxDistance, box.min, box.max, distance)) {
+                            visit(indices[e], distance);
+                        }
+                    }
+                    continue;
+                }
+                uint32_t left = (uint32_t)(&node - nodes.data()) + 1;
+                uint32_t right = node.right;
+                float leftDistance, rightDistance;
+                bool hitLeft = intersect(origin, inverse, maxDistance, nodes[left].min, nodes[left].max, leftDistance);
+                bool hitRight = intersect(origin, inverse, maxDistance, nodes[right].min, nodes[right].max, rightDistance);
+                if (hitLeft && hitRight) {
+                    // Push the far child first so the near one is popped next
+                    if (leftDistance > rightDistance) {
+                        std::swap(left, right);
+                    }
+                    stack[size++] = right;
+                    stack[size++] = left;
+                } else if (hitLeft) {
+                    stack[size++] = left;
+                } else if (hitRight) {
+                    stack[size++] = right;
+                }
+            }
+        }
+
+        // Calls visit(entry) for every entry whose box overlaps the sphere
+        template <typename F>
+        void querySphere(const glm::vec3& center, float radius, F visit) const {
+            if (nodes.empty()) {
+                return;
+            }
+            const float radiusSquared = radius * radius;
+            std::array<uint32_t, MAX_DEPTH + 1> stack;
+            uint32_t size = 0;
+            stack[size++] = 0;
+            while (size) {
+                uint32_t index = stack[--size];
+                const Node& node = nodes[index];
+                if (distanceSquared(center, node.min, node.max) > radiusSquared) {
+                    continue;
+                }
+                if (node.isLeaf()) {
+                    for (uint32_t e = node.first; e < node.first + node.count; ++e) {
+                        const Aabb& box = bounds[indices[e]];
+                        if (distanceSquared(center, box.min, box.max) <= radiusSquared) {
+                            visit(indices[e]);
+                        }
+                    }
+                } else {
+                    stack[size++] = node.right;
+                    stack[size++] = index + 1;
+                }
+            }
+        }
+
+    private:
+        std::vector<glm::vec3> centers;
+        uint32_t maxLeafSize{ 4 };
+
+        static Aabb nodeBounds(const Node& node) {
+            return Aabb(node.min, node.max);
+        }
+
+        uint32_t buildNode(uint32_t begin, uint32_t end, uint32_t depth) {
+            const uint32_t index = (uint32_t)nodes.size();
+            nodes.push_back(Node());
+
+            Aabb box, centerBox;
+            for (uint32_t i = begin; i < end; ++i) {
+                box.expand(bounds[indices[i]]);
+                centerBox.expand(centers[indices[i]]);
+            }
+            const uint32_t count = end - begin;
+            nodes[index].min = box.min;
+            nodes[index].max = box.max;
+            nodes[index].first = begin;
+            nodes[index].count = count;
+            nodes[index].right = 0;
+
+            if (count <= maxLeafSize || depth + 1 >= MAX_DEPTH) {
+                return index;
+            }
+
+            uint32_t middle = split(begin, end, box, centerBox);
+            if (middle == UINT32_MAX) {
+                return index;
+            }
+            buildNode(begin, middle, depth + 1);
+            uint32_t right = buildNode(middle, end, depth + 1);
+            nodes[index].right = right;
+            return index;
+        }
+
+        // Partitions [begin, end) along the cheapest binned SAH split.  Returns UINT32_MAX when a leaf is cheaper.
+        uint32_t split(uint32_t begin, uint32_t end, const Aabb& box, const Aabb& centerBox) {
+            const uint32_t count = end - begin;
+            const glm::vec3 centerSize = centerBox.max - centerBox.min;
+            int axis = centerSize.x > centerSize.y ? (centerSize.x > centerSize.z ? 0 : 2) : (centerSize.y > centerSize.z ? 1 : 2);
+            if (centerSize[axis] <= 0.0f) {
+                // All centers coincide, no plane separates them
+                return (count > maxLeafSize * 4) ? medianSplit(begin, end, axis) : UINT32_MAX;
+            }
+
+            float bestCost = FLT_MAX;
+            int bestAxis = -1;
+            uint32_t bestBin = 0;
+            for (int a = 0; a < 3; ++a) {
+                if (centerSize[a] <= 0.0f) {
+                    continue;
+                }
+                std::array<Aabb, BIN_COUNT> binBounds;
+                std::array<uint32_t, BIN_COUNT> binCounts{};
+                const float scale = BIN_COUNT / centerSize[a];
+                for (uint32_t i = begin; i < end; ++i) {
+                    uint32_t bin = binIndex(centers[indices[i]][a], centerBox.min[a], scale);
+                    binBounds[bin].expand(bounds[indices[i]]);
+                    ++binCounts[bin];
+                }
+
+                // Sweep from the right to get the cost of the right side of every split plane
+                std::array<float, BIN_COUNT> rightCost;
+                Aabb rightBox;
+                uint32_t rightCount = 0;
+                for (uint32_t bin = BIN_COUNT - 1; bin > 0; --bin) {
+                    rightBox.expand(binBounds[bin]);
+                    rightCount += binCounts[bin];
+                    rightCost[bin] = rightBox.surfaceArea() * rightCount;
+                }
+                Aabb leftBox;
+                uint32_t leftCount = 0;
+                for (uint32_t bin = 0; bin + 1 < BIN_COUNT; ++bin) {
+                    leftBox.expand(binBounds[bin]);
+                    leftCount += binCounts[bin];
+                    float cost = leftBox.surfaceArea() * leftCount + rightCost[bin + 1];
+                    if (leftCount && leftCount < count && cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = a;
+                        bestBin = bin;
+                    }
+                }
+            }
+
+            // Compare against the cost of intersecting every entry of a leaf, with a traversal
+            // step costing about as much as one entry test
+            const float leafCost = box.surfaceArea() * count;
+            const float splitCost = box.surfaceArea() + bestCost;
+            if (bestAxis < 0 || (splitCost >= leafCost && count <= maxLeafSize * 4)) {
+                return bestAxis < 0 ? medianSplit(begin, end, axis) : UINT32_MAX;
+            }
+
+            const float scale = BIN_COUNT / centerSize[bestAxis];
+            const float minimum = centerBox.min[bestAxis];
+            auto middle = std::partition(indices.begin() + begin, indices.begin() + end, [&](uint32_t entry) {
+                return binIndex(centers[entry][bestAxis], minimum, scale) <= bestBin;
+            });
+            return (uint32_t)(middle - indices.begin());
+        }
+
+        uint32_t medianSplit(uint32_t begin, uint32_t end, int axis) {
+            uint32_t middle = begin + (end - begin) / 2;
+            std::nth_element(indices.begin() + begin, indices.begin() + middle, indices.begin() + end, [&](uint32_t a, uint32_t b) {
+                return centers[a][axis] < centers[b][axis];
+            });
+            return middle;
+        }
+
+        static uint32_t binIndex(float value, float minimum, float scale) {
+            return std::min(BIN_COUNT - 1, (uint32_t)((value - minimum) * scale));
+        }
+
+        // Returns false if the box is outside any of the planes.  Clears the planes the box is fully inside of.
+        static bool classify(const vkTools::Frustum& frustum, const glm::vec3& min, const glm::vec3& max, uint32_t& planes) {
+            const glm::vec3 center = (min + max) * 0.5f;
+            const glm::vec3 extent = (max - min) * 0.5f;
+            for (uint32_t p = 0; p < 6; ++p) {
+                if (!(planes & (1u << p))) {
+                    continue;
+                }
+                const glm::vec4& plane = frustum.planes[p];
+                float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+                float radius = fabsf(plane.x) * extent.x + fabsf(plane.y) * extent.y + fabsf(plane.z) * extent.z;
+                if (distance <= -radius) {
+                    return false;
+                }
+                if (distance >= radius) {
+                    planes &= ~(1u << p);
+                }
+            }
+            return true;
+        }
+
+        // Slab test, distance is where the ray enters the box (0 if it starts inside)
+        static bool intersect(const glm::vec3& origin, const glm::vec3& inverse, float maxDistance, const glm::vec3& min, const glm::vec3& max, float& distance) {
+            glm::vec3 t0 = (min - origin) * inverse;
+            glm::vec3 t1 = (max - origin) * inverse;
+            glm::vec3 entry = glm::min(t0, t1);
+            glm::vec3 leave = glm::max(t0, t1);
+            float enter = std::max(std::max(entry.x, entry.y), std::max(entry.z, 0.0f));
+            float exit = std::min(std::min(leave.x, leave.y), std::min(leave.z, maxDistance));
+            distance = enter;
+            return enter <= exit;
+        }
+
+        static float distanceSquared(const glm::vec3& point, const glm::vec3& min, const glm::vec3& max) {
+            glm::vec3 closest = glm::clamp(point, min, max);
+            glm::vec3 delta = point - closest;
+            return glm::dot(delta, delta);
+        }
+    };
+}
@@ -23,4 +23,32 @@ const vec3& Vectors::UP = Vectors::UNIT_Y;
 const vec3& Vectors::FRONT = Vectors::UNIT_NEG_Z;
 
 const quat Rotations::IDENTITY{ 1.0f, 0.0f, 0.0f, 0.0f };
-const quat Rotations::Y_180{ 0.0f, 0.0f, 1.0f, 0.0f };
\ No newline at end of file
+const quat Rotations::Y_180{ 0.0f, 0.0f, 1.0f, 0.0f };
+
+std::vector<std::string> CommandLine::arguments;
+
+void CommandLine::set(int argc, const char* argv[]) {
+    arguments.assign(argv, argv + argc);
+}
+
+bool CommandLine::has(const std::string& flag) {
+    return std::find(arguments.begin(), arguments.end(), flag) != arguments.end();
+}
+
+std::string CommandLine::value(const std::string& flag, const std::string& defaultValue) {
+    auto itr = std::find(arguments.begin(), arguments.end(), flag);
+    if (itr == arguments.end() || ++itr == arguments.end()) {
+        return defaultValue;
+    }
+    return *itr;
+}
+
+uint32_t randomSeed() {
+    if (CommandLine::has("-seed")) {
+        return (uint32_t)std::stoul(CommandLine::value("-seed", "0"));
+    }
+    if (CommandLine::has("-benchmark")) {
+        return 1234;
+    }
+    return (uint32_t)time(nullptr);
+}
@@ -17,6 +17,7 @@
 #include <iostream>
 #include <iomanip>
 #include <list>
+#include <memory>
 #include <mutex>
 #include <random>
 #include <set>
@@ -106,6 +107,24 @@ public:
     static const vec3 ZERO4;
 };
 
+// Arguments the executable was started with, set by ENTRY_POINT_START
+class CommandLine {
+public:
+    static void set(int argc, const char* argv[]);
+    static const std::vector<std::string>& get() { return arguments; }
+    // True if the flag is present
+    static bool has(const std::string& flag);
+    // The argument following the flag, or defaultValue if there is none
+    static std::string value(const std::string& flag, const std::string& defaultValue = "");
+
+private:
+    static std::vector<std::string> arguments;
+};
+
+// Seed for random number generators.  Fixed by -seed <n>, or in -benchmark mode, so runs are
+// reproducible, otherwise the current time.
+uint32_t randomSeed();
+
 
 // Image loading 
 #include <gli/gli.hpp>
@@ -124,7 +143,8 @@ public:
         }
 #else
 #define ENTRY_POINT_START \
-        int main(const int argc, const char *argv[]) {
+        int main(const int argc, const char *argv[]) { \
+            CommandLine::set(argc, argv);
 
 #define ENTRY_POINT_END \
         }
@@ -0,0 +1,102 @@
+/*
+* CPU scope profiler
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "cpuProfiler.hpp"
+
+#include <string.h>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <vector>
+
+#include "benchmark.hpp"
+
+namespace vkx {
+    namespace profiler {
+        namespace {
+            const auto start = std::chrono::steady_clock::now();
+            std::atomic<bool> enabled{ true };
+            // Registered buffers, only ever prepended to.  They outlive their threads so the events
+            // of finished threads still make it into the trace.
+            std::atomic<ThreadBuffer*> buffers{ nullptr };
+            std::atomic<uint32_t> threadCount{ 0 };
+
+            ThreadBuffer* registerThread() {
+                ThreadBuffer* buffer = new ThreadBuffer();
+                buffer->id = threadCount.fetch_add(1, std::memory_order_relaxed);
+                snprintf(buffer->name, sizeof(buffer->name), "Thread %u", buffer->id);
+                buffer->next = buffers.load(std::memory_order_relaxed);
+                while (!buffers.compare_exchange_weak(buffer->next, buffer, std::memory_order_release, std::memory_order_relaxed)) {
+                }
+                return buffer;
+            }
+        }
+
+        uint64_t now() {
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        ThreadBuffer& threadBuffer() {
+            static thread_local ThreadBuffer* buffer = registerThread();
+            return *buffer;
+        }
+
+        void setThreadName(const std::string& name) {
+            auto& buffer = threadBuffer();
+            strncpy(buffer.name, name.c_str(), sizeof(buffer.name) - 1);
+        }
+
+        void setEnabled(bool enable) {
+            enabled.store(enable, std::memory_order_relaxed);
+        }
+
+        bool isEnabled() {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        bool writeChromeTrace(const std::string& filename) {
+            std::ofstream out(filename);
+            if (!out) {
+                return false;
+            }
+            using vkx::benchmark::quote;
+            // Microseconds, with the full nanosecond resolution
+            out << std::fixed << std::setprecision(3);
+            out << "{ \"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+            bool first = true;
+            auto separator = [&] {
+                out << (first ? "  " : ",\n  ");
+                first = false;
+            };
+            std::vector<Event> events;
+            for (ThreadBuffer* buffer = buffers.load(std::memory_order_acquire); buffer; buffer = buffer->next) {
+                separator();
+                out << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->id
+                    << ", \"args\": { \"name\": " << quote(buffer->name) << " } }";
+
+                // The owning thread keeps writing, so copy the ring and keep only the events it
+                // can't have overwritten while copying
+                uint64_t end = buffer->written.load(std::memory_order_acquire);
+                uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+                events.clear();
+                for (uint64_t i = begin; i < end; ++i) {
+                    events.push_back(buffer->events[i % RING_SIZE]);
+                }
+                // The thread may already be writing event overwritten, into the slot of event overwritten - RING_SIZE
+                uint64_t overwritten = buffer->written.load(std::memory_order_acquire);
+                uint64_t valid = overwritten + 1 > RING_SIZE ? overwritten + 1 - RING_SIZE : 0;
+                for (uint64_t i = std::max(begin, valid); i < end; ++i) {
+                    const auto& event = events[i - begin];
+                    separator();
+                    out << "{ \"name\": " << quote(event.name) << ", \"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->id
+                        << ", \"ts\": " << event.begin / 1000.0 << ", \"dur\": " << (event.end - event.begin) / 1000.0 << " }";
+                }
+            }
+            out << "\n] }\n";
+            return (bool)out;
+        }
+    }
+}
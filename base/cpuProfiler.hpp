@@ -0,0 +1,95 @@
+/*
+* CPU scope profiler
+*
+* VKX_PROFILE_SCOPE("name") times the enclosing scope, VKX_PROFILE_FUNCTION() the enclosing
+* function.  Every thread appends its events to a ring buffer of its own, so recording takes no
+* locks; the rings are registered once in a lock-free list and merged when the trace is written.
+* When a ring is full the oldest events are overwritten.
+*
+* The trace uses the Chrome trace_event format and can be opened in chrome://tracing or Perfetto.
+* Name threads with VKX_PROFILE_THREAD_NAME("name") so they are easy to tell apart.
+*
+* The macros compile to nothing unless VKX_PROFILE is defined (cmake -DENABLE_CPU_PROFILER=ON).
+* Names must be string literals, only the pointer is stored.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace vkx {
+    namespace profiler {
+        struct Event {
+            const char* name;
+            // Nanoseconds since the profiler started
+            uint64_t begin;
+            uint64_t end;
+        };
+
+        // Events kept per thread
+        static const uint32_t RING_SIZE = 1 << 15;
+
+        // Ring buffer of one thread, only ever written by that thread
+        struct ThreadBuffer {
+            uint32_t id{ 0 };
+            char name[64]{};
+            // Events written so far, the last RING_SIZE of them are in the ring
+            std::atomic<uint64_t> written{ 0 };
+            Event events[RING_SIZE];
+            ThreadBuffer* next{ nullptr };
+
+            void push(const char* name, uint64_t begin, uint64_t end) {
+                uint64_t index = written.load(std::memory_order_relaxed);
+                events[index % RING_SIZE] = { name, begin, end };
+                written.store(index + 1, std::memory_order_release);
+            }
+        };
+
+        // Nanoseconds since the profiler started
+        uint64_t now();
+
+        // The calling thread's buffer, registered on first use
+        ThreadBuffer& threadBuffer();
+
+        // Names the calling thread in the trace
+        void setThreadName(const std::string& name);
+
+        // Recording can be paused at runtime, it is on by default
+        void setEnabled(bool enabled);
+        bool isEnabled();
+
+        // Writes the events of all threads as Chrome trace_event JSON
+        bool writeChromeTrace(const std::string& filename);
+
+        class Scope {
+        public:
+            Scope(const char* name) : name(name), begin(isEnabled() ? now() : UINT64_MAX) {}
+            ~Scope() {
+                if (begin != UINT64_MAX) {
+                    threadBuffer().push(name, begin, now());
+                }
+            }
+        private:
+            const char* name;
+            uint64_t begin;
+        };
+    }
+}
+
+#define VKX_PROFILE_CONCAT_INNER(a, b) a##b
+#define VKX_PROFILE_CONCAT(a, b) VKX_PROFILE_CONCAT_INNER(a, b)
+
+#if defined(VKX_PROFILE)
+#define VKX_PROFILE_SCOPE(name) vkx::profiler::Scope VKX_PROFILE_CONCAT(profileScope, __COUNTER__)(name)
+#define VKX_PROFILE_FUNCTION() VKX_PROFILE_SCOPE(__FUNCTION__)
+#define VKX_PROFILE_THREAD_NAME(name) vkx::profiler::setThreadName(name)
+#else
+#define VKX_PROFILE_SCOPE(name) ((void)0)
+#define VKX_PROFILE_FUNCTION() ((void)0)
+#define VKX_PROFILE_THREAD_NAME(name) ((void)0)
+#endif
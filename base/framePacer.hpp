@@ -0,0 +1,57 @@
+/*
+* Sleep based frame pacer
+*
+* Holds a loop to a target frame rate by sleeping until each frame's deadline.  Sleeps can
+* overshoot by a scheduler tick, so the last stretch before the deadline is spent yielding.
+* A frame that runs more than a period late starts a new schedule instead of rushing the
+* following frames to catch up.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <chrono>
+#include <thread>
+
+namespace vkx {
+    class FramePacer {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        // 0 disables pacing
+        void setTargetFps(double fps) {
+            period = fps > 0.0 ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / fps)) : Clock::duration::zero();
+            deadline = Clock::time_point();
+        }
+
+        bool isEnabled() const {
+            return period != Clock::duration::zero();
+        }
+
+        // Blocks until the next frame is due
+        void wait() {
+            if (!isEnabled()) {
+                return;
+            }
+            auto now = Clock::now();
+            if (deadline == Clock::time_point() || now > deadline + period) {
+                deadline = now;
+            } else {
+                if (now < deadline - spinMargin) {
+                    std::this_thread::sleep_until(deadline - spinMargin);
+                }
+                while (Clock::now() < deadline) {
+                    std::this_thread::yield();
+                }
+            }
+            deadline += period;
+        }
+
+    private:
+        const Clock::duration spinMargin{ std::chrono::milliseconds(1) };
+        Clock::duration period{ Clock::duration::zero() };
+        // Start of the next frame
+        Clock::time_point deadline;
+    };
+}
@@ -0,0 +1,456 @@
+/*
+* Batch view frustum culling
+*
+* Tests many bounding spheres or boxes against a vkTools::Frustum at once.  Bounds are kept in
+* structure of arrays layout so the SSE and AVX2 kernels can load 4 or 8 objects per register,
+* a scalar kernel handles the tails and non x86 targets.  The result is a visibility bitmask,
+* which can be compacted into a list of visible indices.
+*
+* Objects are processed in blocks of 8.  An optional PlaneCache remembers, per block, the plane
+* that rejected it in the previous frame and tests that plane first, so blocks that stay outside
+* the frustum are usually rejected after a single plane.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustum.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VKX_CULLING_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define VKX_TARGET_SSE
+#define VKX_TARGET_AVX2
+#else
+#include <immintrin.h>
+#define VKX_TARGET_SSE __attribute__((target("sse2")))
+#define VKX_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace vkx {
+    // Bounding spheres in structure of arrays layout
+    struct SphereList {
+        std::vector<float> x, y, z, radius;
+
+        uint32_t size() const {
+            return (uint32_t)x.size();
+        }
+
+        void resize(uint32_t count) {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+            radius.resize(count);
+        }
+
+        void set(uint32_t index, const glm::vec3& center, float r) {
+            x[index] = center.x;
+            y[index] = center.y;
+            z[index] = center.z;
+            radius[index] = r;
+        }
+
+        void add(const glm::vec3& center, float r) {
+            resize(size() + 1);
+            set(size() - 1, center, r);
+        }
+    };
+
+    // Axis aligned bounding boxes in structure of arrays layout, stored as center and half extent
+    struct BoxList {
+        std::vector<float> x, y, z;
+        std::vector<float> extentX, extentY, extentZ;
+
+        uint32_t size() const {
+            return (uint32_t)x.size();
+        }
+
+        void resize(uint32_t count) {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+            extentX.resize(count);
+            extentY.resize(count);
+            extentZ.resize(count);
+        }
+
+        void set(uint32_t index, const glm::vec3& min, const glm::vec3& max) {
+            glm::vec3 center = (min + max) * 0.5f;
+            glm::vec3 extent = (max - min) * 0.5f;
+            x[index] = center.x;
+            y[index] = center.y;
+            z[index] = center.z;
+            extentX[index] = extent.x;
+            extentY[index] = extent.y;
+            extentZ[index] = extent.z;
+        }
+
+        void add(const glm::vec3& min, const glm::vec3& max) {
+            resize(size() + 1);
+            set(size() - 1, min, max);
+        }
+    };
+
+    // One bit per object, object i is visible when bit (i % 32) of word (i / 32) is set
+    struct VisibilityMask {
+        std::vector<uint32_t> words;
+        uint32_t count{ 0 };
+
+        void resize(uint32_t newCount) {
+            count = newCount;
+            words.resize((count + 31) / 32);
+        }
+
+        bool isVisible(uint32_t index) const {
+            return 0 != (words[index >> 5] & (1u << (index & 31)));
+        }
+
+        uint32_t visibleCount() const {
+            uint32_t result = 0;
+            for (uint32_t word : words) {
+                // Clear the lowest set bit until none are left
+                for (; word; word &= word - 1) {
+                    ++result;
+                }
+            }
+            return result;
+        }
+
+        // Replaces the contents of indices with the visible object indices in ascending order
+        uint32_t compact(std::vector<uint32_t>& indices) const {
+            indices.resize(count);
+            uint32_t visible = 0;
+            for (uint32_t w = 0; w < words.size(); ++w) {
+                for (uint32_t word = words[w]; word; word &= word - 1) {
+                    indices[visible++] = (w << 5) + lowestBit(word);
+                }
+            }
+            indices.resize(visible);
+            return visible;
+        }
+
+    private:
+        static uint32_t lowestBit(uint32_t word) {
+#if defined(_MSC_VER)
+            unsigned long index;
+            _BitScanForward(&index, word);
+            return index;
+#else
+            return __builtin_ctz(word);
+#endif
+        }
+    };
+
+    // Frame to frame coherency, the plane each block of 8 objects should be tested against first
+    struct PlaneCache {
+        std::vector<uint8_t> firstPlane;
+
+        void reset() {
+            std::fill(firstPlane.begin(), firstPlane.end(), 0);
+        }
+    };
+
+    namespace culling {
+        enum class Isa { Scalar, Sse, Avx2 };
+
+        static const uint32_t BLOCK_SIZE = 8;
+
+        inline const char* isaName(Isa isa) {
+            switch (isa) {
+            case Isa::Sse: return "sse";
+            case Isa::Avx2: return "avx2";
+            default: return "scalar";
+            }
+        }
+
+        inline bool isSupported(Isa isa) {
+#if defined(VKX_CULLING_X86)
+            if (isa == Isa::Avx2) {
+#if defined(_MSC_VER)
+                int info[4];
+                __cpuid(info, 0);
+                if (info[0] < 7) {
+                    return false;
+                }
+                __cpuid(info, 1);
+                // The OS must save the AVX registers
+                const bool osxsave = 0 != (info[2] & (1 << 27));
+                if (!osxsave || (_xgetbv(0) & 6) != 6) {
+                    return false;
+                }
+                __cpuidex(info, 7, 0);
+                return 0 != (info[1] & (1 << 5));
+#else
+                __builtin_cpu_init();
+                return 0 != __builtin_cpu_supports("avx2");
+#endif
+            }
+            return true;
+#else
+            return isa == Isa::Scalar;
+#endif
+        }
+
+        inline Isa bestIsa() {
+            static const Isa best = isSupported(Isa::Avx2) ? Isa::Avx2 : (isSupported(Isa::Sse) ? Isa::Sse : Isa::Scalar);
+            return best;
+        }
+
+        namespace detail {
+            // Plane test order when starting at a given plane
+            static const uint8_t PLANE_ORDER[6][6] = {
+                { 0, 1, 2, 3, 4, 5 },
+                { 1, 0, 2, 3, 4, 5 },
+                { 2, 0, 1, 3, 4, 5 },
+                { 3, 0, 1, 2, 4, 5 },
+                { 4, 0, 1, 2, 3, 5 },
+                { 5, 0, 1, 2, 3, 4 },
+            };
+
+            struct Planes {
+                float x[6], y[6], z[6], w[6];
+                // Absolute normals for the box extent projection
+                float ax[6], ay[6], az[6];
+
+                Planes(const vkTools::Frustum& frustum) {
+                    for (uint32_t p = 0; p < 6; ++p) {
+                        x[p] = frustum.planes[p].x;
+                        y[p] = frustum.planes[p].y;
+                        z[p] = frustum.planes[p].z;
+                        w[p] = frustum.planes[p].w;
+                        ax[p] = fabsf(x[p]);
+                        ay[p] = fabsf(y[p]);
+                        az[p] = fabsf(z[p]);
+                    }
+                }
+            };
+
+            // Scalar test of a single object.  radius is the sphere radius, or for boxes the
+            // extent projected onto the plane normal.
+            template <typename Radius>
+            inline bool visible(const Planes& planes, float x, float y, float z, const Radius& radius, uint8_t& firstPlane) {
+                for (uint32_t k = 0; k < 6; ++k) {
+                    uint32_t p = PLANE_ORDER[firstPlane][k];
+                    if (planes.x[p] * x + planes.y[p] * y + planes.z[p] * z + planes.w[p] <= -radius(p)) {
+                        firstPlane = (uint8_t)p;
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            inline void cullSpheresScalar(const Planes& planes, const SphereList& spheres, uint32_t begin, uint32_t end, uint32_t* words, uint8_t* cache) {
+                for (uint32_t i = begin; i < end; ++i) {
+                    uint8_t unused = 0;
+                    uint8_t& firstPlane = cache ? cache[i / BLOCK_SIZE] : unused;
+                    float r = spheres.radius[i];
+                    if (visible(planes, spheres.x[i], spheres.y[i], spheres.z[i], [r](uint32_t) { return r; }, firstPlane)) {
+                        words[i >> 5] |= 1u << (i & 31);
+                    }
+                }
+            }
+
+            inline void cullBoxesScalar(const Planes& planes, const BoxList& boxes, uint32_t begin, uint32_t end, uint32_t* words, uint8_t* cache) {
+                for (uint32_t i = begin; i < end; ++i) {
+                    uint8_t unused = 0;
+                    uint8_t& firstPlane = cache ? cache[i / BLOCK_SIZE] : unused;
+                    float ex = boxes.extentX[i], ey = boxes.extentY[i], ez = boxes.extentZ[i];
+                    auto radius = [&](uint32_t p) { return planes.ax[p] * ex + planes.ay[p] * ey + planes.az[p] * ez; };
+                    if (visible(planes, boxes.x[i], boxes.y[i], boxes.z[i], radius, firstPlane)) {
+                        words[i >> 5] |= 1u << (i & 31);
+                    }
+                }
+            }
+
+#if defined(VKX_CULLING_X86)
+            // Returns the visibility bits of a block of 8 spheres, two groups of 4 lanes
+            VKX_TARGET_SSE inline uint32_t sphereBlockSse(const Planes& planes, const float* x, const float* y, const float* z, const float* r, uint8_t& firstPlane) {
+                const __m128 zero = _mm_setzero_ps();
+                __m128 x0 = _mm_loadu_ps(x), x1 = _mm_loadu_ps(x + 4);
+                __m128 y0 = _mm_loadu_ps(y), y1 = _mm_loadu_ps(y + 4);
+                __m128 z0 = _mm_loadu_ps(z), z1 = _mm_loadu_ps(z + 4);
+                __m128 r0 = _mm_sub_ps(zero, _mm_loadu_ps(r)), r1 = _mm_sub_ps(zero, _mm_loadu_ps(r + 4));
+                __m128 visible0 = _mm_cmpeq_ps(zero, zero), visible1 = visible0;
+                for (uint32_t k = 0; k < 6; ++k) {
+                    uint32_t p = PLANE_ORDER[firstPlane][k];
+                    __m128 px = _mm_set1_ps(planes.x[p]), py = _mm_set1_ps(planes.y[p]), pz = _mm_set1_ps(planes.z[p]), pw = _mm_set1_ps(planes.w[p]);
+                    __m128 d0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, x0), _mm_mul_ps(py, y0)), _mm_add_ps(_mm_mul_ps(pz, z0), pw));
+                    __m128 d1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, x1), _mm_mul_ps(py, y1)), _mm_add_ps(_mm_mul_ps(pz, z1), pw));
+                    visible0 = _mm_and_ps(visible0, _mm_cmpgt_ps(d0, r0));
+                    visible1 = _mm_and_ps(visible1, _mm_cmpgt_ps(d1, r1));
+                    if (!_mm_movemask_ps(_mm_or_ps(visible0, visible1))) {
+                        firstPlane = (uint8_t)p;
+                        return 0;
+                    }
+                }
+                return (uint32_t)_mm_movemask_ps(visible0) | ((uint32_t)_mm_movemask_ps(visible1) << 4);
+            }
+
+            VKX_TARGET_SSE inline uint32_t boxBlockSse(const Planes& planes, const BoxList& boxes, uint32_t i, uint8_t& firstPlane) {
+                const __m128 zero = _mm_setzero_ps();
+                __m128 x0 = _mm_loadu_ps(&boxes.x[i]), x1 = _mm_loadu_ps(&boxes.x[i + 4]);
+                __m128 y0 = _mm_loadu_ps(&boxes.y[i]), y1 = _mm_loadu_ps(&boxes.y[i + 4]);
+                __m128 z0 = _mm_loadu_ps(&boxes.z[i]), z1 = _mm_loadu_ps(&boxes.z[i + 4]);
+                __m128 ex0 = _mm_loadu_ps(&boxes.extentX[i]), ex1 = _mm_loadu_ps(&boxes.extentX[i + 4]);
+                __m128 ey0 = _mm_loadu_ps(&boxes.extentY[i]), ey1 = _mm_loadu_ps(&boxes.extentY[i + 4]);
+                __m128 ez0 = _mm_loadu_ps(&boxes.extentZ[i]), ez1 = _mm_loadu_ps(&boxes.extentZ[i + 4]);
+                __m128 visible0 = _mm_cmpeq_ps(zero, zero), visible1 = visible0;
+                for (uint32_t k = 0; k < 6; ++k) {
+                    uint32_t p = PLANE_ORDER[firstPlane][k];
+                    __m128 px = _mm_set1_ps(planes.x[p]), py = _mm_set1_ps(planes.y[p]), pz = _mm_set1_ps(planes.z[p]), pw = _mm_set1_ps(planes.w[p]);
+                    __m128 ax = _mm_set1_ps(planes.ax[p]), ay = _mm_set1_ps(planes.ay[p]), az = _mm_set1_ps(planes.az[p]);
+                    __m128 d0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, x0), _mm_mul_ps(py, y0)), _mm_add_ps(_mm_mul_ps(pz, z0), pw));
+                    __m128 d1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, x1), _mm_mul_ps(py, y1)), _mm_add_ps(_mm_mul_ps(pz, z1), pw));
+                    __m128 r0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ex0), _mm_mul_ps(ay, ey0)), _mm_mul_ps(az, ez0));
+                    __m128 r1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ex1), _mm_mul_ps(ay, ey1)), _mm_mul_ps(az, ez1));
+                    visible0 = _mm_and_ps(visible0, _mm_cmpgt_ps(d0, _mm_sub_ps(zero, r0)));
+                    visible1 = _mm_and_ps(visible1, _mm_cmpgt_ps(d1, _mm_sub_ps(zero, r1)));
+                    if (!_mm_movemask_ps(_mm_or_ps(visible0, visible1))) {
+                        firstPlane = (uint8_t)p;
+                        return 0;
+                    }
+                }
+                return (uint32_t)_mm_movemask_ps(visible0) | ((uint32_t)_mm_movemask_ps(visible1) << 4);
+            }
+
+            VKX_TARGET_AVX2 inline uint32_t sphereBlockAvx2(const Planes& planes, const float* x, const float* y, const float* z, const float* r, uint8_t& firstPlane) {
+                const __m256 zero = _mm256_setzero_ps();
+                __m256 cx = _mm256_loadu_ps(x), cy = _mm256_loadu_ps(y), cz = _mm256_loadu_ps(z);
+                __m256 negativeRadius = _mm256_sub_ps(zero, _mm256_loadu_ps(r));
+                __m256 visible = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+                for (uint32_t k = 0; k < 6; ++k) {
+                    uint32_t p = PLANE_ORDER[firstPlane][k];
+                    __m256 d = _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.x[p]), cx), _mm256_mul_ps(_mm256_set1_ps(planes.y[p]), cy)),
+                        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.z[p]), cz), _mm256_set1_ps(planes.w[p])));
+                    visible = _mm256_and_ps(visible, _mm256_cmp_ps(d, negativeRadius, _CMP_GT_OQ));
+                    if (!_mm256_movemask_ps(visible)) {
+                        firstPlane = (uint8_t)p;
+                        return 0;
+                    }
+                }
+                return (uint32_t)_mm256_movemask_ps(visible);
+            }
+
+            VKX_TARGET_AVX2 inline uint32_t boxBlockAvx2(const Planes& planes, const BoxList& boxes, uint32_t i, uint8_t& firstPlane) {
+                const __m256 zero = _mm256_setzero_ps();
+                __m256 cx = _mm256_loadu_ps(&boxes.x[i]), cy = _mm256_loadu_ps(&boxes.y[i]), cz = _mm256_loadu_ps(&boxes.z[i]);
+                __m256 ex = _mm256_loadu_ps(&boxes.extentX[i]), ey = _mm256_loadu_ps(&boxes.extentY[i]), ez = _mm256_loadu_ps(&boxes.extentZ[i]);
+                __m256 visible = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+                for (uint32_t k = 0; k < 6; ++k) {
+                    uint32_t p = PLANE_ORDER[firstPlane][k];
+                    __m256 d = _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.x[p]), cx), _mm256_mul_ps(_mm256_set1_ps(planes.y[p]), cy)),
+                        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.z[p]), cz), _mm256_set1_ps(planes.w[p])));
+                    __m256 r = _mm256_add_ps(
+                        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(planes.ax[p]), ex), _mm256_mul_ps(_mm256_set1_ps(planes.ay[p]), ey)),
+                        _mm256_mul_ps(_mm256_set1_ps(planes.az[p]), ez));
+                    visible = _mm256_and_ps(visible, _mm256_cmp_ps(d, _mm256_sub_ps(zero, r), _CMP_GT_OQ));
+                    if (!_mm256_movemask_ps(visible)) {
+                        firstPlane = (uint8_t)p;
+                        return 0;
+                    }
+                }
+                return (uint32_t)_mm256_movemask_ps(visible);
+            }
+#endif
+
+            // Shared driver, block(i, firstPlane) returns the visibility bits of objects [i, i + 8)
+            template <typename Block, typename Tail>
+            inline void cull(uint32_t count, VisibilityMask& visible, PlaneCache* coherency, uint32_t begin, uint32_t end, Isa isa, const Block& block, const Tail& tail) {
+                // Like the cache, size the mask before culling ranges in parallel
+                if (visible.count != count) {
+                    visible.resize(count);
+                }
+                uint8_t* cache = nullptr;
+                if (coherency) {
+                    // Resizing is not thread safe, size the cache before culling ranges in parallel
+                    if (coherency->firstPlane.size() != (count + BLOCK_SIZE - 1) / BLOCK_SIZE) {
+                        assert(begin == 0 && end >= count);
+                        coherency->firstPlane.assign((count + BLOCK_SIZE - 1) / BLOCK_SIZE, 0);
+                    }
+                    cache = coherency->firstPlane.data();
+                }
+                end = std::min(end, count);
+                // Ranges culled from different threads must not share mask words
+                assert((begin & 31) == 0 && ((end & 31) == 0 || end == count));
+                if (begin >= end) {
+                    return;
+                }
+                uint32_t* words = visible.words.data();
+                std::fill(words + (begin >> 5), words + ((end + 31) >> 5), 0u);
+
+                uint32_t i = begin;
+                if (isa != Isa::Scalar) {
+                    uint8_t unused = 0;
+                    for (; i + BLOCK_SIZE <= end; i += BLOCK_SIZE) {
+                        uint8_t& firstPlane = cache ? cache[i / BLOCK_SIZE] : unused;
+                        words[i >> 5] |= block(i, firstPlane) << (i & 31);
+                    }
+                }
+                tail(i, end, words, cache);
+            }
+        }
+
+        // Tests spheres [begin, end) against the frustum and writes their bits into visible, which is sized
+        // to the number of spheres.  begin must be a multiple of 32 and end a multiple of 32 or the sphere
+        // count, so ranges can be culled from different threads.
+        inline void cullSpheres(const vkTools::Frustum& frustum, const SphereList& spheres, VisibilityMask& visible, PlaneCache* coherency = nullptr,
+            Isa isa = bestIsa(), uint32_t begin = 0, uint32_t end = UINT32_MAX) {
+            const detail::Planes planes(frustum);
+            auto tail = [&](uint32_t first, uint32_t last, uint32_t* words, uint8_t* cache) {
+                detail::cullSpheresScalar(planes, spheres, first, last, words, cache);
+            };
+#if defined(VKX_CULLING_X86)
+            if (isa == Isa::Avx2) {
+                detail::cull(spheres.size(), visible, coherency, begin, end, isa, [&](uint32_t i, uint8_t& firstPlane) {
+                    return detail::sphereBlockAvx2(planes, &spheres.x[i], &spheres.y[i], &spheres.z[i], &spheres.radius[i], firstPlane);
+                }, tail);
+                return;
+            }
+            if (isa == Isa::Sse) {
+                detail::cull(spheres.size(), visible, coherency, begin, end, isa, [&](uint32_t i, uint8_t& firstPlane) {
+                    return detail::sphereBlockSse(planes, &spheres.x[i], &spheres.y[i], &spheres.z[i], &spheres.radius[i], firstPlane);
+                }, tail);
+                return;
+            }
+#endif
+            detail::cull(spheres.size(), visible, coherency, begin, end, Isa::Scalar, [](uint32_t, uint8_t&) { return 0u; }, tail);
+        }
+
+        // Same as cullSpheres for axis aligned boxes
+        inline void cullBoxes(const vkTools::Frustum& frustum, const BoxList& boxes, VisibilityMask& visible, PlaneCache* coherency = nullptr,
+            Isa isa = bestIsa(), uint32_t begin = 0, uint32_t end = UINT32_MAX) {
+            const detail::Planes planes(frustum);
+            auto tail = [&](uint32_t first, uint32_t last, uint32_t* words, uint8_t* cache) {
+                detail::cullBoxesScalar(planes, boxes, first, last, words, cache);
+            };
+#if defined(VKX_CULLING_X86)
+            if (isa == Isa::Avx2) {
+                detail::cull(boxes.size(), visible, coherency, begin, end, isa, [&](uint32_t i, uint8_t& firstPlane) {
+                    return detail::boxBlockAvx2(planes, boxes, i, firstPlane);
+                }, tail);
+                return;
+            }
+            if (isa == Isa::Sse) {
+                detail::cull(boxes.size(), visible, coherency, begin, end, isa, [&](uint32_t i, uint8_t& firstPlane) {
+                    return detail::boxBlockSse(planes, boxes, i, firstPlane);
+                }, tail);
+                return;
+            }
+#endif
+            detail::cull(boxes.size(), visible, coherency, begin, end, Isa::Scalar, [](uint32_t, uint8_t&) { return 0u; }, tail);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+/*
+* Linear scratch allocator for transient arrays
+*
+* Hands out memory from one block by bumping an offset, and takes it all back with reset(), which
+* ExampleBase calls once per frame.  Nested users that don't know about the frame can bracket their
+* allocations with a ScratchAllocator::Scope instead.  Requests that don't fit go to overflow
+* blocks; reset() releases those and grows the main block to fit, so after a few frames the
+* allocator stops touching the heap.
+*
+* Only for trivially destructible types, nothing is destroyed.  Not thread safe.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <assert.h>
+#include <cstddef>
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace vkx {
+    // Fixed capacity array in scratch memory
+    template <typename T>
+    class ScratchArray {
+    public:
+        ScratchArray(T* data = nullptr, uint32_t capacity = 0) : elements(data), capacity(capacity) {}
+
+        void push_back(const T& value) {
+            assert(count < capacity);
+            elements[count++] = value;
+        }
+
+        T* data() { return elements; }
+        const T* data() const { return elements; }
+        uint32_t size() const { return count; }
+        bool empty() const { return 0 == count; }
+        T& operator[](uint32_t index) { return elements[index]; }
+        const T& operator[](uint32_t index) const { return elements[index]; }
+        T* begin() { return elements; }
+        T* end() { return elements + count; }
+        const T* begin() const { return elements; }
+        const T* end() const { return elements + count; }
+
+    private:
+        T* elements{ nullptr };
+        uint32_t count{ 0 };
+        uint32_t capacity{ 0 };
+    };
+
+    class ScratchAllocator {
+    public:
+        // Rewinds the allocator to where it was when the scope was opened
+        class Scope {
+        public:
+            Scope(ScratchAllocator& allocator) : allocator(allocator), offset(allocator.offset) {}
+            ~Scope() {
+                allocator.offset = offset;
+            }
+        private:
+            ScratchAllocator& allocator;
+            size_t offset;
+        };
+
+        ScratchAllocator(size_t capacity = 16 * 1024) : capacity(capacity), block(new uint8_t[capacity]) {}
+
+        void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+            size_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+            if (aligned + size <= capacity) {
+                offset = aligned + size;
+                highWater = std::max(highWater, offset + overflowSize);
+                return block.get() + aligned;
+            }
+            // new[] is aligned for any fundamental type
+            overflow.emplace_back(new uint8_t[size]);
+            overflowSize += size;
+            highWater = std::max(highWater, offset + overflowSize);
+            return overflow.back().get();
+        }
+
+        template <typename T>
+        T* allocate(size_t count) {
+            static_assert(std::is_trivially_destructible<T>::value, "Scratch memory is never destroyed");
+            return (T*)allocate(sizeof(T) * count, alignof(T));
+        }
+
+        template <typename T>
+        ScratchArray<T> array(uint32_t capacity) {
+            return ScratchArray<T>(allocate<T>(capacity), capacity);
+        }
+
+        // Takes back everything, call when nothing allocated since the last reset is in use
+        void reset() {
+            offset = 0;
+            if (!overflow.empty()) {
+                overflow.clear();
+                overflowSize = 0;
+                capacity = std::max(capacity * 2, highWater);
+                block.reset(new uint8_t[capacity]);
+            }
+        }
+
+        size_t getCapacity() const {
+            return capacity;
+        }
+
+    private:
+        size_t capacity;
+        std::unique_ptr<uint8_t[]> block;
+        size_t offset{ 0 };
+        std::vector<std::unique_ptr<uint8_t[]>> overflow;
+        size_t overflowSize{ 0 };
+        // Most memory in use at once since the allocator was created
+        size_t highWater{ 0 };
+    };
+}
@@ -0,0 +1,500 @@
+/*
+* Software occlusion culling
+*
+* A small depth only rasterizer in the spirit of masked occlusion culling.  A few large
+* occluder meshes are rasterized at low resolution into a tiled depth buffer, and occludee
+* boxes are then tested against it, all on the CPU.  Visibility is known as soon as the
+* occluders are rasterized, without waiting on the GPU, and the results are deterministic,
+* so it works headless and can be benchmarked.
+*
+* The buffer is split into 8x8 pixel tiles that store their pixels contiguously, so one
+* tile row is two SSE registers.  Every tile also keeps the farthest depth it contains,
+* which lets both the rasterizer and the occludee test skip whole tiles.  Triangle setup
+* runs in parallel over the occluders and rasterization in parallel over rows of tiles,
+* so no two threads ever write the same tile.
+*
+* Depth is the post projection z / w, smaller is nearer.  Occluder depth is pushed back to
+* the farthest value across each pixel, and occludees are tested with their nearest depth
+* over every pixel they touch.  Coverage is sampled at pixel centers.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "frustumCulling.hpp"
+#include "taskGraph.hpp"
+
+namespace vkx {
+    struct OccluderMesh {
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t> indices;
+    };
+
+    struct Occluder {
+        const OccluderMesh* mesh{ nullptr };
+        glm::mat4 model;
+    };
+
+    class SoftwareOcclusion {
+    public:
+        static const uint32_t TILE_SIZE = 8;
+        static const uint32_t TILE_PIXELS = TILE_SIZE * TILE_SIZE;
+
+        // Occluder triangles are clipped against a guard band this many times the viewport,
+        // which keeps the edge functions well inside float precision
+        static constexpr float GUARD_BAND = 2.0f;
+
+        culling::Isa isa{ culling::bestIsa() };
+
+        struct Stats {
+            // Triangles left after clipping, i.e. the ones actually rasterized
+            uint32_t triangles{ 0 };
+        } stats;
+
+        // The resolution is independent of the window, 256x128 or so is usually plenty
+        void setResolution(uint32_t width, uint32_t height) {
+            this->width = width;
+            this->height = height;
+            tilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+            tilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+            depthBuffer.assign(tilesX * tilesY * TILE_PIXELS, 1.0f);
+            tileMax.assign(tilesX * tilesY, 1.0f);
+        }
+
+        uint32_t getWidth() const {
+            return width;
+        }
+
+        uint32_t getHeight() const {
+            return height;
+        }
+
+        // Clears the buffer and rasterizes the occluders, spread across pool when one is given.
+        // The view projection is kept for the following occludee tests.
+        void rasterize(const glm::mat4& viewProjection, const std::vector<Occluder>& occluders, WorkStealingPool* pool = nullptr) {
+            this->viewProjection = viewProjection;
+            setupCount = (uint32_t)occluders.size();
+            if (setups.size() < setupCount) {
+                setups.resize(setupCount);
+            }
+
+            forEach(pool, setupCount, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; ++i) {
+                    setup(occluders[i], setups[i]);
+                }
+            }, 1);
+
+            stats.triangles = 0;
+            for (uint32_t i = 0; i < setupCount; ++i) {
+                stats.triangles += (uint32_t)setups[i].triangles.size();
+            }
+
+            forEach(pool, tilesY, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t tileY = begin; tileY < end; ++tileY) {
+                    rasterizeBand(tileY);
+                }
+            }, 1);
+        }
+
+        // True if any part of the box may be visible.  Boxes with a corner in front of the near plane
+        // (clip z < 0 with the zero to one depth range) are always visible, boxes entirely outside the
+        // viewport never are.
+        bool isVisible(const glm::vec3& min, const glm::vec3& max) const {
+            glm::vec2 screenMin{ FLT_MAX }, screenMax{ -FLT_MAX };
+            float nearest = FLT_MAX;
+            for (uint32_t i = 0; i < 8; ++i) {
+                glm::vec3 corner{ (i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z };
+                glm::vec4 clip = viewProjection * glm::vec4(corner, 1.0f);
+                if (clip.z < 0.0f) {
+                    return true;
+                }
+                glm::vec2 screen = toScreen(clip);
+                screenMin = glm::min(screenMin, screen);
+                screenMax = glm::max(screenMax, screen);
+                nearest = std::min(nearest, clip.z / clip.w);
+            }
+
+            // Every pixel the box touches
+            int x0 = std::max(0, (int)floorf(screenMin.x));
+            int y0 = std::max(0, (int)floorf(screenMin.y));
+            int x1 = std::min((int)width - 1, (int)floorf(screenMax.x));
+            int y1 = std::min((int)height - 1, (int)floorf(screenMax.y));
+            if (x0 > x1 || y0 > y1) {
+                return false;
+            }
+
+            for (int tileY = y0 / TILE_SIZE; tileY <= y1 / (int)TILE_SIZE; ++tileY) {
+                for (int tileX = x0 / TILE_SIZE; tileX <= x1 / (int)TILE_SIZE; ++tileX) {
+                    uint32_t tile = tileY * tilesX + tileX;
+                    if (nearest > tileMax[tile]) {
+                        continue;
+                    }
+                    int left = tileX * TILE_SIZE, top = tileY * TILE_SIZE;
+                    // The farthest pixel of the tile is inside the box rect
+                    if (x0 <= left && x1 >= left + (int)TILE_SIZE - 1 && y0 <= top && y1 >= top + (int)TILE_SIZE - 1) {
+                        return true;
+                    }
+                    if (anyPixelBehind(tile, std::max(x0, left) - left, std::min(x1, left + (int)TILE_SIZE - 1) - left,
+                        std::max(y0, top) - top, std::min(y1, top + (int)TILE_SIZE - 1) - top, nearest)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+        // Tests boxes against the buffer and writes their bits into visible, spread across pool when one is given
+        void testBoxes(const BoxList& boxes, VisibilityMask& visible, WorkStealingPool* pool = nullptr) const {
+            const uint32_t count = boxes.size();
+            if (visible.count != count) {
+                visible.resize(count);
+            }
+            // Chunks must not share mask words
+            uint32_t grain = pool ? autoGrainSize(count, pool->threadCount(), 32) : count;
+            grain = (grain + 31) & ~31u;
+            forEach(pool, count, [&](uint32_t begin, uint32_t end) {
+                uint32_t* words = visible.words.data();
+                std::fill(words + (begin >> 5), words + ((end + 31) >> 5), 0u);
+                for (uint32_t i = begin; i < end; ++i) {
+                    glm::vec3 center{ boxes.x[i], boxes.y[i], boxes.z[i] };
+                    glm::vec3 extent{ boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i] };
+                    if (isVisible(center - extent, center + extent)) {
+                        words[i >> 5] |= 1u << (i & 31);
+                    }
+                }
+            }, grain);
+        }
+
+        // Stored depth of a pixel, for debug views
+        float depth(uint32_t x, uint32_t y) const {
+            uint32_t tile = (y / TILE_SIZE) * tilesX + x / TILE_SIZE;
+            return depthBuffer[tile * TILE_PIXELS + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE];
+        }
+
+    private:
+        struct Triangle {
+            // Edge functions a * x + b * y + c, positive inside
+            float edgeA[3], edgeB[3], edgeC[3];
+            // Depth plane, already offset to the farthest depth across a pixel
+            float depthA, depthB, depthC;
+            float zMin, zMax;
+            // Pixel bounds, inclusive and clamped to the viewport
+            int minX, minY, maxX, maxY;
+        };
+
+        // Per occluder scratch, reused from frame to frame
+        struct Setup {
+            std::vector<glm::vec4> clip;
+            std::vector<Triangle> triangles;
+        };
+
+        uint32_t width{ 0 }, height{ 0 };
+        uint32_t tilesX{ 0 }, tilesY{ 0 };
+        std::vector<float> depthBuffer;
+        std::vector<float> tileMax;
+        glm::mat4 viewProjection;
+        std::vector<Setup> setups;
+        uint32_t setupCount{ 0 };
+
+        template <typename F>
+        static void forEach(WorkStealingPool* pool, uint32_t count, const F& body, uint32_t grain) {
+            if (pool) {
+                parallelFor(*pool, count, body, grain);
+            } else if (count) {
+                body(0u, count);
+            }
+        }
+
+        glm::vec2 toScreen(const glm::vec4& clip) const {
+            return glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * width, (clip.y / clip.w * 0.5f + 0.5f) * height);
+        }
+
+        // Signed distance to the near plane and the guard band planes, inside is positive.  The near plane
+        // is z = 0 of the zero to one depth range, clipping at w = 0 instead would keep depths below zero.
+        static float planeDistance(uint32_t plane, const glm::vec4& v) {
+            switch (plane) {
+            case 0: return v.z;
+            case 1: return GUARD_BAND * v.w - v.x;
+            case 2: return GUARD_BAND * v.w + v.x;
+            case 3: return GUARD_BAND * v.w - v.y;
+            default: return GUARD_BAND * v.w + v.y;
+            }
+        }
+
+        static uint32_t outcode(const glm::vec4& v) {
+            uint32_t code = 0;
+            for (uint32_t plane = 0; plane < 5; ++plane) {
+                if (planeDistance(plane, v) < 0.0f) {
+                    code |= 1u << plane;
+                }
+            }
+            return code;
+        }
+
+        void setup(const Occluder& occluder, Setup& result) const {
+            const OccluderMesh& mesh = *occluder.mesh;
+            const glm::mat4 mvp = viewProjection * occluder.model;
+            result.triangles.clear();
+            result.clip.resize(mesh.positions.size());
+            for (size_t i = 0; i < mesh.positions.size(); ++i) {
+                result.clip[i] = mvp * glm::vec4(mesh.positions[i], 1.0f);
+            }
+
+            for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3) {
+                const glm::vec4& a = result.clip[mesh.indices[i]];
+                const glm::vec4& b = result.clip[mesh.indices[i + 1]];
+                const glm::vec4& c = result.clip[mesh.indices[i + 2]];
+                uint32_t codeA = outcode(a), codeB = outcode(b), codeC = outcode(c);
+                if (codeA & codeB & codeC) {
+                    continue;
+                }
+                if (!(codeA | codeB | codeC)) {
+                    addTriangle(a, b, c, result.triangles);
+                    continue;
+                }
+
+                // Sutherland-Hodgman, each plane adds at most one vertex
+                glm::vec4 polygon[8], clipped[8];
+                uint32_t count = 3;
+                polygon[0] = a;
+                polygon[1] = b;
+                polygon[2] = c;
+                for (uint32_t plane = 0; plane < 5 && count; ++plane) {
+                    uint32_t clippedCount = 0;
+                    for (uint32_t v = 0; v < count; ++v) {
+                        const glm::vec4& current = polygon[v];
+                        const glm::vec4& next = polygon[(v + 1) % count];
+                        float dCurrent = planeDistance(plane, current);
+                        float dNext = planeDistance(plane, next);
+                        if (dCurrent >= 0.0f) {
+                            clipped[clippedCount++] = current;
+                        }
+                        if ((dCurrent >= 0.0f) != (dNext >= 0.0f)) {
+                            clipped[clippedCount++] = glm::mix(current, next, dCurrent / (dCurrent - dNext));
+                        }
+                    }
+                    count = clippedCount;
+                    std::copy(clipped, clipped + count, polygon);
+                }
+                for (uint32_t v = 2; v < count; ++v) {
+                    addTriangle(polygon[0], polygon[v - 1], polygon[v], result.triangles);
+                }
+            }
+        }
+
+        void addTriangle(const glm::vec4& clipA, const glm::vec4& clipB, const glm::vec4& clipC, std::vector<Triangle>& triangles) const {
+            glm::vec3 v[3] = {
+                glm::vec3(toScreen(clipA), clipA.z / clipA.w),
+                glm::vec3(toScreen(clipB), clipB.z / clipB.w),
+                glm::vec3(toScreen(clipC), clipC.z / clipC.w),
+            };
+            float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+            if (fabsf(area) < 1e-6f) {
+                return;
+            }
+            // Occluders are closed meshes, so rasterize both windings instead of guessing the front face
+            if (area < 0.0f) {
+                std::swap(v[1], v[2]);
+                area = -area;
+            }
+
+            Triangle triangle;
+            triangle.minX = std::max(0, (int)ceilf(std::min({ v[0].x, v[1].x, v[2].x }) - 0.5f));
+            triangle.minY = std::max(0, (int)ceilf(std::min({ v[0].y, v[1].y, v[2].y }) - 0.5f));
+            triangle.maxX = std::min((int)width - 1, (int)floorf(std::max({ v[0].x, v[1].x, v[2].x }) - 0.5f));
+            triangle.maxY = std::min((int)height - 1, (int)floorf(std::max({ v[0].y, v[1].y, v[2].y }) - 0.5f));
+            // Misses every pixel center
+            if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) {
+                return;
+            }
+
+            for (uint32_t e = 0; e < 3; ++e) {
+                const glm::vec3& v0 = v[e];
+                const glm::vec3& v1 = v[(e + 1) % 3];
+                triangle.edgeA[e] = v0.y - v1.y;
+                triangle.edgeB[e] = v1.x - v0.x;
+                triangle.edgeC[e] = v0.x * v1.y - v0.y * v1.x;
+            }
+
+            float dz1 = v[1].z - v[0].z, dz2 = v[2].z - v[0].z;
+            triangle.depthA = (dz1 * (v[2].y - v[0].y) - dz2 * (v[1].y - v[0].y)) / area;
+            triangle.depthB = (dz2 * (v[1].x - v[0].x) - dz1 * (v[2].x - v[0].x)) / area;
+            // Farthest depth anywhere in the pixel rather than at its center
+            triangle.depthC = v[0].z - triangle.depthA * v[0].x - triangle.depthB * v[0].y + 0.5f * (fabsf(triangle.depthA) + fabsf(triangle.depthB));
+            triangle.zMin = std::min({ v[0].z, v[1].z, v[2].z });
+            triangle.zMax = std::max({ v[0].z, v[1].z, v[2].z });
+            triangles.push_back(triangle);
+        }
+
+        // Clears one row of tiles and rasterizes every triangle overlapping it
+        void rasterizeBand(uint32_t tileY) {
+            std::fill(depthBuffer.begin() + tileY * tilesX * TILE_PIXELS, depthBuffer.begin() + (tileY + 1) * tilesX * TILE_PIXELS, 1.0f);
+            std::fill(tileMax.begin() + tileY * tilesX, tileMax.begin() + (tileY + 1) * tilesX, 1.0f);
+
+            const int bandTop = (int)(tileY * TILE_SIZE);
+            const int bandBottom = std::min(bandTop + (int)TILE_SIZE, (int)height) - 1;
+            for (uint32_t s = 0; s < setupCount; ++s) {
+                for (const Triangle& triangle : setups[s].triangles) {
+                    if (triangle.maxY < bandTop || triangle.minY > bandBottom) {
+                        continue;
+                    }
+                    const int y0 = std::max(triangle.minY, bandTop);
+                    const int y1 = std::min(triangle.maxY, bandBottom);
+                    for (int tileX = triangle.minX / (int)TILE_SIZE; tileX <= triangle.maxX / (int)TILE_SIZE; ++tileX) {
+                        const uint32_t tile = tileY * tilesX + tileX;
+                        // Everything in the tile is already nearer than the triangle
+                        if (triangle.zMin >= tileMax[tile]) {
+                            continue;
+                        }
+                        const int left = tileX * (int)TILE_SIZE;
+                        const int x0 = std::max(triangle.minX, left);
+                        const int x1 = std::min(triangle.maxX, left + (int)TILE_SIZE - 1);
+                        if (!overlaps(triangle, x0, y0, x1, y1)) {
+                            continue;
+                        }
+#if defined(VKX_CULLING_X86)
+                        if (isa != culling::Isa::Scalar) {
+                            tileMax[tile] = rasterizeTileSse(triangle, &depthBuffer[tile * TILE_PIXELS], left, bandTop, x0, y0, x1, y1);
+                            continue;
+                        }
+#endif
+                        tileMax[tile] = rasterizeTileScalar(triangle, &depthBuffer[tile * TILE_PIXELS], left, bandTop, x0, y0, x1, y1);
+                    }
+                }
+            }
+        }
+
+        // False if the pixel centers of the rect are all outside one of the edges
+        static bool overlaps(const Triangle& triangle, int x0, int y0, int x1, int y1) {
+            for (uint32_t e = 0; e < 3; ++e) {
+                float x = (triangle.edgeA[e] > 0.0f ? x1 : x0) + 0.5f;
+                float y = (triangle.edgeB[e] > 0.0f ? y1 : y0) + 0.5f;
+                if (triangle.edgeA[e] * x + triangle.edgeB[e] * y + triangle.edgeC[e] < 0.0f) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Rasterizes the [x0, x1] x [y0, y1] part of a tile, returns the new farthest depth of the tile
+        static float rasterizeTileScalar(const Triangle& triangle, float* tile, int left, int top, int x0, int y0, int x1, int y1) {
+            for (int y = y0; y <= y1; ++y) {
+                const float py = y + 0.5f;
+                float* row = tile + (y - top) * TILE_SIZE;
+                for (int x = x0; x <= x1; ++x) {
+                    const float px = x + 0.5f;
+                    bool inside = true;
+                    for (uint32_t e = 0; e < 3; ++e) {
+                        inside = inside && triangle.edgeA[e] * px + triangle.edgeB[e] * py + triangle.edgeC[e] >= 0.0f;
+                    }
+                    if (inside) {
+                        float z = std::min(triangle.depthA * px + triangle.depthB * py + triangle.depthC, triangle.zMax);
+                        row[x - left] = std::min(row[x - left], z);
+                    }
+                }
+            }
+            return *std::max_element(tile, tile + TILE_PIXELS);
+        }
+
+        bool anyPixelBehind(uint32_t tile, int x0, int x1, int y0, int y1, float nearest) const {
+            const float* pixels = &depthBuffer[tile * TILE_PIXELS];
+#if defined(VKX_CULLING_X86)
+            if (isa != culling::Isa::Scalar) {
+                return anyPixelBehindSse(pixels, x0, x1, y0, y1, nearest);
+            }
+#endif
+            for (int y = y0; y <= y1; ++y) {
+                for (int x = x0; x <= x1; ++x) {
+                    if (pixels[y * TILE_SIZE + x] >= nearest) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+
+#if defined(VKX_CULLING_X86)
+        // Lane masks for the tile columns [x0, x1], as two groups of 4
+        VKX_TARGET_SSE static void columnMask(int x0, int x1, __m128& mask0, __m128& mask1) {
+            const __m128 columns0 = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+            const __m128 columns1 = _mm_setr_ps(4.0f, 5.0f, 6.0f, 7.0f);
+            const __m128 first = _mm_set1_ps((float)x0), last = _mm_set1_ps((float)x1);
+            mask0 = _mm_and_ps(_mm_cmpge_ps(columns0, first), _mm_cmple_ps(columns0, last));
+            mask1 = _mm_and_ps(_mm_cmpge_ps(columns1, first), _mm_cmple_ps(columns1, last));
+        }
+
+        VKX_TARGET_SSE static float rasterizeTileSse(const Triangle& triangle, float* tile, int left, int top, int x0, int y0, int x1, int y1) {
+            const __m128 zero = _mm_setzero_ps();
+            __m128 inRange0, inRange1;
+            columnMask(x0 - left, x1 - left, inRange0, inRange1);
+            // Pixel center x of the 8 tile columns
+            const __m128 px0 = _mm_add_ps(_mm_set1_ps(left + 0.5f), _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f));
+            const __m128 px1 = _mm_add_ps(px0, _mm_set1_ps(4.0f));
+
+            __m128 edgeX0[3], edgeX1[3];
+            for (uint32_t e = 0; e < 3; ++e) {
+                const __m128 a = _mm_set1_ps(triangle.edgeA[e]);
+                edgeX0[e] = _mm_mul_ps(a, px0);
+                edgeX1[e] = _mm_mul_ps(a, px1);
+            }
+            const __m128 depthA = _mm_set1_ps(triangle.depthA);
+            const __m128 depthX0 = _mm_mul_ps(depthA, px0), depthX1 = _mm_mul_ps(depthA, px1);
+            const __m128 zMax = _mm_set1_ps(triangle.zMax);
+
+            for (int y = y0; y <= y1; ++y) {
+                const float py = y + 0.5f;
+                float* row = tile + (y - top) * TILE_SIZE;
+                __m128 inside0 = inRange0, inside1 = inRange1;
+                for (uint32_t e = 0; e < 3; ++e) {
+                    const __m128 rowValue = _mm_set1_ps(triangle.edgeB[e] * py + triangle.edgeC[e]);
+                    inside0 = _mm_and_ps(inside0, _mm_cmpge_ps(_mm_add_ps(edgeX0[e], rowValue), zero));
+                    inside1 = _mm_and_ps(inside1, _mm_cmpge_ps(_mm_add_ps(edgeX1[e], rowValue), zero));
+                }
+                const int coverage = _mm_movemask_ps(inside0) | (_mm_movemask_ps(inside1) << 4);
+                if (!coverage) {
+                    continue;
+                }
+                const __m128 rowDepth = _mm_set1_ps(triangle.depthB * py + triangle.depthC);
+                const __m128 z0 = _mm_min_ps(_mm_add_ps(depthX0, rowDepth), zMax);
+                const __m128 z1 = _mm_min_ps(_mm_add_ps(depthX1, rowDepth), zMax);
+                const __m128 old0 = _mm_loadu_ps(row), old1 = _mm_loadu_ps(row + 4);
+                const __m128 new0 = _mm_min_ps(old0, z0), new1 = _mm_min_ps(old1, z1);
+                _mm_storeu_ps(row, _mm_or_ps(_mm_and_ps(inside0, new0), _mm_andnot_ps(inside0, old0)));
+                _mm_storeu_ps(row + 4, _mm_or_ps(_mm_and_ps(inside1, new1), _mm_andnot_ps(inside1, old1)));
+            }
+
+            __m128 farthest = _mm_loadu_ps(tile);
+            for (uint32_t i = 4; i < TILE_PIXELS; i += 4) {
+                farthest = _mm_max_ps(farthest, _mm_loadu_ps(tile + i));
+            }
+            farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+            farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+            return _mm_cvtss_f32(farthest);
+        }
+
+        VKX_TARGET_SSE static bool anyPixelBehindSse(const float* pixels, int x0, int x1, int y0, int y1, float nearest) {
+            __m128 inRange0, inRange1;
+            columnMask(x0, x1, inRange0, inRange1);
+            const __m128 threshold = _mm_set1_ps(nearest);
+            for (int y = y0; y <= y1; ++y) {
+                const float* row = pixels + y * TILE_SIZE;
+                __m128 behind0 = _mm_and_ps(inRange0, _mm_cmpge_ps(_mm_loadu_ps(row), threshold));
+                __m128 behind1 = _mm_and_ps(inRange1, _mm_cmpge_ps(_mm_loadu_ps(row + 4), threshold));
+                if (_mm_movemask_ps(_mm_or_ps(behind0, behind1))) {
+                    return true;
+                }
+            }
+            return false;
+        }
+#endif
+    };
+}
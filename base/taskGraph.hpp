@@ -0,0 +1,216 @@
+/*
+* Task graph on top of the work stealing pool
+*
+* Tasks are added once with their dependencies and the graph is then run every frame.
+* Running a graph only resets per-task counters, so no memory is allocated after the
+* graph has been built.  A task becomes ready when all of its predecessors have finished,
+* and parallel for tasks are split into chunks that are spread across the pool.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "workStealingPool.hpp"
+
+namespace vkx {
+
+    // Number of items per chunk when splitting count items across a pool.  Aims for a few
+    // chunks per thread so uneven work still balances, without going below minGrain.
+    inline uint32_t autoGrainSize(uint32_t count, uint32_t threadCount, uint32_t minGrain = 1) {
+        const uint32_t chunksPerThread = 4;
+        uint32_t chunks = std::max(1u, threadCount * chunksPerThread);
+        return std::max(std::max(1u, minGrain), (count + chunks - 1) / chunks);
+    }
+
+    // Blocking parallel loop over [0, count).  body is called with half open ranges [begin, end).
+    // A grain of 0 picks the chunk size automatically.
+    template <typename F>
+    void parallelFor(WorkStealingPool& pool, uint32_t count, const F& body, uint32_t grain = 0) {
+        if (!grain) {
+            grain = autoGrainSize(count, pool.threadCount());
+        }
+        if (count <= grain) {
+            if (count) {
+                body(0u, count);
+            }
+            return;
+        }
+        std::atomic<uint32_t> remaining{ (count + grain - 1) / grain };
+        const F* function = &body;
+        // Keep the first chunk for the calling thread
+        for (uint32_t begin = grain; begin < count; begin += grain) {
+            uint32_t end = std::min(begin + grain, count);
+            pool.submit([function, begin, end, &remaining] {
+                (*function)(begin, end);
+                remaining.fetch_sub(1, std::memory_order_acq_rel);
+            });
+        }
+        body(0u, grain);
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!pool.tryRunOne()) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    class TaskGraph {
+    public:
+        using TaskId = uint32_t;
+        using Work = std::function<void()>;
+        using RangeWork = std::function<void(uint32_t begin, uint32_t end)>;
+
+        // Add a task that runs once per execution of the graph
+        TaskId add(Work work) {
+            TaskId id = createTask();
+            tasks[id]->work = std::move(work);
+            return id;
+        }
+
+        // Add a task that splits [0, count) into chunks run in parallel.  A grain of 0 sizes the
+        // chunks automatically from the thread count of the pool the graph runs on.
+        TaskId addParallelFor(uint32_t count, RangeWork work, uint32_t grain = 0) {
+            TaskId id = createTask();
+            Task& task = *tasks[id];
+            task.rangeWork = std::move(work);
+            task.count = count;
+            task.grain = grain;
+            return id;
+        }
+
+        // Make after wait for before to finish
+        void precede(TaskId before, TaskId after) {
+            tasks[before]->successors.push_back(after);
+            ++tasks[after]->dependencyCount;
+        }
+
+        // Add a continuation that runs once task has finished
+        TaskId then(TaskId task, Work work) {
+            TaskId id = add(std::move(work));
+            precede(task, id);
+            return id;
+        }
+
+        size_t size() const {
+            return tasks.size();
+        }
+
+        // Starts executing the graph on the pool and returns immediately.  The graph must not be
+        // modified or run again until wait() has returned.
+        void run(WorkStealingPool& pool) {
+            this->pool = &pool;
+            remainingTasks.store((uint32_t)tasks.size(), std::memory_order_relaxed);
+            done = tasks.empty();
+            for (auto& task : tasks) {
+                task->remainingDependencies.store(task->dependencyCount, std::memory_order_relaxed);
+            }
+            if (tasks.empty()) {
+                return;
+            }
+            for (TaskId id = 0; id < tasks.size(); ++id) {
+                if (!tasks[id]->dependencyCount) {
+                    schedule(id);
+                }
+            }
+        }
+
+        // Waits for the current run to finish, helping the pool while waiting.  Must not be called from a task.
+        void wait() {
+            // Only the flag set under the mutex says the run is over.  Seeing remainingTasks reach zero
+            // isn't enough, the last task may still be about to notify and the graph could be gone by then.
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!done) {
+                lock.unlock();
+                const bool ran = pool->tryRunOne();
+                lock.lock();
+                if (!ran) {
+                    finished.wait(lock, [this] { return done; });
+                }
+            }
+        }
+
+        void execute(WorkStealingPool& pool) {
+            run(pool);
+            wait();
+        }
+
+    private:
+        struct Task {
+            Work work;
+            RangeWork rangeWork;
+            uint32_t count{ 0 };
+            uint32_t grain{ 0 };
+            std::vector<TaskId> successors;
+            uint32_t dependencyCount{ 0 };
+            std::atomic<uint32_t> remainingDependencies{ 0 };
+            std::atomic<uint32_t> remainingChunks{ 0 };
+        };
+
+        std::vector<std::unique_ptr<Task>> tasks;
+        WorkStealingPool* pool{ nullptr };
+        std::atomic<uint32_t> remainingTasks{ 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+        // Set by the last task to complete, guarded by mutex
+        bool done{ true };
+
+        TaskId createTask() {
+            tasks.push_back(std::unique_ptr<Task>(new Task()));
+            return (TaskId)(tasks.size() - 1);
+        }
+
+        void schedule(TaskId id) {
+            Task& task = *tasks[id];
+            if (!task.rangeWork) {
+                pool->submit([this, id] {
+                    if (tasks[id]->work) {
+                        tasks[id]->work();
+                    }
+                    complete(id);
+                });
+                return;
+            }
+
+            const uint32_t grain = task.grain ? task.grain : autoGrainSize(task.count, pool->threadCount());
+            const uint32_t chunks = (task.count + grain - 1) / grain;
+            if (!chunks) {
+                complete(id);
+                return;
+            }
+            task.remainingChunks.store(chunks, std::memory_order_relaxed);
+            for (uint32_t begin = 0; begin < task.count; begin += grain) {
+                uint32_t end = std::min(begin + grain, task.count);
+                pool->submit([this, id, begin, end] {
+                    Task& task = *tasks[id];
+                    task.rangeWork(begin, end);
+                    if (task.remainingChunks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        complete(id);
+                    }
+                });
+            }
+        }
+
+        void complete(TaskId id) {
+            for (TaskId successor : tasks[id]->successors) {
+                if (tasks[successor]->remainingDependencies.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    schedule(successor);
+                }
+            }
+            if (remainingTasks.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                // Notify while holding the lock, once it's released wait() may return and destroy the
+                // graph, so nothing after this may touch it
+                std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+                finished.notify_all();
+            }
+        }
+    };
+}
@@ -0,0 +1,197 @@
+/*
+* Supercompressed texture container (.ktxz)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "textureContainer.h"
+#include "workStealingPool.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace vkx {
+    namespace ktxz {
+
+        namespace {
+            // Buffer to image copies need offsets that are a multiple of 4 and of the texel block size
+            uint64_t chunkAlignment(uint64_t blockSize) {
+                uint64_t alignment = 4;
+                while (alignment % blockSize) {
+                    alignment += 4;
+                }
+                return alignment;
+            }
+
+            void inflateChunk(const Container& container, const Chunk& chunk, uint8_t* destination) {
+                uLongf destinationSize = (uLongf)chunk.size;
+                int result = uncompress(
+                    destination + chunk.uncompressedOffset, &destinationSize,
+                    container.fileData.data() + chunk.offset, (uLong)chunk.compressedSize);
+                if (result != Z_OK || destinationSize != chunk.size) {
+                    throw std::runtime_error("Corrupt texture container chunk");
+                }
+            }
+        }
+
+        uint64_t Container::uncompressedSize() const {
+            uint64_t result = 0;
+            for (const auto& chunk : chunks) {
+                result = std::max(result, chunk.uncompressedOffset + chunk.size);
+            }
+            return result;
+        }
+
+        std::string containerFilename(const std::string& filename) {
+            auto dot = filename.find_last_of('.');
+            auto slash = filename.find_last_of("/\\");
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+                return filename + ".ktxz";
+            }
+            return filename.substr(0, dot) + ".ktxz";
+        }
+
+        bool read(const std::string& filename, Container& result) {
+            std::ifstream file(filename, std::ios::binary | std::ios::ate);
+            if (!file.is_open()) {
+                return false;
+            }
+            size_t fileSize = (size_t)file.tellg();
+            file.seekg(0, std::ios::beg);
+            result.fileData.resize(fileSize);
+            file.read((char*)result.fileData.data(), fileSize);
+            if (!file || fileSize < sizeof(Header)) {
+                throw std::runtime_error("Unable to read texture container " + filename);
+            }
+
+            memcpy(&result.header, result.fileData.data(), sizeof(Header));
+            if (result.header.magic != MAGIC) {
+                throw std::runtime_error("Invalid texture container " + filename);
+            }
+            if (result.header.version != VERSION) {
+                throw std::runtime_error("Texture container " + filename + " has an unsupported version, convert the texture again with ktxz");
+            }
+
+            const Header& header = result.header;
+            if (header.format < (uint32_t)gli::FORMAT_FIRST || header.format > (uint32_t)gli::FORMAT_LAST) {
+                throw std::runtime_error("Invalid format in texture container " + filename);
+            }
+
+            size_t tableSize = sizeof(Chunk) * header.chunkCount;
+            if (fileSize < sizeof(Header) + tableSize) {
+                throw std::runtime_error("Truncated texture container " + filename);
+            }
+            result.chunks.resize(header.chunkCount);
+            memcpy(result.chunks.data(), result.fileData.data() + sizeof(Header), tableSize);
+            const uint64_t blockSize = gli::block_size((gli::format)header.format);
+            const uint64_t alignment = chunkAlignment(blockSize);
+            for (const auto& chunk : result.chunks) {
+                if (chunk.compressedSize > fileSize || chunk.offset > fileSize - chunk.compressedSize) {
+                    throw std::runtime_error("Truncated texture container " + filename);
+                }
+                // The loader copies each chunk into the subresource it names, so it has to exist
+                if (chunk.level >= header.levels || chunk.layer >= header.layers || chunk.face >= header.faces) {
+                    throw std::runtime_error("Chunk outside of the texture in texture container " + filename);
+                }
+                if (chunk.uncompressedOffset % alignment || chunk.size % blockSize) {
+                    throw std::runtime_error("Misaligned chunk in texture container " + filename);
+                }
+            }
+            return true;
+        }
+
+        void decompress(const Container& container, uint8_t* destination, WorkStealingPool* threadPool) {
+            if (!threadPool || container.chunks.size() < 2) {
+                for (const auto& chunk : container.chunks) {
+                    inflateChunk(container, chunk, destination);
+                }
+                return;
+            }
+
+            // Exceptions can't cross the worker threads, so just record the failure
+            std::atomic<bool> failed{ false };
+            for (const auto& chunk : container.chunks) {
+                threadPool->submit([&container, &chunk, destination, &failed] {
+                    try {
+                        inflateChunk(container, chunk, destination);
+                    } catch (const std::exception&) {
+                        failed = true;
+                    }
+                });
+            }
+            threadPool->wait();
+            if (failed) {
+                throw std::runtime_error("Corrupt texture container chunk");
+            }
+        }
+
+        uint64_t write(const std::string& filename, const gli::texture& texture, int compressionLevel) {
+            Container container;
+            Header& header = container.header;
+            header.format = (uint32_t)texture.format();
+            header.width = (uint32_t)texture.dimensions().x;
+            header.height = (uint32_t)texture.dimensions().y;
+            header.depth = (uint32_t)texture.dimensions().z;
+            header.levels = (uint32_t)texture.levels();
+            header.layers = (uint32_t)texture.layers();
+            header.faces = (uint32_t)texture.faces();
+
+            // Subresources in the same order as the gli storage
+            std::vector<std::vector<uint8_t>> compressed;
+            const uint64_t alignment = chunkAlignment(gli::block_size(texture.format()));
+            uint64_t uncompressedOffset = 0;
+            for (uint32_t layer = 0; layer < header.layers; ++layer) {
+                for (uint32_t face = 0; face < header.faces; ++face) {
+                    for (uint32_t level = 0; level < header.levels; ++level) {
+                        Chunk chunk;
+                        chunk.layer = layer;
+                        chunk.face = face;
+                        chunk.level = level;
+                        chunk.width = (uint32_t)texture.dimensions(level).x;
+                        chunk.height = (uint32_t)texture.dimensions(level).y;
+                        chunk.depth = (uint32_t)texture.dimensions(level).z;
+                        chunk.size = (uint64_t)texture.size(level);
+                        chunk.uncompressedOffset = (uncompressedOffset + alignment - 1) / alignment * alignment;
+                        uncompressedOffset = chunk.uncompressedOffset + chunk.size;
+
+                        uLongf compressedSize = compressBound((uLong)chunk.size);
+                        std::vector<uint8_t> data(compressedSize);
+                        if (Z_OK != compress2(data.data(), &compressedSize, (const Bytef*)texture.data(layer, face, level), (uLong)chunk.size, compressionLevel)) {
+                            throw std::runtime_error("Unable to compress texture data");
+                        }
+                        data.resize(compressedSize);
+                        chunk.compressedSize = compressedSize;
+                        compressed.push_back(std::move(data));
+                        container.chunks.push_back(chunk);
+                    }
+                }
+            }
+            header.chunkCount = (uint32_t)container.chunks.size();
+
+            uint64_t offset = sizeof(Header) + sizeof(Chunk) * container.chunks.size();
+            for (auto& chunk : container.chunks) {
+                chunk.offset = offset;
+                offset += chunk.compressedSize;
+            }
+
+            std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+            if (!file.is_open()) {
+                throw std::runtime_error("Unable to open " + filename + " for writing");
+            }
+            file.write((const char*)&header, sizeof(Header));
+            file.write((const char*)container.chunks.data(), sizeof(Chunk) * container.chunks.size());
+            for (const auto& data : compressed) {
+                file.write((const char*)data.data(), data.size());
+            }
+            if (!file) {
+                throw std::runtime_error("Unable to write " + filename);
+            }
+            return offset;
+        }
+    }
+}
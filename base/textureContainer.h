@@ -0,0 +1,87 @@
+/*
+* Supercompressed texture container (.ktxz)
+*
+* Stores the same images as a KTX file, but every (layer, face, level) subresource is
+* deflated independently so the chunks can be inflated in parallel straight into a
+* mapped staging buffer.  The decompressed chunks are laid out in the same order gli
+* uses for its texture storage, each starting at a multiple of 4 and of the texel
+* block size so it can be copied to an image straight from the buffer.
+* Version 1 packed the chunks back to back, such containers have to be written again.
+*
+* File layout:
+*   Header
+*   Chunk[header.chunkCount]
+*   compressed chunk data
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <gli/gli.hpp>
+
+namespace vkx {
+    class WorkStealingPool;
+
+    namespace ktxz {
+        // 'KTXZ'
+        static const uint32_t MAGIC = 0x5A58544B;
+        static const uint32_t VERSION = 2;
+
+        struct Header {
+            uint32_t magic{ MAGIC };
+            uint32_t version{ VERSION };
+            // gli::format of the stored texels
+            uint32_t format{ 0 };
+            uint32_t width{ 0 };
+            uint32_t height{ 0 };
+            uint32_t depth{ 0 };
+            uint32_t levels{ 0 };
+            uint32_t layers{ 0 };
+            uint32_t faces{ 0 };
+            uint32_t chunkCount{ 0 };
+        };
+
+        struct Chunk {
+            uint32_t layer{ 0 };
+            uint32_t face{ 0 };
+            uint32_t level{ 0 };
+            uint32_t width{ 0 };
+            uint32_t height{ 0 };
+            uint32_t depth{ 0 };
+            // Location of the deflated data within the file
+            uint64_t offset{ 0 };
+            uint64_t compressedSize{ 0 };
+            // Location of the inflated data within the staging buffer, aligned for buffer to image copies
+            uint64_t uncompressedOffset{ 0 };
+            uint64_t size{ 0 };
+        };
+
+        struct Container {
+            Header header;
+            std::vector<Chunk> chunks;
+            // Raw contents of the file, chunk offsets are relative to the start of this
+            std::vector<uint8_t> fileData;
+
+            // Total size of the texture once all chunks are inflated
+            uint64_t uncompressedSize() const;
+        };
+
+        // Name of the container that corresponds to a KTX or DDS file, with the extension replaced by .ktxz
+        std::string containerFilename(const std::string& filename);
+
+        // Reads a container into memory.  Returns false if the file does not exist and throws if it is malformed.
+        bool read(const std::string& filename, Container& result);
+
+        // Inflate all chunks into destination, which must hold at least uncompressedSize() bytes.
+        // If a thread pool is provided, the chunks are distributed across its threads.
+        void decompress(const Container& container, uint8_t* destination, WorkStealingPool* threadPool = nullptr);
+
+        // Deflate every subresource of a texture and write the container to disk, returns the number of bytes written
+        uint64_t write(const std::string& filename, const gli::texture& texture, int compressionLevel = 9);
+    }
+}
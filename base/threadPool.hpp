@@ -6,12 +6,18 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <vector>
 #include <thread>
 #include <queue>
+#include <memory>
+#include <functional>
 #include <mutex>
 #include <condition_variable>
 
+#include "cpuProfiler.hpp"
+
 namespace vkx {
     class Thread {
     private:
@@ -23,6 +29,7 @@ namespace vkx {
 
         // Loop through all remaining jobs
         void queueLoop() {
+            VKX_PROFILE_THREAD_NAME("Thread pool");
             while (true) {
                 std::function<void()> job;
                 {
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "common.hpp"
+#include "cpuProfiler.hpp"
+#include "scratchAllocator.hpp"
 #include "vulkanDebug.h"
 #include "vulkanTools.h"
 #include "vulkanShaders.h"
+#include "vulkanTextureTable.hpp"
 
 namespace vkx {
     class Context {
@@ -11,8 +14,14 @@ namespace vkx {
         static std::list<std::string> requestedLayers;
         // Set to true when example is created with enabled validation layers
         bool enableValidation = false;
+        // Set to false when the context was created without the surface and swap chain extensions
+        bool enableSurface = true;
         // Set to true when the debug marker extension is detected
         bool enableDebugMarkers = false;
+        // Set to true when descriptor indexing is available, in which case textureTable is valid
+        bool enableDescriptorIndexing = false;
+        // Set to true when the swap chain can report when images reach the display
+        bool enableDisplayTiming = false;
         // fps timer (one second interval)
         float fpsTimer = 0.0f;
         // Create application wide Vulkan instance
@@ -26,9 +35,11 @@ namespace vkx {
             return result;
         }
 
-        void createContext(bool enableValidation = false) {
+        // Without enableSurface no window system extensions are required, for headless rendering
+        void createContext(bool enableValidation = false, bool enableSurface = true) {
 
             this->enableValidation = enableValidation;
+            this->enableSurface = enableSurface;
             {
                 // Vulkan instance
                 vk::ApplicationInfo appInfo;
@@ -36,21 +47,29 @@ namespace vkx {
                 appInfo.pEngineName = "VulkanExamples";
                 appInfo.apiVersion = VK_API_VERSION_1_0;
 
-                std::vector<const char*> enabledExtensions = { VK_KHR_SURFACE_EXTENSION_NAME };
-                // Enable surface extensions depending on os
+                std::vector<const char*> enabledExtensions;
+                if (enableSurface) {
+                    enabledExtensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+                    // Enable surface extensions depending on os
 #if defined(_WIN32)
-                enabledExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+                    enabledExtensions.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
 #elif defined(__ANDROID__)
-                enabledExtensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
+                    enabledExtensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
 #elif defined(__linux__)
-                enabledExtensions.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
+                    enabledExtensions.push_back(VK_KHR_XCB_SURFACE_EXTENSION_NAME);
 #endif
+                }
+                // Needed to query extended device features such as descriptor indexing
+                if (checkGlobalExtensionPresent(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+                    enabledExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+                    enablePhysicalDeviceProperties2 = true;
+                }
                 vk::InstanceCreateInfo instanceCreateInfo;
                 instanceCreateInfo.pApplicationInfo = &appInfo;
+                if (enableValidation) {
+                    enabledExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+                }
                 if (enabledExtensions.size() > 0) {
-                    if (enableValidation) {
-                        enabledExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-                    }
                     instanceCreateInfo.enabledExtensionCount = (uint32_t)enabledExtensions.size();
                     instanceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
                 }
@@ -85,6 +104,8 @@ namespace vkx {
             // Gather physical device memory properties
             deviceMemoryProperties = physicalDevice.getMemoryProperties();
 
+            bool descriptorUpdateAfterBind = false;
+            uint32_t textureTableCapacity = 0;
             // Vulkan device
             {
                 // Find a queue that supports graphics operations
@@ -94,7 +115,10 @@ namespace vkx {
                 queueCreateInfo.queueFamilyIndex = graphicsQueueIndex;
                 queueCreateInfo.queueCount = 1;
                 queueCreateInfo.pQueuePriorities = queuePriorities.data();
-                std::vector<const char*> enabledExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+                std::vector<const char*> enabledExtensions;
+                if (enableSurface) {
+                    enabledExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+                }
                 vk::DeviceCreateInfo deviceCreateInfo;
                 deviceCreateInfo.queueCreateInfoCount = 1;
                 deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
@@ -104,6 +128,60 @@ namespace vkx {
                     enabledExtensions.push_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
                     enableDebugMarkers = true;
                 }
+#if defined(VK_GOOGLE_display_timing)
+                // Used to measure the latency of presents
+                if (enableSurface && vkx::checkDeviceExtensionPresent(physicalDevice, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME)) {
+                    enabledExtensions.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+                    enableDisplayTiming = true;
+                }
+#endif
+#if defined(VK_EXT_descriptor_indexing)
+                // Enable the subset of descriptor indexing used by the texture table
+                VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
+                VkPhysicalDeviceDescriptorIndexingFeaturesEXT enabledIndexingFeatures{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT };
+                if (enablePhysicalDeviceProperties2 &&
+                    vkx::checkDeviceExtensionPresent(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+                    vkx::checkDeviceExtensionPresent(physicalDevice, VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+                    auto getFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR");
+                    VkPhysicalDeviceFeatures2KHR features2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR };
+                    features2.pNext = &indexingFeatures;
+                    getFeatures2(physicalDevice, &features2);
+                    if (indexingFeatures.runtimeDescriptorArray && indexingFeatures.descriptorBindingPartiallyBound &&
+                        indexingFeatures.descriptorBindingVariableDescriptorCount && indexingFeatures.shaderSampledImageArrayNonUniformIndexing) {
+                        enabledIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+                        enabledIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+                        enabledIndexingFeatures.descriptorBindingVariableDescriptorCount = VK_TRUE;
+                        enabledIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+                        enabledIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = indexingFeatures.descriptorBindingSampledImageUpdateAfterBind;
+                        enabledIndexingFeatures.descriptorBindingUpdateUnusedWhilePending = indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+                        enabledExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+                        enabledExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+                        deviceCreateInfo.pNext = &enabledIndexingFeatures;
+                        enableDescriptorIndexing = true;
+                        descriptorUpdateAfterBind = indexingFeatures.descriptorBindingSampledImageUpdateAfterBind && indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+
+                        // The table is a single combined image sampler binding visible to every graphics stage and compute,
+                        // so the sampler, sampled image and per stage resource limits all apply.  An update after bind
+                        // binding is held to the update after bind variants of those limits instead.
+                        const auto& limits = deviceProperties.limits;
+                        uint32_t capacity = std::min({ limits.maxPerStageDescriptorSampledImages, limits.maxDescriptorSetSampledImages,
+                            limits.maxPerStageDescriptorSamplers, limits.maxDescriptorSetSamplers, limits.maxPerStageResources });
+                        if (descriptorUpdateAfterBind) {
+                            auto getProperties2 = (PFN_vkGetPhysicalDeviceProperties2KHR)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR");
+                            VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT };
+                            VkPhysicalDeviceProperties2KHR properties2{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR };
+                            properties2.pNext = &indexingProperties;
+                            getProperties2(physicalDevice, &properties2);
+                            capacity = std::min({ indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+                                indexingProperties.maxPerStageUpdateAfterBindResources });
+                        }
+                        textureTableCapacity = std::min(TextureTable::MAX_TEXTURES, capacity);
+                    }
+                }
+#endif
                 if (enabledExtensions.size() > 0) {
                     deviceCreateInfo.enabledExtensionCount = (uint32_t)enabledExtensions.size();
                     deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
@@ -128,6 +206,13 @@ namespace vkx {
             // Get the graphics queue
             queue = device.getQueue(graphicsQueueIndex, 0);
 
+#if defined(VK_EXT_descriptor_indexing)
+            if (enableDescriptorIndexing) {
+                textureTable = std::make_shared<TextureTable>();
+                textureTable->create(device, textureTableCapacity, descriptorUpdateAfterBind);
+            }
+#endif
+
         }
 
         void destroyContext() {
@@ -141,6 +226,10 @@ namespace vkx {
                 recycle();
             }
 
+            if (textureTable) {
+                textureTable->destroy();
+                textureTable.reset();
+            }
             destroyCommandPool();
             device.destroyPipelineCache(pipelineCache);
             device.destroy();
@@ -185,6 +274,10 @@ namespace vkx {
         vk::Queue queue;
         // Find a queue that supports graphics operations
         uint32_t graphicsQueueIndex;
+        // Set when VK_KHR_get_physical_device_properties2 is enabled on the instance
+        bool enablePhysicalDeviceProperties2 = false;
+        // Global texture array, shared by all copies of the context.  Null unless enableDescriptorIndexing is set.
+        std::shared_ptr<TextureTable> textureTable;
 
         ///////////////////////////////////////////////////////////////////////
         //
@@ -204,7 +297,12 @@ namespace vkx {
         // in order to check the fences and execute the associated destructors for any that are signalled.
         using VoidLambda = std::function<void()>;
         using VoidLambdaList = std::list<VoidLambda>;
-        using FencedLambda = std::pair<vk::Fence, VoidLambda>;
+        struct FencedLambda {
+            vk::Fence fence;
+            VoidLambda lambda;
+            // Persistent fences (like the per frame fences) are reset and reused by their owner
+            bool ownsFence{ true };
+        };
         using FencedLambdaQueue = std::queue<FencedLambda>;
 
         // A collection of items queued for destruction.  Once a fence has been created
@@ -213,6 +311,10 @@ namespace vkx {
         VoidLambdaList dumpster;
         FencedLambdaQueue recycler;
 
+        // Transient arrays for building submissions on the main thread.  ExampleBase resets it
+        // every frame, other code should bracket its use with a ScratchAllocator::Scope.
+        ScratchAllocator scratch;
+
         template<typename T>
         void trash(T value, std::function<void(const T& t)> destructor) {
             if (!value) {
@@ -278,26 +380,37 @@ namespace vkx {
 
         // Should be called from time to time by the application to migrate zombie resources
         // to the recycler along with a fence that will be signalled when the objects are 
-        // safe to delete.
-        void emptyDumpster(vk::Fence fence) {
+        // safe to delete.  Unless ownsFence is false the recycler destroys the fence afterwards.
+        void emptyDumpster(vk::Fence fence, bool ownsFence = true) {
+            if (dumpster.empty()) {
+                // Called every frame, so don't queue anything unless the fence needs destroying
+                if (ownsFence) {
+                    recycler.push(FencedLambda{ fence, VoidLambda(), ownsFence });
+                }
+                return;
+            }
             VoidLambdaList newDumpster;
             newDumpster.swap(dumpster);
-            recycler.push(FencedLambda{ fence, [fence, newDumpster, this] {
+            recycler.push(FencedLambda{ fence, [newDumpster = std::move(newDumpster)] {
                 for (const auto & f : newDumpster) { f(); }
-            } });
+            }, ownsFence });
         }
 
         // Check the recycler fences for signalled status.  Any that are signalled will have their corresponding
         // lambdas executed, freeing up the associated resources
         void recycle() {
-            while (!recycler.empty() && vk::Result::eSuccess == device.getFenceStatus(recycler.front().first)) {
-                vk::Fence fence = recycler.front().first;
-                VoidLambda lambda = recycler.front().second;
+            VKX_PROFILE_SCOPE("recycle");
+            while (!recycler.empty() && vk::Result::eSuccess == device.getFenceStatus(recycler.front().fence)) {
+                vk::Fence fence = recycler.front().fence;
+                VoidLambda lambda = std::move(recycler.front().lambda);
+                bool ownsFence = recycler.front().ownsFence;
                 recycler.pop();
 
-                lambda();
+                if (lambda) {
+                    lambda();
+                }
 
-                if (recycler.empty() || fence != recycler.front().first) {
+                if (ownsFence && (recycler.empty() || fence != recycler.front().fence)) {
                     device.destroyFence(fence);
                 }
             }
@@ -615,14 +728,18 @@ namespace vkx {
             const vk::ArrayProxy<const SemaphoreStagePair>& wait = {},
             const vk::ArrayProxy<const vk::Semaphore>& signals = {},
             const vk::Fence& fence = vk::Fence()) {
-            std::vector<vk::Semaphore> waitSemaphores;
-            std::vector<vk::PipelineStageFlags> waitStages;
+            ScratchAllocator::Scope scope(scratch);
+            auto waitSemaphores = scratch.array<vk::Semaphore>(wait.size());
+            auto waitStages = scratch.array<vk::PipelineStageFlags>(wait.size());
             for (size_t i = 0; i < wait.size(); ++i) {
                 const auto& pair = wait.data()[i];
                 waitSemaphores.push_back(pair.first);
                 waitStages.push_back(pair.second);
             }
-            submit(commandBuffers, waitSemaphores, waitStages, signals, fence);
+            submit(commandBuffers,
+                vk::ArrayProxy<const vk::Semaphore>(waitSemaphores.size(), waitSemaphores.data()),
+                vk::ArrayProxy<const vk::PipelineStageFlags>(waitStages.size(), waitStages.data()),
+                signals, fence);
         }
     };
 
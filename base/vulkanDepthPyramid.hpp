@@ -0,0 +1,254 @@
+/*
+* Hierarchical depth (Hi-Z) pyramid built with a single compute dispatch
+*
+* Level 0 is the depth buffer reduced to the next lower power of two, every further level
+* holds the farthest depth of the 2x2 texels below it.  An object whose nearest depth is
+* farther than the pyramid texels covering its screen rect is hidden.
+*
+* Each 256 thread workgroup reduces a 64x64 tile of level 0 down to a single texel of
+* level 6 in shared memory.  The last workgroup to finish, found with an atomic counter,
+* reduces level 6 to the remaining levels, so no barriers between levels are needed.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "vulkanContext.hpp"
+
+namespace vkx {
+
+    class DepthPyramid {
+    public:
+        // Must match depthpyramid.comp.  Level 0 is at most 4096 wide so the last
+        // workgroup only has to reduce a single 64x64 tile of level 6.
+        static const uint32_t MAX_LEVELS{ 13 };
+        static const uint32_t MAX_SIZE{ 1u << (MAX_LEVELS - 1) };
+        static const uint32_t TILE_SIZE{ 64 };
+
+        CreateImageResult image;
+        vk::Extent2D extent;
+        uint32_t levels{ 0 };
+        vk::Extent2D depthExtent;
+
+        DepthPyramid(const vkx::Context& context) : context(context) {}
+
+        ~DepthPyramid() {
+            destroy();
+        }
+
+        static uint32_t previousPowerOfTwo(uint32_t value) {
+            uint32_t result = 1;
+            while (result * 2 <= value) {
+                result *= 2;
+            }
+            return result;
+        }
+
+        // depthView must be a depth aspect view in eDepthStencilReadOnlyOptimal when build() runs.
+        // Can be called again after a resize.
+        void create(const vk::ImageView& depthView, const vk::Extent2D& depthExtent) {
+            destroyImage();
+            this->depthExtent = depthExtent;
+            extent.width = std::min(previousPowerOfTwo(depthExtent.width), MAX_SIZE);
+            extent.height = std::min(previousPowerOfTwo(depthExtent.height), MAX_SIZE);
+            levels = 1;
+            while ((std::max(extent.width, extent.height) >> levels) > 0) {
+                ++levels;
+            }
+
+            vk::ImageCreateInfo imageCreateInfo;
+            imageCreateInfo.imageType = vk::ImageType::e2D;
+            imageCreateInfo.format = vk::Format::eR32Sfloat;
+            imageCreateInfo.extent = vk::Extent3D{ extent.width, extent.height, 1 };
+            imageCreateInfo.mipLevels = levels;
+            imageCreateInfo.arrayLayers = 1;
+            imageCreateInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled;
+            image = context.createImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+            vk::ImageViewCreateInfo viewCreateInfo;
+            viewCreateInfo.image = image.image;
+            viewCreateInfo.viewType = vk::ImageViewType::e2D;
+            viewCreateInfo.format = vk::Format::eR32Sfloat;
+            viewCreateInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, levels, 0, 1 };
+            image.view = context.device.createImageView(viewCreateInfo);
+            viewCreateInfo.subresourceRange.levelCount = 1;
+            for (uint32_t level = 0; level < levels; ++level) {
+                viewCreateInfo.subresourceRange.baseMipLevel = level;
+                levelViews.push_back(context.device.createImageView(viewCreateInfo));
+            }
+
+            // Texels are fetched, never filtered
+            vk::SamplerCreateInfo samplerCreateInfo;
+            samplerCreateInfo.magFilter = vk::Filter::eNearest;
+            samplerCreateInfo.minFilter = vk::Filter::eNearest;
+            samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+            samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+            samplerCreateInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+            samplerCreateInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+            samplerCreateInfo.maxLod = (float)levels;
+            image.sampler = context.device.createSampler(samplerCreateInfo);
+
+            // The pyramid stays in the general layout, it is written as a storage image and fetched by the culling shaders
+            context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) {
+                vkx::setImageLayout(cmdBuffer, image.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral,
+                    vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, levels, 0, 1 });
+            });
+
+            if (!pipeline) {
+                preparePipeline();
+            }
+            updateDescriptorSet(depthView);
+        }
+
+        // Record outside of a render pass.  Waits for depth writes, and for earlier compute reads of the
+        // pyramid and the last build's writes to it and to the counter.
+        void build(const vk::CommandBuffer& cmdBuffer, const vk::Image& depthImage) const {
+            vk::ImageMemoryBarrier depthBarrier;
+            depthBarrier.srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+            depthBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+            depthBarrier.oldLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+            depthBarrier.newLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+            depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            depthBarrier.image = depthImage;
+            depthBarrier.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 };
+            vk::MemoryBarrier readBarrier{ vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), readBarrier, nullptr, depthBarrier);
+
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+            PushConstants pushConstants;
+            pushConstants.size = glm::uvec2(extent.width, extent.height);
+            pushConstants.depthSize = glm::uvec2(depthExtent.width, depthExtent.height);
+            pushConstants.levels = levels;
+            pushConstants.workgroups = ((extent.width + TILE_SIZE - 1) / TILE_SIZE) * ((extent.height + TILE_SIZE - 1) / TILE_SIZE);
+            cmdBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), &pushConstants);
+            cmdBuffer.dispatch((extent.width + TILE_SIZE - 1) / TILE_SIZE, (extent.height + TILE_SIZE - 1) / TILE_SIZE, 1);
+
+            // Pyramid is complete for the shaders that test against it
+            vk::MemoryBarrier writeBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), writeBarrier, nullptr, nullptr);
+        }
+
+        // Whole mip chain, for texelFetch in the culling shaders
+        vk::DescriptorImageInfo descriptor() const {
+            return vk::DescriptorImageInfo{ image.sampler, image.view, vk::ImageLayout::eGeneral };
+        }
+
+        void destroy() {
+            destroyImage();
+            if (pipeline) {
+                context.device.destroyPipeline(pipeline);
+                pipeline = vk::Pipeline();
+            }
+            if (pipelineLayout) {
+                context.device.destroyPipelineLayout(pipelineLayout);
+                pipelineLayout = vk::PipelineLayout();
+            }
+            if (descriptorSetLayout) {
+                context.device.destroyDescriptorSetLayout(descriptorSetLayout);
+                descriptorSetLayout = vk::DescriptorSetLayout();
+            }
+            if (descriptorPool) {
+                context.device.destroyDescriptorPool(descriptorPool);
+                descriptorPool = vk::DescriptorPool();
+            }
+            if (depthSampler) {
+                context.device.destroySampler(depthSampler);
+                depthSampler = vk::Sampler();
+            }
+            counter.destroy();
+        }
+
+    private:
+        struct PushConstants {
+            glm::uvec2 size;
+            glm::uvec2 depthSize;
+            uint32_t levels;
+            uint32_t workgroups;
+        };
+
+        const vkx::Context& context;
+        std::vector<vk::ImageView> levelViews;
+        // Workgroups finished, reset to zero by the last one
+        CreateBufferResult counter;
+        vk::Sampler depthSampler;
+        vk::DescriptorPool descriptorPool;
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::DescriptorSet descriptorSet;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+
+        void destroyImage() {
+            for (const auto& view : levelViews) {
+                context.device.destroyImageView(view);
+            }
+            levelViews.clear();
+            image.destroy();
+        }
+
+        void preparePipeline() {
+            uint32_t zero = 0;
+            counter = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, zero);
+
+            vk::SamplerCreateInfo samplerCreateInfo;
+            samplerCreateInfo.magFilter = vk::Filter::eNearest;
+            samplerCreateInfo.minFilter = vk::Filter::eNearest;
+            samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+            samplerCreateInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+            samplerCreateInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+            depthSampler = context.device.createSampler(samplerCreateInfo);
+
+            std::vector<vk::DescriptorPoolSize> poolSizes = {
+                vkx::descriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1),
+                vkx::descriptorPoolSize(vk::DescriptorType::eStorageImage, MAX_LEVELS),
+                vkx::descriptorPoolSize(vk::DescriptorType::eStorageBuffer, 1),
+            };
+            descriptorPool = context.device.createDescriptorPool(vkx::descriptorPoolCreateInfo((uint32_t)poolSizes.size(), poolSizes.data(), 1));
+
+            std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+                // Binding 0 : Source depth
+                vkx::descriptorSetLayoutBinding(vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute, 0),
+                // Binding 1 : One storage image per pyramid level
+                vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageImage, vk::ShaderStageFlagBits::eCompute, 1),
+                // Binding 2 : Workgroup counter
+                vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 2),
+            };
+            setLayoutBindings[1].descriptorCount = MAX_LEVELS;
+            descriptorSetLayout = context.device.createDescriptorSetLayout(vkx::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), (uint32_t)setLayoutBindings.size()));
+            vk::PushConstantRange pushConstantRange = vkx::pushConstantRange(vk::ShaderStageFlagBits::eCompute, sizeof(PushConstants), 0);
+            vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo = vkx::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+            pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+            pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+            pipelineLayout = context.device.createPipelineLayout(pipelineLayoutCreateInfo);
+            descriptorSet = context.device.allocateDescriptorSets(vkx::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1))[0];
+
+            vk::ComputePipelineCreateInfo computePipelineCreateInfo = vkx::computePipelineCreateInfo(pipelineLayout);
+            vkx::shader::initGlsl();
+            computePipelineCreateInfo.stage = context.loadGlslShader(getAssetPath() + "shaders/base/depthpyramid.comp", vk::ShaderStageFlagBits::eCompute);
+            vkx::shader::finalizeGlsl();
+            pipeline = context.device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo, nullptr)[0];
+        }
+
+        void updateDescriptorSet(const vk::ImageView& depthView) {
+            vk::DescriptorImageInfo depthDescriptor{ depthSampler, depthView, vk::ImageLayout::eDepthStencilReadOnlyOptimal };
+            // Every slot must hold a valid view, the unused ones point at the last level and are never written
+            std::vector<vk::DescriptorImageInfo> levelDescriptors;
+            for (uint32_t level = 0; level < MAX_LEVELS; ++level) {
+                levelDescriptors.push_back(vk::DescriptorImageInfo{ vk::Sampler(), levelViews[std::min(level, levels - 1)], vk::ImageLayout::eGeneral });
+            }
+
+            std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
+                vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eCombinedImageSampler, 0, &depthDescriptor),
+                vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eStorageImage, 1, levelDescriptors.data()),
+                vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eStorageBuffer, 2, &counter.descriptor),
+            };
+            writeDescriptorSets[1].descriptorCount = MAX_LEVELS;
+            context.device.updateDescriptorSets(writeDescriptorSets, nullptr);
+        }
+    };
+}
@@ -26,14 +26,39 @@ ExampleBase::ExampleBase(bool enableValidation) : swapChain(*this) {
 #endif
 
 #if !defined(__ANDROID__)
+    // Parsed here rather than in run(), the context needs to know whether there will be a surface
+    headless.enabled = CommandLine::has("-headless");
+    headless.frames = (uint32_t)std::stoul(CommandLine::value("-frames", "0"));
+    headless.screenshot = CommandLine::value("-screenshot");
+    if (headless.enabled) {
+        swapChain.headlessReadback = !headless.screenshot.empty();
+    }
+    benchmark.enabled = CommandLine::has("-benchmark");
+    benchmark.warmupFrames = (uint32_t)std::stoul(CommandLine::value("-benchmark-warmup", std::to_string(benchmark.warmupFrames)));
+    benchmark.frames = std::max(1u, (uint32_t)std::stoul(CommandLine::value("-benchmark-frames", std::to_string(benchmark.frames))));
+    benchmark.output = CommandLine::value("-benchmark-output", benchmark.output);
+    if (benchmark.enabled) {
+        benchmark.cpuFrameTimes.reserve(benchmark.frames);
+        benchmark.gpuFrameTimes.reserve(benchmark.frames + benchmark.warmupFrames);
+        latency.inputToSubmitTimes.reserve(benchmark.frames);
+        latency.submitToPresentTimes.reserve(benchmark.frames);
+    }
+    framePacer.setTargetFps(std::stod(CommandLine::value("-fps", "0")));
+    allocationCheck.strict = CommandLine::has("-strict-allocations");
+    traceFile = CommandLine::value("-trace");
+    VKX_PROFILE_THREAD_NAME("Main");
+
     // Android Vulkan initialization is handled in APP_CMD_INIT_WINDOW event
+    auto tStart = std::chrono::high_resolution_clock::now();
     initVulkan(enableValidation);
+    startupTimes.push_back({ "context", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count() });
 #endif
 }
 
 ExampleBase::~ExampleBase() {
     // Clean up Vulkan resources
     swapChain.cleanup();
+    gpuProfiler.destroy();
     if (descriptorPool) {
         device.destroyDescriptorPool(descriptorPool);
     }
@@ -41,10 +66,12 @@ ExampleBase::~ExampleBase() {
         device.freeCommandBuffers(cmdPool, primaryCmdBuffers);
         primaryCmdBuffers.clear();
     }
-    if (!drawCmdBuffers.empty()) {
-        device.freeCommandBuffers(cmdPool, drawCmdBuffers);
-        drawCmdBuffers.clear();
+    // Destroying the pools frees the draw command buffers
+    for (auto& drawCmdPool : drawCmdPools) {
+        device.destroyCommandPool(drawCmdPool);
     }
+    drawCmdPools.clear();
+    drawCmdBuffers.clear();
     if (!textCmdBuffers.empty()) {
         device.freeCommandBuffers(cmdPool, textCmdBuffers);
         textCmdBuffers.clear();
@@ -67,44 +94,101 @@ ExampleBase::~ExampleBase() {
         delete textOverlay;
     }
 
-    device.destroySemaphore(semaphores.acquireComplete);
-    device.destroySemaphore(semaphores.renderComplete);
+    // Frame fences are not owned by the recycler, so let it finish with them first
+    queue.waitIdle();
+    while (!recycler.empty()) {
+        recycle();
+    }
+    if (frames.empty()) {
+        device.destroySemaphore(semaphores.acquireComplete);
+        device.destroySemaphore(semaphores.renderComplete);
+    }
+    for (auto& frame : frames) {
+        device.destroyFence(frame.fence);
+        device.destroyCommandPool(frame.commandPool);
+        device.destroySemaphore(frame.acquireComplete);
+        device.destroySemaphore(frame.renderComplete);
+        device.destroySemaphore(frame.transferPending);
+        device.destroySemaphore(frame.transferComplete);
+    }
+    frames.clear();
 
     destroyContext();
 
 #if defined(__ANDROID__)
     // todo : android cleanup (if required)
 #else
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 #endif
 }
 
 
 void ExampleBase::run() {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    auto phaseComplete = [&](const std::string& phase) {
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        startupTimes.push_back({ phase, std::chrono::duration<double, std::milli>(tEnd - tStart).count() });
+        tStart = tEnd;
+    };
+
+    if (headless.enabled) {
+        swapChain.createHeadless();
+        camera.setAspectRatio(size);
+    } else {
 #if defined(_WIN32)
-    setupWindow();
+        setupWindow();
 #elif defined(__ANDROID__)
-    // Attach vulkan example to global android application state
-    state->userData = vulkanExample;
-    state->onAppCmd = VulkanExample::handleAppCommand;
-    state->onInputEvent = VulkanExample::handleAppInput;
-    androidApp = state;
+        // Attach vulkan example to global android application state
+        state->userData = vulkanExample;
+        state->onAppCmd = VulkanExample::handleAppCommand;
+        state->onInputEvent = VulkanExample::handleAppInput;
+        androidApp = state;
 #elif defined(__linux__)
-    setupWindow();
+        setupWindow();
 #endif
+    }
 #if !defined(__ANDROID__)
-    prepare();
+    phaseComplete("window");
+    {
+        VKX_PROFILE_SCOPE("prepare");
+        prepare();
+    }
+    phaseComplete("prepare");
 #endif
     renderLoop();
 
     // Once we exit the render loop, wait for everything to become idle before proceeding to the descructor.
     queue.waitIdle();
     device.waitIdle();
+
+    if (benchmark.enabled) {
+        // Hand out the timestamps of the last frames
+        recycle();
+        writeBenchmarkReport();
+    }
+
+    if (!traceFile.empty()) {
+#if defined(VKX_PROFILE)
+        if (!profiler::writeChromeTrace(traceFile)) {
+            std::cerr << "Could not write " << traceFile << std::endl;
+        }
+#else
+        std::cerr << "-trace needs a build with ENABLE_CPU_PROFILER" << std::endl;
+#endif
+    }
+
+    if (headless.enabled && !headless.screenshot.empty()) {
+        if (!swapChain.saveLastImage(headless.screenshot)) {
+            std::cerr << "Could not save " << headless.screenshot << std::endl;
+        }
+    }
 }
 
 void ExampleBase::initVulkan(bool enableValidation) {
-    createContext(enableValidation);
+    createContext(enableValidation, !headless.enabled);
     // Find a suitable depth format
     depthFormat = getSupportedDepthFormat(physicalDevice);
 
@@ -155,6 +239,8 @@ void ExampleBase::renderLoop() {
             break;
         }
 
+        fencePoller.poll(device);
+
         // Render frame
         if (prepared) {
             auto tStart = std::chrono::high_resolution_clock::now();
@@ -173,6 +259,7 @@ void ExampleBase::renderLoop() {
             fpsTimer += (float)tDiff;
             if (fpsTimer > 1000.0f) {
                 lastFPS = frameCounter;
+                updateRecordStats();
                 updateTextOverlay();
                 fpsTimer = 0.0f;
                 frameCounter = 0;
@@ -180,12 +267,52 @@ void ExampleBase::renderLoop() {
         }
     }
 #else
+    if (headless.enabled) {
+        // No events to poll, just render until the requested frame count is reached
+        auto tStart = std::chrono::high_resolution_clock::now();
+        for (uint32_t frame = 0; headless.frames == 0 || frame < headless.frames; ++frame) {
+            uint64_t allocations = vkx::allocations::count();
+            waitForFrame();
+            framePacer.wait();
+            auto tEnd = std::chrono::high_resolution_clock::now();
+            auto tDiffSeconds = std::chrono::duration<float>(tEnd - tStart).count();
+            tStart = tEnd;
+            if (benchmark.enabled) {
+                if (!benchmarkFrame(tDiffSeconds * 1000.0)) {
+                    break;
+                }
+                tDiffSeconds = benchmark.timestep;
+            }
+            inputSampled();
+            VKX_PROFILE_SCOPE("frame");
+            fencePoller.poll(device);
+            {
+                VKX_PROFILE_SCOPE("update");
+                update(tDiffSeconds);
+            }
+            render();
+            checkAllocations(vkx::allocations::count() - allocations);
+        }
+        return;
+    }
+
     auto tStart = std::chrono::high_resolution_clock::now();
     while (!glfwWindowShouldClose(window)) {
+        uint64_t allocations = vkx::allocations::count();
+        // Block on the GPU before reading input rather than after, so that nothing waits between
+        // sampling the input, updating and submitting the frame that shows it
+        waitForFrame();
+        framePacer.wait();
         auto tEnd = std::chrono::high_resolution_clock::now();
         auto tDiff = std::chrono::duration<float, std::milli>(tEnd - tStart).count();
         auto tDiffSeconds = tDiff / 1000.0f;
         tStart = tEnd;
+        if (benchmark.enabled) {
+            if (!benchmarkFrame(tDiff)) {
+                break;
+            }
+            tDiffSeconds = benchmark.timestep;
+        }
         glfwPollEvents();
 
         if (glfwJoystickPresent(0)) {
@@ -237,11 +364,16 @@ void ExampleBase::renderLoop() {
         } else {
             memset(&gamePadState.axes, 0, sizeof(gamePadState.axes));
         }
+        inputSampled();
 
-
+        VKX_PROFILE_SCOPE("frame");
+        fencePoller.poll(device);
+        {
+            VKX_PROFILE_SCOPE("update");
+            update(tDiffSeconds);
+        }
         render();
-        update(tDiffSeconds);
-
+        checkAllocations(vkx::allocations::count() - allocations);
     }
 #endif
 }
@@ -267,6 +399,14 @@ void ExampleBase::prepare() {
     cmdPool = getCommandPool();
 
     swapChain.create(size, enableVsync);
+    setupFrames();
+    gpuProfiler.create(graphicsQueueIndex, framesInFlight);
+    gpuProfiler.onFrame = [this](double milliseconds) {
+        // Arrive a few frames late, so the first measured frames get the warm-up's last timings
+        if (benchmark.enabled && benchmark.frame > benchmark.warmupFrames) {
+            benchmark.gpuFrameTimes.push_back(milliseconds);
+        }
+    };
     setupDepthStencil();
     setupRenderPass();
     setupRenderPassBeginInfo();
@@ -319,32 +459,402 @@ void ExampleBase::updateTextOverlay() {
 
     std::stringstream ss;
     ss << std::fixed << std::setprecision(2) << (frameTimer * 1000.0f) << "ms (" << lastFPS << " fps)";
+    // Command buffer recording over the last second
+    ss << ", " << lastRecordStats.recorded << " re-records/s (" << lastRecordStats.cpuTime << "ms)";
+    // Without display timing the second figure runs to the GPU finishing, not to the present
+    ss << ", latency " << latency.lastInputToSubmit << " + " << latency.lastSubmitToPresent << "ms" << (latency.displayTiming ? "" : " (to GPU done)");
     textOverlay->addText(ss.str(), 5.0f, 25.0f, TextOverlay::alignLeft);
     textOverlay->addText(deviceProperties.deviceName, 5.0f, 45.0f, TextOverlay::alignLeft);
+    if (gpuProfiler.visible) {
+        // Top right, clear of the examples' own text
+        float y = 5.0f;
+        for (const auto& timing : gpuProfiler.getTimings()) {
+            std::stringstream line;
+            line << std::string(timing.depth * 2, ' ') << timing.name << " " << std::fixed << std::setprecision(3) << timing.milliseconds << "ms";
+            textOverlay->addText(line.str(), (float)size.width - 260.0f, y, TextOverlay::alignLeft);
+            y += 20.0f;
+        }
+    }
     getOverlayText(textOverlay);
     textOverlay->endTextUpdate();
 
-    trashCommandBuffers(textCmdBuffers);
-    populateSubCommandBuffers(textCmdBuffers, [&](const vk::CommandBuffer& cmdBuffer) {
-        textOverlay->writeCommandBuffer(cmdBuffer);
-    });
-    primaryCmdBuffersDirty = true;
+    textCmdBufferDirty.assign(framesInFlight, true);
+}
+
+bool ExampleBase::allocateDrawCommandBuffers() {
+    drawCmdBufferParts = std::max(1u, drawCmdBufferParts);
+    const uint32_t count = framesInFlight * drawCmdBufferParts;
+    if (drawCmdBuffers.size() == count) {
+        return false;
+    }
+
+    // The old buffers may still be executing, so their pools go once the next frame has finished
+    for (const auto& drawCmdPool : drawCmdPools) {
+        dumpster.push_back([drawCmdPool, this] {
+            device.destroyCommandPool(drawCmdPool);
+        });
+    }
+    drawCmdPools.resize(count);
+    drawCmdBuffers.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        vk::CommandPoolCreateInfo cmdPoolInfo;
+        cmdPoolInfo.queueFamilyIndex = graphicsQueueIndex;
+        cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+        drawCmdPools[i] = device.createCommandPool(cmdPoolInfo);
+
+        vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
+        cmdBufAllocateInfo.commandPool = drawCmdPools[i];
+        cmdBufAllocateInfo.commandBufferCount = 1;
+        cmdBufAllocateInfo.level = vk::CommandBufferLevel::eSecondary;
+        drawCmdBuffers[i] = device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
+    }
+    // Every frame has to record its parts into the new buffers
+    drawCmdBufferDirty.assign(framesInFlight, true);
+    return true;
+}
+
+void ExampleBase::updateRecordStats() {
+    lastRecordStats = recordStats;
+    recordStats = RecordStats();
 }
 
 void ExampleBase::getOverlayText(vkx::TextOverlay *textOverlay) {
     // Can be overriden in derived class
 }
 
-void ExampleBase::prepareFrame() {
+bool ExampleBase::prepareFrame() {
+    waitForFrame();
+    // Nothing to recreate while the window is minimized, skip frames until it's restored
+    if (swapChain.outOfDate && !recreateSwapChain()) {
+        return false;
+    }
+    {
+        VKX_PROFILE_SCOPE("acquire");
+        // Acquire the next image from the swap chaing
+        currentBuffer = swapChain.acquireNextImage(semaphores.acquireComplete);
+    }
+    // Went out of date since the last present, the semaphore was left unsignalled.  The swap chain
+    // is recreated by the next frame.
+    if (currentBuffer == UINT32_MAX) {
+        return false;
+    }
+    buildFrameCommandBuffers();
+    return true;
+}
+
+void ExampleBase::buildFrameCommandBuffers() {
+    VKX_PROFILE_SCOPE("record command buffers");
+    auto tStart = std::chrono::high_resolution_clock::now();
+    uint32_t recorded = 0;
+    gpuProfiler.setSlot(currentFrame);
+
+    const uint32_t primaryCount = framesInFlight * swapChain.imageCount;
+    if (primaryCmdBuffers.size() != primaryCount) {
+        allocateCommandBuffers(primaryCmdBuffers, primaryCount, vk::CommandBufferLevel::ePrimary);
+        primaryCmdBuffersDirty = true;
+    }
     if (primaryCmdBuffersDirty) {
-        buildCommandBuffers();
+        primaryCmdBufferDirty.assign(primaryCount, true);
+        primaryCmdBuffersDirty = false;
+    }
+
+    // Secondaries of this frame.  Re-recording one invalidates the frame's primaries, for every image.
+    bool secondariesRecorded = false;
+    if (!drawCmdBufferDirty.empty() && drawCmdBufferDirty[currentFrame]) {
+        if (allocateDrawCommandBuffers()) {
+            primaryCmdBufferDirty.assign(primaryCount, true);
+        }
+        const uint32_t partCount = drawCmdBufferParts;
+        const uint32_t firstPart = currentFrame * partCount;
+        auto recordParts = [&](uint32_t begin, uint32_t end) {
+            for (uint32_t part = begin; part < end; ++part) {
+                VKX_PROFILE_SCOPE("record draw part");
+                buildSubCommandBuffer(drawCmdBuffers[firstPart + part], [&](const vk::CommandBuffer& cmdBuffer) {
+                    GpuProfiler::Scope scope(gpuProfiler, cmdBuffer, partCount == 1 ? "Draw" : "Draw " + std::to_string(part));
+                    if (partCount == 1) {
+                        updateDrawCommandBuffer(cmdBuffer);
+                    } else {
+                        updateDrawCommandBuffer(cmdBuffer, part, partCount);
+                    }
+                });
+            }
+        };
+        if (partCount > 1) {
+            parallelFor(getRecordThreads(), partCount, recordParts, 1);
+        } else {
+            recordParts(0, 1);
+        }
+        drawCmdBufferDirty[currentFrame] = false;
+        secondariesRecorded = true;
+        recorded += partCount;
+    }
+    if (enableTextOverlay && !textCmdBufferDirty.empty() && textCmdBufferDirty[currentFrame]) {
+        allocateCommandBuffers(textCmdBuffers, framesInFlight, vk::CommandBufferLevel::eSecondary);
+        buildSubCommandBuffer(textCmdBuffers[currentFrame], [&](const vk::CommandBuffer& cmdBuffer) {
+            GpuProfiler::Scope scope(gpuProfiler, cmdBuffer, "Text overlay", glm::vec4(1.0f, 0.94f, 0.3f, 1.0f));
+            textOverlay->writeCommandBuffer(cmdBuffer);
+        });
+        textCmdBufferDirty[currentFrame] = false;
+        secondariesRecorded = true;
+        ++recorded;
+    }
+    if (secondariesRecorded) {
+        for (uint32_t i = 0; i < swapChain.imageCount; ++i) {
+            primaryCmdBufferDirty[currentFrame * swapChain.imageCount + i] = true;
+        }
+    }
+
+    const uint32_t primaryIndex = currentFrame * swapChain.imageCount + currentBuffer;
+    if (primaryCmdBufferDirty[primaryIndex]) {
+        buildCommandBuffer(primaryCmdBuffers[primaryIndex]);
+        primaryCmdBufferDirty[primaryIndex] = false;
+        ++recorded;
+    }
+
+    if (recorded) {
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        recordStats.recorded += recorded;
+        recordStats.cpuTime += std::chrono::duration<float, std::milli>(tEnd - tStart).count();
     }
-    // Acquire the next image from the swap chaing
-    currentBuffer = swapChain.acquireNextImage(semaphores.acquireComplete);
 }
 
 void ExampleBase::submitFrame() {
-    swapChain.queuePresent(semaphores.renderComplete);
+    {
+        VKX_PROFILE_SCOPE("present");
+        swapChain.queuePresent(semaphores.renderComplete);
+    }
+    framePresented();
+    nextFrame();
+}
+
+void ExampleBase::setupFrames() {
+    framesInFlight = std::max(1u, std::min(framesInFlight, MAX_FRAMES_IN_FLIGHT));
+    frames.resize(framesInFlight);
+    for (uint32_t i = 0; i < framesInFlight; ++i) {
+        auto& frame = frames[i];
+        frame.fence = device.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+        vk::CommandPoolCreateInfo cmdPoolInfo;
+        cmdPoolInfo.queueFamilyIndex = graphicsQueueIndex;
+        cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+        frame.commandPool = device.createCommandPool(cmdPoolInfo);
+        if (i == 0) {
+            // The first frame adopts the semaphores created with the device
+            frame.acquireComplete = semaphores.acquireComplete;
+            frame.renderComplete = semaphores.renderComplete;
+        } else {
+            frame.acquireComplete = device.createSemaphore(vk::SemaphoreCreateInfo());
+            frame.renderComplete = device.createSemaphore(vk::SemaphoreCreateInfo());
+        }
+        frame.transferPending = device.createSemaphore(vk::SemaphoreCreateInfo());
+        frame.transferComplete = device.createSemaphore(vk::SemaphoreCreateInfo());
+    }
+    currentFrame = 0;
+    frameReady = false;
+    imageFences.assign(swapChain.imageCount, vk::Fence());
+}
+
+void ExampleBase::nextFrame() {
+    currentFrame = (currentFrame + 1) % framesInFlight;
+    frameReady = false;
+}
+
+void ExampleBase::waitForFrame() {
+    if (frameReady || frames.empty()) {
+        return;
+    }
+    auto& frame = frames[currentFrame];
+    {
+        VKX_PROFILE_SCOPE("wait for frame");
+        // Only blocks if the CPU is framesInFlight frames ahead of the GPU
+        device.waitForFences(frame.fence, VK_TRUE, UINT64_MAX);
+    }
+    if (frame.awaitingComplete) {
+        frame.awaitingComplete = false;
+        addLatencySample(false, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame.submitTime).count());
+    }
+    frameReady = true;
+    gpuProfiler.collect(currentFrame);
+    scratch.reset();
+    device.resetCommandPool(frame.commandPool, vk::CommandPoolResetFlags());
+    semaphores.acquireComplete = frame.acquireComplete;
+    semaphores.renderComplete = frame.renderComplete;
+    recycle();
+}
+
+bool ExampleBase::benchmarkFrame(double frameTime) {
+    if (benchmark.frame == 1) {
+        startupTimes.push_back({ "firstFrame", frameTime });
+    }
+    if (benchmark.frame > benchmark.warmupFrames) {
+        benchmark.cpuFrameTimes.push_back(frameTime);
+    }
+    if (benchmark.frame == benchmark.warmupFrames + benchmark.frames) {
+        return false;
+    }
+    if (benchmark.frame == benchmark.warmupFrames) {
+        benchmark.cameraStart = camera.yawPitch;
+    }
+    if (benchmark.frame >= benchmark.warmupFrames) {
+        benchmarkCamera((float)(benchmark.frame - benchmark.warmupFrames) / (float)benchmark.frames);
+    }
+    ++benchmark.frame;
+    return true;
+}
+
+void ExampleBase::inputSampled() {
+    if (!frames.empty()) {
+        frames[currentFrame].inputTime = std::chrono::steady_clock::now();
+    }
+}
+
+void ExampleBase::frameSubmitted() {
+    auto now = std::chrono::steady_clock::now();
+    auto& frame = frames[currentFrame];
+    if (frame.inputTime != std::chrono::steady_clock::time_point()) {
+        addLatencySample(true, std::chrono::duration<double, std::milli>(now - frame.inputTime).count());
+        frame.inputTime = std::chrono::steady_clock::time_point();
+    }
+    frame.submitTime = now;
+#if defined(__linux__)
+    // Display times are only comparable to steady_clock where both are CLOCK_MONOTONIC
+    latency.displayTiming = swapChain.presentTiming;
+#endif
+    frame.awaitingComplete = !latency.displayTiming;
+    uint32_t id = ++latency.presents;
+    latency.submits[id % LATENCY_HISTORY] = { id, now };
+    swapChain.presentId = id;
+}
+
+void ExampleBase::framePresented() {
+    if (latency.displayTiming) {
+        swapChain.pastPresentTimes([this](uint32_t id, uint64_t nanoseconds) {
+            const auto& submit = latency.submits[id % LATENCY_HISTORY];
+            int64_t submitted = std::chrono::duration_cast<std::chrono::nanoseconds>(submit.second.time_since_epoch()).count();
+            if (submit.first == id && (int64_t)nanoseconds >= submitted) {
+                addLatencySample(false, ((int64_t)nanoseconds - submitted) / 1e6);
+            }
+        });
+        return;
+    }
+    // Frames in flight whose fence has signalled since the last look
+    auto now = std::chrono::steady_clock::now();
+    for (auto& frame : frames) {
+        if (frame.awaitingComplete && vk::Result::eSuccess == device.getFenceStatus(frame.fence)) {
+            frame.awaitingComplete = false;
+            addLatencySample(false, std::chrono::duration<double, std::milli>(now - frame.submitTime).count());
+        }
+    }
+}
+
+void ExampleBase::addLatencySample(bool inputToSubmit, double milliseconds) {
+    const bool measured = benchmark.enabled && benchmark.frame > benchmark.warmupFrames;
+    if (inputToSubmit) {
+        latency.inputToSubmit += milliseconds;
+        ++latency.inputToSubmitCount;
+        if (measured) {
+            latency.inputToSubmitTimes.push_back(milliseconds);
+        }
+    } else {
+        latency.submitToPresent += milliseconds;
+        ++latency.submitToPresentCount;
+        if (measured) {
+            latency.submitToPresentTimes.push_back(milliseconds);
+        }
+    }
+}
+
+void ExampleBase::updateLatencyStats() {
+    latency.lastInputToSubmit = latency.inputToSubmitCount ? (float)(latency.inputToSubmit / latency.inputToSubmitCount) : 0.0f;
+    latency.lastSubmitToPresent = latency.submitToPresentCount ? (float)(latency.submitToPresent / latency.submitToPresentCount) : 0.0f;
+    latency.inputToSubmit = 0;
+    latency.inputToSubmitCount = 0;
+    latency.submitToPresent = 0;
+    latency.submitToPresentCount = 0;
+}
+
+void ExampleBase::checkAllocations(uint64_t allocations) {
+    if (allocationCheck.skipFrame) {
+        allocationCheck.skipFrame = false;
+        return;
+    }
+    if (!vkx::allocations::counting() || ++allocationCheck.frame <= allocationCheck.settleFrames) {
+        return;
+    }
+    if (allocations) {
+        if (allocationCheck.strict) {
+            throw std::runtime_error("Frame " + std::to_string(allocationCheck.frame) + " made " + std::to_string(allocations) + " heap allocations");
+        }
+        allocationCheck.total += allocations;
+        allocationCheck.unreported += allocations;
+        ++allocationCheck.unreportedFrames;
+    }
+    // Summarized about once a second rather than per frame, printing allocates as well
+    auto now = std::chrono::steady_clock::now();
+    if (allocationCheck.unreportedFrames && now - allocationCheck.lastReport > std::chrono::seconds(1)) {
+        std::cerr << "Warning: " << allocationCheck.unreportedFrames << " frames made " << allocationCheck.unreported << " heap allocations" << std::endl;
+        allocationCheck.unreported = 0;
+        allocationCheck.unreportedFrames = 0;
+        allocationCheck.lastReport = now;
+    }
+}
+
+void ExampleBase::writeBenchmarkReport() {
+    std::ofstream out(benchmark.output);
+    if (!out) {
+        std::cerr << "Could not write " << benchmark.output << std::endl;
+        return;
+    }
+    using vkx::benchmark::quote;
+    out << "{\n";
+    out << "  \"example\": " << quote(name) << ",\n";
+    out << "  \"device\": " << quote(deviceProperties.deviceName) << ",\n";
+    out << "  \"width\": " << size.width << ",\n";
+    out << "  \"height\": " << size.height << ",\n";
+    out << "  \"headless\": " << (headless.enabled ? "true" : "false") << ",\n";
+    out << "  \"seed\": " << randomSeed() << ",\n";
+    out << "  \"warmupFrames\": " << benchmark.warmupFrames << ",\n";
+    out << "  \"frames\": " << benchmark.frames << ",\n";
+    out << "  \"timestep\": " << benchmark.timestep << ",\n";
+    out << "  \"startup\": {";
+    for (size_t i = 0; i < startupTimes.size(); ++i) {
+        out << (i ? ", " : " ") << quote(startupTimes[i].first) << ": " << startupTimes[i].second;
+    }
+    out << " },\n";
+    // Textures loaded from .ktxz containers, reading the file and decoding the chunks
+    out << "  \"textureLoading\": ";
+    if (textureLoader) {
+        const auto& stats = textureLoader->stats;
+        out << "{ \"bytesRead\": " << stats.bytesRead << ", \"bytesDecoded\": " << stats.bytesDecoded
+            << ", \"readSeconds\": " << stats.readSeconds << ", \"decodeSeconds\": " << stats.decodeSeconds << " },\n";
+    } else {
+        out << "null,\n";
+    }
+    out << "  \"cpuFrameTime\": ";
+    vkx::benchmark::writeJson(out, vkx::benchmark::summarize(benchmark.cpuFrameTimes));
+    out << ",\n";
+    out << "  \"gpuFrameTime\": ";
+    if (gpuProfiler.isEnabled()) {
+        vkx::benchmark::writeJson(out, vkx::benchmark::summarize(benchmark.gpuFrameTimes));
+    } else {
+        out << "null";
+    }
+    out << ",\n";
+    out << "  \"inputToSubmit\": ";
+    vkx::benchmark::writeJson(out, vkx::benchmark::summarize(latency.inputToSubmitTimes));
+    out << ",\n";
+    // To the display with VK_GOOGLE_display_timing, else to the frame's fence being seen signalled
+    out << "  \"submitToPresent\": ";
+    vkx::benchmark::writeJson(out, vkx::benchmark::summarize(latency.submitToPresentTimes));
+    out << ",\n";
+    out << "  \"presentTimes\": " << (latency.displayTiming ? "\"display\"" : "\"fence\"") << ",\n";
+    // Of whole frames once the loop has settled, only known in builds with ENABLE_ALLOCATION_COUNTER
+    out << "  \"heapAllocations\": ";
+    if (vkx::allocations::counting()) {
+        out << allocationCheck.total;
+    } else {
+        out << "null";
+    }
+    out << "\n}\n";
 }
 
 #if defined(__ANDROID__)
@@ -522,7 +1032,14 @@ void ExampleBase::setupWindow() {
 #endif
 
 void ExampleBase::setupDepthStencil() {
-    depthStencil.destroy();
+    // Frames in flight may still use the old image
+    if (depthStencil.image) {
+        CreateImageResult oldDepthStencil = depthStencil;
+        dumpster.push_back([oldDepthStencil]() mutable {
+            oldDepthStencil.destroy();
+        });
+        depthStencil = CreateImageResult();
+    }
 
     vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
     vk::ImageCreateInfo image;
@@ -534,14 +1051,22 @@ void ExampleBase::setupDepthStencil() {
     image.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc;
     depthStencil = createImage(image, vk::MemoryPropertyFlagBits::eDeviceLocal);
 
-    withPrimaryCommandBuffer([&](const vk::CommandBuffer& setupCmdBuffer) {
+    {
+        vk::CommandBuffer setupCmdBuffer = createCommandBuffer(vk::CommandBufferLevel::ePrimary, true);
         setImageLayout(
             setupCmdBuffer,
             depthStencil.image,
             aspect,
             vk::ImageLayout::eUndefined,
             vk::ImageLayout::eDepthStencilAttachmentOptimal);
-    });
+        setupCmdBuffer.end();
+        // The barrier orders it before every later submission to the queue, so nothing waits for it
+        vk::SubmitInfo submitInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &setupCmdBuffer;
+        queue.submit(submitInfo, vk::Fence());
+        trashCommandBuffer(setupCmdBuffer);
+    }
 
 
     vk::ImageViewCreateInfo depthStencilView;
@@ -555,13 +1080,11 @@ void ExampleBase::setupDepthStencil() {
 }
 
 void ExampleBase::setupFrameBuffer() {
-    // Recreate the frame buffers
-    if (!framebuffers.empty()) {
-        for (uint32_t i = 0; i < framebuffers.size(); i++) {
-            device.destroyFramebuffer(framebuffers[i]);
-        }
-        framebuffers.clear();
-    }
+    // Recreate the frame buffers, the old ones go once the frames in flight are done with them
+    std::function<void(const vk::Framebuffer&)> destructor = [this](const vk::Framebuffer& framebuffer) {
+        device.destroyFramebuffer(framebuffer);
+    };
+    trash(framebuffers, destructor);
 
     vk::ImageView attachments[2];
 
@@ -593,7 +1116,7 @@ void ExampleBase::setupRenderPass() {
     attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
     attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
     attachments[0].initialLayout = vk::ImageLayout::eUndefined;
-    attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+    attachments[0].finalLayout = swapChain.presentLayout;
 
     // Depth attachment
     attachments[1].format = depthFormat;
@@ -649,19 +1172,43 @@ void ExampleBase::windowResize(const glm::uvec2& newSize) {
     if (!prepared) {
         return;
     }
-    prepared = false;
-
-    queue.waitIdle();
-    device.waitIdle();
+    // Polled between frames, the swap chain is recreated by the next prepareFrame()
+    requestedSize = vk::Extent2D{ newSize.x, newSize.y };
+    swapChain.outOfDate = true;
+}
 
-    // Recreate swap chain
-    size.width = newSize.x;
-    size.height = newSize.y;
-    camera.setAspectRatio(size);
-    swapChain.create(size, enableVsync);
+bool ExampleBase::recreateSwapChain() {
+    VKX_PROFILE_SCOPE("recreate swap chain");
+    const vk::Extent2D oldSize = size;
+    vk::Extent2D newSize = size;
+    if (requestedSize.width && requestedSize.height) {
+        newSize = requestedSize;
+    }
 
-    setupDepthStencil();
+    // The old swap chain and its image views are retired through the dumpster
+    if (!swapChain.create(newSize, enableVsync)) {
+        return false;
+    }
+    size = newSize;
+    requestedSize = vk::Extent2D();
+    imageFences.assign(swapChain.imageCount, vk::Fence());
+    const bool resized = size.width != oldSize.width || size.height != oldSize.height;
+
+    // The depth buffer only depends on the size, the frame buffers reference the new image views
+    if (resized) {
+        camera.setAspectRatio(size);
+        setupDepthStencil();
+    }
     setupFrameBuffer();
+
+    // Primary command buffers need to be re-recorded as they
+    // reference the recreated frame buffers
+    primaryCmdBuffersDirty = true;
+
+    if (!resized) {
+        return true;
+    }
+
     if (enableTextOverlay && textOverlay->visible) {
         updateTextOverlay();
     }
@@ -673,13 +1220,14 @@ void ExampleBase::windowResize(const glm::uvec2& newSize) {
     // Can be overriden in derived class
     updateDrawCommandBuffers();
 
-    // Command buffers need to be recreated as they may store
-    // references to the recreated frame buffer
-    buildCommandBuffers();
-
     viewChanged();
+    return true;
+}
 
-    prepared = true;
+void ExampleBase::waitForFramesInFlight() {
+    for (const auto& frame : frames) {
+        device.waitForFences(frame.fence, VK_TRUE, UINT64_MAX);
+    }
 }
 
 void ExampleBase::windowResized() {}
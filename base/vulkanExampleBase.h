@@ -17,10 +17,16 @@
 #include "vulkanFramebuffer.hpp"
 
 #include "vulkanContext.hpp"
+#include "vulkanFencePoller.hpp"
 #include "vulkanSwapChain.hpp"
 #include "vulkanTextureLoader.hpp"
 #include "vulkanMeshLoader.hpp"
 #include "vulkanTextOverlay.hpp"
+#include "taskGraph.hpp"
+#include "vulkanGpuProfiler.hpp"
+#include "benchmark.hpp"
+#include "allocationCounter.hpp"
+#include "framePacer.hpp"
 
 #define GAMEPAD_BUTTON_A 0x1000
 #define GAMEPAD_BUTTON_B 0x1001
@@ -57,7 +63,7 @@ namespace vkx {
 
     public:
         void run();
-        // Called if the window is resized and some resources have to be recreatesd
+        // Called if the window is resized, the swap chain is recreated before the next frame
         void windowResize(const glm::uvec2& newSize);
 
     private:
@@ -72,11 +78,32 @@ namespace vkx {
 
     protected:
         bool enableVsync{ false };
-        // Command buffers used for rendering
+        // Command buffers used for rendering.  The secondaries exist once per frame in flight, the
+        // primaries once per frame in flight and swap chain image.  All of them are recorded in place,
+        // lazily, right before the frame that uses them is submitted.
         std::vector<vk::CommandBuffer> primaryCmdBuffers;
         std::vector<vk::CommandBuffer> textCmdBuffers;
         std::vector<vk::CommandBuffer> drawCmdBuffers;
+        // Set to re-record all primaries, e.g. after toggling what they execute
         bool primaryCmdBuffersDirty{ true };
+        // The draw commands of a frame can be split into several secondaries that are recorded in parallel,
+        // see updateDrawCommandBuffer(cmdBuffer, part, partCount).  Work stealing doesn't pin a part to a
+        // thread, so every part has a command pool of its own rather than using the recording thread's.
+        uint32_t drawCmdBufferParts{ 1 };
+        std::vector<vk::CommandPool> drawCmdPools;
+        // Worker threads recording the parts, created on first use
+        std::unique_ptr<WorkStealingPool> recordThreads;
+        // Dirty flags matching the command buffers above
+        std::vector<bool> primaryCmdBufferDirty;
+        std::vector<bool> textCmdBufferDirty;
+        std::vector<bool> drawCmdBufferDirty;
+        // Command buffer recording, counted over the last second for the overlay
+        struct RecordStats {
+            uint32_t recorded{ 0 };
+            float cpuTime{ 0.0f };
+        };
+        RecordStats recordStats;
+        RecordStats lastRecordStats;
         std::vector<vk::ClearValue> clearValues;
         vk::RenderPassBeginInfo renderPassBeginInfo;
 
@@ -92,59 +119,46 @@ namespace vkx {
             renderPassBeginInfo.pClearValues = clearValues.data();
         }
 
-        virtual void buildCommandBuffers() final {
-            if (drawCmdBuffers.empty()) {
-                throw std::runtime_error("Draw command buffers have not been populated.");
+        // Records the primary command buffer of the current frame and image
+        void buildCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
+            vk::CommandBufferBeginInfo cmdBufInfo;
+            cmdBuffer.reset(vk::CommandBufferResetFlags());
+            cmdBuffer.begin(cmdBufInfo);
+
+            gpuProfiler.beginFrame(cmdBuffer);
+
+            // Let child classes execute operations outside the renderpass, like buffer barriers or query pool operations
+            updatePrimaryCommandBuffer(cmdBuffer);
+
+            renderPassBeginInfo.framebuffer = framebuffers[currentBuffer];
+            cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+            if (!drawCmdBuffers.empty()) {
+                const vk::CommandBuffer* parts = drawCmdBuffers.data() + currentFrame * drawCmdBufferParts;
+                cmdBuffer.executeCommands(vk::ArrayProxy<const vk::CommandBuffer>(drawCmdBufferParts, parts));
             }
-            trashCommandBuffers(primaryCmdBuffers);
-
-            // FIXME find a better way to ensure that the draw and text buffers are no longer in use before 
-            // executing them within this command buffer.
-            queue.waitIdle();
-
-            // Destroy command buffers if already present
-            if (primaryCmdBuffers.empty()) {
-                // Create one command buffer per image in the swap chain
-
-                // Command buffers store a reference to the
-                // frame buffer inside their render pass info
-                // so for static usage without having to rebuild
-                // them each frame, we use one per frame buffer
-                vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
-                cmdBufAllocateInfo.commandPool = cmdPool;
-                cmdBufAllocateInfo.commandBufferCount = swapChain.imageCount;
-                primaryCmdBuffers = device.allocateCommandBuffers(cmdBufAllocateInfo);
+            if (enableTextOverlay && !textCmdBuffers.empty() && textOverlay && textOverlay->visible) {
+                cmdBuffer.executeCommands(textCmdBuffers[currentFrame]);
             }
+            cmdBuffer.endRenderPass();
+            // And after it, like copying query results
+            updatePrimaryCommandBufferPostRenderPass(cmdBuffer);
 
-            vk::CommandBufferBeginInfo cmdBufInfo;
-            for (size_t i = 0; i < swapChain.imageCount; ++i) {
-                const auto& cmdBuffer = primaryCmdBuffers[i];
-                cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
-                cmdBuffer.begin(cmdBufInfo);
-
-                // Let child classes execute operations outside the renderpass, like buffer barriers or query pool operations
-                updatePrimaryCommandBuffer(cmdBuffer);
-
-                renderPassBeginInfo.framebuffer = framebuffers[i];
-                cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
-                if (!drawCmdBuffers.empty()) {
-                    cmdBuffer.executeCommands(drawCmdBuffers[i]);
-                }
-                if (enableTextOverlay && !textCmdBuffers.empty() && textOverlay && textOverlay->visible) {
-                    cmdBuffer.executeCommands(textCmdBuffers[i]);
-                }
-                cmdBuffer.endRenderPass();
-                cmdBuffer.end();
-            }
-            primaryCmdBuffersDirty = false;
+            gpuProfiler.endFrame(cmdBuffer);
+            cmdBuffer.end();
         }
+
+        // Re-records whatever the current frame and image need before they are submitted.  The frame's
+        // previous submission has finished by now, so its command buffers can be reset in place.
+        void buildFrameCommandBuffers();
+
     protected:
         // Last frame time, measured using a high performance timer (if available)
         float frameTimer{ 1.0f };
         // Frame counter to display fps
         uint32_t frameCounter{ 0 };
         uint32_t lastFPS{ 0 };
-        std::list<UpdateOperation> pendingUpdates;
+        // Kept across frames so its storage is reused
+        std::vector<UpdateOperation> pendingUpdates;
 
         // Color buffer format
         vk::Format colorformat{ vk::Format::eB8G8R8A8Unorm };
@@ -163,6 +177,39 @@ namespace vkx {
         std::vector<vk::Framebuffer> framebuffers;
         // Active frame buffer index
         uint32_t currentBuffer = 0;
+
+        // Frames the CPU may record ahead of the GPU, independent of the number of swap chain images.
+        // Set it in the constructor, it is read in prepare().
+        static const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+        uint32_t framesInFlight{ 2 };
+        // Index of the frame being recorded, 0 .. framesInFlight - 1.  Dynamic data (uniform buffer
+        // copies, particle buffers, ...) has one copy per frame and only the current one is written;
+        // by the time a frame slot comes around again the GPU has finished with it.
+        uint32_t currentFrame = 0;
+
+        struct Frame {
+            // Signalled once the frame's work has finished, created signalled
+            vk::Fence fence;
+            // Transient command buffers of the frame, reset when the slot is reused
+            vk::CommandPool commandPool;
+            vk::Semaphore acquireComplete;
+            vk::Semaphore renderComplete;
+            // Order the frame's pending updates after its rendering, and the next frame after the updates
+            vk::Semaphore transferPending;
+            vk::Semaphore transferComplete;
+            // CPU timestamps for the latency measurements
+            std::chrono::steady_clock::time_point inputTime;
+            std::chrono::steady_clock::time_point submitTime;
+            // Set until the fence has been seen signalled, when it stands in for the present time
+            bool awaitingComplete{ false };
+        };
+        std::vector<Frame> frames;
+        // Set once the current frame's previous use has finished, see waitForFrame()
+        bool frameReady{ false };
+        // Fence of the frame that last rendered to each swap chain image
+        std::vector<vk::Fence> imageFences;
+        // Window size reported since the swap chain was last created, zero if none
+        vk::Extent2D requestedSize;
         // Descriptor set pool
         vk::DescriptorPool descriptorPool;
 
@@ -181,6 +228,10 @@ namespace vkx {
         // Simple texture loader
         TextureLoader *textureLoader{ nullptr };
 
+        // Runs callbacks once their fence is signalled, polled every frame.  Used to resume
+        // asynchronous loaders waiting on the GPU without blocking the render loop.
+        FencePoller fencePoller;
+
         // Returns the base asset path (for shaders, models, textures) depending on the os
         const std::string& getAssetPath();
 
@@ -234,9 +285,102 @@ namespace vkx {
         // true if application has focused, false if moved to background
         bool focused = false;
 #else 
-        GLFWwindow* window;
+        GLFWwindow* window{ nullptr };
 #endif
 
+        // Render without a window into a headless swap chain, selected with -headless.
+        // -frames <n> exits after n frames, -screenshot <file> saves the last one as a PPM.
+        struct {
+            bool enabled{ false };
+            // Frames to render before exiting, 0 renders until the process is stopped
+            uint32_t frames{ 0 };
+            std::string screenshot;
+        } headless;
+
+        // Chrome trace of the CPU profiler scopes written on exit, set with -trace <file>.  Needs a
+        // build with ENABLE_CPU_PROFILER.
+        std::string traceFile;
+
+        // Reproducible measurement, selected with -benchmark.  After -benchmark-warmup <n> frames,
+        // -benchmark-frames <n> frames are measured with a fixed timestep while the camera follows
+        // benchmarkCamera().  The report is written to -benchmark-output <file> as JSON on exit.
+        struct {
+            bool enabled{ false };
+            uint32_t warmupFrames{ 60 };
+            uint32_t frames{ 600 };
+            // Replaces the measured frame time passed to update()
+            float timestep{ 1.0f / 60.0f };
+            std::string output{ "benchmark.json" };
+            // Frames started so far
+            uint32_t frame{ 0 };
+            glm::vec2 cameraStart;
+            // Milliseconds of every measured frame
+            std::vector<double> cpuFrameTimes;
+            std::vector<double> gpuFrameTimes;
+        } benchmark;
+        // Heap allocations of each render loop iteration once the loop has settled, counted in builds
+        // with ENABLE_ALLOCATION_COUNTER.  Allocating frames are reported as warnings, or throw with
+        // -strict-allocations.  Frames that rebuild the once a second stats and overlay are left out.
+        struct {
+            bool strict{ false };
+            bool skipFrame{ false };
+            uint32_t settleFrames{ 100 };
+            uint32_t frame{ 0 };
+            uint64_t total{ 0 };
+            uint64_t unreported{ 0 };
+            uint32_t unreportedFrames{ 0 };
+            std::chrono::steady_clock::time_point lastReport;
+        } allocationCheck;
+        // Holds the render loop to the frame rate set with -fps <n>
+        FramePacer framePacer;
+        // Time from sampling input to submitting the frame, and from submitting it to the image reaching
+        // the display.  The display time is reported by VK_GOOGLE_display_timing where available.
+        // Otherwise the frame's fence being seen signalled stands in for it, which leaves out the wait
+        // for the vertical blank.
+        static const uint32_t LATENCY_HISTORY = 16;
+        struct {
+            // Present ids and submit times of recent frames, to match up with reported display times
+            std::array<std::pair<uint32_t, std::chrono::steady_clock::time_point>, LATENCY_HISTORY> submits;
+            uint32_t presents{ 0 };
+            bool displayTiming{ false };
+            // Accumulated over the current second
+            double inputToSubmit{ 0 };
+            uint32_t inputToSubmitCount{ 0 };
+            double submitToPresent{ 0 };
+            uint32_t submitToPresentCount{ 0 };
+            // Averages of the last second, in milliseconds
+            float lastInputToSubmit{ 0 };
+            float lastSubmitToPresent{ 0 };
+            // Milliseconds of every measured frame in benchmark mode
+            std::vector<double> inputToSubmitTimes;
+            std::vector<double> submitToPresentTimes;
+        } latency;
+        // Milliseconds spent in each startup phase, in order
+        std::vector<std::pair<std::string, double>> startupTimes;
+        // Times debug marker scopes on the GPU.  F2 shows the averages in the overlay, F3 prints them.
+        GpuProfiler gpuProfiler{ *this };
+
+        // Scripted camera of the benchmark, t goes from 0 to 1 over the measured frames.  The default
+        // orbits once around the view the example started with.
+        virtual void benchmarkCamera(float t) {
+            camera.yawPitch = benchmark.cameraStart + glm::vec2(t * 2.0f * (float)M_PI, 0.0f);
+            camera.rotate(glm::vec2(0.0f));
+            viewChanged();
+        }
+
+        // Called at the start of every frame in benchmark mode with the duration of the previous one.
+        // Returns false once all frames have been measured.
+        bool benchmarkFrame(double frameTime);
+        void checkAllocations(uint64_t allocations);
+        // Latency bookkeeping, called when input has been sampled, after submitting and after presenting
+        void inputSampled();
+        void frameSubmitted();
+        void framePresented();
+        void addLatencySample(bool inputToSubmit, double milliseconds);
+        // Moves the latency averages of the last second to lastInputToSubmit / lastSubmitToPresent
+        void updateLatencyStats();
+        void writeBenchmarkReport();
+
         // Setup the vulkan instance, enable required extensions and connect to the physical device (GPU)
         void initVulkan(bool enableValidation);
 
@@ -250,7 +394,9 @@ namespace vkx {
         // A default draw implementation
         virtual void draw() {
             // Get next image in the swap chain (back/front buffer)
-            prepareFrame();
+            if (!prepareFrame()) {
+                return;
+            }
             // Execute the compiled command buffer for the current swap chain image
             drawCurrentCommandBuffer();
             // Push the rendered frame to the surface
@@ -277,12 +423,16 @@ namespace vkx {
             }
             fpsTimer += (float)frameTimer;
             if (fpsTimer > 1.0f) {
-                if (!enableTextOverlay) {
+                if (!enableTextOverlay && window) {
                     std::string windowTitle = getWindowTitle();
                     glfwSetWindowTitle(window, windowTitle.c_str());
                 }
                 lastFPS = frameCounter;
+                updateRecordStats();
+                updateLatencyStats();
+                gpuProfiler.update();
                 updateTextOverlay();
+                allocationCheck.skipFrame = true;
                 fpsTimer = 0.0f;
                 frameCounter = 0;
             }
@@ -319,8 +469,18 @@ namespace vkx {
 
         // Called when the window has been resized
         // Can be overriden in derived class to recreate or rebuild resources attached to the frame buffer / swapchain
+        // Earlier frames may still be in flight, so replaced resources have to go through the dumpster,
+        // or the override has to call waitForFramesInFlight() before destroying them
         virtual void windowResized();
 
+        // Recreates the swap chain from the old one, and whatever depends on its images or size.
+        // Called before acquiring when the swap chain is out of date, nothing waits for the device.
+        // Returns false and leaves everything as it was while the surface has no area.
+        bool recreateSwapChain();
+
+        // Blocks until every submitted frame has finished
+        void waitForFramesInFlight();
+
         // Setup default depth and stencil views
         void setupDepthStencil();
         // Create framebuffers for all requested swap chain images
@@ -332,42 +492,50 @@ namespace vkx {
         virtual void setupRenderPass();
 
 
-        void populateSubCommandBuffers(std::vector<vk::CommandBuffer>& cmdBuffers, std::function<void(const vk::CommandBuffer& commandBuffer)> f) {
-            if (!cmdBuffers.empty()) {
-                trashCommandBuffers(cmdBuffers);
+        void allocateCommandBuffers(std::vector<vk::CommandBuffer>& cmdBuffers, uint32_t count, vk::CommandBufferLevel level) {
+            if (cmdBuffers.size() == count) {
+                return;
             }
-
+            trashCommandBuffers(cmdBuffers);
             vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
             cmdBufAllocateInfo.commandPool = getCommandPool();
-            cmdBufAllocateInfo.commandBufferCount = swapChain.imageCount;
-            cmdBufAllocateInfo.level = vk::CommandBufferLevel::eSecondary;
+            cmdBufAllocateInfo.commandBufferCount = count;
+            cmdBufAllocateInfo.level = level;
             cmdBuffers = device.allocateCommandBuffers(cmdBufAllocateInfo);
+        }
+
+        // Creates a pool and a secondary for every part of every frame, returns true if they changed
+        bool allocateDrawCommandBuffers();
 
+        WorkStealingPool& getRecordThreads() {
+            if (!recordThreads) {
+                recordThreads.reset(new WorkStealingPool());
+            }
+            return *recordThreads;
+        }
+
+        // Resets and records one of the current frame's secondaries
+        void buildSubCommandBuffer(const vk::CommandBuffer& cmdBuffer, std::function<void(const vk::CommandBuffer& commandBuffer)> f) {
+            // Executed for every swap chain image, so the framebuffer is left unspecified
             vk::CommandBufferInheritanceInfo inheritance;
             inheritance.renderPass = renderPass;
             inheritance.subpass = 0;
             vk::CommandBufferBeginInfo beginInfo;
             beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse;
             beginInfo.pInheritanceInfo = &inheritance;
-            for (size_t i = 0; i < swapChain.imageCount; ++i) {
-                currentBuffer = i;
-                inheritance.framebuffer = framebuffers[i];
-                vk::CommandBuffer& cmdBuffer = cmdBuffers[i];
-                cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
-                cmdBuffer.begin(beginInfo);
-                f(cmdBuffer);
-                cmdBuffer.end();
-            }
-            currentBuffer = 0;
+            cmdBuffer.reset(vk::CommandBufferResetFlags());
+            cmdBuffer.begin(beginInfo);
+            f(cmdBuffer);
+            cmdBuffer.end();
         }
 
         virtual void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) {}
 
+        virtual void updatePrimaryCommandBufferPostRenderPass(const vk::CommandBuffer& cmdBuffer) {}
+
+        // Marks the draw command buffers of every frame in flight for re-recording
         virtual void updateDrawCommandBuffers() final {
-            populateSubCommandBuffers(drawCmdBuffers, [&](const vk::CommandBuffer& cmdBuffer) {
-                updateDrawCommandBuffer(cmdBuffer);
-            });
-            primaryCmdBuffersDirty = true;
+            drawCmdBufferDirty.assign(framesInFlight, true);
         }
 
         // Pure virtual function to be overriden by the dervice class
@@ -375,70 +543,81 @@ namespace vkx {
         // all command buffers that may reference this
         virtual void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommand) = 0;
 
-        void drawCurrentCommandBuffer(const vk::Semaphore& semaphore = vk::Semaphore()) {
-            vk::Fence fence = swapChain.getSubmitFence();
-            {
-                uint32_t fenceIndex = currentBuffer;
-                dumpster.push_back([fenceIndex, this] {
-                    swapChain.clearSubmitFence(fenceIndex);
-                });
+        // Records part of the draw commands when drawCmdBufferParts is more than one.  The parts are
+        // recorded concurrently on the record threads and executed in order, so an override must only
+        // read shared state and set all the state its draws need.
+        virtual void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommand, uint32_t part, uint32_t partCount) {
+            if (part == 0) {
+                updateDrawCommandBuffer(drawCommand);
             }
+        }
 
-            // Command buffer(s) to be sumitted to the queue
-            std::vector<vk::Semaphore> waitSemaphores{ { semaphore == vk::Semaphore() ? semaphores.acquireComplete : semaphore } };
-            std::vector<vk::PipelineStageFlags> waitStages{ submitPipelineStages };
+        void drawCurrentCommandBuffer(const vk::Semaphore& semaphore = vk::Semaphore()) {
+            VKX_PROFILE_SCOPE("submit");
+            vk::Fence fence = frames[currentFrame].fence;
+            // The image may still be in use by an older frame if there are more images than frames in flight
+            vk::Fence& imageFence = imageFences[currentBuffer];
+            if (imageFence && imageFence != fence) {
+                device.waitForFences(imageFence, VK_TRUE, UINT64_MAX);
+            }
+            imageFence = fence;
+            device.resetFences(fence);
+
+            // Semaphores of the submission, in scratch memory since this runs every frame
+            auto waitSemaphores = scratch.array<vk::Semaphore>(2);
+            auto waitStages = scratch.array<vk::PipelineStageFlags>(2);
+            waitSemaphores.push_back(semaphore == vk::Semaphore() ? semaphores.acquireComplete : semaphore);
+            waitStages.push_back(submitPipelineStages);
             if (semaphores.transferComplete) {
-                auto transferComplete = semaphores.transferComplete;
-                semaphores.transferComplete = vk::Semaphore();
-                waitSemaphores.push_back(transferComplete);
+                // Signalled by the previous frame's updates
+                waitSemaphores.push_back(semaphores.transferComplete);
                 waitStages.push_back(vk::PipelineStageFlagBits::eTransfer);
-                dumpster.push_back([transferComplete, this] {
-                    device.destroySemaphore(transferComplete);
-                });
+                semaphores.transferComplete = vk::Semaphore();
             }
 
-            emptyDumpster(fence);
+            gpuProfiler.submitted(currentFrame);
+            emptyDumpster(fence, false);
 
             vk::Semaphore transferPending;
-            std::vector<vk::Semaphore> signalSemaphores{ { semaphores.renderComplete } };
+            auto signalSemaphores = scratch.array<vk::Semaphore>(2);
+            signalSemaphores.push_back(semaphores.renderComplete);
             if (!pendingUpdates.empty()) {
-                transferPending = device.createSemaphore(vk::SemaphoreCreateInfo());
+                transferPending = frames[currentFrame].transferPending;
                 signalSemaphores.push_back(transferPending);
             }
 
             {
                 vk::SubmitInfo submitInfo;
-                submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+                submitInfo.waitSemaphoreCount = waitSemaphores.size();
                 submitInfo.pWaitSemaphores = waitSemaphores.data();
                 submitInfo.pWaitDstStageMask = waitStages.data();
                 submitInfo.signalSemaphoreCount = signalSemaphores.size();
                 submitInfo.pSignalSemaphores = signalSemaphores.data();
                 submitInfo.commandBufferCount = 1;
-                submitInfo.pCommandBuffers = &primaryCmdBuffers[currentBuffer];
-                // Submit to queue
-                queue.submit(submitInfo, fence);
+                submitInfo.pCommandBuffers = &primaryCmdBuffers[currentFrame * swapChain.imageCount + currentBuffer];
+                // Submit to queue.  With pending transfers the frame fence goes on the transfer submission,
+                // which covers this one as well.
+                queue.submit(submitInfo, pendingUpdates.empty() ? fence : vk::Fence());
             }
+            frameSubmitted();
 
-            executePendingTransfers(transferPending);
-            recycle();
+            executePendingTransfers(transferPending, fence);
         }
 
-        void executePendingTransfers(vk::Semaphore transferPending) {
+        void executePendingTransfers(vk::Semaphore transferPending, vk::Fence fence) {
             if (!pendingUpdates.empty()) {
-                vk::Fence transferFence = device.createFence(vk::FenceCreateInfo());
-                semaphores.transferComplete = device.createSemaphore(vk::SemaphoreCreateInfo());
+                // Both semaphores belong to the frame.  The next frame's submission has waited on
+                // transferComplete by the time this slot signals it again.
+                semaphores.transferComplete = frames[currentFrame].transferComplete;
                 assert(transferPending);
-                assert(semaphores.transferComplete);
-                // Command buffers store a reference to the
-                // frame buffer inside their render pass info
-                // so for static usage without having to rebuild
-                // them each frame, we use one per frame buffer
+                // Allocated from the frame's pool, which is reset once the frame fence has been waited on
                 vk::CommandBuffer transferCmdBuffer;
                 {
                     vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
-                    cmdBufAllocateInfo.commandPool = cmdPool;
+                    cmdBufAllocateInfo.commandPool = frames[currentFrame].commandPool;
                     cmdBufAllocateInfo.commandBufferCount = 1;
-                    transferCmdBuffer = device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
+                    // The vector returning overload would allocate every frame
+                    device.allocateCommandBuffers(&cmdBufAllocateInfo, &transferCmdBuffer);
                 }
 
 
@@ -462,13 +641,9 @@ namespace vkx {
                     transferSubmitInfo.waitSemaphoreCount = 1;
                     transferSubmitInfo.commandBufferCount = 1;
                     transferSubmitInfo.pCommandBuffers = &transferCmdBuffer;
-                    queue.submit(transferSubmitInfo, transferFence);
+                    queue.submit(transferSubmitInfo, fence);
                 }
 
-                recycler.push({ transferFence, [transferPending, transferCmdBuffer, this] {
-                    device.destroySemaphore(transferPending);
-                    device.freeCommandBuffers(cmdPool, transferCmdBuffer);
-                } });
                 pendingUpdates.clear();
             }
         }
@@ -492,22 +667,35 @@ namespace vkx {
             vk::PipelineStageFlags *pipelineStages);
 
         void updateTextOverlay();
+        // Moves the recording counters of the last second to lastRecordStats
+        void updateRecordStats();
 
         // Called when the text overlay is updating
         // Can be overriden in derived class to add custom text to the overlay
         virtual void getOverlayText(vkx::TextOverlay * textOverlay);
 
         // Prepare the frame for workload submission
+        // - Waits for the frame's previous use to finish, unless the render loop already has
         // - Acquires the next image from the swap chain 
         // - Submits a post present barrier
         // - Sets the default wait and signal semaphores
-        void prepareFrame();
+        // Returns false if no image could be acquired, e.g. while the window is minimized.  The frame
+        // is skipped then and nothing may be submitted, the next one tries again.
+        bool prepareFrame();
 
         // Submit the frames' workload 
-        // - Submits the text overlay (if enabled)
-        // - 
+        // - Presents the current image
+        // - Moves on to the next frame in flight
         void submitFrame();
 
+        // Creates the per frame fences, command pools and semaphores
+        void setupFrames();
+        // Advances currentFrame
+        void nextFrame();
+        // Waits for the current frame's previous use to finish and recycles its resources.  The render
+        // loop calls it before sampling input, so the input isn't stale by the time it is rendered.
+        void waitForFrame();
+
         virtual const glm::mat4& getProjection() const {
             return camera.matrices.perspective;
         }
@@ -534,6 +722,15 @@ namespace vkx {
                 }
                 break;
 
+            case GLFW_KEY_F2:
+                gpuProfiler.visible = !gpuProfiler.visible;
+                updateTextOverlay();
+                break;
+
+            case GLFW_KEY_F3:
+                gpuProfiler.dump(std::cout);
+                break;
+
             case GLFW_KEY_ESCAPE:
                 glfwSetWindowShouldClose(window, 1);
                 break;
@@ -0,0 +1,85 @@
+/*
+* Fence poller
+*
+* Runs callbacks on the rendering thread once their fence has been signalled.  The example
+* base polls once per frame, so work waiting on the GPU never blocks the frame loop.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <vulkan/vk_cpp.hpp>
+
+namespace vkx {
+    class FencePoller {
+    public:
+        using Callback = std::function<void()>;
+
+        // Call callback from poll() once fence is signalled.  The poller does not take ownership of the fence.
+        // Can be called from any thread.
+        void add(const vk::Fence& fence, Callback callback) {
+            std::unique_lock<std::mutex> lock(mutex);
+            pending.push_back({ fence, std::move(callback) });
+        }
+
+        // Call callback from the next poll(), regardless of any fence
+        void post(Callback callback) {
+            add(vk::Fence(), std::move(callback));
+        }
+
+        // Run the callbacks of all signalled fences.  Must be called from the thread that owns the queue,
+        // callbacks may add new entries, which are checked on the next poll.
+        void poll(const vk::Device& device) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (pending.empty()) {
+                    return;
+                }
+                polling.swap(pending);
+            }
+
+            for (auto& entry : polling) {
+                if (!entry.fence || vk::Result::eSuccess == device.getFenceStatus(entry.fence)) {
+                    ready.push_back(std::move(entry.callback));
+                } else {
+                    waiting.push_back(std::move(entry));
+                }
+            }
+            polling.clear();
+
+            if (!waiting.empty()) {
+                std::unique_lock<std::mutex> lock(mutex);
+                pending.insert(pending.end(), std::make_move_iterator(waiting.begin()), std::make_move_iterator(waiting.end()));
+                waiting.clear();
+            }
+
+            for (auto& callback : ready) {
+                callback();
+            }
+            ready.clear();
+        }
+
+        bool empty() const {
+            std::unique_lock<std::mutex> lock(mutex);
+            return pending.empty();
+        }
+
+    private:
+        struct Entry {
+            vk::Fence fence;
+            Callback callback;
+        };
+
+        mutable std::mutex mutex;
+        std::vector<Entry> pending;
+        // Scratch lists reused between polls
+        std::vector<Entry> polling;
+        std::vector<Entry> waiting;
+        std::vector<Callback> ready;
+    };
+}
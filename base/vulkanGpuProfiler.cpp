@@ -0,0 +1,5 @@
+#include "vulkanGpuProfiler.hpp"
+
+using namespace vkx;
+
+thread_local std::vector<uint32_t> GpuProfiler::openScopes;
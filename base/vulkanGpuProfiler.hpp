@@ -0,0 +1,244 @@
+/*
+* GPU timestamp profiler
+*
+* A profiled scope is a debug marker region that also writes a timestamp where it begins and
+* ends.  The timestamps go into the query pool of the frame slot being recorded (QueryManager,
+* one pool per frame in flight) and are read back with collect() once the frame's fence has been
+* waited on, a few frames later, so the GPU is never waited for.
+* Timings are averaged between calls to update(), about once a second like the fps counter.
+*
+* A scope is identified by its name and the scope it is nested in, and keeps its queries once they
+* are assigned, since command buffers are reused across frames.  That means:
+*   a scope may only be recorded once per frame, give repeated or parallel scopes distinct names
+*   scopes belong in command buffers recorded for a single frame slot, see setSlot()
+* Scopes with no enclosing scope on the recording thread are nested in the frame scope, which is
+* written by beginFrame() / endFrame() around the frame's primary command buffer.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <map>
+#include <mutex>
+
+#include "vulkanContext.hpp"
+#include "vulkanDebug.h"
+#include "vulkanQueryManager.hpp"
+
+namespace vkx {
+    class GpuProfiler {
+    public:
+        struct Timing {
+            std::string name;
+            // Nesting level, 0 for the frame
+            uint32_t depth{ 0 };
+            double milliseconds{ 0 };
+        };
+
+        // Opens a debug marker region that is timed as well, closed when going out of scope
+        class Scope {
+        public:
+            Scope(GpuProfiler& profiler, const vk::CommandBuffer& cmdBuffer, const std::string& name, const glm::vec4& color = glm::vec4(0.8f)) : profiler(profiler), cmdBuffer(cmdBuffer) {
+                profiler.begin(cmdBuffer, name, color);
+            }
+            ~Scope() {
+                profiler.end(cmdBuffer);
+            }
+        private:
+            GpuProfiler& profiler;
+            const vk::CommandBuffer& cmdBuffer;
+        };
+
+        // Shown in the text overlay when set
+        bool visible{ false };
+        // Called with the frame scope's time of every collected frame, e.g. for benchmarks
+        std::function<void(double milliseconds)> onFrame;
+
+        GpuProfiler(Context& context) : context(context), queries(context) {}
+
+        // Stays disabled, only emitting the debug markers, if the queue family can't write timestamps
+        bool create(uint32_t queueFamilyIndex, uint32_t slotCount, uint32_t maxScopes = 64) {
+            const uint32_t validBits = context.physicalDevice.getQueueFamilyProperties()[queueFamilyIndex].timestampValidBits;
+            if (0 == validBits) {
+                return false;
+            }
+            timestampMask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+            this->maxScopes = maxScopes;
+            queries.create(vk::QueryType::eTimestamp, maxScopes * 2, slotCount);
+            queries.onResults([this](const QueryResults& results) {
+                collect(results);
+            });
+            submittedSlots.assign(slotCount, false);
+            scopes.clear();
+            scopeIds.clear();
+            // The frame scope, id 0
+            scopes.push_back({ "Frame", UINT32_MAX });
+            enabled = true;
+            return true;
+        }
+
+        void destroy() {
+            queries.destroy();
+            enabled = false;
+        }
+
+        bool isEnabled() const {
+            return enabled;
+        }
+
+        // Frame slot the following scopes are recorded for
+        void setSlot(uint32_t slot) {
+            this->slot = slot;
+        }
+
+        // Start of the frame's primary command buffer, outside of a render pass
+        void beginFrame(const vk::CommandBuffer& cmdBuffer) {
+            if (enabled) {
+                queries.reset(cmdBuffer, slot);
+                queries.timestamp(cmdBuffer, slot, 0, vk::PipelineStageFlagBits::eTopOfPipe);
+            }
+        }
+
+        // End of the frame's primary command buffer, outside of a render pass
+        void endFrame(const vk::CommandBuffer& cmdBuffer) {
+            if (enabled) {
+                queries.timestamp(cmdBuffer, slot, 1);
+                queries.copyResults(cmdBuffer, slot);
+            }
+        }
+
+        // Call when the slot's primary command buffer is submitted
+        void submitted(uint32_t slot) {
+            if (enabled) {
+                submittedSlots[slot] = true;
+            }
+        }
+
+        // Call once the slot's last submission has finished, e.g. after waiting on its frame fence
+        void collect(uint32_t slot) {
+            if (enabled && submittedSlots[slot]) {
+                submittedSlots[slot] = false;
+                queries.collect(slot);
+            }
+        }
+
+        void begin(const vk::CommandBuffer& cmdBuffer, const std::string& name, const glm::vec4& color = glm::vec4(0.8f)) {
+            if (debug::marker::active) {
+                debug::marker::beginRegion(cmdBuffer, name, color);
+            }
+            uint32_t id = UINT32_MAX;
+            if (enabled) {
+                id = getScope(openScopes.empty() ? 0 : openScopes.back(), name);
+                if (id != UINT32_MAX) {
+                    queries.timestamp(cmdBuffer, slot, id * 2, vk::PipelineStageFlagBits::eTopOfPipe);
+                }
+            }
+            openScopes.push_back(id);
+        }
+
+        void end(const vk::CommandBuffer& cmdBuffer) {
+            assert(!openScopes.empty());
+            uint32_t id = openScopes.back();
+            openScopes.pop_back();
+            if (id != UINT32_MAX) {
+                queries.timestamp(cmdBuffer, slot, id * 2 + 1);
+            }
+            if (debug::marker::active) {
+                debug::marker::endRegion(cmdBuffer);
+            }
+        }
+
+        // Averages what was collected since the last call
+        void update() {
+            std::unique_lock<std::mutex> lock(mutex);
+            timings.clear();
+            std::function<void(uint32_t, uint32_t)> visit = [&](uint32_t id, uint32_t depth) {
+                auto& scope = scopes[id];
+                if (scope.count) {
+                    timings.push_back({ scope.name, depth, scope.total / scope.count });
+                }
+                scope.total = 0;
+                scope.count = 0;
+                for (uint32_t child : scope.children) {
+                    visit(child, depth + 1);
+                }
+            };
+            if (!scopes.empty()) {
+                visit(0, 0);
+            }
+        }
+
+        // Averaged timings in hierarchy order, each scope followed by the ones nested in it
+        const std::vector<Timing>& getTimings() const {
+            return timings;
+        }
+
+        void dump(std::ostream& out) const {
+            out << "GPU timings (ms)" << std::endl;
+            for (const auto& timing : timings) {
+                out << std::string(2 + timing.depth * 2, ' ') << timing.name << ": "
+                    << std::fixed << std::setprecision(3) << timing.milliseconds << std::endl;
+            }
+        }
+
+    private:
+        struct ScopeInfo {
+            std::string name;
+            uint32_t parent;
+            std::vector<uint32_t> children;
+            double total{ 0 };
+            uint32_t count{ 0 };
+        };
+
+        Context& context;
+        QueryManager queries;
+        bool enabled{ false };
+        uint32_t slot{ 0 };
+        uint32_t maxScopes{ 0 };
+        uint64_t timestampMask{ UINT64_MAX };
+        std::vector<bool> submittedSlots;
+        // Parts may be recorded in parallel, which registers scopes concurrently
+        std::mutex mutex;
+        std::vector<ScopeInfo> scopes;
+        std::map<std::pair<uint32_t, std::string>, uint32_t> scopeIds;
+        std::vector<Timing> timings;
+        // Scopes open on the recording thread
+        static thread_local std::vector<uint32_t> openScopes;
+
+        // Returns UINT32_MAX once all queries are in use
+        uint32_t getScope(uint32_t parent, const std::string& name) {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto key = std::make_pair(parent, name);
+            auto itr = scopeIds.find(key);
+            if (itr != scopeIds.end()) {
+                return itr->second;
+            }
+            if (scopes.size() == maxScopes) {
+                return UINT32_MAX;
+            }
+            uint32_t id = (uint32_t)scopes.size();
+            scopes.push_back({ name, parent });
+            scopes[parent].children.push_back(id);
+            scopeIds[key] = id;
+            return id;
+        }
+
+        void collect(const QueryResults& results) {
+            std::unique_lock<std::mutex> lock(mutex);
+            for (uint32_t id = 0; id < scopes.size(); ++id) {
+                // Scopes that were not recorded for this frame stay unavailable
+                if (!results.available(id * 2) || !results.available(id * 2 + 1)) {
+                    continue;
+                }
+                uint64_t ticks = (results.value(id * 2 + 1) - results.value(id * 2)) & timestampMask;
+                double milliseconds = queries.toMilliseconds(ticks);
+                scopes[id].total += milliseconds;
+                ++scopes[id].count;
+                if (id == 0 && onFrame) {
+                    onFrame(milliseconds);
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1,224 @@
+/*
+* GPU frustum culling for instanced indirect draws
+*
+* A compute pass tests every instance's bounding sphere against one or two view frustums,
+* copies the survivors into a compacted instance buffer and counts them into the
+* instanceCount of an indirect draw buffer.  Each draw owns the instance range
+* [firstInstance, firstInstance + instanceCount) of the source buffer and keeps the same
+* range in the compacted buffer, so the vertex shader doesn't change.
+*
+* The instance layout and animation must match shaders/indirect/indirect.vert:
+* vec3 pos, vec3 rot, float scale, rotated around rot by time * 100 / scale degrees.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <vector>
+
+#include "vulkanContext.hpp"
+#include "frustum.hpp"
+
+namespace vkx {
+
+    class InstanceCuller {
+    public:
+        static const uint32_t MAX_DRAWS{ 16 };
+        static const uint32_t MAX_VIEWS{ 2 };
+        static const uint32_t WORKGROUP_SIZE{ 64 };
+        // pos, rot, scale
+        static const uint32_t INSTANCE_SIZE{ sizeof(float) * 7 };
+
+        // std140 layout of the UBO in cull.comp
+        struct Ubo {
+            std::array<glm::vec4, MAX_VIEWS * 6> planes;
+            // firstInstance, instanceCount, radius as float bits, unused
+            std::array<glm::uvec4, MAX_DRAWS> draws;
+            float time{ 0.0f };
+            uint32_t viewCount{ 1 };
+            uint32_t drawCount{ 0 };
+            uint32_t instanceCount{ 0 };
+        } ubo;
+
+        InstanceCuller(const vkx::Context& context) : context(context) {}
+
+        ~InstanceCuller() {
+            destroy();
+        }
+
+        // Instances are read from a storage buffer, so the source needs eStorageBuffer usage.
+        // radii holds the bounding sphere radius of each draw's mesh at scale 1.
+        void prepare(const CreateBufferResult& instances, const std::vector<vk::DrawIndirectCommand>& draws, const std::vector<float>& radii) {
+            if (draws.size() > MAX_DRAWS || draws.size() != radii.size()) {
+                throw std::runtime_error("Invalid draw list for instance culling");
+            }
+
+            ubo.drawCount = (uint32_t)draws.size();
+            ubo.instanceCount = (uint32_t)(instances.size / INSTANCE_SIZE);
+            for (uint32_t i = 0; i < ubo.drawCount; ++i) {
+                ubo.draws[i] = glm::uvec4(draws[i].firstInstance, draws[i].instanceCount, glm::floatBitsToUint(radii[i]), 0);
+                submitted += draws[i].instanceCount;
+            }
+
+            // The compute pass only ever increments the instance counts
+            resetDraws = draws;
+            for (auto& draw : resetDraws) {
+                draw.instanceCount = 0;
+            }
+
+            auto indirectSize = sizeof(vk::DrawIndirectCommand) * draws.size();
+            culledInstances = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, instances.size);
+            indirect = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc, draws);
+            readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, indirectSize);
+            readback.map();
+            readback.copy(draws);
+            uniformData = context.createUniformBuffer(ubo, 1);
+
+            std::vector<vk::DescriptorPoolSize> poolSizes = {
+                vkx::descriptorPoolSize(vk::DescriptorType::eUniformBuffer, 1),
+                vkx::descriptorPoolSize(vk::DescriptorType::eStorageBuffer, 3),
+            };
+            descriptorPool = context.device.createDescriptorPool(vkx::descriptorPoolCreateInfo((uint32_t)poolSizes.size(), poolSizes.data(), 1));
+
+            std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+                // Binding 0 : Frustum planes and draw ranges
+                vkx::descriptorSetLayoutBinding(vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eCompute, 0),
+                // Binding 1 : Source instances
+                vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 1),
+                // Binding 2 : Compacted instances
+                vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 2),
+                // Binding 3 : Indirect draw commands
+                vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 3),
+            };
+            descriptorSetLayout = context.device.createDescriptorSetLayout(vkx::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), (uint32_t)setLayoutBindings.size()));
+            pipelineLayout = context.device.createPipelineLayout(vkx::pipelineLayoutCreateInfo(&descriptorSetLayout, 1));
+            descriptorSet = context.device.allocateDescriptorSets(vkx::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1))[0];
+
+            vk::DescriptorBufferInfo sourceDescriptor = instances.descriptor;
+            std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
+                vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eUniformBuffer, 0, &uniformData.descriptor),
+                vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eStorageBuffer, 1, &sourceDescriptor),
+                vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eStorageBuffer, 2, &culledInstances.descriptor),
+                vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eStorageBuffer, 3, &indirect.descriptor),
+            };
+            context.device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+            vk::ComputePipelineCreateInfo computePipelineCreateInfo = vkx::computePipelineCreateInfo(pipelineLayout);
+            vkx::shader::initGlsl();
+            computePipelineCreateInfo.stage = context.loadGlslShader(getAssetPath() + "shaders/indirect/cull.comp", vk::ShaderStageFlagBits::eCompute);
+            vkx::shader::finalizeGlsl();
+            pipeline = context.device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo, nullptr)[0];
+        }
+
+        void update(float time, const glm::mat4& viewProjection) {
+            update(time, { viewProjection }, 1);
+        }
+
+        void update(float time, const std::array<glm::mat4, MAX_VIEWS>& viewProjections, uint32_t viewCount) {
+            ubo.time = time;
+            ubo.viewCount = viewCount;
+            for (uint32_t view = 0; view < viewCount; ++view) {
+                vkTools::Frustum frustum;
+                frustum.update(viewProjections[view]);
+                std::copy(frustum.planes.begin(), frustum.planes.end(), ubo.planes.begin() + view * 6);
+            }
+            uniformData.copy(ubo);
+        }
+
+        // Must be recorded outside of a render pass, before the draws that consume the results
+        void record(const vk::CommandBuffer& cmdBuffer) const {
+            vk::BufferMemoryBarrier indirectBarrier;
+            indirectBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            indirectBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            indirectBarrier.buffer = indirect.buffer;
+            indirectBarrier.size = VK_WHOLE_SIZE;
+            vk::BufferMemoryBarrier instanceBarrier = indirectBarrier;
+            instanceBarrier.buffer = culledInstances.buffer;
+
+            // Previous frame's draws and statistics copy are done with the indirect buffer
+            indirectBarrier.srcAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eTransferRead;
+            indirectBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, indirectBarrier, nullptr);
+            cmdBuffer.updateBuffer(indirect.buffer, 0, sizeof(vk::DrawIndirectCommand) * resetDraws.size(), resetDraws.data());
+
+            // Counts are reset and the vertex shader is done with the previous compacted instances
+            indirectBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            indirectBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+            instanceBarrier.srcAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+            instanceBarrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
+            std::vector<vk::BufferMemoryBarrier> barriers{ indirectBarrier, instanceBarrier };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), nullptr, barriers, nullptr);
+
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+            cmdBuffer.dispatch((ubo.instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+            indirectBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            indirectBarrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eTransferRead;
+            instanceBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            instanceBarrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
+            barriers = { indirectBarrier, instanceBarrier };
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, barriers, nullptr);
+
+            // Statistics only, read back without waiting on the frame
+            cmdBuffer.copyBuffer(indirect.buffer, readback.buffer, vk::BufferCopy(0, 0, readback.size));
+        }
+
+        // Instances in the draw ranges, before culling
+        uint32_t submittedInstances() const {
+            return submitted;
+        }
+
+        // Instances that survived culling in a recently completed frame
+        uint32_t drawnInstances() const {
+            auto draws = (const vk::DrawIndirectCommand*)readback.mapped;
+            return std::accumulate(draws, draws + ubo.drawCount, 0u, [](uint32_t sum, const vk::DrawIndirectCommand& draw) {
+                return sum + draw.instanceCount;
+            });
+        }
+
+        void destroy() {
+            if (pipeline) {
+                context.device.destroyPipeline(pipeline);
+                pipeline = vk::Pipeline();
+            }
+            if (pipelineLayout) {
+                context.device.destroyPipelineLayout(pipelineLayout);
+                pipelineLayout = vk::PipelineLayout();
+            }
+            if (descriptorSetLayout) {
+                context.device.destroyDescriptorSetLayout(descriptorSetLayout);
+                descriptorSetLayout = vk::DescriptorSetLayout();
+            }
+            if (descriptorPool) {
+                context.device.destroyDescriptorPool(descriptorPool);
+                descriptorPool = vk::DescriptorPool();
+            }
+            culledInstances.destroy();
+            indirect.destroy();
+            readback.destroy();
+            uniformData.destroy();
+        }
+
+        // Bind in place of the source instance buffer
+        CreateBufferResult culledInstances;
+        // Draw with this in place of the source indirect buffer
+        CreateBufferResult indirect;
+
+    private:
+        const vkx::Context& context;
+        std::vector<vk::DrawIndirectCommand> resetDraws;
+        CreateBufferResult readback;
+        UniformData uniformData;
+        uint32_t submitted{ 0 };
+        vk::DescriptorPool descriptorPool;
+        vk::DescriptorSetLayout descriptorSetLayout;
+        vk::DescriptorSet descriptorSet;
+        vk::PipelineLayout pipelineLayout;
+        vk::Pipeline pipeline;
+    };
+}
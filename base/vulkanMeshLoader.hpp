@@ -15,6 +15,8 @@
 #include <stdio.h>
 #include <vector>
 #include <map>
+
+#include "cpuProfiler.hpp"
 #ifdef _WIN32
 #include <windows.h>
 #include <fcntl.h>
@@ -37,6 +39,7 @@
 #endif
 
 #include "vulkanTools.h"
+#include "bvh.hpp"
 
 namespace vkx {
     typedef enum VertexLayout {
@@ -223,6 +226,7 @@ namespace vkx {
 
         // Load the mesh with custom flags
         bool load(const std::string& filename, int flags) {
+            VKX_PROFILE_SCOPE("load mesh");
 #if defined(__ANDROID__)
             // Meshes are stored inside the apk on Android (compressed)
             // So they need to be loaded via the asset manager
@@ -249,6 +253,22 @@ namespace vkx {
             return parse(pScene, filename);
         }
 
+        // Loads the mesh from file contents that have already been read, the extension of filename selects the importer
+        bool loadFromMemory(const void* data, size_t size, const std::string& filename) {
+            int flags = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
+
+            return loadFromMemory(data, size, filename, flags);
+        }
+
+        bool loadFromMemory(const void* data, size_t size, const std::string& filename, int flags) {
+            std::string extension = filename.substr(filename.find_last_of('.') + 1);
+            pScene = Importer.ReadFileFromMemory(data, size, flags, extension.c_str());
+            if (!pScene) {
+                throw std::runtime_error("Unable to parse " + filename);
+            }
+            return parse(pScene, filename);
+        }
+
     private:
         bool parse(const aiScene* pScene, const std::string& Filename) {
             m_Entries.resize(pScene->mNumMeshes);
@@ -320,11 +340,62 @@ namespace vkx {
         }
 
     public:
+        // Bounds of each mesh entry, in the space of the vertex positions (y flipped) after applying scale
+        std::vector<Aabb> entryBounds(float scale = 1.0f) const {
+            std::vector<Aabb> result(m_Entries.size());
+            for (size_t m = 0; m < m_Entries.size(); m++) {
+                for (const auto& vertex : m_Entries[m].Vertices) {
+                    result[m].expand(vertex.m_pos * scale);
+                }
+            }
+            return result;
+        }
+
+        Aabb bounds(float scale = 1.0f) const {
+            Aabb result;
+            for (const auto& entry : entryBounds(scale)) {
+                result.expand(entry);
+            }
+            return result;
+        }
+
         // Create vertex and index buffer with given layout
         // Note : Only does staging if a valid command buffer and transfer queue are passed
         MeshBuffer createBuffers(const Context& context, const std::vector<VertexLayout>& layout, float scale) {
-
             std::vector<float> vertexBuffer;
+            std::vector<uint32_t> indexBuffer;
+            fillBuffers(layout, scale, vertexBuffer, indexBuffer);
+
+            MeshBuffer meshBuffer;
+            meshBuffer.vertices.size = vertexBuffer.size() * sizeof(float);
+
+            dim.min *= scale;
+            dim.max *= scale;
+            dim.size *= scale;
+
+            meshBuffer.indexCount = (uint32_t)indexBuffer.size();
+            // Use staging buffer to move vertex and index buffer to device local memory
+            // Vertex buffer
+            meshBuffer.vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
+            // Index buffer
+            meshBuffer.indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexBuffer);
+            meshBuffer.dim = dim.size;
+            return meshBuffer;
+        }
+
+        // Interleaves the vertices in the given layout and concatenates the indices of all entries,
+        // the CPU side of createBuffers()
+        void fillBuffers(const std::vector<VertexLayout>& layout, float scale, std::vector<float>& vertexBuffer, std::vector<uint32_t>& indexBuffer) const {
+            size_t vertexCount = 0, indexCount = 0;
+            for (const auto& entry : m_Entries) {
+                vertexCount += entry.Vertices.size();
+                indexCount += entry.Indices.size();
+            }
+            vertexBuffer.clear();
+            vertexBuffer.reserve(vertexCount * vertexSize(layout) / sizeof(float));
+            indexBuffer.clear();
+            indexBuffer.reserve(indexCount);
+
             for (int m = 0; m < m_Entries.size(); m++) {
                 for (int i = 0; i < m_Entries[m].Vertices.size(); i++) {
                     // Push vertex data depending on layout
@@ -377,29 +448,12 @@ namespace vkx {
                     }
                 }
             }
-            MeshBuffer meshBuffer;
-            meshBuffer.vertices.size = vertexBuffer.size() * sizeof(float);
-
-            dim.min *= scale;
-            dim.max *= scale;
-            dim.size *= scale;
-
-            std::vector<uint32_t> indexBuffer;
             for (uint32_t m = 0; m < m_Entries.size(); m++) {
                 uint32_t indexBase = (uint32_t)indexBuffer.size();
                 for (uint32_t i = 0; i < m_Entries[m].Indices.size(); i++) {
                     indexBuffer.push_back(m_Entries[m].Indices[i] + indexBase);
                 }
             }
-
-            meshBuffer.indexCount = (uint32_t)indexBuffer.size();
-            // Use staging buffer to move vertex and index buffer to device local memory
-            // Vertex buffer
-            meshBuffer.vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
-            // Index buffer
-            meshBuffer.indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexBuffer);
-            meshBuffer.dim = dim.size;
-            return meshBuffer;
         }
     };
 }
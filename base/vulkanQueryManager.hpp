@@ -0,0 +1,199 @@
+/*
+* Non-blocking query readback
+*
+* Owns one query pool per frame slot (one per frame in flight, ExampleBase::currentFrame, since
+* every frame has its own command buffers).  The command buffers copy the results of a slot, with availability, into
+* a persistently mapped host buffer using vkCmdCopyQueryPoolResults.  The host reads them once
+* the submission that wrote them has finished, found through the recycler fence of that frame,
+* so the CPU never waits on the GPU.  Results therefore arrive a few frames late.
+*
+* Recording, per slot:
+*   reset() outside of a render pass, before the first query
+*   begin() / end() or timestamp() for each query
+*   copyResults() outside of a render pass, after the last query
+* and before submitting the slot's command buffer, submitted() so the results get collected.
+* Owners that already wait for the slot's submission, like a frame fence, can call collect()
+* themselves instead, which avoids queueing anything per submission.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "vulkanContext.hpp"
+
+namespace vkx {
+    // Results of one slot.  Each query has valuesPerQuery values (one, or one per enabled pipeline
+    // statistic) followed by its availability.
+    struct QueryResults {
+        uint32_t slot{ 0 };
+        uint32_t queryCount{ 0 };
+        uint32_t valuesPerQuery{ 1 };
+        const uint64_t* data{ nullptr };
+
+        bool available(uint32_t query) const {
+            return 0 != data[query * (valuesPerQuery + 1) + valuesPerQuery];
+        }
+
+        uint64_t value(uint32_t query, uint32_t index = 0) const {
+            return data[query * (valuesPerQuery + 1) + index];
+        }
+    };
+
+    class QueryManager {
+    public:
+        using Callback = std::function<void(const QueryResults& results)>;
+
+        QueryManager(Context& context) : context(context) {}
+
+        void create(vk::QueryType type, uint32_t queryCount, uint32_t slotCount, vk::QueryPipelineStatisticFlags statistics = vk::QueryPipelineStatisticFlags()) {
+            this->queryCount = queryCount;
+            valuesPerQuery = 1;
+            if (type == vk::QueryType::ePipelineStatistics) {
+                valuesPerQuery = 0;
+                for (uint32_t bits = (VkQueryPipelineStatisticFlags)statistics; bits; bits &= bits - 1) {
+                    ++valuesPerQuery;
+                }
+            }
+
+            vk::QueryPoolCreateInfo queryPoolInfo;
+            queryPoolInfo.queryType = type;
+            queryPoolInfo.queryCount = queryCount;
+            queryPoolInfo.pipelineStatistics = statistics;
+            queryPools.resize(slotCount);
+            for (auto& queryPool : queryPools) {
+                queryPool = context.device.createQueryPool(queryPoolInfo);
+            }
+
+            // Zeroed, so slots that were never submitted read as unavailable
+            std::vector<uint64_t> initial(slotCount * slotValues(), 0);
+            results = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, initial);
+            results.map();
+
+            reader = std::make_shared<Reader>();
+            reader->data = (const uint64_t*)results.mapped;
+            reader->queryCount = queryCount;
+            reader->valuesPerQuery = valuesPerQuery;
+            reader->callback = callback;
+            reader->submissions.assign(slotCount, 0);
+        }
+
+        void destroy() {
+            for (auto& queryPool : queryPools) {
+                context.device.destroyQueryPool(queryPool);
+            }
+            queryPools.clear();
+            results.destroy();
+            // Collections still waiting in the recycler become no-ops
+            reader.reset();
+        }
+
+        // Called with the results of every submitted slot
+        void onResults(Callback callback) {
+            this->callback = callback;
+            if (reader) {
+                reader->callback = callback;
+            }
+        }
+
+        // Timestamp ticks to milliseconds
+        double toMilliseconds(uint64_t ticks) const {
+            return (double)ticks * context.deviceProperties.limits.timestampPeriod / 1e6;
+        }
+
+        void reset(const vk::CommandBuffer& cmdBuffer, uint32_t slot) const {
+            cmdBuffer.resetQueryPool(queryPools[slot], 0, queryCount);
+        }
+
+        void begin(const vk::CommandBuffer& cmdBuffer, uint32_t slot, uint32_t query, vk::QueryControlFlags flags = vk::QueryControlFlags()) const {
+            cmdBuffer.beginQuery(queryPools[slot], query, flags);
+        }
+
+        void end(const vk::CommandBuffer& cmdBuffer, uint32_t slot, uint32_t query) const {
+            cmdBuffer.endQuery(queryPools[slot], query);
+        }
+
+        void timestamp(const vk::CommandBuffer& cmdBuffer, uint32_t slot, uint32_t query, vk::PipelineStageFlagBits stage = vk::PipelineStageFlagBits::eBottomOfPipe) const {
+            cmdBuffer.writeTimestamp(stage, queryPools[slot], query);
+        }
+
+        // Copies the slot's results into the host buffer without waiting for them
+        void copyResults(const vk::CommandBuffer& cmdBuffer, uint32_t slot) const {
+            const vk::DeviceSize stride = (valuesPerQuery + 1) * sizeof(uint64_t);
+            const vk::DeviceSize offset = slot * slotValues() * sizeof(uint64_t);
+            cmdBuffer.copyQueryPoolResults(queryPools[slot], 0, queryCount, results.buffer, offset, stride, vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+
+            vk::BufferMemoryBarrier barrier;
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.buffer = results.buffer;
+            barrier.offset = offset;
+            barrier.size = slotValues() * sizeof(uint64_t);
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), nullptr, barrier, nullptr);
+        }
+
+        // Call before the slot's command buffer is submitted.  The results are handed to the callback
+        // from the recycler once that submission has finished.
+        void submitted(uint32_t slot) {
+            uint64_t submission = ++reader->submissions[slot];
+            std::weak_ptr<Reader> weakReader = reader;
+            context.dumpster.push_back([weakReader, slot, submission] {
+                auto reader = weakReader.lock();
+                // The recycler may only get to this fence after the slot was submitted again,
+                // in which case the GPU could be rewriting the results
+                if (reader && reader->submissions[slot] == submission) {
+                    reader->collect(slot);
+                }
+            });
+        }
+
+        // Hands the slot's results to the callback right away.  Only call once the submission that
+        // wrote them has finished.
+        void collect(uint32_t slot) const {
+            if (reader) {
+                reader->collect(slot);
+            }
+        }
+
+    private:
+        // Shared with the pending collections, which may outlive the manager in the recycler
+        struct Reader {
+            const uint64_t* data{ nullptr };
+            uint32_t queryCount{ 0 };
+            uint32_t valuesPerQuery{ 1 };
+            Callback callback;
+            // Submissions of each slot so far
+            std::vector<uint64_t> submissions;
+
+            void collect(uint32_t slot) const {
+                if (!callback) {
+                    return;
+                }
+                QueryResults slotResults;
+                slotResults.slot = slot;
+                slotResults.queryCount = queryCount;
+                slotResults.valuesPerQuery = valuesPerQuery;
+                slotResults.data = data + slot * queryCount * (valuesPerQuery + 1);
+                callback(slotResults);
+            }
+        };
+
+        Context& context;
+        std::vector<vk::QueryPool> queryPools;
+        uint32_t queryCount{ 0 };
+        uint32_t valuesPerQuery{ 1 };
+        CreateBufferResult results;
+        Callback callback;
+        std::shared_ptr<Reader> reader;
+
+        uint32_t slotValues() const {
+            return queryCount * (valuesPerQuery + 1);
+        }
+    };
+}
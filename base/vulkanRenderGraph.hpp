@@ -0,0 +1,736 @@
+/*
+* Render graph for offscreen passes
+*
+* Passes declare the named images they render to and the ones they read.  The graph creates the
+* images, render passes and frame buffers, and records the passes with the barriers and layout
+* transitions between them, typically into the frame's primary command buffer from
+* ExampleBase::updatePrimaryCommandBuffer().
+*
+*   addImage() / addPass()    declare the graph, passes in an order that writes images before reading them
+*   setOutput()               marks images used after the graph, e.g. sampled by the main render pass
+*   compile()                 creates the images, render passes and frame buffers, and schedules the passes
+*   execute()                 records the passes
+*
+* Scheduling
+*   Passes that contribute nothing to an enabled output are culled.  Clearing an attachment
+*   makes the earlier writers of that image unnecessary.
+*   The remaining passes are grouped into levels, each pass going one level after the last pass
+*   it depends on.  A level's passes are recorded back to back after a single batch of barriers,
+*   so passes that don't depend on each other are free to overlap on the GPU.
+*   Barriers are only emitted for hazards: reads after writes, writes after reads or writes, and
+*   layout changes.  A read needs none if an earlier barrier already made the write visible to it.
+*   Every image ends the frame in a fixed layout, that of its output or else of its last use, so
+*   that any schedule can follow any other when outputs are toggled.  The first barrier on an
+*   image in a frame waits for every stage the image is used in, covering the previous frame.
+*
+* Attachments are kept in the layout they are used in, the render passes don't transition them.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkanContext.hpp"
+#include "vulkanDebug.h"
+#include "vulkanGpuProfiler.hpp"
+
+namespace vkx {
+    class RenderGraph {
+    public:
+        // How a pass uses an image
+        enum class Use {
+            ColorAttachment,
+            DepthAttachment,
+            SampledFragment,
+            SampledCompute,
+            StorageRead,
+            StorageWrite,
+            TransferSrc,
+            TransferDst,
+        };
+
+        using RecordFunction = std::function<void(const vk::CommandBuffer& cmdBuffer)>;
+
+        class Pass {
+        public:
+            // Render targets, cleared unless clear is false, in which case their contents are loaded
+            Pass& color(const std::string& name, bool clear = true) {
+                return use(name, Use::ColorAttachment, clear);
+            }
+
+            Pass& depth(const std::string& name, bool clear = true) {
+                return use(name, Use::DepthAttachment, clear);
+            }
+
+            Pass& read(const std::string& name, Use use = Use::SampledFragment) {
+                return this->use(name, use, false);
+            }
+
+            Pass& write(const std::string& name, Use use = Use::StorageWrite) {
+                return this->use(name, use, false);
+            }
+
+            Pass& clearColor(const glm::vec4& color) {
+                clearColorValue = color;
+                return *this;
+            }
+
+            const std::string& getName() const {
+                return name;
+            }
+
+            // Null for passes without attachments.  Pipelines drawn in the pass are created with it.
+            const vk::RenderPass& getRenderPass() const {
+                return renderPass;
+            }
+
+            const vk::Extent2D& getExtent() const {
+                return extent;
+            }
+
+            bool isCulled() const {
+                return culled;
+            }
+
+        private:
+            friend class RenderGraph;
+
+            struct Access {
+                uint32_t resource;
+                Use use;
+                bool clear;
+            };
+
+            Pass(RenderGraph& graph, const std::string& name, const RecordFunction& record) : graph(graph), name(name), record(record) {}
+
+            Pass& use(const std::string& name, Use use, bool clear) {
+                accesses.push_back({ graph.getResourceIndex(name), use, clear });
+                return *this;
+            }
+
+            RenderGraph& graph;
+            std::string name;
+            RecordFunction record;
+            std::vector<Access> accesses;
+            glm::vec4 clearColorValue{ 0.0f, 0.0f, 0.0f, 1.0f };
+            std::vector<vk::ClearValue> clearValues;
+            vk::RenderPass renderPass;
+            vk::Framebuffer framebuffer;
+            vk::Extent2D extent;
+            bool culled{ false };
+            uint32_t level{ 0 };
+        };
+
+        struct Stats {
+            uint32_t passes{ 0 };
+            uint32_t culled{ 0 };
+            uint32_t levels{ 0 };
+            uint32_t barriers{ 0 };
+        };
+
+        // Passes are timed as GPU profiler scopes when set, otherwise they are debug marker regions
+        GpuProfiler* profiler{ nullptr };
+
+        RenderGraph(vkx::Context& context) : context(context) {}
+
+        ~RenderGraph() {
+            destroy();
+        }
+
+        void addImage(const std::string& name, vk::Format format, const vk::Extent2D& extent) {
+            assert(resourceIndices.find(name) == resourceIndices.end());
+            resourceIndices[name] = (uint32_t)resources.size();
+            resources.push_back(Resource());
+            auto& resource = resources.back();
+            resource.name = name;
+            resource.format = format;
+            resource.extent = extent;
+        }
+
+        Pass& addPass(const std::string& name, const RecordFunction& record) {
+            passes.emplace_back(new Pass(*this, name, record));
+            return *passes.back();
+        }
+
+        // An image used after the graph, only passes contributing to enabled outputs are recorded.
+        // Scheduled again by the next execute(), so command buffers recorded before have to be as well.
+        void setOutput(const std::string& name, bool enabled = true, Use use = Use::SampledFragment) {
+            auto& resource = resources[getResourceIndex(name)];
+            resource.output = true;
+            resource.outputEnabled = enabled;
+            resource.outputUse = use;
+            dirty = true;
+        }
+
+        // Creates the images, render passes and frame buffers, and schedules the passes.  Call once, after
+        // declaring the graph.  Culled passes are backed as well, so toggling outputs never allocates.
+        void compile() {
+            for (auto& resource : resources) {
+                resource.usage = vk::ImageUsageFlags();
+                resource.stages = vk::PipelineStageFlags();
+                resource.writeAccess = vk::AccessFlags();
+                resource.restLayout = vk::ImageLayout::eUndefined;
+                resource.stored = resource.output;
+                if (resource.output) {
+                    addUse(resource, getUseInfo(resource.outputUse));
+                }
+            }
+            for (const auto& pass : passes) {
+                for (const auto& access : pass->accesses) {
+                    auto& resource = resources[access.resource];
+                    const auto info = getUseInfo(access.use);
+                    addUse(resource, info);
+                    if (!resource.output) {
+                        resource.restLayout = info.layout;
+                    }
+                    if (!isAttachment(access.use) || !access.clear) {
+                        resource.stored = true;
+                    }
+                }
+            }
+
+            std::vector<uint32_t> created;
+            for (uint32_t i = 0; i < resources.size(); ++i) {
+                if (!resources[i].image.image) {
+                    createImage(resources[i]);
+                    created.push_back(i);
+                }
+            }
+            for (auto& pass : passes) {
+                if (!pass->renderPass) {
+                    createRenderPass(*pass);
+                }
+            }
+
+            schedule();
+            initializeImages(created);
+        }
+
+        void execute(const vk::CommandBuffer& cmdBuffer) {
+            if (dirty) {
+                schedule();
+            }
+            for (const auto& batch : batches) {
+                if (!batch.barriers.empty()) {
+                    cmdBuffer.pipelineBarrier(batch.srcStages, batch.dstStages, vk::DependencyFlags(), nullptr, nullptr, batch.barriers);
+                }
+                for (Pass* pass : batch.passes) {
+                    if (profiler) {
+                        GpuProfiler::Scope scope(*profiler, cmdBuffer, pass->name, passColor);
+                        recordPass(cmdBuffer, *pass);
+                    } else {
+                        debug::marker::Marker marker(cmdBuffer, pass->name, passColor);
+                        recordPass(cmdBuffer, *pass);
+                    }
+                }
+            }
+        }
+
+        // Images exist once compile() has run
+        const CreateImageResult& getImage(const std::string& name) const {
+            return resources[getResourceIndex(name)].image;
+        }
+
+        Pass& getPass(const std::string& name) {
+            for (auto& pass : passes) {
+                if (pass->name == name) {
+                    return *pass;
+                }
+            }
+            throw std::runtime_error("No render graph pass named " + name);
+        }
+
+        // Of the last schedule
+        const Stats& getStats() const {
+            return stats;
+        }
+
+        void destroy() {
+            for (auto& pass : passes) {
+                if (pass->framebuffer) {
+                    context.device.destroyFramebuffer(pass->framebuffer);
+                    pass->framebuffer = vk::Framebuffer();
+                }
+                if (pass->renderPass) {
+                    context.device.destroyRenderPass(pass->renderPass);
+                    pass->renderPass = vk::RenderPass();
+                }
+            }
+            for (auto& resource : resources) {
+                resource.image.destroy();
+            }
+            batches.clear();
+        }
+
+    private:
+        // Synchronization state of an image
+        struct State {
+            vk::ImageLayout layout{ vk::ImageLayout::eUndefined };
+            // Stages and access of the last write or layout transition
+            vk::PipelineStageFlags writeStages;
+            vk::AccessFlags writeAccess;
+            // Stages and access the last write has been made visible to
+            vk::PipelineStageFlags visibleStages;
+            vk::AccessFlags visibleAccess;
+            // Stages that read since the last write
+            vk::PipelineStageFlags readStages;
+        };
+
+        struct Resource {
+            std::string name;
+            vk::Format format{ vk::Format::eUndefined };
+            vk::Extent2D extent;
+            vk::ImageUsageFlags usage;
+            CreateImageResult image;
+            // Read after being written, by a pass or as an output, so attachments have to store it
+            bool stored{ false };
+            bool output{ false };
+            bool outputEnabled{ false };
+            Use outputUse{ Use::SampledFragment };
+            // Of all uses, waited for by the first barrier of a frame
+            vk::PipelineStageFlags stages;
+            vk::AccessFlags writeAccess;
+            // Layout between frames
+            vk::ImageLayout restLayout{ vk::ImageLayout::eUndefined };
+        };
+
+        struct UseInfo {
+            vk::ImageLayout layout;
+            vk::PipelineStageFlags stages;
+            vk::AccessFlags access;
+            vk::ImageUsageFlags usage;
+            bool write;
+        };
+
+        // Barriers recorded before a level's passes.  The last batch only has the output barriers.
+        struct Batch {
+            vk::PipelineStageFlags srcStages;
+            vk::PipelineStageFlags dstStages;
+            std::vector<vk::ImageMemoryBarrier> barriers;
+            std::vector<Pass*> passes;
+        };
+
+        const glm::vec4 passColor{ 0.4f, 0.7f, 1.0f, 1.0f };
+        vkx::Context& context;
+        std::vector<Resource> resources;
+        std::unordered_map<std::string, uint32_t> resourceIndices;
+        std::vector<std::unique_ptr<Pass>> passes;
+        std::vector<Batch> batches;
+        Stats stats;
+        bool dirty{ true };
+
+        uint32_t getResourceIndex(const std::string& name) const {
+            auto itr = resourceIndices.find(name);
+            if (itr == resourceIndices.end()) {
+                throw std::runtime_error("No render graph image named " + name);
+            }
+            return itr->second;
+        }
+
+        static void addUse(Resource& resource, const UseInfo& info) {
+            resource.usage |= info.usage;
+            resource.stages |= info.stages;
+            if (info.write) {
+                resource.writeAccess |= info.access & getWriteAccessMask();
+            }
+            if (resource.restLayout == vk::ImageLayout::eUndefined) {
+                resource.restLayout = info.layout;
+            }
+        }
+
+        static vk::AccessFlags getWriteAccessMask() {
+            return vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+                vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite;
+        }
+
+        static bool isAttachment(Use use) {
+            return use == Use::ColorAttachment || use == Use::DepthAttachment;
+        }
+
+        static UseInfo getUseInfo(Use use) {
+            using Stage = vk::PipelineStageFlagBits;
+            using Access = vk::AccessFlagBits;
+            using Usage = vk::ImageUsageFlagBits;
+            switch (use) {
+            case Use::ColorAttachment:
+                return { vk::ImageLayout::eColorAttachmentOptimal, Stage::eColorAttachmentOutput, Access::eColorAttachmentRead | Access::eColorAttachmentWrite, Usage::eColorAttachment, true };
+            case Use::DepthAttachment:
+                return { vk::ImageLayout::eDepthStencilAttachmentOptimal, Stage::eEarlyFragmentTests | Stage::eLateFragmentTests, Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite, Usage::eDepthStencilAttachment, true };
+            case Use::SampledFragment:
+                return { vk::ImageLayout::eShaderReadOnlyOptimal, Stage::eFragmentShader, Access::eShaderRead, Usage::eSampled, false };
+            case Use::SampledCompute:
+                return { vk::ImageLayout::eShaderReadOnlyOptimal, Stage::eComputeShader, Access::eShaderRead, Usage::eSampled, false };
+            case Use::StorageRead:
+                return { vk::ImageLayout::eGeneral, Stage::eComputeShader, Access::eShaderRead, Usage::eStorage, false };
+            case Use::StorageWrite:
+                return { vk::ImageLayout::eGeneral, Stage::eComputeShader, Access::eShaderRead | Access::eShaderWrite, Usage::eStorage, true };
+            case Use::TransferSrc:
+                return { vk::ImageLayout::eTransferSrcOptimal, Stage::eTransfer, Access::eTransferRead, Usage::eTransferSrc, false };
+            case Use::TransferDst:
+                return { vk::ImageLayout::eTransferDstOptimal, Stage::eTransfer, Access::eTransferWrite, Usage::eTransferDst, true };
+            }
+            throw std::runtime_error("Unhandled render graph use");
+        }
+
+        static bool isDepthFormat(vk::Format format) {
+            switch (format) {
+            case vk::Format::eD16Unorm:
+            case vk::Format::eX8D24UnormPack32:
+            case vk::Format::eD32Sfloat:
+            case vk::Format::eD16UnormS8Uint:
+            case vk::Format::eD24UnormS8Uint:
+            case vk::Format::eD32SfloatS8Uint:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        // All aspects, for barriers
+        static vk::ImageAspectFlags getAspects(vk::Format format) {
+            switch (format) {
+            case vk::Format::eD16UnormS8Uint:
+            case vk::Format::eD24UnormS8Uint:
+            case vk::Format::eD32SfloatS8Uint:
+                return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+            default:
+                return isDepthFormat(format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+            }
+        }
+
+        template <typename T>
+        static bool contains(const T& flags, const T& subset) {
+            return (flags & subset) == subset;
+        }
+
+        void createImage(Resource& resource) {
+            vk::ImageCreateInfo imageCreateInfo;
+            imageCreateInfo.imageType = vk::ImageType::e2D;
+            imageCreateInfo.format = resource.format;
+            imageCreateInfo.extent = vk::Extent3D{ resource.extent.width, resource.extent.height, 1 };
+            imageCreateInfo.mipLevels = 1;
+            imageCreateInfo.arrayLayers = 1;
+            imageCreateInfo.usage = resource.usage;
+            resource.image = context.createImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+            // Like the offscreen frame buffers, depth is viewed without stencil so that it can be sampled
+            const bool depth = isDepthFormat(resource.format);
+            vk::ImageViewCreateInfo viewCreateInfo;
+            viewCreateInfo.image = resource.image.image;
+            viewCreateInfo.viewType = vk::ImageViewType::e2D;
+            viewCreateInfo.format = resource.format;
+            viewCreateInfo.subresourceRange = vk::ImageSubresourceRange{ depth ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
+            resource.image.view = context.device.createImageView(viewCreateInfo);
+
+            if (resource.usage & vk::ImageUsageFlagBits::eSampled) {
+                vk::SamplerCreateInfo sampler;
+                sampler.magFilter = vk::Filter::eLinear;
+                sampler.minFilter = vk::Filter::eLinear;
+                sampler.mipmapMode = vk::SamplerMipmapMode::eLinear;
+                sampler.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+                sampler.addressModeV = sampler.addressModeU;
+                sampler.addressModeW = sampler.addressModeU;
+                sampler.compareOp = vk::CompareOp::eNever;
+                sampler.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+                resource.image.sampler = context.device.createSampler(sampler);
+            }
+
+            if (debug::marker::active) {
+                debug::marker::setImageName(context.device, resource.image.image, resource.name.c_str());
+            }
+        }
+
+        void createRenderPass(Pass& pass) {
+            std::vector<vk::AttachmentDescription> attachments;
+            std::vector<vk::AttachmentReference> colorReferences;
+            vk::AttachmentReference depthReference;
+            bool hasDepth = false;
+            std::vector<vk::ImageView> views;
+            pass.clearValues.clear();
+            for (const auto& access : pass.accesses) {
+                if (!isAttachment(access.use)) {
+                    continue;
+                }
+                const auto& resource = resources[access.resource];
+                assert(pass.extent == vk::Extent2D() || pass.extent == resource.extent);
+                pass.extent = resource.extent;
+
+                const vk::ImageLayout layout = getUseInfo(access.use).layout;
+                vk::AttachmentDescription attachment;
+                attachment.format = resource.format;
+                attachment.loadOp = access.clear ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad;
+                attachment.storeOp = resource.stored ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+                attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+                attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+                attachment.initialLayout = layout;
+                attachment.finalLayout = layout;
+
+                vk::AttachmentReference reference;
+                reference.attachment = (uint32_t)attachments.size();
+                reference.layout = layout;
+                if (access.use == Use::ColorAttachment) {
+                    colorReferences.push_back(reference);
+                    pass.clearValues.push_back(vkx::clearColor(pass.clearColorValue));
+                } else {
+                    assert(!hasDepth);
+                    depthReference = reference;
+                    hasDepth = true;
+                    pass.clearValues.push_back(vk::ClearDepthStencilValue{ 1.0f, 0 });
+                }
+                attachments.push_back(attachment);
+                views.push_back(resource.image.view);
+            }
+            if (attachments.empty()) {
+                return;
+            }
+
+            vk::SubpassDescription subpass;
+            subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+            subpass.colorAttachmentCount = (uint32_t)colorReferences.size();
+            subpass.pColorAttachments = colorReferences.data();
+            subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+            vk::RenderPassCreateInfo renderPassInfo;
+            renderPassInfo.attachmentCount = (uint32_t)attachments.size();
+            renderPassInfo.pAttachments = attachments.data();
+            renderPassInfo.subpassCount = 1;
+            renderPassInfo.pSubpasses = &subpass;
+            pass.renderPass = context.device.createRenderPass(renderPassInfo);
+
+            vk::FramebufferCreateInfo framebufferInfo;
+            framebufferInfo.renderPass = pass.renderPass;
+            framebufferInfo.attachmentCount = (uint32_t)views.size();
+            framebufferInfo.pAttachments = views.data();
+            framebufferInfo.width = pass.extent.width;
+            framebufferInfo.height = pass.extent.height;
+            framebufferInfo.layers = 1;
+            pass.framebuffer = context.device.createFramebuffer(framebufferInfo);
+
+            if (debug::marker::active) {
+                debug::marker::setRenderPassName(context.device, pass.renderPass, pass.name.c_str());
+                debug::marker::setFramebufferName(context.device, pass.framebuffer, pass.name.c_str());
+            }
+        }
+
+        void schedule() {
+            dirty = false;
+            stats = Stats();
+            stats.passes = (uint32_t)passes.size();
+
+            // Walk back from the outputs, a pass is needed if it writes an image that is needed
+            // after it.  Clearing an attachment means the image isn't needed before the pass.
+            std::vector<bool> needed(resources.size(), false);
+            for (uint32_t i = 0; i < resources.size(); ++i) {
+                needed[i] = resources[i].output && resources[i].outputEnabled;
+            }
+            for (auto itr = passes.rbegin(); itr != passes.rend(); ++itr) {
+                Pass& pass = **itr;
+                pass.culled = true;
+                for (const auto& access : pass.accesses) {
+                    if (getUseInfo(access.use).write && needed[access.resource]) {
+                        pass.culled = false;
+                    }
+                }
+                if (pass.culled) {
+                    ++stats.culled;
+                    continue;
+                }
+                for (const auto& access : pass.accesses) {
+                    if (isAttachment(access.use) && access.clear) {
+                        needed[access.resource] = false;
+                    }
+                }
+                for (const auto& access : pass.accesses) {
+                    if (!isAttachment(access.use) || !access.clear) {
+                        needed[access.resource] = true;
+                    }
+                }
+            }
+
+            // A pass goes after the last writer of what it reads, and after the last writer and
+            // readers of what it writes or reads in another layout
+            struct Tracker {
+                int32_t lastWrite{ -1 };
+                int32_t lastRead{ -1 };
+                vk::ImageLayout layout;
+            };
+            std::vector<Tracker> trackers(resources.size());
+            for (uint32_t i = 0; i < resources.size(); ++i) {
+                trackers[i].layout = resources[i].restLayout;
+            }
+            std::vector<Pass*> order;
+            uint32_t levelCount = 0;
+            for (auto& pass : passes) {
+                if (pass->culled) {
+                    continue;
+                }
+                int32_t level = 0;
+                for (const auto& access : pass->accesses) {
+                    const auto info = getUseInfo(access.use);
+                    const auto& tracker = trackers[access.resource];
+                    if (info.write || tracker.layout != info.layout) {
+                        level = std::max(level, std::max(tracker.lastWrite, tracker.lastRead) + 1);
+                    } else {
+                        level = std::max(level, tracker.lastWrite + 1);
+                    }
+                }
+                for (const auto& access : pass->accesses) {
+                    const auto info = getUseInfo(access.use);
+                    auto& tracker = trackers[access.resource];
+                    if (info.write || tracker.layout != info.layout) {
+                        tracker.lastWrite = level;
+                        tracker.lastRead = -1;
+                        tracker.layout = info.layout;
+                    } else {
+                        tracker.lastRead = std::max(tracker.lastRead, level);
+                    }
+                }
+                pass->level = (uint32_t)level;
+                levelCount = std::max(levelCount, pass->level + 1);
+                order.push_back(pass.get());
+            }
+            std::stable_sort(order.begin(), order.end(), [](const Pass* a, const Pass* b) {
+                return a->level < b->level;
+            });
+            stats.levels = levelCount;
+
+            std::vector<State> states(resources.size());
+            for (uint32_t i = 0; i < resources.size(); ++i) {
+                states[i].layout = resources[i].restLayout;
+                states[i].writeStages = resources[i].stages;
+                states[i].writeAccess = resources[i].writeAccess;
+            }
+            batches.clear();
+            batches.resize(levelCount + 1);
+            for (Pass* pass : order) {
+                Batch& batch = batches[pass->level];
+                for (const auto& access : pass->accesses) {
+                    addBarrier(batch, access.resource, states[access.resource], getUseInfo(access.use), isAttachment(access.use) && access.clear);
+                }
+                batch.passes.push_back(pass);
+            }
+            // Outputs are made visible to their use, the other images return to their resting layout
+            for (uint32_t i = 0; i < resources.size(); ++i) {
+                const auto& resource = resources[i];
+                if (resource.output && resource.outputEnabled) {
+                    addBarrier(batches.back(), i, states[i], getUseInfo(resource.outputUse), false);
+                } else if (states[i].layout != resource.restLayout) {
+                    addImageBarrier(batches.back(), i, states[i].layout, resource.restLayout, states[i].writeStages | states[i].readStages,
+                        states[i].writeAccess, resource.stages, vk::AccessFlags());
+                }
+            }
+            for (const auto& batch : batches) {
+                stats.barriers += (uint32_t)batch.barriers.size();
+            }
+        }
+
+        // Makes the batch cover the access, discard means the previous contents aren't needed
+        void addBarrier(Batch& batch, uint32_t resource, State& state, const UseInfo& info, bool discard) {
+            if (info.write || info.layout != state.layout) {
+                // Waits for the last write and everything that read it, and makes the write available
+                addImageBarrier(batch, resource, discard ? vk::ImageLayout::eUndefined : state.layout, info.layout,
+                    state.writeStages | state.readStages, state.writeAccess, info.stages, info.access);
+                state.layout = info.layout;
+                state.writeStages = info.stages;
+                state.writeAccess = info.access & getWriteAccessMask();
+                if (info.write) {
+                    state.visibleStages = vk::PipelineStageFlags();
+                    state.visibleAccess = vk::AccessFlags();
+                    state.readStages = vk::PipelineStageFlags();
+                } else {
+                    // A layout transition for reading, which this read already waits for
+                    state.visibleStages = info.stages;
+                    state.visibleAccess = info.access;
+                    state.readStages = info.stages;
+                }
+            } else {
+                if (state.writeStages && !(contains(state.visibleStages, info.stages) && contains(state.visibleAccess, info.access))) {
+                    addImageBarrier(batch, resource, state.layout, state.layout, state.writeStages, state.writeAccess, info.stages, info.access);
+                    state.visibleStages |= info.stages;
+                    state.visibleAccess |= info.access;
+                }
+                state.readStages |= info.stages;
+            }
+        }
+
+        void addImageBarrier(Batch& batch, uint32_t resource, vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+            vk::PipelineStageFlags srcStages, vk::AccessFlags srcAccess, vk::PipelineStageFlags dstStages, vk::AccessFlags dstAccess) {
+            const auto& image = resources[resource];
+            // Nothing to wait for, only the layout transition
+            batch.srcStages |= srcStages ? srcStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+            batch.dstStages |= dstStages;
+            for (auto& barrier : batch.barriers) {
+                if (barrier.image == image.image.image && barrier.oldLayout == oldLayout && barrier.newLayout == newLayout) {
+                    barrier.srcAccessMask |= srcAccess;
+                    barrier.dstAccessMask |= dstAccess;
+                    return;
+                }
+            }
+            vk::ImageMemoryBarrier barrier;
+            barrier.oldLayout = oldLayout;
+            barrier.newLayout = newLayout;
+            barrier.srcAccessMask = srcAccess;
+            barrier.dstAccessMask = dstAccess;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = image.image.image;
+            barrier.subresourceRange = vk::ImageSubresourceRange{ getAspects(image.format), 0, 1, 0, 1 };
+            batch.barriers.push_back(barrier);
+        }
+
+        // New images are put in their resting layout, which is where the schedule starts
+        void initializeImages(const std::vector<uint32_t>& created) {
+            std::vector<vk::ImageMemoryBarrier> barriers;
+            for (uint32_t i : created) {
+                const auto& resource = resources[i];
+                if (resource.restLayout == vk::ImageLayout::eUndefined) {
+                    continue;
+                }
+                vk::ImageMemoryBarrier barrier;
+                barrier.oldLayout = vk::ImageLayout::eUndefined;
+                barrier.newLayout = resource.restLayout;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = resource.image.image;
+                barrier.subresourceRange = vk::ImageSubresourceRange{ getAspects(resource.format), 0, 1, 0, 1 };
+                barriers.push_back(barrier);
+            }
+            if (barriers.empty()) {
+                return;
+            }
+            vk::CommandBuffer cmdBuffer = context.createCommandBuffer(vk::CommandBufferLevel::ePrimary, true);
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), nullptr, nullptr, barriers);
+            cmdBuffer.end();
+            // Ordered before the frames by the barrier, so nothing waits for it
+            vk::SubmitInfo submitInfo;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &cmdBuffer;
+            context.queue.submit(submitInfo, vk::Fence());
+            context.trashCommandBuffer(cmdBuffer);
+        }
+
+        void recordPass(const vk::CommandBuffer& cmdBuffer, const Pass& pass) const {
+            if (!pass.renderPass) {
+                pass.record(cmdBuffer);
+                return;
+            }
+            vk::RenderPassBeginInfo renderPassBeginInfo;
+            renderPassBeginInfo.renderPass = pass.renderPass;
+            renderPassBeginInfo.framebuffer = pass.framebuffer;
+            renderPassBeginInfo.renderArea.extent = pass.extent;
+            renderPassBeginInfo.clearValueCount = (uint32_t)pass.clearValues.size();
+            renderPassBeginInfo.pClearValues = pass.clearValues.data();
+            cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+            pass.record(cmdBuffer);
+            cmdBuffer.endRenderPass();
+        }
+    };
+}
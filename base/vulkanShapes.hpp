@@ -11,6 +11,7 @@
 #pragma once
 
 #include "vulkanOffscreen.hpp"
+#include "vulkanInstanceCulling.hpp"
 #include "vulkanTools.h"
 #include "shapes.h"
 #include "easings.hpp"
@@ -70,6 +71,12 @@ namespace vkx {
         } pipelines;
 
         std::vector<ShapeVertexData> shapes;
+        // Bounding sphere radius of each shape at instance scale 1
+        std::vector<float> shapeRadii;
+        // Frustum culls the instances on the GPU, against both eyes when rendering in stereo
+        vkx::InstanceCuller culler{ context };
+        // Call buildCommandBuffer() after changing this
+        bool gpuCulling{ true };
         vk::PipelineLayout pipelineLayout;
         vk::DescriptorSet descriptorSet;
         vk::DescriptorSetLayout descriptorSetLayout;
@@ -90,7 +97,7 @@ namespace vkx {
 #endif
 
         ShapesRenderer(const vkx::Context& context, bool stereo = false) : Parent(context), stereo(stereo) {
-            srand((uint32_t)time(NULL));
+            srand(randomSeed());
         }
 
         ~ShapesRenderer() {
@@ -100,6 +107,7 @@ namespace vkx {
             context.device.destroyPipeline(pipelines.solid);
             context.device.destroyPipelineLayout(pipelineLayout);
             context.device.destroyDescriptorSetLayout(descriptorSetLayout);
+            culler.destroy();
             uniformData.vsScene.destroy();
         }
 
@@ -125,6 +133,12 @@ namespace vkx {
             vkx::setImageLayout(cmdBuffer, framebuffer.colors[0].image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eColorAttachmentOptimal);
             vkx::setImageLayout(cmdBuffer, framebuffer.depth.image, vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
 
+            if (gpuCulling) {
+                culler.record(cmdBuffer);
+            }
+            const vk::Buffer& instances = gpuCulling ? culler.culledInstances.buffer : instanceBuffer.buffer;
+            const vk::Buffer& indirect = gpuCulling ? culler.indirect.buffer : indirectBuffer.buffer;
+
             vk::RenderPassBeginInfo renderPassBeginInfo;
             renderPassBeginInfo.renderPass = renderPass;
             renderPassBeginInfo.renderArea.extent.width = framebufferSize.x;
@@ -141,11 +155,11 @@ namespace vkx {
                 // Binding point 0 : Mesh vertex buffer
                 cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.buffer, { 0 });
                 // Binding point 1 : Instance data buffer
-                cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, instanceBuffer.buffer, { 0 });
+                cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, instances, { 0 });
                 for (uint32_t i = 0; i < 2; ++i) {
                     cmdBuffer.setViewport(0, viewport);
                     cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, { (uint32_t)i * (uint32_t)uniformData.vsScene.alignment });
-                    cmdBuffer.drawIndirect(indirectBuffer.buffer, 0, SHAPES_COUNT, sizeof(vk::DrawIndirectCommand));
+                    cmdBuffer.drawIndirect(indirect, 0, SHAPES_COUNT, sizeof(vk::DrawIndirectCommand));
                     viewport.x += viewport.width;
                 }
             } else {
@@ -155,8 +169,8 @@ namespace vkx {
                 // Binding point 0 : Mesh vertex buffer
                 cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.buffer, { 0 });
                 // Binding point 1 : Instance data buffer
-                cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, instanceBuffer.buffer, { 0 });
-                cmdBuffer.drawIndirect(indirectBuffer.buffer, 0, SHAPES_COUNT, sizeof(vk::DrawIndirectCommand));
+                cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, instances, { 0 });
+                cmdBuffer.drawIndirect(indirect, 0, SHAPES_COUNT, sizeof(vk::DrawIndirectCommand));
             }
             cmdBuffer.endRenderPass();
             cmdBuffer.end();
@@ -190,6 +204,12 @@ namespace vkx {
             }
             shape.vertices = vertices.size() - shape.baseVertex;
             shapes.push_back(shape);
+
+            float radius = 0.0f;
+            for (const auto& vertex : solid.vertices) {
+                radius = std::max(radius, glm::length(vec3(vertex)));
+            }
+            shapeRadii.push_back(radius);
         }
 
         void loadShapes() {
@@ -203,6 +223,9 @@ namespace vkx {
             for (auto& vertex : vertexData) {
                 vertex.position *= 0.2f;
             }
+            for (auto& radius : shapeRadii) {
+                radius *= 0.2f;
+            }
             meshes = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexData);
         }
 
@@ -366,13 +389,14 @@ namespace vkx {
                 drawIndirectCommand.vertexCount = (uint32_t)shapeData.vertices;
             }
             indirectBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, indirectData);
+            culler.prepare(instanceBuffer, indirectData, shapeRadii);
         }
 
         void prepareInstanceData() {
             std::vector<InstanceData> instanceData;
             instanceData.resize(INSTANCE_COUNT);
 
-            std::mt19937 rndGenerator((uint32_t)time(nullptr));
+            std::mt19937 rndGenerator(randomSeed());
             std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
             std::exponential_distribution<float> expDist(1);
 
@@ -386,7 +410,8 @@ namespace vkx {
                 instance.pos *= instance.scale * (1.0f + expDist(rndGenerator) / 2.0f) * 4.0f;
             }
 
-            instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+            // Also read by the culling compute shader
+            instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, instanceData);
         }
 
         void prepareUniformBuffers() {
@@ -421,6 +446,7 @@ namespace vkx {
             uboVS.projection = projections[1];
             uboVS.view = views[1];
             uniformData.vsScene.copy(uboVS, uniformData.vsScene.alignment);
+            culler.update(uboVS.time, { projections[0] * views[0], projections[1] * views[1] }, stereo ? 2 : 1);
 #if 0
             frameTimer = deltaTime;
             if (!paused) {
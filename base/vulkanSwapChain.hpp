@@ -4,6 +4,15 @@
 * A swap chain is a collection of framebuffers used for rendering
 * The swap chain images can then presented to the windowing system
 *
+* Without a window the swap chain can be headless instead: it owns N offscreen images,
+* "acquiring" hands them out in turn and "presenting" only retires the image, optionally
+* copying it to host memory first.  Everything else sees the same images and framebuffers.
+*
+* Acquire and present don't throw when the swap chain no longer matches the surface, they set
+* outOfDate instead and the owner calls create() again.  The new swap chain is created from the
+* old one, which goes into the context's dumpster with its image views, so nothing waits for the
+* device to go idle.
+*
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
@@ -23,11 +32,30 @@ namespace vkx {
 
     class SwapChain {
     private:
-        const vkx::Context& context;
+        vkx::Context& context;
         vk::SurfaceKHR surface;
         vk::SwapchainKHR swapChain;
         vk::PresentInfoKHR presentInfo;
 
+        // Headless backend
+        struct HeadlessImage {
+            CreateImageResult image;
+            // Signalled when the image has been presented, and may be acquired again
+            vk::Fence presented;
+            // Copies the image to the readback buffer, when enabled
+            vk::CommandBuffer readbackCmdBuffer;
+            CreateBufferResult readback;
+        };
+        std::vector<HeadlessImage> headlessImages;
+        vk::Extent2D headlessSize;
+        uint32_t lastPresented{ UINT32_MAX };
+
+#if defined(VK_GOOGLE_display_timing)
+        PFN_vkGetPastPresentationTimingGOOGLE getPastPresentationTiming{ nullptr };
+        VkPresentTimeGOOGLE presentTime{};
+        VkPresentTimesInfoGOOGLE presentTimesInfo{ VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE };
+#endif
+
     public:
         std::vector<SwapChainImage> images;
         vk::Format colorFormat;
@@ -36,8 +64,23 @@ namespace vkx {
         uint32_t currentImage{ 0 };
         // Index of the deteced graphics and presenting device queue
         uint32_t queueNodeIndex = UINT32_MAX;
-
-        SwapChain(const vkx::Context& context) : context(context) {
+        // Layout the images have to be left in for presenting
+        vk::ImageLayout presentLayout{ vk::ImageLayout::ePresentSrcKHR };
+
+        // Set by createHeadless()
+        bool headless{ false };
+        // Number of offscreen images of a headless swap chain
+        uint32_t headlessImageCount{ 3 };
+        // Copy every presented headless image to host memory, see saveLastImage()
+        bool headlessReadback{ false };
+        // Set when the presentation engine reports when images reach the display, see pastPresentTimes()
+        bool presentTiming{ false };
+        // Identifies the next present in pastPresentTimes()
+        uint32_t presentId{ 0 };
+        // Set when acquire or present reports the swap chain as suboptimal or out of date, cleared by create()
+        bool outOfDate{ false };
+
+        SwapChain(vkx::Context& context) : context(context) {
             presentInfo.swapchainCount = 1;
             presentInfo.pSwapchains = &swapChain;
             presentInfo.pImageIndices = &currentImage;
@@ -100,18 +143,39 @@ namespace vkx {
             queueNodeIndex = context.findQueue(vk::QueueFlagBits::eGraphics, surface);
         }
 
+        // Use offscreen images instead of a surface.  Call instead of createSurface().
+        void createHeadless(vk::Format format = vk::Format::eB8G8R8A8Unorm) {
+            headless = true;
+            colorFormat = format;
+            colorSpace = vk::ColorSpaceKHR::eSrgbNonlinear;
+            queueNodeIndex = context.graphicsQueueIndex;
+            // Left ready for the readback copy, there is no presentation engine
+            presentLayout = vk::ImageLayout::eTransferSrcOptimal;
+        }
+
         // Creates an os specific surface
         // Tries to find a graphics and a present queue
-        void create(
+        // Returns false while the surface has no area, e.g. the window is minimized.  The old swap chain
+        // is kept and stays out of date, so the owner skips frames and calls create() again later.
+        bool create(
             vk::Extent2D& size, bool vsync = false
             ) {
+            if (headless) {
+                createHeadlessImages(size);
+                return true;
+            }
             assert(surface);
             assert(queueNodeIndex != UINT32_MAX);
-            vk::SwapchainKHR oldSwapchain = swapChain;
-            currentImage = 0;
 
             // Get physical device surface properties and formats
             vk::SurfaceCapabilitiesKHR surfCaps = context.physicalDevice.getSurfaceCapabilitiesKHR(surface);
+            if (surfCaps.currentExtent.width == 0 || surfCaps.currentExtent.height == 0) {
+                outOfDate = true;
+                return false;
+            }
+            vk::SwapchainKHR oldSwapchain = swapChain;
+            currentImage = 0;
+            outOfDate = false;
             // Get available present modes
             std::vector<vk::PresentModeKHR> presentModes = context.physicalDevice.getSurfacePresentModesKHR(surface);
             auto presentModeCount = presentModes.size();
@@ -175,15 +239,27 @@ namespace vkx {
             swapchainCI.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque;
 
             swapChain = context.device.createSwapchainKHR(swapchainCI);
+#if defined(VK_GOOGLE_display_timing)
+            if (context.enableDisplayTiming) {
+                getPastPresentationTiming = (PFN_vkGetPastPresentationTimingGOOGLE)vkGetDeviceProcAddr(context.device, "vkGetPastPresentationTimingGOOGLE");
+                presentTiming = getPastPresentationTiming != nullptr;
+            }
+#endif
 
-
-            // If an existing sawp chain is re-created, destroy the old swap chain
-            // This also cleans up all the presentable images
+            // If an existing swap chain is re-created, retire the old one once the frames in flight
+            // are done with it.  This also cleans up all the presentable images.
             if (oldSwapchain) {
+                std::vector<vk::ImageView> oldViews;
                 for (uint32_t i = 0; i < imageCount; i++) {
-                    context.device.destroyImageView(images[i].view);
+                    oldViews.push_back(images[i].view);
                 }
-                context.device.destroySwapchainKHR(oldSwapchain);
+                vk::Device device = context.device;
+                context.dumpster.push_back([device, oldViews, oldSwapchain] {
+                    for (const auto& view : oldViews) {
+                        device.destroyImageView(view);
+                    }
+                    device.destroySwapchainKHR(oldSwapchain);
+                });
             }
 
             vk::ImageViewCreateInfo colorAttachmentView;
@@ -205,6 +281,7 @@ namespace vkx {
                 images[i].view = context.device.createImageView(colorAttachmentView);
                 images[i].fence = vk::Fence();
             }
+            return true;
         }
 
         std::vector<vk::Framebuffer> createFramebuffers(vk::FramebufferCreateInfo framebufferCreateInfo) {
@@ -228,17 +305,31 @@ namespace vkx {
             return framebuffers;
         }
 
-        // Acquires the next image in the swap chain
+        // Acquires the next image in the swap chain.  Returns UINT32_MAX if the swap chain is out of
+        // date, in which case the semaphore is not signalled and create() has to be called first.
+        // A suboptimal swap chain still hands out the image but sets outOfDate.
         uint32_t acquireNextImage(vk::Semaphore presentCompleteSemaphore) {
-            auto resultValue = context.device.acquireNextImageKHR(swapChain, UINT64_MAX, presentCompleteSemaphore, vk::Fence());
-            vk::Result result = resultValue.result;
-            if (result != vk::Result::eSuccess) {
-                // TODO handle eSuboptimalKHR
+            if (headless) {
+                return acquireHeadlessImage(presentCompleteSemaphore);
+            }
+            // The C entry point, so that the expected results don't turn into exceptions
+            uint32_t index = UINT32_MAX;
+            vk::Result result = (vk::Result)vkAcquireNextImageKHR(context.device, swapChain, UINT64_MAX, presentCompleteSemaphore, VK_NULL_HANDLE, &index);
+            switch (result) {
+            case vk::Result::eSuccess:
+                break;
+            case vk::Result::eSuboptimalKHR:
+                outOfDate = true;
+                break;
+            case vk::Result::eErrorOutOfDateKHR:
+                outOfDate = true;
+                return UINT32_MAX;
+            default:
                 std::cerr << "Invalid acquire result: " << vk::to_string(result);
                 throw std::error_code(result);
             }
 
-            currentImage = resultValue.value;
+            currentImage = index;
             return currentImage;
         }
 
@@ -264,19 +355,205 @@ namespace vkx {
 
         // Present the current image to the queue
         vk::Result queuePresent(vk::Semaphore waitSemaphore) {
+            if (headless) {
+                presentHeadlessImage(waitSemaphore);
+                return vk::Result::eSuccess;
+            }
             presentInfo.waitSemaphoreCount = waitSemaphore ? 1 : 0;
             presentInfo.pWaitSemaphores = &waitSemaphore;
-            return context.queue.presentKHR(presentInfo);
+#if defined(VK_GOOGLE_display_timing)
+            if (presentTiming) {
+                presentTime.presentID = presentId;
+                presentTime.desiredPresentTime = 0;
+                presentTimesInfo.swapchainCount = 1;
+                presentTimesInfo.pTimes = &presentTime;
+                presentInfo.pNext = &presentTimesInfo;
+            }
+#endif
+            vk::Result result = (vk::Result)vkQueuePresentKHR(context.queue, (const VkPresentInfoKHR*)&presentInfo);
+            switch (result) {
+            case vk::Result::eSuccess:
+                break;
+            case vk::Result::eSuboptimalKHR:
+            case vk::Result::eErrorOutOfDateKHR:
+                // The image was still retired, recreating the swap chain is up to the owner
+                outOfDate = true;
+                break;
+            default:
+                std::cerr << "Invalid present result: " << vk::to_string(result);
+                throw std::error_code(result);
+            }
+            return result;
+        }
+
+        // Calls f(presentId, nanoseconds) for each present whose display time became known since the
+        // last call.  The times are from the presentation engine's clock, which is CLOCK_MONOTONIC (and
+        // std::chrono::steady_clock) on Linux and Android.
+        template <typename F>
+        void pastPresentTimes(F f) {
+#if defined(VK_GOOGLE_display_timing)
+            if (!presentTiming) {
+                return;
+            }
+            VkPastPresentationTimingGOOGLE timings[8];
+            uint32_t count = 0;
+            do {
+                getPastPresentationTiming(context.device, swapChain, &count, nullptr);
+                if (!count) {
+                    break;
+                }
+                count = std::min(count, (uint32_t)(sizeof(timings) / sizeof(timings[0])));
+                getPastPresentationTiming(context.device, swapChain, &count, timings);
+                for (uint32_t i = 0; i < count; ++i) {
+                    f(timings[i].presentID, timings[i].actualPresentTime);
+                }
+            } while (count == sizeof(timings) / sizeof(timings[0]));
+#endif
+        }
+
+        // Writes the last presented headless image as a binary PPM.  Needs headlessReadback.
+        bool saveLastImage(const std::string& filename) {
+            if (!headless || !headlessReadback || lastPresented == UINT32_MAX) {
+                return false;
+            }
+            const auto& image = headlessImages[lastPresented];
+            context.device.waitForFences(image.presented, VK_TRUE, UINT64_MAX);
+            std::ofstream file(filename, std::ios::out | std::ios::binary);
+            if (!file) {
+                return false;
+            }
+            file << "P6\n" << headlessSize.width << " " << headlessSize.height << "\n255\n";
+            const bool bgr = colorFormat == vk::Format::eB8G8R8A8Unorm || colorFormat == vk::Format::eB8G8R8A8Srgb;
+            const uint8_t* pixels = (const uint8_t*)image.readback.mapped;
+            std::vector<uint8_t> row(headlessSize.width * 3);
+            for (uint32_t y = 0; y < headlessSize.height; ++y) {
+                for (uint32_t x = 0; x < headlessSize.width; ++x) {
+                    const uint8_t* pixel = pixels + (y * headlessSize.width + x) * 4;
+                    row[x * 3 + 0] = pixel[bgr ? 2 : 0];
+                    row[x * 3 + 1] = pixel[1];
+                    row[x * 3 + 2] = pixel[bgr ? 0 : 2];
+                }
+                file.write((const char*)row.data(), row.size());
+            }
+            return true;
         }
 
         // Free all Vulkan resources used by the swap chain
         void cleanup() {
+            if (headless) {
+                destroyHeadlessImages();
+                return;
+            }
             for (uint32_t i = 0; i < imageCount; i++) {
                 context.device.destroyImageView(images[i].view);
             }
             context.device.destroySwapchainKHR(swapChain);
             context.instance.destroySurfaceKHR(surface);
         }
+
+    private:
+        void createHeadlessImages(const vk::Extent2D& size) {
+            destroyHeadlessImages();
+            headlessSize = size;
+            imageCount = std::max(1u, headlessImageCount);
+            currentImage = imageCount - 1;
+            lastPresented = UINT32_MAX;
+
+            vk::ImageCreateInfo imageCreateInfo;
+            imageCreateInfo.imageType = vk::ImageType::e2D;
+            imageCreateInfo.format = colorFormat;
+            imageCreateInfo.extent = vk::Extent3D{ size.width, size.height, 1 };
+            imageCreateInfo.mipLevels = 1;
+            imageCreateInfo.arrayLayers = 1;
+            imageCreateInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst;
+
+            vk::ImageViewCreateInfo colorAttachmentView;
+            colorAttachmentView.format = colorFormat;
+            colorAttachmentView.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+            colorAttachmentView.subresourceRange.levelCount = 1;
+            colorAttachmentView.subresourceRange.layerCount = 1;
+            colorAttachmentView.viewType = vk::ImageViewType::e2D;
+
+            headlessImages.resize(imageCount);
+            images.resize(imageCount);
+            for (uint32_t i = 0; i < imageCount; i++) {
+                auto& headlessImage = headlessImages[i];
+                headlessImage.image = context.createImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+                colorAttachmentView.image = headlessImage.image.image;
+                headlessImage.image.view = context.device.createImageView(colorAttachmentView);
+                // Available right away
+                headlessImage.presented = context.device.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+                images[i].image = headlessImage.image.image;
+                images[i].view = headlessImage.image.view;
+                images[i].fence = vk::Fence();
+
+                if (headlessReadback) {
+                    headlessImage.readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, (vk::DeviceSize)size.width * size.height * 4);
+                    headlessImage.readback.map();
+                    // Recorded once, the image is always in presentLayout when presented
+                    headlessImage.readbackCmdBuffer = context.createCommandBuffer(vk::CommandBufferLevel::ePrimary, true);
+                    vk::BufferImageCopy region;
+                    region.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+                    region.imageSubresource.layerCount = 1;
+                    region.imageExtent = vk::Extent3D{ size.width, size.height, 1 };
+                    headlessImage.readbackCmdBuffer.copyImageToBuffer(headlessImage.image.image, presentLayout, headlessImage.readback.buffer, region);
+                    vk::BufferMemoryBarrier barrier;
+                    barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+                    barrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+                    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    barrier.buffer = headlessImage.readback.buffer;
+                    barrier.size = VK_WHOLE_SIZE;
+                    headlessImage.readbackCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), nullptr, barrier, nullptr);
+                    headlessImage.readbackCmdBuffer.end();
+                }
+            }
+        }
+
+        uint32_t acquireHeadlessImage(vk::Semaphore presentCompleteSemaphore) {
+            currentImage = (currentImage + 1) % imageCount;
+            // Like a real swap chain, only hand out images that are done being presented
+            const auto& image = headlessImages[currentImage];
+            context.device.waitForFences(image.presented, VK_TRUE, UINT64_MAX);
+            context.device.resetFences(image.presented);
+            // Nothing else would signal the semaphore the frame's submission waits on
+            vk::SubmitInfo submitInfo;
+            submitInfo.signalSemaphoreCount = presentCompleteSemaphore ? 1 : 0;
+            submitInfo.pSignalSemaphores = &presentCompleteSemaphore;
+            context.queue.submit(submitInfo, vk::Fence());
+            return currentImage;
+        }
+
+        void presentHeadlessImage(vk::Semaphore waitSemaphore) {
+            const auto& image = headlessImages[currentImage];
+            vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eTransfer;
+            vk::SubmitInfo submitInfo;
+            submitInfo.waitSemaphoreCount = waitSemaphore ? 1 : 0;
+            submitInfo.pWaitSemaphores = &waitSemaphore;
+            submitInfo.pWaitDstStageMask = &waitStage;
+            submitInfo.commandBufferCount = image.readbackCmdBuffer ? 1 : 0;
+            submitInfo.pCommandBuffers = &image.readbackCmdBuffer;
+            context.queue.submit(submitInfo, image.presented);
+            lastPresented = currentImage;
+        }
+
+        void destroyHeadlessImages() {
+            if (headlessImages.empty()) {
+                return;
+            }
+            for (auto& headlessImage : headlessImages) {
+                context.device.waitForFences(headlessImage.presented, VK_TRUE, UINT64_MAX);
+                context.device.destroyFence(headlessImage.presented);
+                if (headlessImage.readbackCmdBuffer) {
+                    context.device.freeCommandBuffers(context.getCommandPool(), headlessImage.readbackCmdBuffer);
+                }
+                headlessImage.readback.destroy();
+                headlessImage.image.destroy();
+            }
+            headlessImages.clear();
+            images.clear();
+            imageCount = 0;
+        }
     };
 }
 
@@ -291,9 +291,16 @@ namespace vkx {
 
         // Add text to the current buffer
         // todo : drop shadow? color attribute?
-        void addText(std::string text, float x, float y, TextAlign align) {
+        void addText(const std::string& text, float x, float y, TextAlign align) {
             assert(mapped != nullptr);
+            mapped = generateGlyphs(stbFontData, text, x, y, align, framebufferWidth, framebufferHeight, mapped);
+            numLetters += (uint32_t)text.size();
+        }
 
+        // Writes a uv mapped quad (4 vertices of position and uv) per character to quads and returns
+        // the end of what was written.  Needs no device, so the glyph generation can be measured alone.
+        static glm::vec4* generateGlyphs(const stb_fontchar* fontData, const std::string& text, float x, float y, TextAlign align,
+            uint32_t framebufferWidth, uint32_t framebufferHeight, glm::vec4* quads) {
             const float charW = 1.5f / framebufferWidth;
             const float charH = 1.5f / framebufferHeight;
 
@@ -305,7 +312,7 @@ namespace vkx {
             // Calculate text width
             float textWidth = 0;
             for (auto letter : text) {
-                stb_fontchar *charData = &stbFontData[(uint32_t)letter - STB_FIRST_CHAR];
+                const stb_fontchar *charData = &fontData[(uint32_t)letter - STB_FIRST_CHAR];
                 textWidth += charData->advance * charW;
             }
 
@@ -322,36 +329,35 @@ namespace vkx {
 
             // Generate a uv mapped quad per char in the new text
             for (auto letter : text) {
-                stb_fontchar *charData = &stbFontData[(uint32_t)letter - STB_FIRST_CHAR];
-
-                mapped->x = (x + (float)charData->x0 * charW);
-                mapped->y = (y + (float)charData->y0 * charH);
-                mapped->z = charData->s0;
-                mapped->w = charData->t0;
-                mapped++;
-
-                mapped->x = (x + (float)charData->x1 * charW);
-                mapped->y = (y + (float)charData->y0 * charH);
-                mapped->z = charData->s1;
-                mapped->w = charData->t0;
-                mapped++;
-
-                mapped->x = (x + (float)charData->x0 * charW);
-                mapped->y = (y + (float)charData->y1 * charH);
-                mapped->z = charData->s0;
-                mapped->w = charData->t1;
-                mapped++;
-
-                mapped->x = (x + (float)charData->x1 * charW);
-                mapped->y = (y + (float)charData->y1 * charH);
-                mapped->z = charData->s1;
-                mapped->w = charData->t1;
-                mapped++;
+                const stb_fontchar *charData = &fontData[(uint32_t)letter - STB_FIRST_CHAR];
+
+                quads->x = (x + (float)charData->x0 * charW);
+                quads->y = (y + (float)charData->y0 * charH);
+                quads->z = charData->s0;
+                quads->w = charData->t0;
+                quads++;
+
+                quads->x = (x + (float)charData->x1 * charW);
+                quads->y = (y + (float)charData->y0 * charH);
+                quads->z = charData->s1;
+                quads->w = charData->t0;
+                quads++;
+
+                quads->x = (x + (float)charData->x0 * charW);
+                quads->y = (y + (float)charData->y1 * charH);
+                quads->z = charData->s0;
+                quads->w = charData->t1;
+                quads++;
+
+                quads->x = (x + (float)charData->x1 * charW);
+                quads->y = (y + (float)charData->y1 * charH);
+                quads->z = charData->s1;
+                quads->w = charData->t1;
+                quads++;
 
                 x += charData->advance * charW;
-
-                numLetters++;
             }
+            return quads;
         }
 
         // Unmap buffer and update command buffers
@@ -362,7 +368,6 @@ namespace vkx {
 
         // Needs to be called by the application
         void writeCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
-            debug::marker::Marker(cmdBuffer, "Text overlay", glm::vec4(1.0f, 0.94f, 0.3f, 1.0f));
             vk::Viewport viewport = vkx::viewport((float)framebufferWidth, (float)framebufferHeight, 0.0f, 1.0f);
             cmdBuffer.setViewport(0, viewport);
             vk::Rect2D scissor = vkx::rect2D(framebufferWidth, framebufferHeight, 0, 0);
@@ -12,9 +12,15 @@
 #pragma warning(disable: 4996 4244 4267)
 #include <gli/gli.hpp>
 #include "vulkanTools.h"
+#include "blockCompression.h"
+#include "textureContainer.h"
+#include "workStealingPool.hpp"
+#include "cpuProfiler.hpp"
 
 #if defined(__ANDROID__)
 #include <android/asset_manager.h>
+#else
+#include <sys/stat.h>
 #endif
 
 namespace vkx {
@@ -63,8 +69,175 @@ namespace vkx {
     private:
         Context context;
         vk::CommandBuffer cmdBuffer;
+        // Worker threads for block compression and chunk decompression, created on first use
+        std::unique_ptr<WorkStealingPool> workerThreads;
+
+        WorkStealingPool* getWorkerThreads() {
+            if (!workerThreads) {
+                workerThreads.reset(new WorkStealingPool());
+            }
+            return workerThreads.get();
+        }
+
+        bool isSampledFormatSupported(vk::Format format) const {
+            vk::FormatProperties formatProperties = context.physicalDevice.getFormatProperties(format);
+            return (bool)(formatProperties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eSampledImage);
+        }
+
+#if !defined(__ANDROID__)
+        static bool getModificationTime(const std::string& filename, time_t& result) {
+            struct stat fileStat;
+            if (0 != stat(filename.c_str(), &fileStat)) {
+                return false;
+            }
+            result = fileStat.st_mtime;
+            return true;
+        }
+
+        // Returns a BC3 compressed copy of an uncompressed RGBA8 texture.  The result is cached on disk
+        // next to the source file, so the encoder only runs again if the source is newer than the cache.
+        gli::texture2D compressTexture(const std::string& filename, const gli::texture2D& source) {
+            const std::string cacheFilename = filename + ".bc3.ktx";
+            const gli::format format = gli::FORMAT_RGBA_DXT5_UNORM;
+            time_t sourceTime, cacheTime;
+            if (getModificationTime(cacheFilename, cacheTime) && getModificationTime(filename, sourceTime) && cacheTime >= sourceTime) {
+                // A stale or foreign file under the cache name is compressed again rather than uploaded as BC3
+                gli::texture2D cached(gli::load(cacheFilename.c_str()));
+                if (!cached.empty() && cached.format() == format && cached.layers() == 1 && cached.faces() == 1 &&
+                    cached.levels() == source.levels() && cached.dimensions() == source.dimensions()) {
+                    return cached;
+                }
+            }
+
+            gli::texture2D result(format, source.dimensions(), source.levels());
+            for (size_t level = 0; level < source.levels(); ++level) {
+                const auto dims = source[level].dimensions();
+                bc::encodeImage(bc::Format::BC3, (const uint8_t*)source[level].data(), (uint32_t)dims.x, (uint32_t)dims.y,
+                    (uint8_t*)result[level].data(), getWorkerThreads());
+            }
+            if (!gli::save_ktx(result, cacheFilename.c_str())) {
+                std::cerr << "Unable to write compressed texture cache " << cacheFilename << std::endl;
+            }
+            return result;
+        }
+
+        // Upload a supercompressed container.  The chunks are inflated in parallel directly
+        // into the mapped staging buffer, so the texels are never copied on the CPU side.
+        Texture loadContainer(const std::string& filename, ktxz::Container& container, vk::Format format, vk::ImageUsageFlags imageUsageFlags) {
+            const auto& header = container.header;
+            // gli numbers its formats like Vulkan does
+            if ((vk::Format)header.format != format) {
+                throw std::runtime_error("Texture container for " + filename + " holds format " + vk::to_string((vk::Format)header.format) +
+                    ", requested " + vk::to_string(format));
+            }
+            const uint64_t uncompressedSize = container.uncompressedSize();
+
+            auto decodeStart = std::chrono::high_resolution_clock::now();
+            auto staging = context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, uncompressedSize);
+            ktxz::decompress(container, staging.map<uint8_t>(), getWorkerThreads());
+            staging.unmap();
+            double decodeSeconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - decodeStart).count();
+
+            stats.bytesDecoded += uncompressedSize;
+            stats.decodeSeconds += decodeSeconds;
+
+            const uint32_t arrayLayers = header.layers * header.faces;
+            std::vector<vk::BufferImageCopy> bufferCopyRegions;
+            for (const auto& chunk : container.chunks) {
+                vk::BufferImageCopy bufferCopyRegion;
+                bufferCopyRegion.bufferOffset = chunk.uncompressedOffset;
+                bufferCopyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+                bufferCopyRegion.imageSubresource.mipLevel = chunk.level;
+                bufferCopyRegion.imageSubresource.baseArrayLayer = chunk.layer * header.faces + chunk.face;
+                bufferCopyRegion.imageSubresource.layerCount = 1;
+                bufferCopyRegion.imageExtent = vk::Extent3D{ chunk.width, chunk.height, 1 };
+                bufferCopyRegions.push_back(bufferCopyRegion);
+            }
+
+            Texture texture;
+            texture.extent.width = header.width;
+            texture.extent.height = header.height;
+            texture.mipLevels = header.levels;
+            texture.layerCount = arrayLayers;
+
+            vk::ImageCreateInfo imageCreateInfo;
+            imageCreateInfo.imageType = vk::ImageType::e2D;
+            imageCreateInfo.format = format;
+            imageCreateInfo.mipLevels = texture.mipLevels;
+            imageCreateInfo.arrayLayers = arrayLayers;
+            imageCreateInfo.extent = texture.extent;
+            imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | imageUsageFlags;
+            if (header.faces == 6) {
+                imageCreateInfo.flags = vk::ImageCreateFlagBits::eCubeCompatible;
+            }
+            texture = context.createImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+            vk::ImageSubresourceRange subresourceRange;
+            subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+            subresourceRange.levelCount = texture.mipLevels;
+            subresourceRange.layerCount = arrayLayers;
+            context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer) {
+                setImageLayout(cmdBuffer, texture.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, subresourceRange);
+                cmdBuffer.copyBufferToImage(staging.buffer, texture.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
+                setImageLayout(cmdBuffer, texture.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal, texture.imageLayout, subresourceRange);
+            });
+            staging.destroy();
+
+            vk::SamplerCreateInfo sampler;
+            sampler.magFilter = vk::Filter::eLinear;
+            sampler.minFilter = vk::Filter::eLinear;
+            sampler.mipmapMode = vk::SamplerMipmapMode::eLinear;
+            if (header.faces == 6 || header.layers > 1) {
+                sampler.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+                sampler.addressModeV = sampler.addressModeU;
+                sampler.addressModeW = sampler.addressModeU;
+            }
+            sampler.maxLod = (float)texture.mipLevels;
+            sampler.maxAnisotropy = 8;
+            sampler.anisotropyEnable = VK_TRUE;
+            sampler.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+            texture.sampler = context.device.createSampler(sampler);
+
+            vk::ImageViewCreateInfo view;
+            view.viewType = header.faces == 6 ? vk::ImageViewType::eCube : (header.layers > 1 ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D);
+            view.format = format;
+            view.subresourceRange = subresourceRange;
+            view.image = texture.image;
+            texture.view = context.device.createImageView(view);
+
+            texture.descriptor.imageLayout = texture.imageLayout;
+            texture.descriptor.imageView = texture.view;
+            texture.descriptor.sampler = texture.sampler;
+            return texture;
+        }
+
+        // Reads the .ktxz container that sits next to a texture file, if there is one
+        bool readContainer(const std::string& filename, ktxz::Container& container) {
+            auto readStart = std::chrono::high_resolution_clock::now();
+            if (!ktxz::read(ktxz::containerFilename(filename), container)) {
+                return false;
+            }
+            stats.bytesRead += container.fileData.size();
+            stats.readSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - readStart).count();
+            return true;
+        }
+#endif
 
     public:
+        // Totals for all textures loaded from supercompressed containers
+        struct Stats {
+            uint64_t bytesRead{ 0 };
+            uint64_t bytesDecoded{ 0 };
+            double readSeconds{ 0 };
+            double decodeSeconds{ 0 };
+        } stats;
+
+        // If set, a .ktxz container next to the requested file is preferred over the file itself
+        bool enableSupercompression{ true };
+
+        // If set, uncompressed RGBA8 2D textures are block compressed to BC3 on the CPU before upload,
+        // provided the device can sample from BC3 images
+        bool enableBlockCompression{ false };
 
         TextureLoader(const Context& context) {
             this->context = context;
@@ -89,6 +262,16 @@ namespace vkx {
 
         // Load a 2D texture
         Texture loadTexture(const std::string& filename, vk::Format format, bool forceLinear = false, vk::ImageUsageFlags imageUsageFlags = vk::ImageUsageFlagBits::eSampled) {
+            VKX_PROFILE_SCOPE("load texture");
+#if !defined(__ANDROID__)
+            if (enableSupercompression && !forceLinear) {
+                ktxz::Container container;
+                if (readContainer(filename, container)) {
+                    return loadContainer(filename, container, format, imageUsageFlags);
+                }
+            }
+#endif
+
 #if defined(__ANDROID__)
             assert(assetManager != nullptr);
 
@@ -111,6 +294,15 @@ namespace vkx {
 #endif        
             assert(!tex2D.empty());
 
+#if !defined(__ANDROID__)
+            if (enableBlockCompression && !forceLinear && format == vk::Format::eR8G8B8A8Unorm &&
+                tex2D[0].size() == (size_t)tex2D[0].dimensions().x * tex2D[0].dimensions().y * 4 &&
+                context.deviceFeatures.textureCompressionBC && isSampledFormatSupported(vk::Format::eBc3UnormBlock)) {
+                tex2D = compressTexture(filename, tex2D);
+                format = vk::Format::eBc3UnormBlock;
+            }
+#endif
+
             Texture texture;
             texture.device = context.device;
             texture.extent.width = (uint32_t)tex2D[0].dimensions().x;
@@ -299,6 +491,16 @@ namespace vkx {
 
         // Load a cubemap texture (single file)
         Texture loadCubemap(const std::string& filename, vk::Format format) {
+            VKX_PROFILE_SCOPE("load cubemap");
+#if !defined(__ANDROID__)
+            if (enableSupercompression) {
+                ktxz::Container container;
+                if (readContainer(filename, container)) {
+                    return loadContainer(filename, container, format, vk::ImageUsageFlagBits::eSampled);
+                }
+            }
+#endif
+
 #if defined(__ANDROID__)
             assert(assetManager != nullptr);
 
@@ -431,6 +633,16 @@ namespace vkx {
 
         // Load an array texture (single file)
         Texture loadTextureArray(const std::string& filename, vk::Format format) {
+            VKX_PROFILE_SCOPE("load texture array");
+#if !defined(__ANDROID__)
+            if (enableSupercompression) {
+                ktxz::Container container;
+                if (readContainer(filename, container)) {
+                    return loadContainer(filename, container, format, vk::ImageUsageFlagBits::eSampled);
+                }
+            }
+#endif
+
 #if defined(__ANDROID__)
             assert(assetManager != nullptr);
 
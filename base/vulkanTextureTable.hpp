@@ -0,0 +1,128 @@
+/*
+* Global (bindless) texture table
+*
+* A single descriptor set holding a variable sized, partially bound array of combined
+* image samplers.  Textures register into a slot once, and shaders select them by index
+* (usually read from a material storage buffer), so draws no longer need a descriptor
+* set per material.  Requires VK_EXT_descriptor_indexing, the Context only creates a
+* table when the device supports it.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkanTools.h"
+
+namespace vkx {
+    class TextureTable {
+    public:
+        // Upper bound on the number of slots, further limited by the device
+        static const uint32_t MAX_TEXTURES = 4096;
+        static const uint32_t INVALID_INDEX = ~0u;
+
+        // Bind the layout as its own set, e.g. layout (set = 1, binding = 0) uniform sampler2D textures[];
+        vk::DescriptorSetLayout layout;
+        vk::DescriptorSet descriptorSet;
+        uint32_t capacity{ 0 };
+        // Slots can be written while command buffers using the set are pending
+        bool updateAfterBind{ false };
+
+#if defined(VK_EXT_descriptor_indexing)
+        void create(const vk::Device& device, uint32_t capacity, bool updateAfterBind) {
+            this->device = device;
+            this->capacity = capacity;
+            this->updateAfterBind = updateAfterBind;
+
+            VkDescriptorBindingFlagsEXT bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
+            if (updateAfterBind) {
+                bindingFlags |= VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+            }
+            VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT };
+            bindingFlagsInfo.bindingCount = 1;
+            bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+            vk::DescriptorSetLayoutBinding binding = descriptorSetLayoutBinding(vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute, 0);
+            binding.descriptorCount = capacity;
+            vk::DescriptorSetLayoutCreateInfo layoutInfo = descriptorSetLayoutCreateInfo(&binding, 1);
+            layoutInfo.pNext = &bindingFlagsInfo;
+            if (updateAfterBind) {
+                layoutInfo.flags = (vk::DescriptorSetLayoutCreateFlagBits)VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+            }
+            layout = device.createDescriptorSetLayout(layoutInfo);
+
+            vk::DescriptorPoolSize poolSize = descriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, capacity);
+            vk::DescriptorPoolCreateInfo poolInfo = descriptorPoolCreateInfo(1, &poolSize, 1);
+            if (updateAfterBind) {
+                poolInfo.flags = (vk::DescriptorPoolCreateFlagBits)VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+            }
+            pool = device.createDescriptorPool(poolInfo);
+
+            VkDescriptorSetVariableDescriptorCountAllocateInfoEXT countInfo{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT };
+            countInfo.descriptorSetCount = 1;
+            countInfo.pDescriptorCounts = &capacity;
+            vk::DescriptorSetAllocateInfo allocInfo = descriptorSetAllocateInfo(pool, &layout, 1);
+            allocInfo.pNext = &countInfo;
+            descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+        }
+#endif
+
+        void destroy() {
+            if (pool) {
+                device.destroyDescriptorPool(pool);
+                pool = vk::DescriptorPool();
+            }
+            if (layout) {
+                device.destroyDescriptorSetLayout(layout);
+                layout = vk::DescriptorSetLayout();
+            }
+            descriptorSet = vk::DescriptorSet();
+            freeSlots.clear();
+            nextSlot = 0;
+        }
+
+        // Writes the texture into a free slot and returns its index.  Without update after bind support,
+        // this must not be called while command buffers that use the table are pending.
+        uint32_t add(const vk::DescriptorImageInfo& texture) {
+            uint32_t slot;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (!freeSlots.empty()) {
+                    slot = freeSlots.back();
+                    freeSlots.pop_back();
+                } else if (nextSlot < capacity) {
+                    slot = nextSlot++;
+                } else {
+                    throw std::runtime_error("Texture table is full");
+                }
+            }
+            update(slot, texture);
+            return slot;
+        }
+
+        // Replace the texture in an existing slot
+        void update(uint32_t slot, vk::DescriptorImageInfo texture) {
+            assert(slot < capacity);
+            vk::WriteDescriptorSet write = writeDescriptorSet(descriptorSet, vk::DescriptorType::eCombinedImageSampler, 0, &texture);
+            write.dstArrayElement = slot;
+            device.updateDescriptorSets(write, {});
+        }
+
+        // Return a slot to the table.  The descriptor is left in place, since the set is partially
+        // bound it only has to be valid if a shader actually reads it.
+        void remove(uint32_t slot) {
+            if (slot == INVALID_INDEX) {
+                return;
+            }
+            std::unique_lock<std::mutex> lock(mutex);
+            freeSlots.push_back(slot);
+        }
+
+    private:
+        vk::Device device;
+        vk::DescriptorPool pool;
+        std::mutex mutex;
+        std::vector<uint32_t> freeSlots;
+        uint32_t nextSlot{ 0 };
+    };
+}
@@ -0,0 +1,454 @@
+/*
+* Work stealing thread pool
+*
+* Every worker owns a fixed size Chase-Lev deque.  Jobs submitted from a worker go to the
+* bottom of its own deque and are popped LIFO by the owner, while idle workers steal FIFO
+* from the top of the other deques.  Jobs submitted from outside the pool go through a
+* shared, fixed size injection ring.  Jobs are stored in a small buffer inside vkx::Job, so closures
+* that capture a few pointers never touch the heap.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <string>
+#include <vector>
+
+#include "cpuProfiler.hpp"
+
+namespace vkx {
+
+    // Move-only type erased callable with inline storage for small closures
+    class Job {
+    public:
+        static const size_t STORAGE_SIZE = 48;
+
+        Job() {}
+
+        template <typename F, typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, Job>::value>::type>
+        Job(F&& function) {
+            using Function = typename std::decay<F>::type;
+            using FitsInline = std::integral_constant<bool, sizeof(Function) <= STORAGE_SIZE && alignof(Function) <= alignof(Storage) && std::is_nothrow_move_constructible<Function>::value>;
+            emplace<Function>(std::forward<F>(function), FitsInline());
+        }
+
+        Job(Job&& other) {
+            *this = std::move(other);
+        }
+
+        Job& operator=(Job&& other) {
+            if (this != &other) {
+                reset();
+                if (other.operations) {
+                    other.operations->move(&other.storage, &storage);
+                    operations = other.operations;
+                    other.operations = nullptr;
+                }
+            }
+            return *this;
+        }
+
+        Job(const Job&) = delete;
+        Job& operator=(const Job&) = delete;
+
+        ~Job() {
+            reset();
+        }
+
+        explicit operator bool() const {
+            return operations != nullptr;
+        }
+
+        void operator()() {
+            operations->invoke(&storage);
+        }
+
+        void reset() {
+            if (operations) {
+                operations->destroy(&storage);
+                operations = nullptr;
+            }
+        }
+
+    private:
+        using Storage = typename std::aligned_storage<STORAGE_SIZE, alignof(max_align_t)>::type;
+
+        struct Operations {
+            void(*invoke)(void*);
+            void(*move)(void* source, void* destination);
+            void(*destroy)(void*);
+        };
+
+        template <typename Function>
+        struct InlineOperations {
+            static void invoke(void* storage) { (*reinterpret_cast<Function*>(storage))(); }
+            static void move(void* source, void* destination) {
+                new (destination) Function(std::move(*reinterpret_cast<Function*>(source)));
+                reinterpret_cast<Function*>(source)->~Function();
+            }
+            static void destroy(void* storage) { reinterpret_cast<Function*>(storage)->~Function(); }
+            static const Operations operations;
+        };
+
+        template <typename Function>
+        struct HeapOperations {
+            static void invoke(void* storage) { (**reinterpret_cast<Function**>(storage))(); }
+            static void move(void* source, void* destination) { *reinterpret_cast<Function**>(destination) = *reinterpret_cast<Function**>(source); }
+            static void destroy(void* storage) { delete *reinterpret_cast<Function**>(storage); }
+            static const Operations operations;
+        };
+
+        template <typename Function, typename F>
+        void emplace(F&& function, std::true_type) {
+            new (&storage) Function(std::forward<F>(function));
+            operations = &InlineOperations<Function>::operations;
+        }
+
+        // Too big for the small buffer, fall back to the heap
+        template <typename Function, typename F>
+        void emplace(F&& function, std::false_type) {
+            *reinterpret_cast<Function**>(&storage) = new Function(std::forward<F>(function));
+            operations = &HeapOperations<Function>::operations;
+        }
+
+        Storage storage;
+        const Operations* operations{ nullptr };
+    };
+
+    template <typename Function>
+    const Job::Operations Job::InlineOperations<Function>::operations = { &invoke, &move, &destroy };
+
+    template <typename Function>
+    const Job::Operations Job::HeapOperations<Function>::operations = { &invoke, &move, &destroy };
+
+    // Fixed capacity Chase-Lev deque of pointers ("Correct and Efficient Work-Stealing for
+    // Weak Memory Models", Le et al. 2013).  push and pop may only be called by the owning
+    // thread, steal may be called from any thread.
+    template <typename T, size_t Capacity>
+    class WorkStealingDeque {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    public:
+        WorkStealingDeque() {
+            for (auto& item : items) {
+                item.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        bool push(T* item) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            if (b - t >= (int64_t)Capacity) {
+                return false;
+            }
+            items[b & (Capacity - 1)].store(item, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        T* pop() {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                // Empty
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            T* item = items[b & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (t == b) {
+                // Last item, race against the thieves for it
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        T* steal() {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+            T* item = items[t & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return item;
+        }
+
+        bool empty() const {
+            return top.load(std::memory_order_acquire) >= bottom.load(std::memory_order_acquire);
+        }
+
+    private:
+        // Keep the indices on separate cache lines, the owner writes bottom and thieves write top
+        std::atomic<int64_t> top{ 0 };
+        char topPadding[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<int64_t> bottom{ 0 };
+        char bottomPadding[64 - sizeof(std::atomic<int64_t>)];
+        std::atomic<T*> items[Capacity];
+    };
+
+    class WorkStealingPool {
+    public:
+        // Maximum number of jobs a single worker can have queued, further submissions from
+        // that worker run inline until a slot frees up
+        static const size_t WORKER_CAPACITY = 1024;
+        // Maximum number of jobs queued from outside the pool, further submissions run inline
+        static const size_t INJECTION_CAPACITY = 1024;
+
+        WorkStealingPool(uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency())) {
+            workers.reserve(threadCount);
+            for (uint32_t i = 0; i < threadCount; ++i) {
+                workers.push_back(std::unique_ptr<Worker>(new Worker()));
+            }
+            for (uint32_t i = 0; i < threadCount; ++i) {
+                workers[i]->thread = std::thread(&WorkStealingPool::workerLoop, this, i);
+            }
+        }
+
+        ~WorkStealingPool() {
+            wait();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            workAvailable.notify_all();
+            for (auto& worker : workers) {
+                worker->thread.join();
+            }
+        }
+
+        uint32_t threadCount() const {
+            return (uint32_t)workers.size();
+        }
+
+        // Index of the calling worker thread in this pool, or -1 when called from outside
+        int32_t currentWorkerIndex() const {
+            const auto& current = currentWorker();
+            return current.pool == this ? current.index : -1;
+        }
+
+        template <typename F>
+        void submit(F&& function) {
+            pending.fetch_add(1, std::memory_order_relaxed);
+            int32_t index = currentWorkerIndex();
+            if (index >= 0) {
+                Worker& worker = *workers[index];
+                JobSlot* slot = worker.allocate();
+                if (!slot) {
+                    // The worker's deque is full, so just do the work now
+                    Job job(std::forward<F>(function));
+                    execute(job);
+                    return;
+                }
+                slot->job = Job(std::forward<F>(function));
+                // Count the job before it's published, a thief may run it right away and
+                // the decrement must never come first
+                ready.fetch_add(1, std::memory_order_seq_cst);
+                worker.deque.push(slot);
+            } else {
+                Job job(std::forward<F>(function));
+                std::unique_lock<std::mutex> lock(injectionMutex);
+                if (injectedCount == INJECTION_CAPACITY) {
+                    // The ring is full, so just do the work now
+                    lock.unlock();
+                    execute(job);
+                    return;
+                }
+                injected[(injectedHead + injectedCount) & (INJECTION_CAPACITY - 1)] = std::move(job);
+                ++injectedCount;
+                ready.fetch_add(1, std::memory_order_seq_cst);
+            }
+            if (sleeping.load(std::memory_order_seq_cst) > 0) {
+                std::lock_guard<std::mutex> lock(mutex);
+                workAvailable.notify_one();
+                allDone.notify_all();
+            }
+        }
+
+        // Runs a single queued job on the calling thread, returns false if there was none
+        bool tryRunOne() {
+            return runOne(currentWorkerIndex());
+        }
+
+        // Blocks until every submitted job has completed.  The calling thread helps run jobs
+        // while it waits.  Must not be called from inside a job of the same pool.
+        void wait() {
+            while (pending.load(std::memory_order_acquire) > 0) {
+                if (runOne(-1)) {
+                    continue;
+                }
+                // Counted as sleeping so that submit() wakes this thread up to help with new jobs
+                std::unique_lock<std::mutex> lock(mutex);
+                sleeping.fetch_add(1, std::memory_order_seq_cst);
+                allDone.wait(lock, [this] {
+                    return pending.load(std::memory_order_acquire) == 0 || ready.load(std::memory_order_seq_cst) > 0;
+                });
+                sleeping.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        struct JobSlot {
+            Job job;
+            std::atomic<bool> used{ false };
+        };
+
+        struct Worker {
+            std::thread thread;
+            WorkStealingDeque<JobSlot, WORKER_CAPACITY> deque;
+            // Backing storage for the jobs in the deque, only allocated by the owner
+            std::unique_ptr<JobSlot[]> slots{ new JobSlot[WORKER_CAPACITY] };
+            size_t nextSlot{ 0 };
+
+            JobSlot* allocate() {
+                for (size_t i = 0; i < WORKER_CAPACITY; ++i) {
+                    JobSlot& slot = slots[(nextSlot + i) & (WORKER_CAPACITY - 1)];
+                    if (!slot.used.load(std::memory_order_acquire)) {
+                        slot.used.store(true, std::memory_order_relaxed);
+                        nextSlot = (nextSlot + i + 1) & (WORKER_CAPACITY - 1);
+                        return &slot;
+                    }
+                }
+                return nullptr;
+            }
+        };
+
+        struct CurrentWorker {
+            const WorkStealingPool* pool{ nullptr };
+            int32_t index{ -1 };
+        };
+
+        static CurrentWorker& currentWorker() {
+            static thread_local CurrentWorker current;
+            return current;
+        }
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::mutex injectionMutex;
+        // Ring of the jobs submitted from outside the pool, guarded by injectionMutex
+        std::unique_ptr<Job[]> injected{ new Job[INJECTION_CAPACITY] };
+        size_t injectedHead{ 0 };
+        size_t injectedCount{ 0 };
+
+        // Jobs submitted but not yet completed
+        std::atomic<size_t> pending{ 0 };
+        // Jobs queued but not yet picked up by a thread
+        std::atomic<size_t> ready{ 0 };
+        // Workers and wait() callers blocked on one of the condition variables
+        std::atomic<uint32_t> sleeping{ 0 };
+        std::mutex mutex;
+        std::condition_variable workAvailable;
+        std::condition_variable allDone;
+        bool stopping{ false };
+
+        void execute(Job& job) {
+            {
+                VKX_PROFILE_SCOPE("job");
+                job();
+            }
+            job.reset();
+            if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                allDone.notify_all();
+            }
+        }
+
+        // Find and run a single job: first from the worker's own deque, then the injection
+        // queue, then by stealing from the other workers.  Returns false if nothing was found.
+        bool runOne(int32_t index) {
+            if (ready.load(std::memory_order_acquire) == 0) {
+                return false;
+            }
+
+            if (index >= 0) {
+                if (JobSlot* slot = workers[index]->deque.pop()) {
+                    return runSlot(slot);
+                }
+            }
+
+            {
+                Job job;
+                {
+                    std::lock_guard<std::mutex> lock(injectionMutex);
+                    if (injectedCount > 0) {
+                        job = std::move(injected[injectedHead]);
+                        injectedHead = (injectedHead + 1) & (INJECTION_CAPACITY - 1);
+                        --injectedCount;
+                    }
+                }
+                if (job) {
+                    ready.fetch_sub(1, std::memory_order_relaxed);
+                    execute(job);
+                    return true;
+                }
+            }
+
+            const size_t count = workers.size();
+            const size_t start = index >= 0 ? (size_t)index + 1 : 0;
+            for (size_t i = 0; i < count; ++i) {
+                size_t victim = (start + i) % count;
+                if ((int32_t)victim == index) {
+                    continue;
+                }
+                if (JobSlot* slot = workers[victim]->deque.steal()) {
+                    return runSlot(slot);
+                }
+            }
+            return false;
+        }
+
+        bool runSlot(JobSlot* slot) {
+            ready.fetch_sub(1, std::memory_order_relaxed);
+            Job job(std::move(slot->job));
+            slot->used.store(false, std::memory_order_release);
+            execute(job);
+            return true;
+        }
+
+        void workerLoop(uint32_t index) {
+            VKX_PROFILE_THREAD_NAME("Worker " + std::to_string(index));
+            currentWorker().pool = this;
+            currentWorker().index = (int32_t)index;
+            while (true) {
+                // Spin briefly before going to sleep, new work often arrives right away
+                bool ran = false;
+                for (int spin = 0; spin < 64 && !ran; ++spin) {
+                    ran = runOne(index);
+                    if (!ran) {
+                        std::this_thread::yield();
+                    }
+                }
+                if (ran) {
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(mutex);
+                sleeping.fetch_add(1, std::memory_order_seq_cst);
+                workAvailable.wait(lock, [this] { return stopping || ready.load(std::memory_order_seq_cst) > 0; });
+                sleeping.fetch_sub(1, std::memory_order_relaxed);
+                if (stopping && ready.load(std::memory_order_acquire) == 0) {
+                    break;
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1,151 @@
+/*
+* Checks and times the BC1 / BC3 encoder on generated reference images
+*
+* Every image is encoded through both the SSE2 and the scalar path, which have to produce the same
+* blocks, and with a thread pool, which has to match the single threaded result.  The decoded
+* result has to reach a minimum PSNR per image and format, so an encoder regression fails the run.
+* The images come from a fixed generator, results don't depend on the platform.
+*
+* Usage: benchmark_blockcompression
+* Exits with 1 if a check fails.  The PSNR thresholds are for the fixed 256x256 images.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "blockCompression.h"
+#include "workStealingPool.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx::benchmark;
+namespace bc = vkx::bc;
+
+namespace {
+    struct Image {
+        std::string name;
+        uint32_t width;
+        uint32_t height;
+        std::vector<uint8_t> rgba;
+        // Minimum PSNR in dB, RGB for BC1 and RGBA for BC3
+        double minBC1;
+        double minBC3;
+    };
+
+    // Small LCG, unlike the <random> distributions its output is the same everywhere
+    struct Random {
+        uint32_t state;
+        uint32_t next(uint32_t range) {
+            state = state * 1664525u + 1013904223u;
+            return (state >> 8) % range;
+        }
+    };
+
+    uint8_t clampByte(float v) {
+        return (uint8_t)std::min(std::max(v + 0.5f, 0.0f), 255.0f);
+    }
+
+    template <typename F>
+    Image generate(const std::string& name, uint32_t width, uint32_t height, double minBC1, double minBC3, F pixel) {
+        Image image{ name, width, height, std::vector<uint8_t>((size_t)width * height * 4), minBC1, minBC3 };
+        for (uint32_t y = 0; y < height; ++y) {
+            for (uint32_t x = 0; x < width; ++x) {
+                pixel(x, y, image.rgba.data() + ((size_t)y * width + x) * 4);
+            }
+        }
+        return image;
+    }
+
+    std::vector<Image> referenceImages(uint32_t size) {
+        std::vector<Image> images;
+        const float scale = 255.0f / (float)(size - 1);
+        images.push_back(generate("gradient", size, size, 42.0, 43.0, [&](uint32_t x, uint32_t y, uint8_t* p) {
+            p[0] = clampByte(x * scale);
+            p[1] = clampByte(y * scale);
+            p[2] = clampByte(255.0f - (x + y) * scale * 0.5f);
+            p[3] = clampByte((x + y) * scale * 0.5f);
+        }));
+        Random random{ 1 };
+        images.push_back(generate("noise", size, size, 29.0, 30.0, [&](uint32_t x, uint32_t y, uint8_t* p) {
+            const float base = 128.0f + 96.0f * sinf(x * 0.05f) * cosf(y * 0.07f);
+            p[0] = clampByte(base + (float)random.next(33) - 16.0f);
+            p[1] = clampByte(base * 0.8f + (float)random.next(33) - 16.0f);
+            p[2] = clampByte(255.0f - base + (float)random.next(33) - 16.0f);
+            p[3] = clampByte(base + (float)random.next(17) - 8.0f);
+        }));
+        // Edges that don't line up with the blocks, with an odd size for partial blocks
+        images.push_back(generate("edges", size - 3, size - 1, 18.0, 19.0, [&](uint32_t x, uint32_t y, uint8_t* p) {
+            static const uint8_t colors[4][4] = { { 230, 40, 40, 255 }, { 40, 200, 60, 0 }, { 30, 60, 220, 128 }, { 240, 230, 200, 64 } };
+            const uint8_t* color = colors[((x / 6) + 2 * (y / 10)) % 4];
+            for (uint32_t c = 0; c < 4; ++c) {
+                p[c] = color[c];
+            }
+        }));
+        return images;
+    }
+
+    bool check(const Image& image, bc::Format format, vkx::WorkStealingPool& pool) {
+        const bool alpha = format == bc::Format::BC3;
+        const double minimum = alpha ? image.minBC3 : image.minBC1;
+        const auto simd = bc::encodeImage(format, image.rgba.data(), image.width, image.height, nullptr, true);
+        const auto scalar = bc::encodeImage(format, image.rgba.data(), image.width, image.height, nullptr, false);
+        const auto threaded = bc::encodeImage(format, image.rgba.data(), image.width, image.height, &pool, true);
+        const auto decoded = bc::decodeImage(format, simd.data(), image.width, image.height);
+        const double psnr = bc::psnr(image.rgba.data(), decoded.data(), (size_t)image.width * image.height, alpha);
+
+        bool passed = true;
+        std::string failures;
+        if (psnr < minimum) {
+            std::stringstream ss;
+            ss << " psnr below " << minimum;
+            failures += ss.str();
+            passed = false;
+        }
+        if (scalar != simd) {
+            failures += " scalar differs from simd";
+            passed = false;
+        }
+        if (threaded != simd) {
+            failures += " threaded differs";
+            passed = false;
+        }
+
+        const size_t pixels = (size_t)image.width * image.height;
+        auto time = [&](vkx::WorkStealingPool* threadPool, bool useSimd) {
+            std::vector<uint8_t> output(bc::imageSize(format, image.width, image.height));
+            return summarize(sample(10, 2, [&] {
+                bc::encodeImage(format, image.rgba.data(), image.width, image.height, output.data(), threadPool, useSimd);
+            })).median * 1e9 / pixels;
+        };
+
+        std::cout << std::left << std::setw(10) << image.name << std::setw(6) << (alpha ? "BC3" : "BC1") << std::right
+            << std::setw(10) << std::fixed << std::setprecision(2) << psnr
+            << std::setw(14) << std::setprecision(3) << time(nullptr, true)
+            << std::setw(14) << time(nullptr, false)
+            << std::setw(14) << time(&pool, true)
+            << (passed ? "  ok" : "  FAILED") << failures << std::endl;
+        return passed;
+    }
+}
+
+int main() {
+    vkx::WorkStealingPool pool;
+    std::cout << std::left << std::setw(10) << "image" << std::setw(6) << "fmt" << std::right
+        << std::setw(10) << "psnr dB"
+        << std::setw(14) << "ns/px simd"
+        << std::setw(14) << "ns/px scalar"
+        << std::setw(14) << "ns/px x" + std::to_string(pool.threadCount()) << std::endl;
+    bool passed = true;
+    for (const auto& image : referenceImages(256)) {
+        for (bc::Format format : { bc::Format::BC1, bc::Format::BC3 }) {
+            passed = check(image, format, pool) && passed;
+        }
+    }
+    return passed ? 0 : 1;
+}
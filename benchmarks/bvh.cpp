@@ -0,0 +1,237 @@
+/*
+* Build and query timings for vkx::Bvh
+*
+* Scenes:
+*   sibenik     one entry per triangle of the sibenik cathedral model, if it is present
+*   instances   N copies of the rock model bounds with random transforms, refit after moving them
+*
+* Frustum queries are compared against a linear scan with the batch culling kernels, both for time
+* and for the result: along the whole camera path the BVH has to visit exactly the entries the scan
+* finds visible, each of them once.
+*
+* Usage: benchmark_bvh [maxInstances]
+* Exits with 1 if a BVH query disagrees with the linear scan.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "vulkanMeshLoader.hpp"
+#include "frustumCulling.hpp"
+#include "bvh.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx::benchmark;
+
+namespace {
+    volatile uint32_t sink{ 0 };
+
+    void report(const std::string& scene, const std::string& test, size_t entries, double milliseconds, const std::string& extra = "") {
+        std::cout << std::left << std::setw(12) << scene << std::setw(22) << test << std::right
+            << std::setw(10) << entries
+            << std::setw(12) << std::fixed << std::setprecision(3) << milliseconds
+            << "  " << extra << std::endl;
+    }
+
+    template <typename F>
+    double milliseconds(uint32_t iterations, F f) {
+        return summarize(sample(iterations, 1, f)).median * 1e3;
+    }
+
+    std::vector<vkTools::Frustum> cameraPath(const vkx::Aabb& sceneBounds) {
+        std::vector<vkTools::Frustum> result;
+        glm::vec3 center = sceneBounds.center();
+        float radius = glm::length(sceneBounds.extent());
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, radius * 2.0f);
+        for (uint32_t i = 0; i < 64; ++i) {
+            float angle = glm::radians(i * 360.0f / 64);
+            glm::vec3 direction(sinf(angle), 0.0f, cosf(angle));
+            vkTools::Frustum frustum;
+            frustum.update(projection * glm::lookAt(center, center + direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+            result.push_back(frustum);
+        }
+        return result;
+    }
+
+    // The entries the BVH visits have to be the visible bits of the linear scan, without duplicates
+    bool matches(const std::string& name, const std::vector<vkTools::Frustum>& frustums, const vkx::Bvh& bvh, const vkx::BoxList& boxes) {
+        vkx::VisibilityMask mask;
+        std::vector<uint32_t> expected, visited;
+        for (uint32_t f = 0; f < frustums.size(); ++f) {
+            vkx::culling::cullBoxes(frustums[f], boxes, mask);
+            mask.compact(expected);
+            visited.clear();
+            bvh.queryFrustum(frustums[f], [&](uint32_t entry) { visited.push_back(entry); });
+            std::sort(visited.begin(), visited.end());
+            if (visited == expected) {
+                continue;
+            }
+            std::cout << "FAILED " << name << " frustum " << f << ": bvh visited " << visited.size() << ", linear found " << expected.size();
+            auto mismatch = std::mismatch(visited.begin(), visited.end(), expected.begin(), expected.end());
+            if (mismatch.first != visited.end()) {
+                std::cout << ", first difference: bvh entry " << *mismatch.first;
+            }
+            if (mismatch.second != expected.end()) {
+                std::cout << ", linear entry " << *mismatch.second;
+            }
+            std::cout << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    bool queries(const std::string& name, const std::vector<vkx::Aabb>& entries, const vkx::Bvh& bvh) {
+        vkx::Aabb sceneBounds;
+        for (const auto& entry : entries) {
+            sceneBounds.expand(entry);
+        }
+        auto frustums = cameraPath(sceneBounds);
+
+        uint32_t visible = 0;
+        double bvhFrustum = milliseconds(20, [&] {
+            visible = 0;
+            for (const auto& frustum : frustums) {
+                bvh.queryFrustum(frustum, [&](uint32_t) { ++visible; });
+            }
+        }) / frustums.size();
+        report(name, "frustum bvh", entries.size(), bvhFrustum, std::to_string(visible / frustums.size()) + " visible");
+
+        vkx::BoxList boxes;
+        boxes.resize((uint32_t)entries.size());
+        for (uint32_t i = 0; i < entries.size(); ++i) {
+            boxes.set(i, entries[i].min, entries[i].max);
+        }
+        vkx::VisibilityMask mask;
+        double linearFrustum = milliseconds(20, [&] {
+            for (const auto& frustum : frustums) {
+                vkx::culling::cullBoxes(frustum, boxes, mask);
+                sink = mask.words[0];
+            }
+        }) / frustums.size();
+        report(name, std::string("frustum linear ") + vkx::culling::isaName(vkx::culling::bestIsa()), entries.size(), linearFrustum);
+        const bool passed = matches(name, frustums, bvh, boxes);
+
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        std::vector<std::pair<glm::vec3, glm::vec3>> rays(1000);
+        for (auto& ray : rays) {
+            ray.first = sceneBounds.center() + sceneBounds.extent() * glm::vec3(unit(random), unit(random), unit(random)) * 0.5f;
+            ray.second = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+        }
+        float maxDistance = glm::length(sceneBounds.extent()) * 2.0f;
+        uint32_t hits = 0;
+        double rayTime = milliseconds(10, [&] {
+            hits = 0;
+            for (const auto& ray : rays) {
+                bvh.queryRay(ray.first, ray.second, maxDistance, [&](uint32_t, float) { ++hits; });
+            }
+        });
+        report(name, "1000 rays", entries.size(), rayTime, std::to_string(hits / rays.size()) + " hits/ray");
+
+        float sphereRadius = glm::length(sceneBounds.extent()) * 0.05f;
+        uint32_t overlaps = 0;
+        double sphereTime = milliseconds(10, [&] {
+            overlaps = 0;
+            for (const auto& ray : rays) {
+                bvh.querySphere(ray.first, sphereRadius, [&](uint32_t) { ++overlaps; });
+            }
+        });
+        report(name, "1000 spheres", entries.size(), sphereTime, std::to_string(overlaps / rays.size()) + " overlaps/sphere");
+        return passed;
+    }
+
+    bool sibenik() {
+        std::string filename = vkx::getAssetPath() + "models/sibenik/sibenik.dae";
+        vkx::MeshLoader loader;
+        try {
+            loader.load(filename);
+        } catch (const std::exception& e) {
+            std::cout << "skipping sibenik: " << e.what() << std::endl;
+            return true;
+        }
+
+        std::vector<vkx::Aabb> triangles;
+        for (const auto& entry : loader.m_Entries) {
+            for (size_t i = 0; i + 2 < entry.Indices.size(); i += 3) {
+                vkx::Aabb box;
+                box.expand(entry.Vertices[entry.Indices[i]].m_pos);
+                box.expand(entry.Vertices[entry.Indices[i + 1]].m_pos);
+                box.expand(entry.Vertices[entry.Indices[i + 2]].m_pos);
+                triangles.push_back(box);
+            }
+        }
+
+        vkx::Bvh bvh;
+        double buildTime = milliseconds(5, [&] { bvh.build(triangles); });
+        report("sibenik", "build", triangles.size(), buildTime, std::to_string(bvh.nodes.size()) + " nodes");
+        return queries("sibenik", triangles, bvh);
+    }
+
+    bool instances(uint32_t count) {
+        vkx::Aabb model(glm::vec3(-1.0f), glm::vec3(1.0f));
+        vkx::MeshLoader loader;
+        try {
+            loader.load(vkx::getAssetPath() + "models/rock01.dae");
+            model = loader.bounds();
+        } catch (const std::exception&) {
+            // Fall back to a unit cube
+        }
+
+        std::mt19937 random(count);
+        std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+        std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+        std::uniform_real_distribution<float> scale(0.5f, 4.0f);
+        std::vector<glm::mat4> transforms(count);
+        std::vector<glm::vec3> velocities(count);
+        std::vector<vkx::Aabb> entries(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            glm::mat4 transform = glm::translate(glm::mat4(), glm::vec3(position(random), position(random) * 0.05f, position(random)));
+            transform = glm::rotate(transform, angle(random), glm::vec3(0.0f, 1.0f, 0.0f));
+            transforms[i] = glm::scale(transform, glm::vec3(scale(random)));
+            velocities[i] = glm::vec3(position(random), 0.0f, position(random)) * 0.001f;
+            entries[i] = model.transformed(transforms[i]);
+        }
+
+        std::string name = "instances";
+        vkx::Bvh bvh;
+        double buildTime = milliseconds(5, [&] { bvh.build(entries); });
+        report(name, "build", count, buildTime, std::to_string(bvh.nodes.size()) + " nodes");
+
+        // Move every instance a little, then refit
+        double refitTime = milliseconds(5, [&] {
+            for (uint32_t i = 0; i < count; ++i) {
+                transforms[i][3] += glm::vec4(velocities[i], 0.0f);
+                entries[i] = model.transformed(transforms[i]);
+            }
+            bvh.refit(entries);
+        });
+        report(name, "move + refit", count, refitTime);
+        return queries(name, entries, bvh);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t maxInstances = 1000000;
+    if (argc > 1) {
+        maxInstances = (uint32_t)atoi(argv[1]);
+    }
+
+    std::cout << std::left << std::setw(12) << "scene" << std::setw(22) << "test" << std::right
+        << std::setw(10) << "entries"
+        << std::setw(12) << "ms" << std::endl;
+    bool passed = sibenik();
+    for (uint32_t count = 10000; count <= maxInstances; count *= 10) {
+        passed = instances(count) && passed;
+    }
+    return passed ? 0 : 1;
+}
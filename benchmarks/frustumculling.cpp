@@ -0,0 +1,185 @@
+/*
+* Compares per object vkTools::Frustum::checkSphere against the batch culling kernels
+* for 1K to 1M objects.
+*
+* Objects are scattered around a camera that turns a little every iteration, so the plane
+* cache sees the same kind of frame to frame coherency as a real scene.  Results are
+* nanoseconds per object (median of the samples).  After timing, every kernel culls against a
+* fixed frustum and its mask has to match the per object tests bit by bit.
+*
+* Usage: benchmark_frustumculling [maxObjects]
+* Exits with 1 if a kernel disagrees with the per object tests.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustumCulling.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx::benchmark;
+using vkx::culling::Isa;
+
+namespace {
+    volatile uint32_t sink{ 0 };
+
+    struct Scene {
+        vkx::SphereList spheres;
+        vkx::BoxList boxes;
+        std::vector<vkTools::Frustum> frustums;
+        uint32_t frame{ 0 };
+
+        Scene(uint32_t count) {
+            std::mt19937 random(count);
+            std::uniform_real_distribution<float> position(-500.0f, 500.0f);
+            std::uniform_real_distribution<float> size(0.5f, 5.0f);
+            spheres.resize(count);
+            boxes.resize(count);
+            for (uint32_t i = 0; i < count; ++i) {
+                glm::vec3 center(position(random), position(random) * 0.1f, position(random));
+                glm::vec3 extent(size(random), size(random), size(random));
+                spheres.set(i, center, glm::length(extent));
+                boxes.set(i, center - extent, center + extent);
+            }
+
+            // A camera turning half a degree per frame
+            glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+            for (uint32_t i = 0; i < 720; ++i) {
+                glm::vec3 direction(sinf(glm::radians(i * 0.5f)), 0.0f, cosf(glm::radians(i * 0.5f)));
+                vkTools::Frustum frustum;
+                frustum.update(projection * glm::lookAt(glm::vec3(0.0f), direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+                frustums.push_back(frustum);
+            }
+        }
+
+        vkTools::Frustum& nextFrustum() {
+            return frustums[frame++ % frustums.size()];
+        }
+    };
+
+    // Nanoseconds per object
+    template <typename F>
+    double measure(uint32_t count, F f) {
+        uint32_t iterations = std::max(5u, std::min(200u, 20000000u / count));
+        return summarize(sample(iterations, 3, f)).median * 1e9 / count;
+    }
+
+    // Per object box test, the extent projected onto each plane normal
+    bool checkBox(const vkTools::Frustum& frustum, const vkx::BoxList& boxes, uint32_t i) {
+        for (const auto& plane : frustum.planes) {
+            float radius = fabsf(plane.x) * boxes.extentX[i] + fabsf(plane.y) * boxes.extentY[i] + fabsf(plane.z) * boxes.extentZ[i];
+            if (plane.x * boxes.x[i] + plane.y * boxes.y[i] + plane.z * boxes.z[i] + plane.w <= -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Compares a kernel's mask with the per object results, reports the first mismatch
+    bool matches(const std::string& name, const vkx::VisibilityMask& visible, const std::vector<bool>& reference) {
+        for (uint32_t i = 0; i < (uint32_t)reference.size(); ++i) {
+            if (visible.isVisible(i) != reference[i]) {
+                std::cout << "FAILED " << name << ": object " << i << " is " << (visible.isVisible(i) ? "visible" : "culled")
+                    << ", expected " << (reference[i] ? "visible" : "culled") << std::endl;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void report(const std::string& name, uint32_t count, double nanoseconds) {
+        std::cout << std::left << std::setw(28) << name << std::right
+            << std::setw(10) << count
+            << std::setw(12) << std::fixed << std::setprecision(3) << nanoseconds << std::endl;
+    }
+
+    bool run(uint32_t count) {
+        Scene scene(count);
+        bool passed = true;
+        vkx::VisibilityMask visible;
+        std::vector<uint32_t> indices;
+
+        std::vector<bool> reference(count);
+        report("checkSphere", count, measure(count, [&] {
+            vkTools::Frustum& frustum = scene.nextFrustum();
+            for (uint32_t i = 0; i < count; ++i) {
+                reference[i] = frustum.checkSphere(glm::vec3(scene.spheres.x[i], scene.spheres.y[i], scene.spheres.z[i]), scene.spheres.radius[i]);
+            }
+        }));
+
+        // Every kernel is checked against the same frustum, the cache is left from the timed runs
+        vkTools::Frustum checkFrustum = scene.frustums[count % scene.frustums.size()];
+        std::vector<bool> boxReference(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            reference[i] = checkFrustum.checkSphere(glm::vec3(scene.spheres.x[i], scene.spheres.y[i], scene.spheres.z[i]), scene.spheres.radius[i]);
+            boxReference[i] = checkBox(checkFrustum, scene.boxes, i);
+        }
+
+        for (Isa isa : { Isa::Scalar, Isa::Sse, Isa::Avx2 }) {
+            if (!vkx::culling::isSupported(isa)) {
+                continue;
+            }
+            std::string name = vkx::culling::isaName(isa);
+            report("spheres " + name, count, measure(count, [&] {
+                vkx::culling::cullSpheres(scene.nextFrustum(), scene.spheres, visible, nullptr, isa);
+            }));
+
+            vkx::PlaneCache cache;
+            report("spheres " + name + " coherent", count, measure(count, [&] {
+                vkx::culling::cullSpheres(scene.nextFrustum(), scene.spheres, visible, &cache, isa);
+            }));
+
+            report("spheres " + name + " compact", count, measure(count, [&] {
+                vkx::culling::cullSpheres(scene.nextFrustum(), scene.spheres, visible, &cache, isa);
+                sink = visible.compact(indices);
+            }));
+
+            vkx::culling::cullSpheres(checkFrustum, scene.spheres, visible, nullptr, isa);
+            passed = matches("spheres " + name, visible, reference) && passed;
+            vkx::culling::cullSpheres(checkFrustum, scene.spheres, visible, &cache, isa);
+            passed = matches("spheres " + name + " coherent", visible, reference) && passed;
+
+            report("boxes " + name, count, measure(count, [&] {
+                vkx::culling::cullBoxes(scene.nextFrustum(), scene.boxes, visible, nullptr, isa);
+            }));
+
+            vkx::PlaneCache boxCache;
+            report("boxes " + name + " coherent", count, measure(count, [&] {
+                vkx::culling::cullBoxes(scene.nextFrustum(), scene.boxes, visible, &boxCache, isa);
+            }));
+
+            vkx::culling::cullBoxes(checkFrustum, scene.boxes, visible, nullptr, isa);
+            passed = matches("boxes " + name, visible, boxReference) && passed;
+            vkx::culling::cullBoxes(checkFrustum, scene.boxes, visible, &boxCache, isa);
+            passed = matches("boxes " + name + " coherent", visible, boxReference) && passed;
+        }
+        return passed;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t maxObjects = 1000000;
+    if (argc > 1) {
+        maxObjects = (uint32_t)atoi(argv[1]);
+    }
+
+    std::cout << "best isa: " << vkx::culling::isaName(vkx::culling::bestIsa()) << std::endl;
+    std::cout << std::left << std::setw(28) << "test" << std::right
+        << std::setw(10) << "objects"
+        << std::setw(12) << "ns/object" << std::endl;
+    bool passed = true;
+    for (uint32_t count = 1000; count <= maxObjects; count *= 10) {
+        passed = run(count) && passed;
+    }
+    return passed ? 0 : 1;
+}
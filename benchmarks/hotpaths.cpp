@@ -0,0 +1,283 @@
+/*
+* Microbenchmarks of the CPU hot paths in base/, none of which need a Vulkan device
+*
+* Frustum update and sphere tests, sphere tesselation, mesh vertex interleaving, text overlay
+* glyph generation, ThreadPool dispatch, camera updates and the easing functions, each at a few
+* sizes.  Every case is warmed up, timed in batches long enough for the clock's resolution not to
+* matter, and summarized after rejecting outliers, see vkx::benchmark::measure().
+*
+* Usage: benchmark_hotpaths [-filter <text>] [-samples N] [-json <file>]
+* -filter only runs cases whose name contains the text, -json also writes the results as JSON.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "frustum.hpp"
+#include "shapes.h"
+#include "vulkanMeshLoader.hpp"
+#include "vulkanTextOverlay.hpp"
+#include "threadPool.hpp"
+#include "camera.hpp"
+#include "easings.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx::benchmark;
+
+namespace {
+    volatile float sink{ 0 };
+
+    struct Result {
+        std::string name;
+        // Items processed per call, results are also reported per item
+        uint64_t size;
+        Measurement measurement;
+    };
+
+    struct Suite {
+        std::string filter;
+        size_t samples{ 50 };
+        std::vector<Result> results;
+
+        template <typename F>
+        void run(const std::string& name, uint64_t size, F f) {
+            if (!filter.empty() && name.find(filter) == std::string::npos) {
+                return;
+            }
+            Result result{ name, size, measure(f, samples) };
+            const Stats& stats = result.measurement.stats;
+            std::cout << std::left << std::setw(32) << name << std::right
+                << std::setw(10) << size
+                << std::setw(14) << std::fixed << std::setprecision(1) << stats.median * 1e9
+                << std::setw(12) << std::setprecision(3) << stats.median * 1e9 / size
+                << std::setw(14) << std::setprecision(1) << stats.p95 * 1e9
+                << std::setw(8) << std::setprecision(1) << result.measurement.variation * 100.0
+                << std::setw(10) << result.measurement.outliers << std::endl;
+            results.push_back(result);
+        }
+
+        bool writeJson(const std::string& filename) const {
+            std::ofstream out(filename);
+            if (!out) {
+                return false;
+            }
+            out << "{\n  \"unit\": \"ns\",\n  \"results\": [";
+            for (size_t i = 0; i < results.size(); ++i) {
+                const auto& result = results[i];
+                const Stats& stats = result.measurement.stats;
+                out << (i ? ",\n" : "\n") << "    { \"name\": " << quote(result.name)
+                    << ", \"size\": " << result.size
+                    << ", \"batch\": " << result.measurement.batch
+                    << ", \"samples\": " << stats.samples
+                    << ", \"outliers\": " << result.measurement.outliers
+                    << ", \"median\": " << stats.median * 1e9
+                    << ", \"mean\": " << stats.mean * 1e9
+                    << ", \"min\": " << stats.min * 1e9
+                    << ", \"p95\": " << stats.p95 * 1e9
+                    << ", \"max\": " << stats.max * 1e9
+                    << ", \"perItem\": " << stats.median * 1e9 / result.size
+                    << ", \"variation\": " << result.measurement.variation << " }";
+            }
+            out << "\n  ]\n}\n";
+            return (bool)out;
+        }
+    };
+
+    void frustum(Suite& suite) {
+        glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 300.0f);
+        std::vector<glm::mat4> views;
+        for (uint32_t i = 0; i < 360; ++i) {
+            glm::vec3 direction(sinf(glm::radians((float)i)), 0.0f, cosf(glm::radians((float)i)));
+            views.push_back(projection * glm::lookAt(glm::vec3(0.0f), direction, glm::vec3(0.0f, 1.0f, 0.0f)));
+        }
+        vkTools::Frustum frustum;
+        uint32_t frame = 0;
+        suite.run("Frustum::update", 1, [&] {
+            frustum.update(views[frame++ % views.size()]);
+        });
+
+        for (uint32_t count : { 1000u, 10000u, 100000u }) {
+            std::mt19937 random(count);
+            std::uniform_real_distribution<float> position(-300.0f, 300.0f);
+            std::vector<glm::vec4> spheres(count);
+            for (auto& sphere : spheres) {
+                sphere = glm::vec4(position(random), position(random) * 0.1f, position(random), 2.0f);
+            }
+            frustum.update(views[0]);
+            suite.run("Frustum::checkSphere", count, [&] {
+                uint32_t visible = 0;
+                for (const auto& sphere : spheres) {
+                    visible += frustum.checkSphere(glm::vec3(sphere), sphere.w) ? 1 : 0;
+                }
+                sink = (float)visible;
+            });
+        }
+    }
+
+    void tesselate(Suite& suite) {
+        for (int count : { 1, 3, 5 }) {
+            // Triangles of the result
+            uint64_t triangles = geometry::icosahedron().faces.size() << (2 * count);
+            suite.run("geometry::tesselate " + std::to_string(count), triangles, [&] {
+                sink = (float)geometry::tesselate(geometry::icosahedron(), count).vertices.size();
+            });
+        }
+    }
+
+    void meshBuffers(Suite& suite) {
+        const vkx::MeshLayout positionNormalUv{ vkx::VERTEX_LAYOUT_POSITION, vkx::VERTEX_LAYOUT_NORMAL, vkx::VERTEX_LAYOUT_UV };
+        const vkx::MeshLayout full{ vkx::VERTEX_LAYOUT_POSITION, vkx::VERTEX_LAYOUT_NORMAL, vkx::VERTEX_LAYOUT_UV,
+            vkx::VERTEX_LAYOUT_COLOR, vkx::VERTEX_LAYOUT_TANGENT, vkx::VERTEX_LAYOUT_BITANGENT };
+        std::vector<float> vertices;
+        std::vector<uint32_t> indices;
+        for (int detail : { 2, 4, 6 }) {
+            // A tesselated sphere standing in for a loaded model
+            const auto sphere = geometry::tesselate(geometry::icosahedron(), detail);
+            vkx::MeshLoader loader;
+            loader.m_Entries.resize(1);
+            auto& entry = loader.m_Entries[0];
+            entry.Vertices.resize(sphere.vertices.size());
+            for (size_t i = 0; i < sphere.vertices.size(); ++i) {
+                entry.Vertices[i].m_pos = sphere.vertices[i];
+                entry.Vertices[i].m_normal = glm::normalize(sphere.vertices[i]);
+                entry.Vertices[i].m_tex = glm::vec2(sphere.vertices[i]);
+                entry.Vertices[i].m_color = glm::vec3(1.0f);
+                entry.Vertices[i].m_tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+                entry.Vertices[i].m_binormal = glm::vec3(0.0f, 1.0f, 0.0f);
+            }
+            for (const auto& face : sphere.faces) {
+                entry.Indices.insert(entry.Indices.end(), face.begin(), face.end());
+            }
+            const uint64_t vertexCount = sphere.vertices.size();
+            suite.run("MeshLoader::createBuffers pnu", vertexCount, [&] {
+                loader.fillBuffers(positionNormalUv, 1.0f, vertices, indices);
+            });
+            suite.run("MeshLoader::createBuffers full", vertexCount, [&] {
+                loader.fillBuffers(full, 1.0f, vertices, indices);
+            });
+        }
+    }
+
+    void textOverlay(Suite& suite) {
+        static stb_fontchar fontData[STB_NUM_CHARS];
+        static unsigned char fontPixels[STB_FONT_HEIGHT][STB_FONT_WIDTH];
+        STB_FONT_NAME(fontData, fontPixels, STB_FONT_HEIGHT);
+        for (uint32_t length : { 16u, 64u, 256u }) {
+            std::string text;
+            for (uint32_t i = 0; i < length; ++i) {
+                text += (char)(' ' + 1 + i % 94);
+            }
+            std::vector<glm::vec4> quads(length * 4);
+            suite.run("TextOverlay::addText", length, [&] {
+                vkx::TextOverlay::generateGlyphs(fontData, text, 5.0f, 5.0f, vkx::TextOverlay::alignCenter, 1280, 720, quads.data());
+                sink = quads[0].x;
+            });
+        }
+    }
+
+    void threadPool(Suite& suite) {
+        const uint32_t threads = std::max(1u, std::thread::hardware_concurrency());
+        vkx::ThreadPool pool;
+        pool.setThreadCount(threads);
+        std::atomic<uint32_t> done{ 0 };
+        for (uint32_t jobs : { 16u, 256u, 4096u }) {
+            suite.run("ThreadPool dispatch x" + std::to_string(threads), jobs, [&] {
+                for (uint32_t job = 0; job < jobs; ++job) {
+                    pool.threads[job % threads]->addJob([&done] { done.fetch_add(1, std::memory_order_relaxed); });
+                }
+                pool.wait();
+            });
+        }
+    }
+
+    void camera(Suite& suite) {
+        Camera camera;
+        camera.type = Camera::CameraType::firstperson;
+        camera.setPerspective(60.0f, 16.0f / 9.0f);
+        camera.keys.up = true;
+        camera.keys.left = true;
+        suite.run("Camera::update firstperson", 1, [&] {
+            camera.rotate(glm::vec2(0.001f, 0.0f));
+            camera.update(1.0f / 60.0f);
+        });
+
+        Camera orbit;
+        orbit.setZoom(-5.0f);
+        suite.run("Camera::rotate lookat", 1, [&] {
+            orbit.rotate(glm::vec2(0.001f, 0.0005f));
+        });
+    }
+
+    void easingFunctions(Suite& suite) {
+        const uint32_t count = 1024;
+        const std::pair<const char*, float (*)(float)> functions[] = {
+            { "inOutQuad", [](float t) { return easings::inOutQuad(t); } },
+            { "inOutCubic", [](float t) { return easings::inOutCubic(t); } },
+            { "inOutSine", [](float t) { return easings::inOutSine(t); } },
+            { "inOutExpo", [](float t) { return easings::inOutExpo(t); } },
+            { "inOutElastic", [](float t) { return easings::inOutElastic(t); } },
+            { "inOutBack", [](float t) { return easings::inOutBack(t); } },
+            { "inOutBounce", [](float t) { return easings::inOutBounce(t); } },
+        };
+        for (const auto& function : functions) {
+            auto f = function.second;
+            suite.run(std::string("easings::") + function.first, count, [&] {
+                float sum = 0;
+                for (uint32_t i = 0; i < count; ++i) {
+                    sum += f((float)i / (count - 1));
+                }
+                sink = sum;
+            });
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    Suite suite;
+    std::string jsonFile;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (0 == strcmp(argv[i], "-filter")) {
+            suite.filter = argv[i + 1];
+        } else if (0 == strcmp(argv[i], "-samples")) {
+            suite.samples = std::max(1, atoi(argv[i + 1]));
+        } else if (0 == strcmp(argv[i], "-json")) {
+            jsonFile = argv[i + 1];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-filter <text>] [-samples N] [-json <file>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << std::left << std::setw(32) << "test" << std::right
+        << std::setw(10) << "size"
+        << std::setw(14) << "ns/call"
+        << std::setw(12) << "ns/item"
+        << std::setw(14) << "p95 ns/call"
+        << std::setw(8) << "cv %"
+        << std::setw(10) << "outliers" << std::endl;
+    frustum(suite);
+    tesselate(suite);
+    meshBuffers(suite);
+    textOverlay(suite);
+    threadPool(suite);
+    camera(suite);
+    easingFunctions(suite);
+
+    if (!jsonFile.empty() && !suite.writeJson(jsonFile)) {
+        std::cerr << "Could not write " << jsonFile << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,197 @@
+/*
+* Checks and times vkx::SoftwareOcclusion
+*
+* A fixed set of boxes is tested against a single wall, each with a known result, including a
+* wall between the camera and the near plane that has to be clipped away rather than hide the
+* scene.  Every case runs with the scalar and the SSE rasterizer, single threaded and on a pool.
+* Then a small city of occluders is rasterized and a cloud of occludee boxes tested against it,
+* reporting milliseconds per call (median of the samples).  The scenes come from a fixed
+* generator, so results don't depend on the platform.
+*
+* Usage: benchmark_softwareocclusion
+* Exits with 1 if a check fails.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdint.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "softwareOcclusion.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx::benchmark;
+using vkx::culling::Isa;
+
+namespace {
+    const uint32_t WIDTH = 256;
+    const uint32_t HEIGHT = 128;
+    const float NEAR_PLANE = 0.1f;
+
+    // Small LCG, unlike the <random> distributions its output is the same everywhere
+    struct Random {
+        uint32_t state;
+        float next(float min, float max) {
+            state = state * 1664525u + 1013904223u;
+            return min + (max - min) * (float)(state >> 8) / (float)(1u << 24);
+        }
+    };
+
+    // Cube from -1 to 1, placed and sized by the occluder's model matrix
+    vkx::OccluderMesh cubeMesh() {
+        vkx::OccluderMesh mesh;
+        for (uint32_t i = 0; i < 8; ++i) {
+            mesh.positions.push_back(glm::vec3((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? 1.0f : -1.0f));
+        }
+        mesh.indices = {
+            0, 1, 3, 0, 3, 2,  4, 6, 7, 4, 7, 5,
+            0, 4, 5, 0, 5, 1,  2, 3, 7, 2, 7, 6,
+            0, 2, 6, 0, 6, 4,  1, 5, 7, 1, 7, 3,
+        };
+        return mesh;
+    }
+
+    vkx::Occluder box(const vkx::OccluderMesh& mesh, const glm::vec3& center, const glm::vec3& extent) {
+        vkx::Occluder occluder;
+        occluder.mesh = &mesh;
+        occluder.model = glm::scale(glm::translate(glm::mat4(), center), extent);
+        return occluder;
+    }
+
+    // Camera at the origin looking down -z
+    glm::mat4 viewProjection() {
+        return glm::perspective(glm::radians(60.0f), (float)WIDTH / (float)HEIGHT, NEAR_PLANE, 200.0f);
+    }
+
+    struct Case {
+        const char* name;
+        glm::vec3 center;
+        glm::vec3 extent;
+        bool visible;
+    };
+
+    struct Scene {
+        const char* name;
+        std::vector<vkx::Occluder> occluders;
+        std::vector<Case> cases;
+    };
+
+    std::vector<Scene> checkScenes(const vkx::OccluderMesh& mesh) {
+        std::vector<Scene> scenes;
+        scenes.push_back({ "wall", { box(mesh, { 0.0f, 0.0f, -10.0f }, { 5.0f, 5.0f, 0.1f }) }, {
+            { "behind", { 0.0f, 0.0f, -20.0f }, glm::vec3(1.0f), false },
+            { "in front", { 0.0f, 0.0f, -5.0f }, glm::vec3(0.5f), true },
+            { "partly behind", { 9.0f, 0.0f, -20.0f }, glm::vec3(1.0f), true },
+            { "beside", { 20.0f, 0.0f, -30.0f }, glm::vec3(1.0f), true },
+            { "crossing near plane", { 0.0f, 0.0f, 0.0f }, glm::vec3(1.0f), true },
+            { "outside viewport", { 0.0f, 50.0f, -20.0f }, glm::vec3(1.0f), false },
+        } });
+        // In front of the near plane but at a positive w, it must be clipped away entirely
+        scenes.push_back({ "wall before near plane", { box(mesh, { 0.0f, 0.0f, -NEAR_PLANE * 0.5f }, { 5.0f, 5.0f, NEAR_PLANE * 0.1f }) }, {
+            { "behind", { 0.0f, 0.0f, -20.0f }, glm::vec3(1.0f), true },
+        } });
+        return scenes;
+    }
+
+    bool check(const Scene& scene, Isa isa, vkx::WorkStealingPool* pool) {
+        vkx::SoftwareOcclusion occlusion;
+        occlusion.isa = isa;
+        occlusion.setResolution(WIDTH, HEIGHT);
+        occlusion.rasterize(viewProjection(), scene.occluders, pool);
+
+        vkx::BoxList boxes;
+        for (const auto& c : scene.cases) {
+            boxes.add(c.center - c.extent, c.center + c.extent);
+        }
+        vkx::VisibilityMask visible;
+        occlusion.testBoxes(boxes, visible, pool);
+
+        bool passed = true;
+        for (uint32_t i = 0; i < scene.cases.size(); ++i) {
+            const Case& c = scene.cases[i];
+            if (visible.isVisible(i) != c.visible || occlusion.isVisible(c.center - c.extent, c.center + c.extent) != c.visible) {
+                std::cout << "FAILED " << scene.name << " / " << c.name << " with " << vkx::culling::isaName(isa)
+                    << (pool ? " threaded" : "") << ": expected " << (c.visible ? "visible" : "occluded") << std::endl;
+                passed = false;
+            }
+        }
+        return passed;
+    }
+
+    // A grid of buildings behind a wall, and boxes scattered through it
+    void city(const vkx::OccluderMesh& mesh, std::vector<vkx::Occluder>& occluders, vkx::BoxList& boxes) {
+        occluders.push_back(box(mesh, { 0.0f, 0.0f, -10.0f }, { 5.0f, 5.0f, 0.1f }));
+        for (uint32_t x = 0; x < 8; ++x) {
+            for (uint32_t z = 0; z < 8; ++z) {
+                float height = 6.0f + (float)((x * 7 + z * 3) % 5) * 2.0f;
+                occluders.push_back(box(mesh, { ((float)x - 3.5f) * 12.0f, height - 8.0f, -15.0f - (float)z * 12.0f }, { 3.0f, height, 3.0f }));
+            }
+        }
+        Random random{ 1 };
+        for (uint32_t i = 0; i < 16384; ++i) {
+            glm::vec3 center(random.next(-60.0f, 60.0f), random.next(-5.0f, 5.0f), random.next(-110.0f, -5.0f));
+            glm::vec3 extent(random.next(0.2f, 1.5f), random.next(0.2f, 1.5f), random.next(0.2f, 1.5f));
+            boxes.add(center - extent, center + extent);
+        }
+    }
+
+    void report(const std::string& name, double rasterize, double test, uint32_t triangles, uint32_t visible) {
+        std::cout << std::left << std::setw(20) << name << std::right << std::fixed << std::setprecision(3)
+            << std::setw(14) << rasterize * 1e3
+            << std::setw(14) << test * 1e3
+            << std::setw(12) << triangles
+            << std::setw(12) << visible << std::endl;
+    }
+}
+
+int main() {
+    vkx::WorkStealingPool pool;
+    const vkx::OccluderMesh mesh = cubeMesh();
+    std::vector<Isa> isas = { Isa::Scalar };
+    if (vkx::culling::isSupported(Isa::Sse)) {
+        isas.push_back(Isa::Sse);
+    }
+
+    bool passed = true;
+    for (const auto& scene : checkScenes(mesh)) {
+        for (Isa isa : isas) {
+            passed = check(scene, isa, nullptr) && passed;
+            passed = check(scene, isa, &pool) && passed;
+        }
+    }
+    std::cout << "checks " << (passed ? "ok" : "FAILED") << std::endl;
+
+    std::vector<vkx::Occluder> occluders;
+    vkx::BoxList boxes;
+    city(mesh, occluders, boxes);
+    std::cout << std::left << std::setw(20) << "test" << std::right
+        << std::setw(14) << "rasterize ms"
+        << std::setw(14) << "test ms"
+        << std::setw(12) << "triangles"
+        << std::setw(12) << "visible" << std::endl;
+    for (Isa isa : isas) {
+        for (vkx::WorkStealingPool* threadPool : { (vkx::WorkStealingPool*)nullptr, &pool }) {
+            vkx::SoftwareOcclusion occlusion;
+            occlusion.isa = isa;
+            occlusion.setResolution(WIDTH, HEIGHT);
+            vkx::VisibilityMask visible;
+            double rasterize = summarize(sample(50, 5, [&] {
+                occlusion.rasterize(viewProjection(), occluders, threadPool);
+            })).median;
+            double test = summarize(sample(50, 5, [&] {
+                occlusion.testBoxes(boxes, visible, threadPool);
+            })).median;
+            std::string name = vkx::culling::isaName(isa);
+            if (threadPool) {
+                name += " x" + std::to_string(threadPool->threadCount());
+            }
+            report(name, rasterize, test, occlusion.stats.triangles, visible.visibleCount());
+        }
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+/*
+* Compares vkx::ThreadPool (per-thread queues, caller picks the thread) against
+* vkx::WorkStealingPool for 1 to N threads.
+*
+* Throughput: many small jobs, and an imbalanced mix where every 16th job is much heavier.
+* Latency: time from submitting a single job until it starts running on a worker.
+*
+* Usage: benchmark_threadpool [maxThreads] [jobCount]
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "threadPool.hpp"
+#include "workStealingPool.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx::benchmark;
+
+namespace {
+    std::atomic<uint64_t> sink{ 0 };
+
+    void spin(uint32_t iterations) {
+        uint64_t value = iterations;
+        for (uint32_t i = 0; i < iterations; ++i) {
+            value = value * 6364136223846793005ull + 1442695040888963407ull;
+        }
+        sink.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    uint32_t jobCost(uint32_t job, bool imbalanced) {
+        return (imbalanced && (job % 16) == 0) ? 20000 : 200;
+    }
+
+    // Adapters so both pools can be driven by the same benchmark code
+    struct QueuePool {
+        vkx::ThreadPool pool;
+        uint32_t next{ 0 };
+        QueuePool(uint32_t threads) { pool.setThreadCount(threads); }
+        template <typename F> void submit(F f) { pool.threads[next++ % pool.threads.size()]->addJob(f); }
+        void wait() { pool.wait(); }
+    };
+
+    struct StealingPool {
+        vkx::WorkStealingPool pool;
+        StealingPool(uint32_t threads) : pool(threads) {}
+        template <typename F> void submit(F f) { pool.submit(f); }
+        void wait() { pool.wait(); }
+    };
+
+    template <typename Pool>
+    double throughput(Pool& pool, uint32_t jobCount, bool imbalanced) {
+        auto samples = sample(5, 1, [&] {
+            for (uint32_t job = 0; job < jobCount; ++job) {
+                uint32_t cost = jobCost(job, imbalanced);
+                pool.submit([cost] { spin(cost); });
+            }
+            pool.wait();
+        });
+        return jobCount / summarize(samples).median;
+    }
+
+    template <typename Pool>
+    Stats latency(Pool& pool, uint32_t iterations) {
+        std::vector<double> samples;
+        samples.reserve(iterations);
+        for (uint32_t i = 0; i < iterations; ++i) {
+            std::atomic<int64_t> started{ 0 };
+            auto submitted = Clock::now();
+            pool.submit([&started] { started = Clock::now().time_since_epoch().count(); });
+            // Spin instead of calling wait() right away, since the stealing pool would run the job on this thread
+            while (!started.load()) {
+                std::this_thread::yield();
+            }
+            pool.wait();
+            samples.push_back(seconds(submitted, Clock::time_point(Clock::duration(started.load()))));
+        }
+        return summarize(samples);
+    }
+
+    template <typename Pool>
+    void run(const char* name, uint32_t threads, uint32_t jobCount) {
+        Pool pool(threads);
+        double uniform = throughput(pool, jobCount, false);
+        double imbalanced = throughput(pool, jobCount, true);
+        Stats delay = latency(pool, 1000);
+        std::cout << std::left << std::setw(14) << name << std::right
+            << std::setw(8) << threads
+            << std::setw(16) << std::fixed << std::setprecision(0) << uniform
+            << std::setw(16) << imbalanced
+            << std::setw(14) << std::setprecision(1) << delay.median * 1e6
+            << std::setw(14) << delay.p99 * 1e6 << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    uint32_t jobCount = 100000;
+    if (argc > 1) {
+        maxThreads = (uint32_t)atoi(argv[1]);
+    }
+    if (argc > 2) {
+        jobCount = (uint32_t)atoi(argv[2]);
+    }
+
+    std::cout << std::left << std::setw(14) << "pool" << std::right
+        << std::setw(8) << "threads"
+        << std::setw(16) << "jobs/s"
+        << std::setw(16) << "imbalanced/s"
+        << std::setw(14) << "latency us"
+        << std::setw(14) << "p99 us" << std::endl;
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threads = 1; threads < maxThreads; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    for (uint32_t threads : threadCounts) {
+        run<QueuePool>("ThreadPool", threads, jobCount);
+        run<StealingPool>("WorkStealing", threads, jobCount);
+    }
+    return 0;
+}
@@ -0,0 +1,21 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec3 inEyePos;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	// y points down, the light comes from above
+	vec3 L = normalize(vec3(0.4, -1.0, 0.25));
+	float diffuse = max(dot(normalize(inNormal), L), 0.0) * 0.8 + 0.2;
+
+	// Fade distant buildings into the clear color
+	float fog = clamp(length(inEyePos) / 600.0, 0.0, 1.0);
+	outFragColor = vec4(mix(inColor * diffuse, vec3(0.025), fog), 1.0);
+}
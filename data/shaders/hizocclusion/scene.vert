@@ -0,0 +1,45 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Unit cube, -1 .. 1
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+
+// Index into the instance buffer, written by the culling shader
+layout (location = 4) in uint instanceIndex;
+
+layout (binding = 0) uniform UBO
+{
+	mat4 projection;
+	mat4 view;
+} ubo;
+
+struct Instance
+{
+	vec4 center;
+	vec4 extent;
+};
+
+layout (std430, binding = 1) readonly buffer Instances
+{
+	Instance instances[ ];
+};
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec3 outEyePos;
+
+void main()
+{
+	Instance instance = instances[instanceIndex];
+	vec4 pos = vec4(instance.center.xyz + inPos * instance.extent.xyz, 1.0);
+
+	// Cheap per instance tint
+	uint hash = instanceIndex * 2654435761u;
+	outColor = vec3(0.55) + 0.35 * vec3((hash >> 8) & 0xFF, (hash >> 16) & 0xFF, (hash >> 24) & 0xFF) / 255.0;
+	outNormal = inNormal;
+	outEyePos = vec3(ubo.view * pos);
+	gl_Position = ubo.projection * ubo.view * pos;
+}
@@ -0,0 +1,47 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+struct Material
+{
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+	float opacity;
+	uint textureIndex;
+};
+
+layout (set = 0, binding = 1) readonly buffer Materials
+{
+	Material materials[];
+};
+
+layout (set = 1, binding = 0) uniform sampler2D textures[];
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inViewVec;
+layout (location = 4) in vec3 inLightVec;
+
+layout(push_constant) uniform PushConsts 
+{
+	uint materialIndex;
+} pushConsts;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	Material material = materials[pushConsts.materialIndex];
+	vec4 color = texture(textures[material.textureIndex], inUV) * vec4(inColor, 1.0);
+	vec3 N = normalize(inNormal);
+	vec3 L = normalize(inLightVec);
+	vec3 V = normalize(inViewVec);
+	vec3 R = reflect(-L, N);
+	vec3 diffuse = max(dot(N, L), 0.0) * material.diffuse.rgb;
+	vec3 specular = pow(max(dot(R, V), 0.0), 16.0) * material.specular.rgb;
+	outFragColor = vec4((material.ambient.rgb + diffuse) * color.rgb + specular, 1.0-material.opacity);
+}
@@ -180,9 +180,6 @@ public:
         vkx::Texture textureTarget;
     } offscreenFrameBuf;
 
-    vk::Semaphore offscreenSemaphore;
-    vk::CommandBuffer offscreenCmdBuffer;
-
     // Random tag data
     struct {
         const char name[17] = "debug marker tag";
@@ -379,18 +376,16 @@ public:
 
         ExampleBase::flushCommandBuffer(cmdBuffer, true);
 
-        // Command buffer for offscreen rendering
-        offscreenCmdBuffer = ExampleBase::createCommandBuffer(vk::CommandBufferLevel::ePrimary, false);
-
         // Name for debugging
         DebugMarker::setObjectName(device, (uint64_t)(VkImage)offscreenFrameBuf.color.image, VK_DEBUG_REPORT_OBJECT_TYPE_IMAGE_EXT, "Off-screen color framebuffer");
         DebugMarker::setObjectName(device, (uint64_t)(VkImage)offscreenFrameBuf.depth.image, VK_DEBUG_REPORT_OBJECT_TYPE_IMAGE_EXT, "Off-screen depth framebuffer");
     }
 
-    // Command buffer for rendering color only scene for glow
-    void buildOffscreenCommandBuffer() {
-        vk::CommandBufferBeginInfo cmdBufInfo;
-        cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
+    // Renders the color only scene for glow, ahead of the main render pass of the frame
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        if (!glow) {
+            return;
+        }
 
         vk::ClearValue clearValues[2];
         clearValues[0].color = vkx::clearColor(glm::vec4(0));
@@ -404,30 +399,28 @@ public:
         renderPassBeginInfo.clearValueCount = 2;
         renderPassBeginInfo.pClearValues = clearValues;
 
-        offscreenCmdBuffer.begin(cmdBufInfo);
-
-        // Start a new debug marker region
-        DebugMarker::beginRegion(offscreenCmdBuffer, "Off-screen scene rendering", glm::vec4(1.0f, 0.78f, 0.05f, 1.0f));
+        // Start a new debug marker region, timed by the GPU profiler
+        vkx::GpuProfiler::Scope scope(gpuProfiler, cmdBuffer, "Off-screen scene rendering", glm::vec4(1.0f, 0.78f, 0.05f, 1.0f));
 
         vk::Viewport viewport = vkx::viewport((float)offscreenFrameBuf.width, (float)offscreenFrameBuf.height, 0.0f, 1.0f);
-        offscreenCmdBuffer.setViewport(0, viewport);
+        cmdBuffer.setViewport(0, viewport);
 
         vk::Rect2D scissor = vkx::rect2D(offscreenFrameBuf.width, offscreenFrameBuf.height, 0, 0);
-        offscreenCmdBuffer.setScissor(0, scissor);
+        cmdBuffer.setScissor(0, scissor);
 
-        offscreenCmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+        cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
 
-        offscreenCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.scene, nullptr);
-        offscreenCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.color);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.scene, nullptr);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.color);
 
         // Draw glow scene
-        sceneGlow.draw(offscreenCmdBuffer);
+        sceneGlow.draw(cmdBuffer);
 
-        offscreenCmdBuffer.endRenderPass();
+        cmdBuffer.endRenderPass();
 
         // Make sure color writes to the framebuffer are finished before using it as transfer source
         vkx::setImageLayout(
-            offscreenCmdBuffer,
+            cmdBuffer,
             offscreenFrameBuf.color.image,
             vk::ImageAspectFlagBits::eColor,
             vk::ImageLayout::eColorAttachmentOptimal,
@@ -435,7 +428,7 @@ public:
 
         // Transform texture target to transfer destination
         vkx::setImageLayout(
-            offscreenCmdBuffer,
+            cmdBuffer,
             offscreenFrameBuf.textureTarget.image,
             vk::ImageAspectFlagBits::eColor,
             vk::ImageLayout::eShaderReadOnlyOptimal,
@@ -460,11 +453,11 @@ public:
 
         // Blit from framebuffer image to texture image
         // vkCmdBlitImage does scaling and (if necessary and possible) also does format conversions
-        offscreenCmdBuffer.blitImage(offscreenFrameBuf.color.image, vk::ImageLayout::eTransferSrcOptimal, offscreenFrameBuf.textureTarget.image, vk::ImageLayout::eTransferDstOptimal, imgBlit, vk::Filter::eLinear);
+        cmdBuffer.blitImage(offscreenFrameBuf.color.image, vk::ImageLayout::eTransferSrcOptimal, offscreenFrameBuf.textureTarget.image, vk::ImageLayout::eTransferDstOptimal, imgBlit, vk::Filter::eLinear);
 
         // Transform framebuffer color attachment back 
         vkx::setImageLayout(
-            offscreenCmdBuffer,
+            cmdBuffer,
             offscreenFrameBuf.color.image,
             vk::ImageAspectFlagBits::eColor,
             vk::ImageLayout::eTransferSrcOptimal,
@@ -474,15 +467,11 @@ public:
         // Makes sure that writes to the texture are finished before
         // it's accessed in the shader
         vkx::setImageLayout(
-            offscreenCmdBuffer,
+            cmdBuffer,
             offscreenFrameBuf.textureTarget.image,
             vk::ImageAspectFlagBits::eColor,
             vk::ImageLayout::eTransferDstOptimal,
             vk::ImageLayout::eShaderReadOnlyOptimal);
-
-        DebugMarker::endRegion(offscreenCmdBuffer);
-
-        offscreenCmdBuffer.end();
     }
 
     // Load a model file as separate meshes into a scene
@@ -571,8 +560,8 @@ public:
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
 
-        // Start a new debug marker region
-        DebugMarker::beginRegion(cmdBuffer, "Render scene", glm::vec4(0.5f, 0.76f, 0.34f, 1.0f));
+        // Start a new debug marker region, timed by the GPU profiler
+        vkx::GpuProfiler::Scope sceneScope(gpuProfiler, cmdBuffer, "Render scene", glm::vec4(0.5f, 0.76f, 0.34f, 1.0f));
 
         cmdBuffer.setViewport(0, vkx::viewport(size));
 
@@ -584,25 +573,24 @@ public:
         // Solid rendering
 
         // Start a new debug marker region
-        DebugMarker::beginRegion(cmdBuffer, "Toon shading draw", glm::vec4(0.78f, 0.74f, 0.9f, 1.0f));
-
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.toonshading);
-        scene.draw(cmdBuffer);
-
-        DebugMarker::endRegion(cmdBuffer);
+        {
+            vkx::GpuProfiler::Scope scope(gpuProfiler, cmdBuffer, "Toon shading draw", glm::vec4(0.78f, 0.74f, 0.9f, 1.0f));
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.toonshading);
+            scene.draw(cmdBuffer);
+        }
 
         // Wireframe rendering
         if (wireframe) {
             // Insert debug marker
-            DebugMarker::beginRegion(cmdBuffer, "Wireframe draw", glm::vec4(0.53f, 0.78f, 0.91f, 1.0f));
+            {
+                vkx::GpuProfiler::Scope scope(gpuProfiler, cmdBuffer, "Wireframe draw", glm::vec4(0.53f, 0.78f, 0.91f, 1.0f));
 
-            scissor.offset.x = size.width / 2;
-            cmdBuffer.setScissor(0, scissor);
-
-            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.wireframe);
-            scene.draw(cmdBuffer);
+                scissor.offset.x = size.width / 2;
+                cmdBuffer.setScissor(0, scissor);
 
-            DebugMarker::endRegion(cmdBuffer);
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.wireframe);
+                scene.draw(cmdBuffer);
+            }
 
             scissor.offset.x = 0;
             scissor.extent.width = size.width;
@@ -611,17 +599,12 @@ public:
 
         // Post processing
         if (glow) {
-            DebugMarker::beginRegion(cmdBuffer, "Apply post processing", glm::vec4(0.93f, 0.89f, 0.69f, 1.0f));
+            vkx::GpuProfiler::Scope scope(gpuProfiler, cmdBuffer, "Apply post processing", glm::vec4(0.93f, 0.89f, 0.69f, 1.0f));
 
             cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.postprocess);
             // Full screen quad is generated by the vertex shaders, so we reuse four vertices (for four invocations) from current vertex buffer
             cmdBuffer.draw(4, 1, 0, 0);
-
-            DebugMarker::endRegion(cmdBuffer);
         }
-
-        // End current debug marker region
-        DebugMarker::endRegion(cmdBuffer);
     }
 
     void setupVertexDescriptions() {
@@ -847,29 +830,8 @@ public:
         uniformData.vsScene.copy(uboVS);
     }
 
-    void draw() override {
-        prepareFrame();
-
-        // Submit offscreen rendering command buffer
-        // todo : use event to ensure that offscreen result is finished bfore render command buffer is started
-        if (glow) {
-            vk::SubmitInfo submitInfo;
-            submitInfo.pWaitDstStageMask = this->submitInfo.pWaitDstStageMask;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &offscreenCmdBuffer;
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = &semaphores.acquireComplete;
-            submitInfo.signalSemaphoreCount = 1;
-            submitInfo.pSignalSemaphores = &offscreenSemaphore;
-            queue.submit(submitInfo, VK_NULL_HANDLE);
-        }
-        drawCurrentCommandBuffer(glow ? offscreenSemaphore : vk::Semaphore());
-        submitFrame();
-    }
-
     void prepare() {
         ExampleBase::prepare();
-        offscreenSemaphore = device.createSemaphore(vk::SemaphoreCreateInfo());
         DebugMarker::setup(device);
         loadScene();
         prepareOffscreen();
@@ -879,7 +841,6 @@ public:
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
-        buildOffscreenCommandBuffer();
         updateDrawCommandBuffers();
         prepared = true;
     }
@@ -904,6 +865,7 @@ public:
         case GLFW_KEY_G:
         case GAMEPAD_BUTTON_A:
             glow = !glow;
+            primaryCmdBuffersDirty = true;
             updateDrawCommandBuffers();
             break;
         }
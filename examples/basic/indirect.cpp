@@ -5,9 +5,11 @@
 */
 
 #include "vulkanExampleBase.h"
+#include "vulkanInstanceCulling.hpp"
 #include "shapes.h"
 #include "easings.hpp"
 #include <glm/gtc/quaternion.hpp>
+#include <map>
 
 #define SHAPES_COUNT 5
 #define INSTANCES_PER_SHAPE 4000
@@ -59,6 +61,18 @@ public:
     } pipelines;
 
     std::vector<ShapeVertexData> shapes;
+    // Bounding sphere radius of each shape at instance scale 1
+    std::vector<float> shapeRadii;
+
+    // Frustum culls the instances on the GPU and writes the surviving instance counts
+    vkx::InstanceCuller culler{ *this };
+    bool gpuCulling{ true };
+
+    // Records one draw per instance instead of the indirect draws, re-recorded every frame to load
+    // the CPU with command recording.  The draws are split across drawCmdBufferParts secondaries.
+    bool directDraws{ false };
+    // Measured recording time per frame for each part count, to show how recording scales with cores
+    std::map<uint32_t, float> recordTimes;
 
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSet descriptorSet;
@@ -68,20 +82,37 @@ public:
         camera.setZoom(-1.0f);
         rotationSpeed = 0.25f;
         title = "Vulkan Example - Instanced mesh rendering";
-        srand(time(NULL));
+        enableTextOverlay = true;
+        srand(randomSeed());
     }
 
     ~VulkanExample() {
         device.destroyPipeline(pipelines.solid);
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
+        culler.destroy();
         instanceBuffer.destroy();
         indirectBuffer.destroy();
         uniformData.vsScene.destroy();
         meshes.destroy();
     }
 
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        if (gpuCulling && !directDraws) {
+            culler.record(cmdBuffer);
+        }
+    }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        updateDrawCommandBuffer(cmdBuffer, 0, 1);
+    }
+
+    // Called on the record threads when the draws are split, so it only reads shared state
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer, uint32_t part, uint32_t partCount) override {
+        const bool culled = gpuCulling && !directDraws;
+        if (!directDraws && part != 0) {
+            return;
+        }
         cmdBuffer.setViewport(0, vkx::viewport(size));
         cmdBuffer.setScissor(0, vkx::rect2D(size));
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
@@ -89,13 +120,19 @@ public:
         // Binding point 0 : Mesh vertex buffer
         cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.buffer, { 0 });
         // Binding point 1 : Instance data buffer
-        cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, instanceBuffer.buffer, { 0 });
-        // Equivlant non-indirect commands:
-        //for (size_t j = 0; j < SHAPES_COUNT; ++j) {
-        //    auto shape = shapes[j];
-        //    cmdBuffer.draw(shape.vertices, INSTANCES_PER_SHAPE, shape.baseVertex, j * INSTANCES_PER_SHAPE);
-        //}
-        cmdBuffer.drawIndirect(indirectBuffer.buffer, 0, SHAPES_COUNT, sizeof(vk::DrawIndirectCommand));
+        // The culled buffers are compacted copies of the source buffers
+        cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, culled ? culler.culledInstances.buffer : instanceBuffer.buffer, { 0 });
+        if (directDraws) {
+            // Equivalent non-indirect commands, one draw per instance, each part taking a contiguous range
+            uint32_t begin = INSTANCE_COUNT * part / partCount;
+            uint32_t end = INSTANCE_COUNT * (part + 1) / partCount;
+            for (uint32_t instance = begin; instance < end; ++instance) {
+                const auto& shape = shapes[instance / INSTANCES_PER_SHAPE];
+                cmdBuffer.draw(shape.vertices, 1, shape.baseVertex, instance);
+            }
+            return;
+        }
+        cmdBuffer.drawIndirect(culled ? culler.indirect.buffer : indirectBuffer.buffer, 0, SHAPES_COUNT, sizeof(vk::DrawIndirectCommand));
     }
 
     template<size_t N>
@@ -126,6 +163,12 @@ public:
         }
         shape.vertices = vertices.size() - shape.baseVertex;
         shapes.push_back(shape);
+
+        float radius = 0.0f;
+        for (const auto& vertex : solid.vertices) {
+            radius = std::max(radius, glm::length(vec3(vertex)));
+        }
+        shapeRadii.push_back(radius);
     }
 
     void loadShapes() {
@@ -139,6 +182,9 @@ public:
         for (auto& vertex : vertexData) {
             vertex.position *= 0.2f;
         }
+        for (auto& radius : shapeRadii) {
+            radius *= 0.2f;
+        }
         meshes = stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexData);
     }
 
@@ -303,6 +349,7 @@ public:
             drawIndirectCommand.vertexCount = shapeData.vertices;
         }
         indirectBuffer = stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, indirectData);
+        culler.prepare(instanceBuffer, indirectData, shapeRadii);
     }
 
 
@@ -310,7 +357,7 @@ public:
         std::vector<InstanceData> instanceData;
         instanceData.resize(INSTANCE_COUNT);
 
-        std::mt19937 rndGenerator(time(nullptr));
+        std::mt19937 rndGenerator(randomSeed());
         std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
         std::exponential_distribution<float> expDist(1);
 
@@ -324,7 +371,8 @@ public:
             instance.pos *= instance.scale * (1.0f + expDist(rndGenerator) / 2.0f) * 4.0f;
         }
 
-        instanceBuffer = stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+        // Also read by the culling compute shader
+        instanceBuffer = stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, instanceData);
     }
 
     void prepareUniformBuffers() {
@@ -343,6 +391,7 @@ public:
         }
 
         memcpy(uniformData.vsScene.mapped, &uboVS, sizeof(uboVS));
+        culler.update(uboVS.time, uboVS.projection * uboVS.view);
     }
 
 
@@ -368,6 +417,13 @@ public:
 
     void update(float delta) override {
         ExampleBase::update(delta);
+        if (directDraws) {
+            // Stand in for a scene that changes every frame
+            updateDrawCommandBuffers();
+            if (lastFPS && lastRecordStats.recorded) {
+                recordTimes[drawCmdBufferParts] = lastRecordStats.cpuTime / lastFPS;
+            }
+        }
         if (!paused) {
             accumulator += delta;
             if (accumulator < duration) {
@@ -393,6 +449,66 @@ public:
     virtual void viewChanged() {
         updateUniformBuffer(true);
     }
+
+    void toggleCulling() {
+        gpuCulling = !gpuCulling;
+        updateDrawCommandBuffers();
+    }
+
+    void toggleDirectDraws() {
+        directDraws = !directDraws;
+        updateDrawCommandBuffers();
+    }
+
+    // 1, 2, 4, ... up to one part per record thread plus the main thread
+    void cycleDrawParts() {
+        uint32_t maxParts = getRecordThreads().threadCount() + 1;
+        drawCmdBufferParts = drawCmdBufferParts >= maxParts ? 1 : std::min(drawCmdBufferParts * 2, maxParts);
+        updateDrawCommandBuffers();
+    }
+
+    void keyPressed(uint32_t key) override {
+        ExampleBase::keyPressed(key);
+        switch (key) {
+        case GLFW_KEY_C:
+        case GAMEPAD_BUTTON_A:
+            toggleCulling();
+            break;
+        case GLFW_KEY_D:
+            toggleDirectDraws();
+            break;
+        case GLFW_KEY_R:
+            cycleDrawParts();
+            break;
+        }
+    }
+
+    void getOverlayText(vkx::TextOverlay *textOverlay) override {
+        uint32_t submitted = culler.submittedInstances();
+        uint32_t drawn = gpuCulling ? culler.drawnInstances() : submitted;
+        std::stringstream ss;
+        ss << "Instances: " << drawn << " drawn of " << submitted << " submitted";
+        textOverlay->addText(ss.str(), 5.0f, 65.0f, vkx::TextOverlay::alignLeft);
+#if defined(__ANDROID__)
+        textOverlay->addText(std::string("GPU culling ") + (gpuCulling ? "on" : "off") + " (\"Button A\" to toggle)", 5.0f, 85.0f, vkx::TextOverlay::alignLeft);
+#else
+        textOverlay->addText(std::string("GPU culling ") + (gpuCulling ? "on" : "off") + " (\"c\" to toggle)", 5.0f, 85.0f, vkx::TextOverlay::alignLeft);
+        textOverlay->addText(std::string("Direct draws ") + (directDraws ? "on" : "off") + " (\"d\" to toggle)", 5.0f, 105.0f, vkx::TextOverlay::alignLeft);
+#endif
+        if (directDraws) {
+            ss.str("");
+            ss << drawCmdBufferParts << " secondaries (\"r\" to change)";
+            textOverlay->addText(ss.str(), 5.0f, 125.0f, vkx::TextOverlay::alignLeft);
+            // Recording time per frame by number of secondaries
+            float y = 145.0f;
+            for (const auto& recordTime : recordTimes) {
+                ss.str("");
+                ss << std::fixed << std::setprecision(2) << recordTime.first << ": " << recordTime.second << "ms";
+                textOverlay->addText(ss.str(), 5.0f, y, vkx::TextOverlay::alignLeft);
+                y += 20.0f;
+            }
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
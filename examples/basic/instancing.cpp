@@ -69,7 +69,7 @@ public:
         camera.setZoom(-12.0f);
         rotationSpeed = 0.25f;
         title = "Vulkan Example - Instanced mesh rendering";
-        srand(time(NULL));
+        srand(randomSeed());
     }
 
     ~VulkanExample() {
@@ -293,7 +293,7 @@ public:
         std::vector<InstanceData> instanceData;
         instanceData.resize(INSTANCE_COUNT);
 
-        std::mt19937 rndGenerator(time(NULL));
+        std::mt19937 rndGenerator(randomSeed());
         std::uniform_real_distribution<double> uniformDist(0.0, 1.0);
 
         for (auto i = 0; i < INSTANCE_COUNT; i++) {
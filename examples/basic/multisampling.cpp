@@ -13,6 +13,7 @@
 struct {
     vkx::CreateImageResult color;
     vkx::CreateImageResult depth;
+    vk::Extent2D size;
 } multisampleTarget;
 
 // Vertex layout for this example
@@ -98,6 +99,16 @@ public:
         vk::SampleCountFlags requiredSamples = SAMPLE_COUNT;
         assert((uint32_t)colorSampleCount >= (uint32_t)requiredSamples && (uint32_t)depthSampleCount >= (uint32_t)requiredSamples);
 
+        // Frames in flight may still render to the old targets
+        if (multisampleTarget.color.image) {
+            auto oldTarget = multisampleTarget;
+            dumpster.push_back([oldTarget]() mutable {
+                oldTarget.color.destroy();
+                oldTarget.depth.destroy();
+            });
+        }
+        multisampleTarget.size = size;
+
         // Color target
         vk::ImageCreateInfo info;
         info.imageType = vk::ImageType::e2D;
@@ -214,7 +225,7 @@ public:
         attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
         attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
         attachments[1].initialLayout = vk::ImageLayout::eUndefined;
-        attachments[1].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+        attachments[1].finalLayout = swapChain.presentLayout;
 
         // Multisampled depth attachment we render to
         attachments[2].format = depthFormat;
@@ -292,7 +303,16 @@ public:
 
         std::array<vk::ImageView, 4> attachments;
 
-        setupMultisampleTarget();
+        // The old frame buffers may still be in use by frames in flight
+        std::function<void(const vk::Framebuffer&)> destructor = [this](const vk::Framebuffer& framebuffer) {
+            device.destroyFramebuffer(framebuffer);
+        };
+        trash(framebuffers, destructor);
+
+        // Only depends on the size, so it is kept when the swap chain is recreated at the same size
+        if (multisampleTarget.size.width != size.width || multisampleTarget.size.height != size.height) {
+            setupMultisampleTarget();
+        }
 
         attachments[0] = multisampleTarget.color.view;
         // attachment[1] = swapchain image
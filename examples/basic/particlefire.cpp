@@ -65,7 +65,9 @@ public:
     glm::vec3 maxVel = glm::vec3(3.0f, 7.0f, 3.0f);
 
     struct {
+        // One copy of the particles per frame in flight
         CreateBufferResult buffer;
+        vk::DeviceSize frameSize{ 0 };
         vk::PipelineVertexInputStateCreateInfo inputState;
         std::vector<vk::VertexInputBindingDescription> bindingDescriptions;
         std::vector<vk::VertexInputAttributeDescription> attributeDescriptions;
@@ -98,6 +100,7 @@ public:
 
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSet descriptorSet;
+    vk::DescriptorSet environmentDescriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
     std::vector<Particle> particleBuffer;
@@ -108,7 +111,7 @@ public:
         title = "Vulkan Example - Particle system";
         zoomSpeed *= 1.5f;
         timerSpeed *= 8.0f;
-        srand(time(NULL));
+        srand(randomSeed());
     }
 
     ~VulkanExample() {
@@ -137,12 +140,17 @@ public:
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
         cmdBuffer.setViewport(0, vkx::viewport(size));
         cmdBuffer.setScissor(0, vkx::rect2D(size));
+        // Each frame in flight reads its own copy of the uniforms and particles
+        uint32_t environmentOffset = currentFrame * (uint32_t)uniformData.environment.alignment;
+        uint32_t fireOffset = currentFrame * (uint32_t)uniformData.fire.alignment;
+        vk::DeviceSize particlesOffset = currentFrame * particles.frameSize;
         // Environment
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, environmentDescriptorSet, environmentOffset);
         meshes.environment.drawIndexed(cmdBuffer);
         // Particle system
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, fireOffset);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.particles);
-        cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, particles.buffer.buffer, { 0 });
+        cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, particles.buffer.buffer, particlesOffset);
         cmdBuffer.draw(PARTICLE_COUNT, 1, 0, 0);
     }
 
@@ -203,8 +211,12 @@ public:
             particle.alpha = 1.0f - (abs(particle.pos.y) / (FLAME_RADIUS * 2.0f));
         }
 
-        particles.buffer = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, particleBuffer);
+        particles.frameSize = particleBuffer.size() * sizeof(Particle);
+        particles.buffer = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, framesInFlight * particles.frameSize);
         particles.buffer.map();
+        for (uint32_t frame = 0; frame < framesInFlight; ++frame) {
+            particles.buffer.copy(particleBuffer, frame * particles.frameSize);
+        }
     }
 
     void updateParticles() {
@@ -230,7 +242,8 @@ public:
             }
         }
 
-        particles.buffer.copy(particleBuffer);
+        // Only the current frame's copy, the GPU may still be reading the others
+        particles.buffer.copy(particleBuffer, currentFrame * particles.frameSize);
     }
 
     void loadTextures() {
@@ -340,7 +353,7 @@ public:
         // Example uses one ubo and one image sampler
         std::vector<vk::DescriptorPoolSize> poolSizes =
         {
-            vkx::descriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2),
+            vkx::descriptorPoolSize(vk::DescriptorType::eUniformBufferDynamic, 2),
             vkx::descriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 4)
         };
 
@@ -353,9 +366,9 @@ public:
     void setupDescriptorSetLayout() {
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings =
         {
-            // Binding 0 : Vertex shader uniform buffer
+            // Binding 0 : Vertex shader uniform buffer, offset to the current frame's copy
             vkx::descriptorSetLayoutBinding(
-            vk::DescriptorType::eUniformBuffer,
+            vk::DescriptorType::eUniformBufferDynamic,
                 vk::ShaderStageFlagBits::eVertex,
                 0),
             // Binding 1 : Fragment shader image sampler
@@ -400,7 +413,7 @@ public:
             // Binding 0 : Vertex shader uniform buffer
             vkx::writeDescriptorSet(
             descriptorSet,
-                vk::DescriptorType::eUniformBuffer,
+                vk::DescriptorType::eUniformBufferDynamic,
                 0,
                 &uniformData.fire.descriptor),
             // Binding 1 : Smoke texture
@@ -420,7 +433,8 @@ public:
         device.updateDescriptorSets(writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
 
         // Environment
-        meshes.environment.descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+        // Bound with the dynamic offset before drawing the mesh
+        environmentDescriptorSet = device.allocateDescriptorSets(allocInfo)[0];
 
         vk::DescriptorImageInfo texDescriptorColorMap =
             vkx::descriptorImageInfo(textures.floor.colorMap.sampler, textures.floor.colorMap.view, vk::ImageLayout::eGeneral);
@@ -431,13 +445,13 @@ public:
 
         // Binding 0 : Vertex shader uniform buffer
         writeDescriptorSets.push_back(
-            vkx::writeDescriptorSet(meshes.environment.descriptorSet, vk::DescriptorType::eUniformBuffer, 0, &uniformData.environment.descriptor));
+            vkx::writeDescriptorSet(environmentDescriptorSet, vk::DescriptorType::eUniformBufferDynamic, 0, &uniformData.environment.descriptor));
         // Binding 1 : Color map
         writeDescriptorSets.push_back(
-            vkx::writeDescriptorSet(meshes.environment.descriptorSet, vk::DescriptorType::eCombinedImageSampler, 1, &texDescriptorColorMap));
+            vkx::writeDescriptorSet(environmentDescriptorSet, vk::DescriptorType::eCombinedImageSampler, 1, &texDescriptorColorMap));
         // Binding 2 : Normal map
         writeDescriptorSets.push_back(
-            vkx::writeDescriptorSet(meshes.environment.descriptorSet, vk::DescriptorType::eCombinedImageSampler, 2, &texDescriptorNormalMap));
+            vkx::writeDescriptorSet(environmentDescriptorSet, vk::DescriptorType::eCombinedImageSampler, 2, &texDescriptorNormalMap));
 
         device.updateDescriptorSets(writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
     }
@@ -521,12 +535,17 @@ public:
 
     // Prepare and initialize uniform buffer containing shader uniforms
     void prepareUniformBuffers() {
+        // Vertex shader uniform buffer block, one copy per frame in flight
+        uniformData.fire = createUniformBuffer(uboVS, framesInFlight);
         // Vertex shader uniform buffer block
-        uniformData.fire = createUniformBuffer(uboVS);
-        // Vertex shader uniform buffer block
-        uniformData.environment = createUniformBuffer(uboEnv);
+        uniformData.environment = createUniformBuffer(uboEnv, framesInFlight);
 
         updateUniformBuffers();
+        // Start every frame's copy out the same
+        for (uint32_t frame = 0; frame < framesInFlight; ++frame) {
+            uniformData.fire.copy(uboVS, frame * uniformData.fire.alignment);
+            uniformData.environment.copy(uboEnv, frame * uniformData.environment.alignment);
+        }
     }
 
     void updateUniformBufferLight() {
@@ -534,7 +553,6 @@ public:
         uboEnv.lightPos.x = sin(timer * 2 * M_PI) * 1.5f;
         uboEnv.lightPos.y = 0.0f;
         uboEnv.lightPos.z = cos(timer * 2 * M_PI) * 1.5f;
-        uniformData.environment.copy(uboEnv);
     }
 
     void updateUniformBuffers() {
@@ -543,14 +561,14 @@ public:
         uboVS.projection = camera.matrices.perspective;
         uboVS.model = camera.matrices.view;
         uboVS.viewportDim = glm::vec2(size.width, size.height);
-        uniformData.fire.copy(uboVS);
+        uniformData.fire.copy(uboVS, currentFrame * uniformData.fire.alignment);
 
         // Environment
         uboEnv.projection = uboVS.projection;
         uboEnv.model = uboVS.model;
         uboEnv.normal = glm::inverseTranspose(uboEnv.model);
         uboEnv.cameraPos = glm::vec4(0.0, 0.0, camera.position.z, 0.0);
-        uniformData.environment.copy(uboEnv);
+        uniformData.environment.copy(uboEnv, currentFrame * uniformData.environment.alignment);
     }
 
     void prepare() {
@@ -568,17 +586,17 @@ public:
         prepared = true;
     }
 
-    virtual void render() {
-        if (!prepared)
+    // Called after the render loop waited for the frame, so its copies are free to write
+    void update(float deltaTime) override {
+        ExampleBase::update(deltaTime);
+        if (!prepared) {
             return;
-        draw();
+        }
         if (!paused) {
             updateUniformBufferLight();
             updateParticles();
         }
-    }
-
-    virtual void viewChanged() {
+        // Every copy has to catch up with view changes, so write the frame's uniforms each frame
         updateUniformBuffers();
     }
 };
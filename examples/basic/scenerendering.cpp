@@ -29,6 +29,17 @@ struct SceneMaterialProperites {
     float opacity;
 };
 
+// Material layout in the storage buffer used with the global texture table
+// Matches the std430 layout of the Material struct in scene_bindless.frag
+struct SceneMaterialData {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    float opacity;
+    uint32_t textureIndex;
+    uint32_t padding[2];
+};
+
 // Stores info on the materials used in the scene
 struct SceneMaterial {
     std::string name;
@@ -38,6 +49,8 @@ struct SceneMaterial {
     vkx::Texture diffuse;
     // The material's descriptor contains the material descriptors
     vk::DescriptorSet descriptorSet;
+    // Slot of the diffuse texture in the context's texture table (bindless path only)
+    uint32_t textureIndex{ vkx::TextureTable::INVALID_INDEX };
     // Pointer to the pipeline used by this material
     vk::Pipeline *pipeline;
 };
@@ -50,6 +63,7 @@ struct SceneMesh {
 
     // Pointer to the material used by this mesh
     SceneMaterial *material;
+    uint32_t materialIndex;
 };
 
 // Class for loading the scene and generating all Vulkan resources
@@ -70,6 +84,9 @@ private:
 
     vk::DescriptorSet descriptorSetScene;
 
+    // Material properties and texture indices for the bindless path
+    vkx::CreateBufferResult materialBuffer;
+
     vkx::TextureLoader *textureLoader;
 
     const aiScene* aScene;
@@ -122,6 +139,11 @@ private:
             materials[i].pipeline = (materials[i].properties.opacity == 0.0f) ? &pipelines.solid : &pipelines.blending;
         }
 
+        if (bindless) {
+            setupBindlessMaterials();
+            return;
+        }
+
         // Generate descriptor sets for the materials
 
         // Descriptor pool
@@ -223,6 +245,79 @@ private:
         device.updateDescriptorSets(writeDescriptorSets, {});
     }
 
+    // With descriptor indexing, all diffuse textures live in the context's texture table and the
+    // materials are read from a storage buffer, so there is a single descriptor set for the whole scene
+    void setupBindlessMaterials() {
+        std::vector<SceneMaterialData> materialData(materials.size());
+        for (size_t i = 0; i < materials.size(); i++) {
+            materials[i].textureIndex = context.textureTable->add(materials[i].diffuse.descriptor);
+            materialData[i].ambient = materials[i].properties.ambient;
+            materialData[i].diffuse = materials[i].properties.diffuse;
+            materialData[i].specular = materials[i].properties.specular;
+            materialData[i].opacity = materials[i].properties.opacity;
+            materialData[i].textureIndex = materials[i].textureIndex;
+        }
+        materialBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, materialData);
+
+        std::vector<vk::DescriptorPoolSize> poolSizes;
+        poolSizes.push_back(vkx::descriptorPoolSize(vk::DescriptorType::eUniformBuffer, 1));
+        poolSizes.push_back(vkx::descriptorPoolSize(vk::DescriptorType::eStorageBuffer, 1));
+        vk::DescriptorPoolCreateInfo descriptorPoolInfo =
+            vkx::descriptorPoolCreateInfo(static_cast<uint32_t>(poolSizes.size()), poolSizes.data(), 1);
+        descriptorPool = device.createDescriptorPool(descriptorPoolInfo);
+
+        // Set 0: Scene matrices and material storage buffer
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings;
+        setLayoutBindings.push_back(vkx::descriptorSetLayoutBinding(
+            vk::DescriptorType::eUniformBuffer,
+            vk::ShaderStageFlagBits::eVertex,
+            0));
+        setLayoutBindings.push_back(vkx::descriptorSetLayoutBinding(
+            vk::DescriptorType::eStorageBuffer,
+            vk::ShaderStageFlagBits::eFragment,
+            1));
+        vk::DescriptorSetLayoutCreateInfo descriptorLayout =
+            vkx::descriptorSetLayoutCreateInfo(
+                setLayoutBindings.data(),
+                static_cast<uint32_t>(setLayoutBindings.size()));
+        descriptorSetLayouts.scene = device.createDescriptorSetLayout(descriptorLayout);
+
+        // Set 1: Global texture table, owned by the context
+        std::array<vk::DescriptorSetLayout, 2> setLayouts = { descriptorSetLayouts.scene, context.textureTable->layout };
+        vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo = vkx::pipelineLayoutCreateInfo(setLayouts.data(), static_cast<uint32_t>(setLayouts.size()));
+
+        // The material index is the only per draw state
+        vk::PushConstantRange pushConstantRange = vkx::pushConstantRange(
+            vk::ShaderStageFlagBits::eFragment,
+            sizeof(uint32_t),
+            0);
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+        pipelineLayout = device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+        vk::DescriptorSetAllocateInfo allocInfo =
+            vkx::descriptorSetAllocateInfo(
+                descriptorPool,
+                &descriptorSetLayouts.scene,
+                1);
+        descriptorSetScene = device.allocateDescriptorSets(allocInfo)[0];
+
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+        // Binding 0 : Vertex shader uniform buffer
+        writeDescriptorSets.push_back(vkx::writeDescriptorSet(
+            descriptorSetScene,
+            vk::DescriptorType::eUniformBuffer,
+            0,
+            &uniformBuffer.descriptor));
+        // Binding 1 : Fragment shader material storage buffer
+        writeDescriptorSets.push_back(vkx::writeDescriptorSet(
+            descriptorSetScene,
+            vk::DescriptorType::eStorageBuffer,
+            1,
+            &materialBuffer.descriptor));
+        device.updateDescriptorSets(writeDescriptorSets, {});
+    }
+
     // Load all meshes from the scene and generate the Vulkan resources
     // for rendering them
     void loadMeshes(vk::CommandBuffer copyCmd) {
@@ -235,6 +330,7 @@ private:
             std::cout << "	Faces: " << aMesh->mNumFaces << std::endl;
 
             meshes[i].material = &materials[aMesh->mMaterialIndex];
+            meshes[i].materialIndex = aMesh->mMaterialIndex;
 
             // Vertices
             std::vector<Vertex> vertices;
@@ -295,6 +391,9 @@ public:
     // Shared pipeline layout
     vk::PipelineLayout pipelineLayout;
 
+    // Use the context's texture table instead of a descriptor set per material
+    bool bindless = false;
+
     // For displaying only a single part of the scene
     bool renderSingleScenePart = false;
     uint32_t scenePartIndex = 0;
@@ -303,6 +402,7 @@ public:
         this->device = context.device;
         this->queue = context.queue;
         this->textureLoader = textureloader;
+        bindless = context.enableDescriptorIndexing;
         uniformBuffer = context.createUniformBuffer(uniformData);
     }
 
@@ -312,8 +412,14 @@ public:
             mesh.indices.destroy();
         }
         for (auto material : materials) {
+            if (context.textureTable) {
+                context.textureTable->remove(material.textureIndex);
+            }
             material.diffuse.destroy();
         }
+        if (materialBuffer.buffer) {
+            materialBuffer.destroy();
+        }
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.material, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.scene, nullptr);
@@ -357,6 +463,11 @@ public:
     // Renders the scene into an active command buffer
     // In a real world application we would do some visibility culling in here
     void render(vk::CommandBuffer cmdBuffer, bool wireframe) {
+        if (bindless) {
+            renderBindless(cmdBuffer, wireframe);
+            return;
+        }
+
         vk::DeviceSize offsets[1] = { 0 };
         for (size_t i = 0; i < meshes.size(); i++) {
             if ((renderSingleScenePart) && (i != scenePartIndex))
@@ -399,6 +510,35 @@ public:
         // Render transparent objects last
 
     }
+
+    // All descriptors are bound once, draws only switch pipelines and push the material index
+    void renderBindless(vk::CommandBuffer cmdBuffer, bool wireframe) {
+        std::array<vk::DescriptorSet, 2> descriptorSets = { descriptorSetScene, context.textureTable->descriptorSet };
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets, {});
+
+        vk::Pipeline boundPipeline;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if ((renderSingleScenePart) && (i != scenePartIndex))
+                continue;
+
+            vk::Pipeline pipeline = wireframe ? pipelines.wireframe : *meshes[i].material->pipeline;
+            if (pipeline != boundPipeline) {
+                cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+                boundPipeline = pipeline;
+            }
+            vkCmdPushConstants(
+                cmdBuffer,
+                pipelineLayout,
+                VK_SHADER_STAGE_FRAGMENT_BIT,
+                0,
+                sizeof(uint32_t),
+                &meshes[i].materialIndex);
+
+            cmdBuffer.bindVertexBuffers(0, meshes[i].vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes[i].indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexed(meshes[i].indexCount, 1, 0, 0, 0);
+        }
+    }
 };
 
 class VulkanExample : public vkx::ExampleBase {
@@ -526,7 +666,7 @@ public:
 
         // Solid rendering pipeline
         shaderStages[0] = loadShader(getAssetPath() + "shaders/scenerendering/scene.vert.spv", vk::ShaderStageFlagBits::eVertex);
-        shaderStages[1] = loadShader(getAssetPath() + "shaders/scenerendering/scene.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        shaderStages[1] = loadShader(getAssetPath() + (scene->bindless ? "shaders/scenerendering/scene_bindless.frag.spv" : "shaders/scenerendering/scene.frag.spv"), vk::ShaderStageFlagBits::eFragment);
 
         vk::GraphicsPipelineCreateInfo pipelineCreateInfo =
             vkx::pipelineCreateInfo(
@@ -66,7 +66,7 @@ public:
         rotationSpeed = 0.25f;
         camera.setRotation({ -15.0f, 35.0f, 0.0f });
         title = "Vulkan Example - Texture arrays";
-        srand(time(NULL));
+        srand(randomSeed());
     }
 
     ~VulkanExample() {
@@ -11,6 +11,7 @@
 */
 
 #include "vulkanExampleBase.h"
+#include "assetPipeline.hpp"
 
 static std::vector<std::string> names{ "logos", "background", "models", "skybox" };
 
@@ -110,14 +111,70 @@ public:
         }
     }
 
-    void prepareVertices() {
-        struct Vertex {
-            float pos[3];
-            float normal[3];
-            float uv[2];
-            float color[3];
-        };
+    struct Vertex {
+        float pos[3];
+        float normal[3];
+        float uv[2];
+        float color[3];
+    };
+
+    // Generate vertex buffer (pos, normal, uv, color) and index buffer for a loaded mesh
+    void buildMeshData(const vkx::MeshLoader* mesh, std::vector<Vertex>& vertexBuffer, std::vector<uint32_t>& indexBuffer) {
+        float scale = 1.0f;
+        for (int m = 0; m < mesh->m_Entries.size(); m++) {
+            for (int i = 0; i < mesh->m_Entries[m].Vertices.size(); i++) {
+                glm::vec3 pos = mesh->m_Entries[m].Vertices[i].m_pos * scale;
+                glm::vec3 normal = mesh->m_Entries[m].Vertices[i].m_normal;
+                glm::vec2 uv = mesh->m_Entries[m].Vertices[i].m_tex;
+                glm::vec3 col = mesh->m_Entries[m].Vertices[i].m_color;
+                Vertex vert = {
+                    { pos.x, pos.y, pos.z },
+                    { normal.x, -normal.y, normal.z },
+                    { uv.s, uv.t },
+                    { col.r, col.g, col.b }
+                };
+
+                // Offset Vulkan meshes
+                // todo : center before export
+                if (mesh != demoMeshes.skybox) {
+                    vert.pos[1] += 1.15f;
+                }
+
+                vertexBuffer.push_back(vert);
+            }
+        }
+
+        for (int m = 0; m < mesh->m_Entries.size(); m++) {
+            int indexBase = indexBuffer.size();
+            for (int i = 0; i < mesh->m_Entries[m].Indices.size(); i++) {
+                indexBuffer.push_back(mesh->m_Entries[m].Indices[i] + indexBase);
+            }
+        }
+    }
+
+#if defined(VKX_ASYNC_ASSETS)
+    // Reads and parses the mesh on the worker threads, then uploads it to device local memory
+    vkx::async::Task<> loadMeshAsync(vkx::async::AssetPipeline& assets, vkx::MeshLoader* mesh, std::string filename) {
+        std::vector<uint8_t> fileData = co_await assets.readFile(filename);
+
+        std::vector<Vertex> vertexBuffer;
+        std::vector<uint32_t> indexBuffer;
+        co_await assets.decode([&] {
+            mesh->loadFromMemory(fileData.data(), fileData.size(), filename);
+            buildMeshData(mesh, vertexBuffer, indexBuffer);
+        });
+
+        auto vertices = co_await assets.uploadBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
+        auto indices = co_await assets.uploadBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexBuffer);
+        mesh->vertexBuffer.buf = vertices.buffer;
+        mesh->vertexBuffer.mem = vertices.memory;
+        mesh->indexBuffer.buf = indices.buffer;
+        mesh->indexBuffer.mem = indices.memory;
+        mesh->indexBuffer.count = indexBuffer.size();
+    }
+#endif
 
+    void prepareVertices() {
         // Load meshes for demos scene
         demoMeshes.logos = new vkx::MeshLoader();
         demoMeshes.background = new vkx::MeshLoader();
@@ -131,54 +188,37 @@ public:
         demoMeshes.skybox->assetManager = androidApp->activity->assetManager;
 #endif
 
-        demoMeshes.logos->load(getAssetPath() + "models/vulkanscenelogos.dae");
-        demoMeshes.background->load(getAssetPath() + "models/vulkanscenebackground.dae");
-        demoMeshes.models->load(getAssetPath() + "models/vulkanscenemodels.dae");
-        demoMeshes.skybox->load(getAssetPath() + "models/cube.obj");
+        std::vector<std::pair<vkx::MeshLoader*, std::string>> meshFiles{
+            { demoMeshes.skybox, getAssetPath() + "models/cube.obj" }, // skybox first because of depth writes
+            { demoMeshes.logos, getAssetPath() + "models/vulkanscenelogos.dae" },
+            { demoMeshes.background, getAssetPath() + "models/vulkanscenebackground.dae" },
+            { demoMeshes.models, getAssetPath() + "models/vulkanscenemodels.dae" },
+        };
 
-        std::vector<vkx::MeshLoader*> meshList;
-        meshList.push_back(demoMeshes.skybox); // skybox first because of depth writes
-        meshList.push_back(demoMeshes.logos);
-        meshList.push_back(demoMeshes.background);
-        meshList.push_back(demoMeshes.models);
+#if defined(VKX_ASYNC_ASSETS) && !defined(__ANDROID__)
+        // All meshes are read, parsed and uploaded concurrently, while the
+        // skybox texture loads on this thread
+        vkx::WorkStealingPool workerThreads;
+        vkx::async::AssetPipeline assets(*this, workerThreads, fencePoller);
+        for (const auto& meshFile : meshFiles) {
+            assets.spawn(loadMeshAsync(assets, meshFile.first, meshFile.second));
+            meshes.push_back(meshFile.first);
+        }
+        loadTextures();
+        assets.waitAll();
+#else
+        loadTextures();
+        for (const auto& meshFile : meshFiles) {
+            vkx::MeshLoader* mesh = meshFile.first;
+            mesh->load(meshFile.second);
 
-        // todo : Use mesh function for loading
-        float scale = 1.0f;
-        for (auto& mesh : meshList) {
-            // Generate vertex buffer (pos, normal, uv, color)
             std::vector<Vertex> vertexBuffer;
-            for (int m = 0; m < mesh->m_Entries.size(); m++) {
-                for (int i = 0; i < mesh->m_Entries[m].Vertices.size(); i++) {
-                    glm::vec3 pos = mesh->m_Entries[m].Vertices[i].m_pos * scale;
-                    glm::vec3 normal = mesh->m_Entries[m].Vertices[i].m_normal;
-                    glm::vec2 uv = mesh->m_Entries[m].Vertices[i].m_tex;
-                    glm::vec3 col = mesh->m_Entries[m].Vertices[i].m_color;
-                    Vertex vert = {
-                        { pos.x, pos.y, pos.z },
-                        { normal.x, -normal.y, normal.z },
-                        { uv.s, uv.t },
-                        { col.r, col.g, col.b }
-                    };
-
-                    // Offset Vulkan meshes
-                    // todo : center before export
-                    if (mesh != demoMeshes.skybox) {
-                        vert.pos[1] += 1.15f;
-                    }
-
-                    vertexBuffer.push_back(vert);
-    }
-}
+            std::vector<uint32_t> indexBuffer;
+            buildMeshData(mesh, vertexBuffer, indexBuffer);
+
             auto result = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
             mesh->vertexBuffer.buf = result.buffer;
             mesh->vertexBuffer.mem = result.memory;
-            std::vector<uint32_t> indexBuffer;
-            for (int m = 0; m < mesh->m_Entries.size(); m++) {
-                int indexBase = indexBuffer.size();
-                for (int i = 0; i < mesh->m_Entries[m].Indices.size(); i++) {
-                    indexBuffer.push_back(mesh->m_Entries[m].Indices[i] + indexBase);
-                }
-            }
             result = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, indexBuffer);
             mesh->indexBuffer.buf = result.buffer;
             mesh->indexBuffer.mem = result.memory;
@@ -186,7 +226,7 @@ public:
 
             meshes.push_back(mesh);
         }
-
+#endif
         // Binding description
         demoMeshes.bindingDescriptions.resize(1);
         demoMeshes.bindingDescriptions[0] =
@@ -381,7 +421,6 @@ public:
 
     void prepare() {
         ExampleBase::prepare();
-        loadTextures();
         prepareVertices();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
@@ -8,8 +8,8 @@
 
 #include "vulkanExampleBase.h"
 
-#include "threadPool.hpp"
-#include "frustum.hpp"
+#include "taskGraph.hpp"
+#include "frustumCulling.hpp"
 
 
 // Vertex layout used in this example
@@ -89,7 +89,14 @@ public:
     };
     std::vector<ThreadData> threadData;
 
-    vkx::ThreadPool threadPool;
+    vkx::WorkStealingPool threadPool{ std::max(1u, std::thread::hardware_concurrency()) };
+
+    // Per frame work, built once and executed every frame:
+    // object update -> batch frustum culling -> per-thread command recording,
+    // with the star sphere recorded independently
+    vkx::TaskGraph frameGraph;
+    // Inheritance info for the secondary command buffers recorded by the current frame's graph
+    vk::CommandBufferInheritanceInfo inheritanceInfo;
 
     // vk::Fence to wait for all command buffers to finish before
     // presenting to the swap chain
@@ -101,6 +108,10 @@ public:
 
     // View frustum for culling invisible objects
     vkTools::Frustum frustum;
+    // Object bounding spheres for batch culling, indexed by thread * numObjectsPerThread + object
+    vkx::SphereList objectSpheres;
+    vkx::VisibilityMask objectVisibility;
+    vkx::PlaneCache planeCache;
 
     VulkanExample() : vkx::ExampleBase(ENABLE_VALIDATION) {
         camera.setZoom(-32.5f);
@@ -117,9 +128,7 @@ public:
 #else
         std::cout << "numThreads = " << numThreads << std::endl;
 #endif
-        srand(time(NULL));
-
-        threadPool.setThreadCount(numThreads);
+        srand(randomSeed());
 
         numObjectsPerThread = 256 / numThreads;
     }
@@ -216,33 +225,47 @@ public:
                 thread->pushConstBlock[j].color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
             }
         }
-    }
 
-    // Builds the secondary command buffer for each thread
-    void threadRenderCode(uint32_t threadIndex, uint32_t cmdBufferIndex, vk::CommandBufferInheritanceInfo inheritanceInfo) {
-        ThreadData *thread = &threadData[threadIndex];
-        ObjectData *objectData = &thread->objectData[cmdBufferIndex];
+        buildFrameGraph();
+    }
 
-        // Check visibility against view frustum
-        objectData->visible = frustum.checkSphere(objectData->pos, objectSphereDim * 0.5f);
+    void buildFrameGraph() {
+        objectSpheres.resize(numThreads * numObjectsPerThread);
 
-        if (!objectData->visible) {
-            return;
-        }
-
-        vk::CommandBufferBeginInfo commandBufferBeginInfo;
-        commandBufferBeginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue;
-        commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+        // Animation has no ordering requirements between objects, so split it
+        // into automatically sized chunks
+        auto update = frameGraph.addParallelFor(numThreads * numObjectsPerThread, [this](uint32_t begin, uint32_t end) {
+            for (uint32_t object = begin; object < end; ++object) {
+                updateObject(object / numObjectsPerThread, object % numObjectsPerThread);
+            }
+        });
 
-        vk::CommandBuffer cmdBuffer = thread->commandBuffer[cmdBufferIndex];
-        cmdBuffer.begin(commandBufferBeginInfo);
+        // All objects are tested in one batch, starting with the plane that rejected them last frame
+        auto cull = frameGraph.add([this] {
+            vkx::culling::cullSpheres(frustum, objectSpheres, objectVisibility, &planeCache);
+        });
+        frameGraph.precede(update, cull);
+
+        // A command pool must only be used by one thread at a time, so each chunk records
+        // all the objects that belong to one pool
+        auto record = frameGraph.addParallelFor(numThreads, [this](uint32_t begin, uint32_t end) {
+            for (uint32_t t = begin; t < end; ++t) {
+                for (uint32_t i = 0; i < numObjectsPerThread; i++) {
+                    threadData[t].objectData[i].visible = objectVisibility.isVisible(t * numObjectsPerThread + i);
+                    threadRenderCode(t, i, inheritanceInfo);
+                }
+            }
+        }, 1);
+        frameGraph.precede(cull, record);
 
-        cmdBuffer.setViewport(0, vkx::viewport(size));
-        cmdBuffer.setScissor(0, vkx::rect2D(size));
+        frameGraph.add([this] { updateSecondaryCommandBuffer(inheritanceInfo); });
+    }
 
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phong);
+    // Animates a single object and updates its bounding sphere
+    void updateObject(uint32_t threadIndex, uint32_t objectIndex) {
+        ThreadData *thread = &threadData[threadIndex];
+        ObjectData *objectData = &thread->objectData[objectIndex];
 
-        // Update
         objectData->rotation.y += 2.5f * objectData->rotationSpeed * frameTimer;
         if (objectData->rotation.y > 360.0f) {
             objectData->rotation.y -= 360.0f;
@@ -258,7 +281,31 @@ public:
         objectData->model = glm::rotate(objectData->model, glm::radians(objectData->deltaT * 360.0f), glm::vec3(0.0f, objectData->rotationDir, 0.0f));
         objectData->model = glm::scale(objectData->model, glm::vec3(objectData->scale));
 
-        thread->pushConstBlock[cmdBufferIndex].mvp = matrices.projection * matrices.view * objectData->model;
+        thread->pushConstBlock[objectIndex].mvp = matrices.projection * matrices.view * objectData->model;
+
+        objectSpheres.set(threadIndex * numObjectsPerThread + objectIndex, objectData->pos, objectSphereDim * 0.5f);
+    }
+
+    // Builds the secondary command buffer for each thread
+    void threadRenderCode(uint32_t threadIndex, uint32_t cmdBufferIndex, const vk::CommandBufferInheritanceInfo& inheritanceInfo) {
+        ThreadData *thread = &threadData[threadIndex];
+        ObjectData *objectData = &thread->objectData[cmdBufferIndex];
+
+        if (!objectData->visible) {
+            return;
+        }
+
+        vk::CommandBufferBeginInfo commandBufferBeginInfo;
+        commandBufferBeginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue;
+        commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+        vk::CommandBuffer cmdBuffer = thread->commandBuffer[cmdBufferIndex];
+        cmdBuffer.begin(commandBufferBeginInfo);
+
+        cmdBuffer.setViewport(0, vkx::viewport(size));
+        cmdBuffer.setScissor(0, vkx::rect2D(size));
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phong);
 
         // Update shader push constant block
         // Contains model view matrix
@@ -272,7 +319,7 @@ public:
         cmdBuffer.end();
     }
 
-    void updateSecondaryCommandBuffer(vk::CommandBufferInheritanceInfo inheritanceInfo) {
+    void updateSecondaryCommandBuffer(const vk::CommandBufferInheritanceInfo& inheritanceInfo) {
         // Secondary command buffer for the sky sphere
         vk::CommandBufferBeginInfo commandBufferBeginInfo;
         commandBufferBeginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue;
@@ -294,7 +341,7 @@ public:
         secondaryCommandBuffer.end();
     }
 
-    // Updates the secondary command buffers using a thread pool 
+    // Updates the secondary command buffers using the frame's task graph
     // and puts them into the primary command buffer that's 
     // lat submitted to the queue for rendering
     void updateCommandBuffers(vk::Framebuffer framebuffer) {
@@ -319,7 +366,7 @@ public:
         primaryCommandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
 
         // Inheritance info for the secondary command buffers
-        vk::CommandBufferInheritanceInfo inheritanceInfo;
+        inheritanceInfo = vk::CommandBufferInheritanceInfo();
         inheritanceInfo.renderPass = renderPass;
         // Secondary command buffer also use the currently active framebuffer
         inheritanceInfo.framebuffer = framebuffer;
@@ -327,19 +374,12 @@ public:
         // Contains the list of secondary command buffers to be executed
         std::vector<vk::CommandBuffer> commandBuffers;
 
+        // Update the objects and record the star sphere and object secondary command buffers
+        frameGraph.execute(threadPool);
+
         // Secondary command buffer with star background sphere
-        updateSecondaryCommandBuffer(inheritanceInfo);
         commandBuffers.push_back(secondaryCommandBuffer);
 
-        // Add a job to the thread's queue for each object to be rendered
-        for (uint32_t t = 0; t < numThreads; t++) {
-            for (uint32_t i = 0; i < numObjectsPerThread; i++) {
-                threadPool.threads[t]->addJob([=] { threadRenderCode(t, i, inheritanceInfo); });
-            }
-        }
-
-        threadPool.wait();
-
         // Only submit if object is within the current view frustum
         for (uint32_t t = 0; t < numThreads; t++) {
             for (uint32_t i = 0; i < numObjectsPerThread; i++) {
@@ -356,7 +396,9 @@ public:
     }
 
     void draw() override {
-        prepareFrame();
+        if (!prepareFrame()) {
+            return;
+        }
         updateCommandBuffers(framebuffers[currentBuffer]);
 
         submitInfo.commandBufferCount = 1;
@@ -7,6 +7,7 @@
 */
 
 #include "vulkanExampleBase.h"
+#include "vulkanQueryManager.hpp"
 
 
 // Vertex layout used in this example
@@ -61,14 +62,8 @@ public:
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    // Stores occlusion query results
-    struct {
-        vk::Buffer buffer;
-        vk::DeviceMemory memory;
-    } queryResult;
-
-    // Pool that stores all occlusion queries
-    vk::QueryPool queryPool;
+    // One occlusion query pool per frame in flight, read back without waiting
+    vkx::QueryManager queries{ *this };
 
     // Passed query samples
     uint64_t passedSamples[2];
@@ -94,10 +89,7 @@ public:
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
 
-        device.destroyQueryPool(queryPool);
-
-        device.destroyBuffer(queryResult.buffer);
-        device.freeMemory(queryResult.memory);
+        queries.destroy();
 
         uniformData.vsScene.destroy();
         uniformData.sphere.destroy();
@@ -108,57 +100,34 @@ public:
         meshes.teapot.destroy();
     }
 
-    // Create a buffer for storing the query result
-    // Setup a query pool
-    void setupQueryResultBuffer() {
-        uint32_t bufSize = 2 * sizeof(uint64_t);
-
-        vk::MemoryRequirements memReqs;
-        vk::MemoryAllocateInfo memAlloc;
-        vk::BufferCreateInfo bufferCreateInfo =
-            vkx::bufferCreateInfo(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst, bufSize);
-
-        // Results are saved in a host visible buffer for easy access by the application
-        queryResult.buffer = device.createBuffer(bufferCreateInfo);
-        memReqs = device.getBufferMemoryRequirements(queryResult.buffer);
-        memAlloc.allocationSize = memReqs.size;
-        memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible);
-        queryResult.memory = device.allocateMemory(memAlloc);
-        device.bindBufferMemory(queryResult.buffer, queryResult.memory, 0);
-
-        // Create query pool
-        vk::QueryPoolCreateInfo queryPoolInfo;
-        // Query pool will be created for occlusion queries
-        queryPoolInfo.queryType = vk::QueryType::eOcclusion;
-        queryPoolInfo.queryCount = 2;
-
-        queryPool = device.createQueryPool(queryPoolInfo, NULL);
-    }
-
-    // Retrieves the results of the occlusion queries submitted to the command buffer
-    void getQueryResults() {
-        queue.waitIdle();
-        device.waitIdle();
-        // We use vkGetQueryResults to copy the results into a host visible buffer
-        // you can use vk::QueryResultFlagBits::eWithAvailability
-            // which also returns the state of the result (ready) in the result
-        device.getQueryPoolResults(
-            queryPool,
-            0,
-            2,
-            sizeof(passedSamples),
-            passedSamples,
-            sizeof(uint64_t),
-            // Store results a 64 bit values and wait until the results have been finished
-            // If you don't want to wait, you can use VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
-            // which also returns the state of the result (ready) in the result
-            vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+    // Setup the query pools, results arrive a few frames after they were rendered
+    void setupQueries() {
+        queries.create(vk::QueryType::eOcclusion, 2, framesInFlight);
+        queries.onResults([this](const vkx::QueryResults& results) {
+            bool changed = false;
+            for (uint32_t i = 0; i < 2; ++i) {
+                // Keep the previous value until the GPU has finished the query
+                if (results.available(i) && passedSamples[i] != results.value(i)) {
+                    passedSamples[i] = results.value(i);
+                    changed = true;
+                }
+            }
+            if (changed) {
+                updateUniformBuffers();
+                updateTextOverlay();
+            }
+        });
     }
 
     void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         // Reset query pool
         // Must be done outside of render pass
-        cmdBuffer.resetQueryPool(queryPool, 0, 2);
+        queries.reset(cmdBuffer, currentFrame);
+    }
+
+    void updatePrimaryCommandBufferPostRenderPass(const vk::CommandBuffer& cmdBuffer) override {
+        // Copy the results to host memory, without waiting for them
+        queries.copyResults(cmdBuffer, currentFrame);
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
@@ -175,24 +144,24 @@ public:
         cmdBuffer.drawIndexed(meshes.plane.indexCount, 1, 0, 0, 0);
 
         // Teapot
-        cmdBuffer.beginQuery(queryPool, 0, vk::QueryControlFlags());
+        queries.begin(cmdBuffer, currentFrame, 0);
 
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.teapot, nullptr);
         cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.teapot.vertices.buffer, { 0 });
         cmdBuffer.bindIndexBuffer(meshes.teapot.indices.buffer, 0, vk::IndexType::eUint32);
         cmdBuffer.drawIndexed(meshes.teapot.indexCount, 1, 0, 0, 0);
 
-        cmdBuffer.endQuery(queryPool, 0);
+        queries.end(cmdBuffer, currentFrame, 0);
 
         // Sphere
-        cmdBuffer.beginQuery(queryPool, 1, vk::QueryControlFlags());
+        queries.begin(cmdBuffer, currentFrame, 1);
 
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.sphere, nullptr);
         cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.sphere.vertices.buffer, { 0 });
         cmdBuffer.bindIndexBuffer(meshes.sphere.indices.buffer, 0, vk::IndexType::eUint32);
         cmdBuffer.drawIndexed(meshes.sphere.indexCount, 1, 0, 0, 0);
 
-        cmdBuffer.endQuery(queryPool, 1);
+        queries.end(cmdBuffer, currentFrame, 1);
 
         // Visible pass
         // Clear color and depth attachments
@@ -233,12 +202,14 @@ public:
     }
 
     void draw() override {
-        prepareFrame();
+        if (!prepareFrame()) {
+            return;
+        }
 
-        drawCurrentCommandBuffer();
+        // Hand this frame's query results to the callback once its submission has finished
+        queries.submitted(currentFrame);
 
-        // Read query results for displaying in next frame
-        getQueryResults();
+        drawCurrentCommandBuffer();
 
         submitFrame();
     }
@@ -449,7 +420,7 @@ public:
     void prepare() {
         ExampleBase::prepare();
         loadMeshes();
-        setupQueryResultBuffer();
+        setupQueries();
         setupVertexDescriptions();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
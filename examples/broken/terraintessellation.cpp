@@ -8,6 +8,7 @@
 
 #include "vulkanexamplebase.h"
 #include "frustum.hpp"
+#include "vulkanQueryManager.hpp"
 
 #define VERTEX_BUFFER_BIND_ID 0
 
@@ -85,9 +86,8 @@ public:
         vk::DescriptorSet skysphere;
     } descriptorSets;
 
-    // Pipeline statistics
-    CreateBufferResult queryResult;
-    vk::QueryPool queryPool;
+    // Pipeline statistics, one query pool per frame in flight
+    vkx::QueryManager queries{ *this };
     std::array<uint64_t, 2> pipelineStats{ 0, 0 };
 
     // View frustum passed to tessellation control shader for culling
@@ -128,32 +128,23 @@ public:
         textures.skySphere.destroy();
         textures.terrainArray.destroy();
 
-        device.destroyQueryPool(queryPool);
-
-        queryResult.destroy();
-        vkFreeMemory(device, queryResult.memory, nullptr);
-    }
-
-    // Setup pool and buffer for storing pipeline statistics results
-    void setupQueryResultBuffer() {
-        uint32_t bufSize = 2 * sizeof(uint64_t);
-        // Results are saved in a host visible buffer for easy access by the application
-        queryResult = createBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst, bufSize);
-
-        // Create query pool
-        vk::QueryPoolCreateInfo queryPoolInfo;
-        queryPoolInfo.queryType = vk::QueryType::ePipelineStatistics;
-        queryPoolInfo.pipelineStatistics = vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
-            vk::QueryPipelineStatisticFlagBits::eTessellationEvaluationShaderInvocations;
-        queryPoolInfo.queryCount = 2;
-        queryPool = device.createQueryPool(queryPoolInfo);
+        queries.destroy();
     }
 
-    // Retrieves the results of the pipeline statistics query submitted to the command buffer
-    void getQueryResults() {
-        // We use vkGetQueryResults to copy the results into a host visible buffer
-        vk::ArrayProxy<uint64_t> proxy{ pipelineStats };
-        device.getQueryPoolResults(queryPool, 0, 1, proxy, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    // Setup the pipeline statistics queries, results arrive a few frames after they were rendered
+    void setupQueries() {
+        queries.create(vk::QueryType::ePipelineStatistics, 1, framesInFlight,
+            vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations | vk::QueryPipelineStatisticFlagBits::eTessellationEvaluationShaderInvocations);
+        queries.onResults([this](const vkx::QueryResults& results) {
+            if (!results.available(0)) {
+                return;
+            }
+            std::array<uint64_t, 2> stats{ results.value(0, 0), results.value(0, 1) };
+            if (stats != pipelineStats) {
+                pipelineStats = stats;
+                updateTextOverlay();
+            }
+        });
     }
 
     void loadTextures() {
@@ -189,8 +180,13 @@ public:
     }
 
     void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
-        cmdBuffer.resetQueryPool(queryPool, 0, 2);
+        queries.reset(cmdBuffer, currentFrame);
     }
+
+    void updatePrimaryCommandBufferPostRenderPass(const vk::CommandBuffer& cmdBuffer) override {
+        queries.copyResults(cmdBuffer, currentFrame);
+    }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
         cmdBuffer.setViewport(0, vkx::viewport(size));
         cmdBuffer.setScissor(0, vkx::rect2D(size));
@@ -204,7 +200,7 @@ public:
 
         // Terrrain
         // Begin pipeline statistics query			
-        cmdBuffer.beginQuery(queryPool, 0, vk::QueryControlFlagBits::ePrecise);
+        queries.begin(cmdBuffer, currentFrame, 0);
         // Render
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wireframe : pipelines.terrain);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.terrain, 0, descriptorSets.terrain, {});
@@ -212,7 +208,7 @@ public:
         cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, vk::IndexType::eUint32);
         cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
         // End pipeline statistics query
-        cmdBuffer.endQuery(queryPool, 0);
+        queries.end(cmdBuffer, currentFrame, 0);
     }
 
     void loadMeshes() {
@@ -556,7 +552,7 @@ public:
         loadMeshes();
         loadTextures();
         generateTerrain();
-        setupQueryResultBuffer();
+        setupQueries();
         setupVertexDescriptions();
         prepareUniformBuffers();
         setupDescriptorSetLayouts();
@@ -567,6 +563,16 @@ public:
         prepared = true;
     }
 
+    void draw() override {
+        if (!prepareFrame()) {
+            return;
+        }
+        // Hand this frame's statistics to the callback once its submission has finished
+        queries.submitted(currentFrame);
+        drawCurrentCommandBuffer();
+        submitFrame();
+    }
+
     virtual void viewChanged() {
         updateUniformBuffers();
     }
@@ -145,7 +145,9 @@ public:
     }
 
     void draw() override {
-        prepareFrame();
+        if (!prepareFrame()) {
+            return;
+        }
         drawCurrentCommandBuffer();
         submitFrame();
     }
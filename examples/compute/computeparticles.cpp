@@ -99,7 +99,11 @@ public:
     }
 
     void loadTextures() {
+        // The particle sprite is stored uncompressed, let the loader block compress it if the device supports BC3
+        textureLoader->enableBlockCompression = true;
         textures.particle = textureLoader->loadTexture(getAssetPath() + "textures/particle01_rgba.ktx",  vk::Format::eR8G8B8A8Unorm);
+        // The gradient is used as a lookup table, so keep it exact
+        textureLoader->enableBlockCompression = false;
         textures.gradient = textureLoader->loadTexture(getAssetPath() + "textures/particle_gradient_rgba.ktx",  vk::Format::eR8G8B8A8Unorm);
     }
 
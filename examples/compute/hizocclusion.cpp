@@ -0,0 +1,558 @@
+/*
+* Vulkan Example - Hierarchical-Z occlusion culling
+*
+* A city of 16K box buildings seen from street level, where almost everything is hidden
+* behind the first row of buildings.  Culling runs entirely on the GPU in two phases:
+*
+*   1. Instances in the frustum that were visible last frame are drawn into a depth
+*      prepass, which a single compute dispatch reduces into a depth pyramid.
+*   2. Every instance in the frustum is tested against the pyramid.  Survivors are
+*      compacted into the instance index list of the main indirect draw and marked
+*      visible for the next frame, so objects that come out from behind an occluder
+*      are drawn the frame they appear.
+*
+*   o - Toggle occlusion culling (frustum culling stays on)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "vulkanExampleBase.h"
+#include "vulkanDepthPyramid.hpp"
+#include "vulkanFramebuffer.hpp"
+#include "frustum.hpp"
+
+// Buildings per side of the city grid
+#define GRID_SIZE 128
+#define INSTANCE_COUNT (GRID_SIZE * GRID_SIZE)
+#define CELL_SIZE 10.0f
+
+class VulkanExample : public vkx::ExampleBase {
+public:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec3 normal;
+    };
+
+    // Axis aligned box, std430 layout of Instance in the shaders
+    struct Instance {
+        glm::vec4 center;
+        glm::vec4 extent;
+    };
+
+    // Written by cull.comp
+    struct Draws {
+        vk::DrawIndirectCommand early;
+        vk::DrawIndirectCommand main;
+        uint32_t frustumVisible{ 0 };
+        uint32_t padding[3];
+    };
+
+    struct {
+        glm::mat4 projection;
+        glm::mat4 view;
+    } uboScene;
+
+    struct {
+        glm::mat4 viewProjection;
+        glm::vec4 planes[6];
+        glm::vec2 pyramidSize;
+        uint32_t pyramidLevels;
+        uint32_t instanceCount{ INSTANCE_COUNT };
+        uint32_t occlusion{ 1 };
+    } uboCull;
+
+    vkx::CreateBufferResult cube;
+    vkx::CreateBufferResult instances;
+    // One flag per instance, visible in the previous frame
+    vkx::CreateBufferResult visibility;
+    // Compacted instance indices, read as an instance rate vertex attribute
+    vkx::CreateBufferResult earlyIndices;
+    vkx::CreateBufferResult mainIndices;
+    vkx::CreateBufferResult draws;
+    // Host visible copy of draws for the overlay
+    vkx::CreateBufferResult drawsReadback;
+    Draws resetDraws;
+
+    struct {
+        vkx::UniformData scene;
+        vkx::UniformData cull;
+    } uniformData;
+
+    // Depth only pass over the early list, source of the depth pyramid
+    struct {
+        vk::RenderPass renderPass;
+        vkx::Framebuffer framebuffer;
+        vk::Format depthFormat;
+        vk::Pipeline pipeline;
+    } prepass;
+
+    vkx::DepthPyramid pyramid{ *this };
+
+    struct {
+        vk::Pipeline solid;
+        vk::Pipeline cull;
+    } pipelines;
+
+    vk::PipelineLayout pipelineLayout;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+
+    vk::PipelineLayout cullPipelineLayout;
+    vk::DescriptorSetLayout cullDescriptorSetLayout;
+    vk::DescriptorSet cullDescriptorSet;
+
+    bool occlusionCulling{ true };
+
+    VulkanExample() : ExampleBase(ENABLE_VALIDATION) {
+        enableTextOverlay = true;
+        camera.type = Camera::CameraType::firstperson;
+        camera.movementSpeed = 20.0f;
+        camera.setPerspective(60.0f, size, 0.5f, 1024.0f);
+        // Street level, y points down
+        camera.setTranslation({ 0.0f, -2.0f, 0.0f });
+        camera.setRotation({ 0.0f, 0.0f, 0.0f });
+        title = "Vulkan Example - Hierarchical-Z occlusion culling";
+    }
+
+    ~VulkanExample() {
+        device.destroyPipeline(pipelines.solid);
+        device.destroyPipeline(pipelines.cull);
+        device.destroyPipeline(prepass.pipeline);
+        device.destroyRenderPass(prepass.renderPass);
+        prepass.framebuffer.destroy();
+        pyramid.destroy();
+        device.destroyPipelineLayout(pipelineLayout);
+        device.destroyDescriptorSetLayout(descriptorSetLayout);
+        device.destroyPipelineLayout(cullPipelineLayout);
+        device.destroyDescriptorSetLayout(cullDescriptorSetLayout);
+        cube.destroy();
+        instances.destroy();
+        visibility.destroy();
+        earlyIndices.destroy();
+        mainIndices.destroy();
+        draws.destroy();
+        drawsReadback.destroy();
+        uniformData.scene.destroy();
+        uniformData.cull.destroy();
+    }
+
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        // The previous frame's draws and copies are done with the culling buffers
+        vk::MemoryBarrier memoryBarrier;
+        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+            vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), memoryBarrier, nullptr, nullptr);
+        cmdBuffer.updateBuffer(draws.buffer, 0, sizeof(Draws), &resetDraws);
+        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), memoryBarrier, nullptr, nullptr);
+
+        uint32_t groupCount = (INSTANCE_COUNT + 63) / 64;
+        uint32_t phase = 1;
+        if (occlusionCulling) {
+            // Phase 1 : last frame's visible set
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.cull);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullPipelineLayout, 0, cullDescriptorSet, nullptr);
+            cmdBuffer.pushConstants(cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(phase), &phase);
+            cmdBuffer.dispatch(groupCount, 1, 1);
+
+            memoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+            memoryBarrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead;
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput, vk::DependencyFlags(), memoryBarrier, nullptr, nullptr);
+
+            vk::ClearValue clearValue;
+            clearValue.depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
+            vk::RenderPassBeginInfo renderPassBeginInfo;
+            renderPassBeginInfo.renderPass = prepass.renderPass;
+            renderPassBeginInfo.framebuffer = prepass.framebuffer.framebuffer;
+            renderPassBeginInfo.renderArea.extent = size;
+            renderPassBeginInfo.clearValueCount = 1;
+            renderPassBeginInfo.pClearValues = &clearValue;
+            cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+            cmdBuffer.setViewport(0, vkx::viewport(size));
+            cmdBuffer.setScissor(0, vkx::rect2D(size));
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, prepass.pipeline);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+            cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, cube.buffer, { 0 });
+            cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, earlyIndices.buffer, { 0 });
+            cmdBuffer.drawIndirect(draws.buffer, offsetof(Draws, early), 1, sizeof(vk::DrawIndirectCommand));
+            cmdBuffer.endRenderPass();
+
+            pyramid.build(cmdBuffer, prepass.framebuffer.depth.image);
+        }
+
+        // Phase 2 : everything in the frustum against the pyramid
+        phase = 2;
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.cull);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, cullPipelineLayout, 0, cullDescriptorSet, nullptr);
+        cmdBuffer.pushConstants(cullPipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(phase), &phase);
+        cmdBuffer.dispatch(groupCount, 1, 1);
+
+        memoryBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        memoryBarrier.dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eTransferRead;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), memoryBarrier, nullptr, nullptr);
+
+        // Statistics only, read back without waiting on the frame
+        cmdBuffer.copyBuffer(draws.buffer, drawsReadback.buffer, vk::BufferCopy(0, 0, sizeof(Draws)));
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        cmdBuffer.setViewport(0, vkx::viewport(size));
+        cmdBuffer.setScissor(0, vkx::rect2D(size));
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, cube.buffer, { 0 });
+        cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, mainIndices.buffer, { 0 });
+        cmdBuffer.drawIndirect(draws.buffer, offsetof(Draws, main), 1, sizeof(vk::DrawIndirectCommand));
+    }
+
+    void prepareCube() {
+        std::vector<Vertex> vertices;
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            for (float sign : { -1.0f, 1.0f }) {
+                glm::vec3 normal;
+                normal[axis] = sign;
+                glm::vec3 u, v;
+                u[(axis + 1) % 3] = 1.0f;
+                v[(axis + 2) % 3] = 1.0f;
+                // Counter clockwise seen from outside
+                if (sign < 0.0f) {
+                    std::swap(u, v);
+                }
+                glm::vec3 corners[4] = { normal - u - v, normal + u - v, normal + u + v, normal - u + v };
+                for (uint32_t index : { 0, 1, 2, 2, 3, 0 }) {
+                    vertices.push_back({ corners[index], normal });
+                }
+            }
+        }
+        cube = stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices);
+
+        resetDraws.early.vertexCount = resetDraws.main.vertexCount = (uint32_t)vertices.size();
+        resetDraws.early.instanceCount = resetDraws.main.instanceCount = 0;
+        resetDraws.early.firstVertex = resetDraws.main.firstVertex = 0;
+        resetDraws.early.firstInstance = resetDraws.main.firstInstance = 0;
+    }
+
+    void prepareInstances() {
+        std::mt19937 rndGenerator(1234);
+        std::uniform_real_distribution<float> footprint(0.3f, 0.45f);
+        std::exponential_distribution<float> height(0.08f);
+
+        // Cell edges lie on multiples of CELL_SIZE, so the axes are streets
+        std::vector<Instance> instanceData(INSTANCE_COUNT);
+        for (uint32_t z = 0; z < GRID_SIZE; ++z) {
+            for (uint32_t x = 0; x < GRID_SIZE; ++x) {
+                auto& instance = instanceData[z * GRID_SIZE + x];
+                glm::vec3 extent(footprint(rndGenerator) * CELL_SIZE, 2.0f + height(rndGenerator), footprint(rndGenerator) * CELL_SIZE);
+                glm::vec2 cell = (glm::vec2(x, z) - glm::vec2(GRID_SIZE / 2) + 0.5f) * CELL_SIZE;
+                instance.center = glm::vec4(cell.x, -extent.y, cell.y, 0.0f);
+                instance.extent = glm::vec4(extent, 0.0f);
+            }
+        }
+
+        instances = stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, instanceData);
+        // Everything counts as visible on the first frame
+        visibility = stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, std::vector<uint32_t>(INSTANCE_COUNT, 1));
+        earlyIndices = createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, INSTANCE_COUNT * sizeof(uint32_t));
+        mainIndices = createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eDeviceLocal, INSTANCE_COUNT * sizeof(uint32_t));
+        draws = stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc, resetDraws);
+        drawsReadback = createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, resetDraws);
+        drawsReadback.map();
+    }
+
+    // The prepass depth has to be sampled by the pyramid shader
+    vk::Format getSampledDepthFormat() {
+        for (auto format : { vk::Format::eD32Sfloat, vk::Format::eD16Unorm }) {
+            vk::FormatProperties formatProperties = physicalDevice.getFormatProperties(format);
+            vk::FormatFeatureFlags required = vk::FormatFeatureFlagBits::eDepthStencilAttachment | vk::FormatFeatureFlagBits::eSampledImage;
+            if ((formatProperties.optimalTilingFeatures & required) == required) {
+                return format;
+            }
+        }
+        throw std::runtime_error("No sampled depth format available");
+    }
+
+    void preparePrepass() {
+        prepass.depthFormat = getSampledDepthFormat();
+
+        vk::AttachmentDescription attachment;
+        attachment.format = prepass.depthFormat;
+        attachment.loadOp = vk::AttachmentLoadOp::eClear;
+        attachment.storeOp = vk::AttachmentStoreOp::eStore;
+        attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+        attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+        attachment.initialLayout = vk::ImageLayout::eUndefined;
+        attachment.finalLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+
+        vk::AttachmentReference depthReference;
+        depthReference.attachment = 0;
+        depthReference.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+        vk::SubpassDescription subpass;
+        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpass.pDepthStencilAttachment = &depthReference;
+
+        // The previous pyramid build has finished reading the depth
+        vk::SubpassDependency dependency;
+        dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+        dependency.srcStageMask = vk::PipelineStageFlagBits::eComputeShader;
+        dependency.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+        dependency.dstSubpass = 0;
+        dependency.dstStageMask = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+        dependency.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+
+        vk::RenderPassCreateInfo renderPassInfo;
+        renderPassInfo.attachmentCount = 1;
+        renderPassInfo.pAttachments = &attachment;
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &dependency;
+        prepass.renderPass = device.createRenderPass(renderPassInfo);
+
+        prepareTargets();
+    }
+
+    // Size dependent, recreated on resize
+    void prepareTargets() {
+        prepass.framebuffer.create(*this, glm::uvec2(size.width, size.height), {}, prepass.depthFormat, prepass.renderPass, vk::ImageUsageFlagBits::eSampled, vk::ImageUsageFlagBits::eSampled);
+        pyramid.create(prepass.framebuffer.depth.view, size);
+        uboCull.pyramidSize = glm::vec2(pyramid.extent.width, pyramid.extent.height);
+        uboCull.pyramidLevels = pyramid.levels;
+    }
+
+    void setupDescriptorPool() {
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            vkx::descriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2),
+            vkx::descriptorPoolSize(vk::DescriptorType::eStorageBuffer, 6),
+            vkx::descriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 1),
+        };
+        descriptorPool = device.createDescriptorPool(vkx::descriptorPoolCreateInfo((uint32_t)poolSizes.size(), poolSizes.data(), 2));
+    }
+
+    void setupDescriptorSetLayouts() {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+            // Binding 0 : Vertex shader uniform buffer
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eVertex, 0),
+            // Binding 1 : Instances
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eVertex, 1),
+        };
+        descriptorSetLayout = device.createDescriptorSetLayout(vkx::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), (uint32_t)setLayoutBindings.size()));
+        pipelineLayout = device.createPipelineLayout(vkx::pipelineLayoutCreateInfo(&descriptorSetLayout, 1));
+
+        std::vector<vk::DescriptorSetLayoutBinding> cullSetLayoutBindings = {
+            // Binding 0 : Frustum and pyramid parameters
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eUniformBuffer, vk::ShaderStageFlagBits::eCompute, 0),
+            // Binding 1 : Instances
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 1),
+            // Binding 2 : Visibility of the previous frame
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 2),
+            // Binding 3 : Early instance indices
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 3),
+            // Binding 4 : Main instance indices
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 4),
+            // Binding 5 : Indirect draws
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eStorageBuffer, vk::ShaderStageFlagBits::eCompute, 5),
+            // Binding 6 : Depth pyramid
+            vkx::descriptorSetLayoutBinding(vk::DescriptorType::eCombinedImageSampler, vk::ShaderStageFlagBits::eCompute, 6),
+        };
+        cullDescriptorSetLayout = device.createDescriptorSetLayout(vkx::descriptorSetLayoutCreateInfo(cullSetLayoutBindings.data(), (uint32_t)cullSetLayoutBindings.size()));
+        // Push constant : culling phase
+        vk::PushConstantRange pushConstantRange = vkx::pushConstantRange(vk::ShaderStageFlagBits::eCompute, sizeof(uint32_t), 0);
+        vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo = vkx::pipelineLayoutCreateInfo(&cullDescriptorSetLayout, 1);
+        pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+        pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+        cullPipelineLayout = device.createPipelineLayout(pipelineLayoutCreateInfo);
+    }
+
+    void setupDescriptorSets() {
+        descriptorSet = device.allocateDescriptorSets(vkx::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1))[0];
+        cullDescriptorSet = device.allocateDescriptorSets(vkx::descriptorSetAllocateInfo(descriptorPool, &cullDescriptorSetLayout, 1))[0];
+
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets = {
+            vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eUniformBuffer, 0, &uniformData.scene.descriptor),
+            vkx::writeDescriptorSet(descriptorSet, vk::DescriptorType::eStorageBuffer, 1, &instances.descriptor),
+            vkx::writeDescriptorSet(cullDescriptorSet, vk::DescriptorType::eUniformBuffer, 0, &uniformData.cull.descriptor),
+            vkx::writeDescriptorSet(cullDescriptorSet, vk::DescriptorType::eStorageBuffer, 1, &instances.descriptor),
+            vkx::writeDescriptorSet(cullDescriptorSet, vk::DescriptorType::eStorageBuffer, 2, &visibility.descriptor),
+            vkx::writeDescriptorSet(cullDescriptorSet, vk::DescriptorType::eStorageBuffer, 3, &earlyIndices.descriptor),
+            vkx::writeDescriptorSet(cullDescriptorSet, vk::DescriptorType::eStorageBuffer, 4, &mainIndices.descriptor),
+            vkx::writeDescriptorSet(cullDescriptorSet, vk::DescriptorType::eStorageBuffer, 5, &draws.descriptor),
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+        updatePyramidDescriptor();
+    }
+
+    void updatePyramidDescriptor() {
+        vk::DescriptorImageInfo pyramidDescriptor = pyramid.descriptor();
+        device.updateDescriptorSets(vkx::writeDescriptorSet(cullDescriptorSet, vk::DescriptorType::eCombinedImageSampler, 6, &pyramidDescriptor), nullptr);
+    }
+
+    void preparePipelines() {
+        vk::PipelineInputAssemblyStateCreateInfo inputAssemblyState =
+            vkx::pipelineInputAssemblyStateCreateInfo(vk::PrimitiveTopology::eTriangleList);
+
+        vk::PipelineRasterizationStateCreateInfo rasterizationState =
+            vkx::pipelineRasterizationStateCreateInfo(vk::PolygonMode::eFill, vk::CullModeFlagBits::eBack, vk::FrontFace::eCounterClockwise);
+
+        vk::PipelineColorBlendAttachmentState blendAttachmentState =
+            vkx::pipelineColorBlendAttachmentState();
+
+        vk::PipelineColorBlendStateCreateInfo colorBlendState =
+            vkx::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+
+        vk::PipelineDepthStencilStateCreateInfo depthStencilState =
+            vkx::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, vk::CompareOp::eLessOrEqual);
+
+        vk::PipelineViewportStateCreateInfo viewportState =
+            vkx::pipelineViewportStateCreateInfo(1, 1);
+
+        vk::PipelineMultisampleStateCreateInfo multisampleState =
+            vkx::pipelineMultisampleStateCreateInfo(vk::SampleCountFlagBits::e1);
+
+        std::vector<vk::DynamicState> dynamicStateEnables = {
+            vk::DynamicState::eViewport,
+            vk::DynamicState::eScissor
+        };
+        vk::PipelineDynamicStateCreateInfo dynamicState =
+            vkx::pipelineDynamicStateCreateInfo(dynamicStateEnables.data(), (uint32_t)dynamicStateEnables.size());
+
+        std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStages;
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo = vkx::computePipelineCreateInfo(cullPipelineLayout);
+        {
+            vkx::shader::initGlsl();
+            shaderStages[0] = loadGlslShader(getAssetPath() + "shaders/hizocclusion/scene.vert", vk::ShaderStageFlagBits::eVertex);
+            shaderStages[1] = loadGlslShader(getAssetPath() + "shaders/hizocclusion/scene.frag", vk::ShaderStageFlagBits::eFragment);
+            computePipelineCreateInfo.stage = loadGlslShader(getAssetPath() + "shaders/hizocclusion/cull.comp", vk::ShaderStageFlagBits::eCompute);
+            vkx::shader::finalizeGlsl();
+        }
+
+        std::vector<vk::VertexInputBindingDescription> bindingDescriptions = {
+            vkx::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, sizeof(Vertex), vk::VertexInputRate::eVertex),
+            vkx::vertexInputBindingDescription(INSTANCE_BUFFER_BIND_ID, sizeof(uint32_t), vk::VertexInputRate::eInstance),
+        };
+        std::vector<vk::VertexInputAttributeDescription> attributeDescriptions = {
+            // Location 0 : Position
+            vkx::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, position)),
+            // Location 1 : Normal
+            vkx::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 1, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, normal)),
+            // Location 4 : Instance index
+            vkx::vertexInputAttributeDescription(INSTANCE_BUFFER_BIND_ID, 4, vk::Format::eR32Uint, 0),
+        };
+        vk::PipelineVertexInputStateCreateInfo vertexInputState;
+        vertexInputState.vertexBindingDescriptionCount = (uint32_t)bindingDescriptions.size();
+        vertexInputState.pVertexBindingDescriptions = bindingDescriptions.data();
+        vertexInputState.vertexAttributeDescriptionCount = (uint32_t)attributeDescriptions.size();
+        vertexInputState.pVertexAttributeDescriptions = attributeDescriptions.data();
+
+        vk::GraphicsPipelineCreateInfo pipelineCreateInfo =
+            vkx::pipelineCreateInfo(pipelineLayout, renderPass);
+        pipelineCreateInfo.pVertexInputState = &vertexInputState;
+        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+        pipelineCreateInfo.pRasterizationState = &rasterizationState;
+        pipelineCreateInfo.pColorBlendState = &colorBlendState;
+        pipelineCreateInfo.pMultisampleState = &multisampleState;
+        pipelineCreateInfo.pViewportState = &viewportState;
+        pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+        pipelineCreateInfo.pDynamicState = &dynamicState;
+        pipelineCreateInfo.stageCount = (uint32_t)shaderStages.size();
+        pipelineCreateInfo.pStages = shaderStages.data();
+        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+
+        // Depth only, no fragment shader and no color attachment
+        colorBlendState.attachmentCount = 0;
+        pipelineCreateInfo.renderPass = prepass.renderPass;
+        pipelineCreateInfo.stageCount = 1;
+        prepass.pipeline = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+
+        pipelines.cull = device.createComputePipelines(pipelineCache, computePipelineCreateInfo, nullptr)[0];
+    }
+
+    void prepareUniformBuffers() {
+        uniformData.scene = createUniformBuffer(uboScene);
+        uniformData.cull = createUniformBuffer(uboCull);
+        updateUniformBuffers();
+    }
+
+    void updateUniformBuffers() {
+        uboScene.projection = getProjection();
+        uboScene.view = camera.matrices.view;
+        uniformData.scene.copy(uboScene);
+
+        uboCull.viewProjection = uboScene.projection * uboScene.view;
+        vkTools::Frustum frustum;
+        frustum.update(uboCull.viewProjection);
+        std::copy(frustum.planes.begin(), frustum.planes.end(), uboCull.planes);
+        uboCull.occlusion = occlusionCulling ? 1 : 0;
+        uniformData.cull.copy(uboCull);
+    }
+
+    void prepare() {
+        ExampleBase::prepare();
+        prepareCube();
+        prepareInstances();
+        preparePrepass();
+        prepareUniformBuffers();
+        setupDescriptorSetLayouts();
+        preparePipelines();
+        setupDescriptorPool();
+        setupDescriptorSets();
+        updateDrawCommandBuffers();
+        prepared = true;
+    }
+
+    void windowResized() override {
+        // The targets are destroyed directly when recreated
+        waitForFramesInFlight();
+        prepareTargets();
+        updatePyramidDescriptor();
+        updateUniformBuffers();
+    }
+
+    void update(float delta) override {
+        ExampleBase::update(delta);
+        // Slowly look around the block
+        if (!paused) {
+            camera.rotate(glm::vec2(delta * 0.1f, 0.0f));
+        }
+        updateUniformBuffers();
+    }
+
+    void viewChanged() override {
+        updateUniformBuffers();
+    }
+
+    void toggleOcclusionCulling() {
+        occlusionCulling = !occlusionCulling;
+        updateUniformBuffers();
+        primaryCmdBuffersDirty = true;
+    }
+
+    void keyPressed(uint32_t key) override {
+        ExampleBase::keyPressed(key);
+        switch (key) {
+        case GLFW_KEY_O:
+        case GAMEPAD_BUTTON_A:
+            toggleOcclusionCulling();
+            break;
+        }
+    }
+
+    void getOverlayText(vkx::TextOverlay *textOverlay) override {
+        const Draws& stats = *(const Draws*)drawsReadback.mapped;
+        std::stringstream ss;
+        ss << "Instances: " << INSTANCE_COUNT << ", in frustum " << stats.frustumVisible << ", drawn " << stats.main.instanceCount;
+        if (occlusionCulling) {
+            ss << " (" << stats.early.instanceCount << " in prepass)";
+        }
+        textOverlay->addText(ss.str(), 5.0f, 65.0f, vkx::TextOverlay::alignLeft);
+#if defined(__ANDROID__)
+        textOverlay->addText(std::string("Occlusion culling ") + (occlusionCulling ? "on" : "off") + " (\"Button A\" to toggle)", 5.0f, 85.0f, vkx::TextOverlay::alignLeft);
+#else
+        textOverlay->addText(std::string("Occlusion culling ") + (occlusionCulling ? "on" : "off") + " (\"o\" to toggle)", 5.0f, 85.0f, vkx::TextOverlay::alignLeft);
+#endif
+    }
+};
+
+RUN_EXAMPLE(VulkanExample)
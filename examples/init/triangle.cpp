@@ -694,6 +694,10 @@ public:
     void draw() {
         // Get next image in the swap chain (back/front buffer)
         currentBuffer = swapChain.acquireNextImage(semaphores.presentComplete);
+        // Out of date, e.g. while minimized.  This example doesn't recreate the swap chain.
+        if (currentBuffer == UINT32_MAX) {
+            return;
+        }
 
         // The submit infor strcuture contains a list of
         // command buffers and semaphores to be submitted to a queue
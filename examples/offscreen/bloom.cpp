@@ -6,7 +6,8 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
-#include "vulkanOffscreenExampleBase.hpp"
+#include "vulkanExampleBase.h"
+#include "vulkanRenderGraph.hpp"
 
 // Texture properties
 #define TEX_DIM 256
@@ -24,8 +25,8 @@ vkx::MeshLayout vertexLayout =
     vkx::VertexLayout::VERTEX_LAYOUT_NORMAL
 };
 
-class VulkanExample : public vkx::OffscreenExampleBase {
-    using Parent = OffscreenExampleBase;
+class VulkanExample : public vkx::ExampleBase {
+    using Parent = ExampleBase;
 public:
     bool bloom = true;
 
@@ -95,7 +96,10 @@ public:
     // all descriptor sets
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    VulkanExample() : vkx::OffscreenExampleBase(ENABLE_VALIDATION) {
+    // Renders the glowing parts and blurs them vertically, culled while bloom is off
+    vkx::RenderGraph graph;
+
+    VulkanExample() : vkx::ExampleBase(ENABLE_VALIDATION), graph(*this) {
         camera.setZoom(-10.25f);
         camera.setRotation({ 7.5f, -343.0f, 0.0f });
         timerSpeed *= 0.5f;
@@ -107,6 +111,8 @@ public:
         // Clean up used Vulkan resources 
         // Note : Inherited destructor cleans up resources stored in base class
 
+        graph.destroy();
+
         device.destroyPipeline(pipelines.blur);
         device.destroyPipeline(pipelines.phongPass);
         device.destroyPipeline(pipelines.colorPass);
@@ -133,63 +139,39 @@ public:
     }
 
 
-    // Render the 3D scene into a texture target
-    void buildOffscreenCommandBuffer() override {
-        vk::Viewport viewport = vkx::viewport(offscreen.size);
-        vk::Rect2D scissor = vkx::rect2D(offscreen.size);
-        vk::DeviceSize offset = 0;
-
-        // Horizontal blur
-        vk::ClearValue clearValues[2];
-        clearValues[0].color = vkx::clearColor({ 0.0f, 0.0f, 0.0f, 1.0f });
-        clearValues[1].depthStencil = { 1.0f, 0 };
-
-
-        offscreen.cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
-        vk::CommandBufferBeginInfo cmdBufInfo;
-        cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
-        offscreen.cmdBuffer.begin(cmdBufInfo);
-
-        // Draw the unblurred geometry to framebuffer 1
-        offscreen.cmdBuffer.setViewport(0, viewport);
-        offscreen.cmdBuffer.setScissor(0, scissor);
-
-        // Draw the bloom geometry.
-        {
-            vk::RenderPassBeginInfo renderPassBeginInfo;
-            renderPassBeginInfo.renderPass = offscreen.renderPass;
-            renderPassBeginInfo.framebuffer = offscreen.framebuffers[0].framebuffer;
-            renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
-            renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
-            renderPassBeginInfo.clearValueCount = 2;
-            renderPassBeginInfo.pClearValues = clearValues;
-            offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-            offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.scene, nullptr);
-            offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phongPass);
-            offscreen.cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.ufoGlow.vertices.buffer, offset);
-            offscreen.cmdBuffer.bindIndexBuffer(meshes.ufoGlow.indices.buffer, 0, vk::IndexType::eUint32);
-            offscreen.cmdBuffer.drawIndexed(meshes.ufoGlow.indexCount, 1, 0, 0, 0);
-            offscreen.cmdBuffer.endRenderPass();
-        }
+    // Render the glowing parts of the scene into a texture target and blur it
+    // vertically into a second one, which the main pass blurs horizontally
+    void setupRenderGraph() {
+        const vk::Extent2D extent{ TEX_DIM, TEX_DIM };
+        graph.profiler = &gpuProfiler;
+        graph.addImage("glow", colorformat, extent);
+        graph.addImage("blurred", colorformat, extent);
+        graph.addImage("depth", depthFormat, extent);
+        graph.addPass("Glow", [this](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.setViewport(0, vkx::viewport(glm::uvec2(TEX_DIM)));
+            cmdBuffer.setScissor(0, vkx::rect2D(glm::uvec2(TEX_DIM)));
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.scene, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phongPass);
+            cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.ufoGlow.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.ufoGlow.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexed(meshes.ufoGlow.indexCount, 1, 0, 0, 0);
+        }).color("glow").depth("depth");
+        graph.addPass("Vertical blur", [this](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.setViewport(0, vkx::viewport(glm::uvec2(TEX_DIM)));
+            cmdBuffer.setScissor(0, vkx::rect2D(glm::uvec2(TEX_DIM)));
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.verticalBlur, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.blur);
+            cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.quad.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexed(meshes.quad.indexCount, 1, 0, 0, 0);
+        }).read("glow").color("blurred").depth("depth");
+        graph.setOutput("blurred", bloom);
+        graph.compile();
+    }
 
-        {
-            vk::RenderPassBeginInfo renderPassBeginInfo;
-            renderPassBeginInfo.renderPass = offscreen.renderPass;
-            renderPassBeginInfo.framebuffer = offscreen.framebuffers[1].framebuffer;
-            renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
-            renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
-            renderPassBeginInfo.clearValueCount = 2;
-            renderPassBeginInfo.pClearValues = clearValues;
-            // Draw a vertical blur pass from framebuffer 1's texture into framebuffer 2
-            offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-            offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.verticalBlur, nullptr);
-            offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.blur);
-            offscreen.cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.quad.vertices.buffer, offset);
-            offscreen.cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
-            offscreen.cmdBuffer.drawIndexed(meshes.quad.indexCount, 1, 0, 0, 0);
-            offscreen.cmdBuffer.endRenderPass();
-        }
-        offscreen.cmdBuffer.end();
+    // Offscreen passes go into the frame's primary command buffer, ahead of the main render pass
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        graph.execute(cmdBuffer);
     }
 
     void loadTextures() {
@@ -219,13 +201,6 @@ public:
 
         // Render vertical blurred scene applying a horizontal blur
         if (bloom) {
-            vkx::setImageLayout(
-                cmdBuffer,
-                offscreen.framebuffers[1].colors[0].image,
-                vk::ImageAspectFlagBits::eColor,
-                vk::ImageLayout::eColorAttachmentOptimal,
-                vk::ImageLayout::eShaderReadOnlyOptimal);
-
             cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.horizontalBlur, nullptr);
             cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.blur);
             cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.quad.vertices.buffer, offset);
@@ -353,7 +328,7 @@ public:
         descriptorSets.verticalBlur = device.allocateDescriptorSets(allocInfo)[0];
 
         vk::DescriptorImageInfo texDescriptorVert =
-            vkx::descriptorImageInfo(offscreen.framebuffers[0].colors[0].sampler, offscreen.framebuffers[0].colors[0].view, vk::ImageLayout::eShaderReadOnlyOptimal);
+            vkx::descriptorImageInfo(graph.getImage("glow").sampler, graph.getImage("glow").view, vk::ImageLayout::eShaderReadOnlyOptimal);
 
         std::vector<vk::WriteDescriptorSet> writeDescriptorSets =
         {
@@ -383,7 +358,7 @@ public:
         descriptorSets.horizontalBlur = device.allocateDescriptorSets(allocInfo)[0];
 
         vk::DescriptorImageInfo texDescriptorHorz =
-            vkx::descriptorImageInfo(offscreen.framebuffers[1].colors[0].sampler, offscreen.framebuffers[1].colors[0].view, vk::ImageLayout::eGeneral);
+            vkx::descriptorImageInfo(graph.getImage("blurred").sampler, graph.getImage("blurred").view, vk::ImageLayout::eShaderReadOnlyOptimal);
 
         writeDescriptorSets =
         {
@@ -485,6 +460,8 @@ public:
         shaderStages[0] = loadShader(getAssetPath() + "shaders/bloom/gaussblur.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/bloom/gaussblur.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
+        // The render graph's passes use the main render pass' formats, so the
+        // pipelines are compatible with both
         vk::GraphicsPipelineCreateInfo pipelineCreateInfo =
             vkx::pipelineCreateInfo(pipelineLayouts.radialBlur, renderPass);
 
@@ -588,22 +565,7 @@ public:
         uniformData.fsHorzBlur.copy(ubos.horzBlur);
     }
 
-    void draw() override {
-        prepareFrame();
-
-        // Offscreen rendering
-        if (bloom) {
-            submit(offscreen.cmdBuffer, { { semaphores.acquireComplete, vk::PipelineStageFlagBits::eBottomOfPipe } }, offscreen.renderComplete);
-        } 
-
-        // Scene rendering
-        drawCurrentCommandBuffer(bloom ? offscreen.renderComplete : semaphores.acquireComplete);
-        submitFrame();
-    }
-
     void prepare() {
-        offscreen.framebuffers.resize(2);
-        offscreen.size = glm::uvec2(TEX_DIM);
         Parent::prepare();
         loadTextures();
         generateQuad();
@@ -611,11 +573,11 @@ public:
         setupVertexDescriptions();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
+        setupRenderGraph();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
         updateDrawCommandBuffers();
-        buildOffscreenCommandBuffer();
         prepared = true;
     }
 
@@ -656,6 +618,10 @@ public:
         textOverlay->addText("Press \"NUMPAD +/-\" to change blur scale", 5.0f, 85.0f, vkx::TextOverlay::alignLeft);
         textOverlay->addText("Press \"B\" to toggle bloom", 5.0f, 105.0f, vkx::TextOverlay::alignLeft);
 #endif
+        const auto& stats = graph.getStats();
+        std::stringstream ss;
+        ss << "Render graph: " << stats.passes - stats.culled << "/" << stats.passes << " passes, " << stats.barriers << " barriers";
+        textOverlay->addText(ss.str(), 5.0f, 125.0f, vkx::TextOverlay::alignLeft);
     }
 
     void changeBlurScale(float delta) {
@@ -666,10 +632,9 @@ public:
 
     void toggleBloom() {
         bloom = !bloom;
+        graph.setOutput("blurred", bloom);
+        primaryCmdBuffersDirty = true;
         updateDrawCommandBuffers();
-        if (bloom) {
-            buildOffscreenCommandBuffer();
-        }
     }
 };
 
@@ -200,7 +200,9 @@ public:
     }
 
     void draw() override {
-        prepareFrame();
+        if (!prepareFrame()) {
+            return;
+        }
         {
             vk::SubmitInfo submitInfo;
             submitInfo.pWaitDstStageMask = this->submitInfo.pWaitDstStageMask;
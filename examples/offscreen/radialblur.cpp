@@ -6,7 +6,8 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
-#include "vulkanOffscreenExampleBase.hpp"
+#include "vulkanExampleBase.h"
+#include "vulkanRenderGraph.hpp"
 
 
 // Texture properties
@@ -21,7 +22,7 @@ std::vector<vkx::VertexLayout> vertexLayout =
     vkx::VertexLayout::VERTEX_LAYOUT_NORMAL
 };
 
-class VulkanExample : public vkx::OffscreenExampleBase {
+class VulkanExample : public vkx::ExampleBase {
 public:
     bool blur = true;
     bool displayTexture = false;
@@ -82,7 +83,10 @@ public:
     // all descriptor sets
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    VulkanExample() : vkx::OffscreenExampleBase(ENABLE_VALIDATION) {
+    // Renders the blur base offscreen, culled while the blur is off
+    vkx::RenderGraph graph;
+
+    VulkanExample() : vkx::ExampleBase(ENABLE_VALIDATION), graph(*this) {
         camera.setZoom(-12.0f);
         camera.setRotation({ -16.25f, -28.75f, 0.0f });
         timerSpeed *= 0.5f;
@@ -94,6 +98,8 @@ public:
         // Clean up used Vulkan resources 
         // Note : Inherited destructor cleans up resources stored in base class
 
+        graph.destroy();
+
         device.destroyPipeline(pipelines.radialBlur);
         device.destroyPipeline(pipelines.phongPass);
         device.destroyPipeline(pipelines.colorPass);
@@ -114,40 +120,29 @@ public:
         uniformData.fsQuad.destroy();
     }
 
-    // The command buffer to copy for rendering 
-    // the offscreen scene and blitting it into
-    // the texture target is only build once
-    // and gets resubmitted 
-    void buildOffscreenCommandBuffer() override {
-        vk::CommandBufferBeginInfo cmdBufInfo;
-        cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
-
-        vk::ClearValue clearValues[2];
-        clearValues[0].color = vkx::clearColor({ 0, 0, 0, 0 });
-        clearValues[1].depthStencil = { 1.0f, 0 };
-
-        vk::RenderPassBeginInfo renderPassBeginInfo;
-        renderPassBeginInfo.renderPass = renderPass;
-        renderPassBeginInfo.framebuffer = offscreen.framebuffers[0].framebuffer;
-        renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
-        renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
-        renderPassBeginInfo.clearValueCount = 2;
-        renderPassBeginInfo.pClearValues = clearValues;
-
-        offscreen.cmdBuffer.begin(cmdBufInfo);
-        offscreen.cmdBuffer.setViewport(0, vkx::viewport(offscreen.size));
-        offscreen.cmdBuffer.setScissor(0, vkx::rect2D(offscreen.size));
-        offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-        offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.scene, nullptr);
-        offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.colorPass);
-
-        vk::DeviceSize offsets = 0;
-        offscreen.cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.example.vertices.buffer, offsets);
-        offscreen.cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
-        offscreen.cmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
-        offscreen.cmdBuffer.endRenderPass();
-
-        offscreen.cmdBuffer.end();
+    // The offscreen color pass renders the glowing parts of the scene into
+    // the texture that the fullscreen quad blurs
+    void setupRenderGraph() {
+        const vk::Extent2D extent{ TEX_DIM, TEX_DIM };
+        graph.profiler = &gpuProfiler;
+        graph.addImage("color", colorformat, extent);
+        graph.addImage("depth", depthFormat, extent);
+        graph.addPass("Color pass", [this](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.setViewport(0, vkx::viewport(glm::uvec2(TEX_DIM)));
+            cmdBuffer.setScissor(0, vkx::rect2D(glm::uvec2(TEX_DIM)));
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.scene, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.colorPass);
+            cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.example.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
+        }).color("color").depth("depth").clearColor(glm::vec4(0));
+        graph.setOutput("color", blur);
+        graph.compile();
+    }
+
+    // Offscreen passes go into the frame's primary command buffer, ahead of the main render pass
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        graph.execute(cmdBuffer);
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
@@ -287,7 +282,7 @@ public:
 
         // vk::Image descriptor for the color map texture
         vk::DescriptorImageInfo texDescriptor =
-            vkx::descriptorImageInfo(offscreen.framebuffers[0].colors[0].sampler, offscreen.framebuffers[0].colors[0].view, vk::ImageLayout::eShaderReadOnlyOptimal);
+            vkx::descriptorImageInfo(graph.getImage("color").sampler, graph.getImage("color").view, vk::ImageLayout::eShaderReadOnlyOptimal);
 
         std::vector<vk::WriteDescriptorSet> writeDescriptorSets =
         {
@@ -405,6 +400,7 @@ public:
         pipelines.phongPass = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
 
         // Color only pass (offscreen blur base)
+        pipelineCreateInfo.renderPass = graph.getPass("Color pass").getRenderPass();
         shaderStages[0] = loadShader(getAssetPath() + "shaders/radialblur/colorpass.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/radialblur/colorpass.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
@@ -449,17 +445,16 @@ public:
     }
 
     void prepare() {
-        offscreen.size = glm::uvec2(TEX_DIM);
-        OffscreenExampleBase::prepare();
+        ExampleBase::prepare();
         generateQuad();
         loadMeshes();
         setupVertexDescriptions();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
+        setupRenderGraph();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
-        buildOffscreenCommandBuffer();
         updateDrawCommandBuffers();
         prepared = true;
     }
@@ -499,10 +494,16 @@ public:
         textOverlay->addText("Press \"B\" to toggle blur", 5.0f, 85.0f, vkx::TextOverlay::alignLeft);
         textOverlay->addText("Press \"T\" to display offscreen texture", 5.0f, 105.0f, vkx::TextOverlay::alignLeft);
 #endif
+        const auto& stats = graph.getStats();
+        std::stringstream ss;
+        ss << "Render graph: " << stats.passes - stats.culled << "/" << stats.passes << " passes, " << stats.barriers << " barriers";
+        textOverlay->addText(ss.str(), 5.0f, 125.0f, vkx::TextOverlay::alignLeft);
     }
 
     void toggleBlur() {
         blur = !blur;
+        graph.setOutput("color", blur);
+        primaryCmdBuffersDirty = true;
         updateUniformBuffersScene();
         updateDrawCommandBuffers();
     }
@@ -176,7 +176,9 @@ namespace vkx {
         virtual void buildOffscreenCommandBuffer() = 0;
 
         void draw() override {
-            prepareFrame();
+            if (!prepareFrame()) {
+                return;
+            }
             if (offscreen.active) {
                 submit(offscreen.cmdBuffer, { { semaphores.acquireComplete, vk::PipelineStageFlagBits::eBottomOfPipe } }, offscreen.renderComplete);
             }
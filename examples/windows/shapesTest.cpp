@@ -78,6 +78,12 @@ public:
     void render() {
         vk::Fence submitFence = swapChain.getSubmitFence(true);
         auto currentImage = swapChain.acquireNextImage(vulkanRenderer.semaphores.renderStart);
+        // Out of date, e.g. while minimized.  This example doesn't recreate the swap chain, but
+        // the image's fence still has to be signalled.
+        if (currentImage == UINT32_MAX) {
+            queue.submit(nullptr, submitFence);
+            return;
+        }
         vulkanRenderer.render();
 
         submit(
@@ -0,0 +1,51 @@
+/*
+* Converts KTX / DDS textures into supercompressed .ktxz containers
+*
+* Usage: ktxz [-level N] <texture> [<texture> ...]
+* Each container is written next to its source, with the extension replaced by .ktxz
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include "textureContainer.h"
+
+int main(int argc, char* argv[]) {
+    int compressionLevel = 9;
+    int converted = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (0 == strcmp(argv[i], "-level") && i + 1 < argc) {
+            compressionLevel = atoi(argv[++i]);
+            continue;
+        }
+
+        const std::string filename = argv[i];
+        gli::texture texture = gli::load(filename);
+        if (texture.empty()) {
+            std::cerr << "Unable to load " << filename << std::endl;
+            return 1;
+        }
+
+        const std::string output = vkx::ktxz::containerFilename(filename);
+        try {
+            uint64_t written = vkx::ktxz::write(output, texture, compressionLevel);
+            std::cout << filename << " -> " << output << ": " << texture.size() << " -> " << written << " bytes ("
+                << std::fixed << std::setprecision(1) << (100.0 * written / texture.size()) << "%)" << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        ++converted;
+    }
+
+    if (!converted) {
+        std::cerr << "Usage: " << argv[0] << " [-level N] <texture> [<texture> ...]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
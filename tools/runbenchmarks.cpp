@@ -0,0 +1,457 @@
+/*
+* Runs examples in headless benchmark mode and compares their reports to a baseline
+*
+* Usage: runbenchmarks [-baseline <file>] [-output <dir>] [-frames N] [-warmup N] [-threshold F]
+*                      [-update-baseline] <example executable> [...]
+*
+* Each example writes <output>/<name>.json.  The frame time percentiles of the report fail the run
+* if they exceed the baseline by more than the threshold, a fraction (0.1 is 10% slower).  The
+* threshold comes from -threshold, else the example's entry in the baseline, else the baseline's
+* top level "threshold".  Heap allocations fail the run if there are more than in the baseline.
+* Examples without baseline values fail the run, so the gate can't pass by comparing nothing.
+* Entries with "skip": true aren't run.  -update-baseline rewrites the baseline with the measured
+* values, keeping thresholds and skipped entries, and doesn't fail on missing values.  The
+* update-benchmark-baseline target does that for benchmarks/baseline.json, run it on the reference
+* machine (lavapipe, headless) and commit the result.
+*
+* Baseline format:
+* { "threshold": 0.15, "examples": { "triangle": { "threshold": 0.2, "cpuFrameTime.p50": 1.5, ... } } }
+*
+* Exits with 1 if an example failed to run, regressed or has no baseline.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark.hpp"
+
+namespace {
+    // Just enough JSON to read the reports and the baseline
+    struct Json {
+        enum class Type { Null, Boolean, Number, String, Array, Object };
+        Type type{ Type::Null };
+        bool boolean{ false };
+        double number{ 0 };
+        std::string string;
+        std::vector<Json> array;
+        std::vector<std::pair<std::string, Json>> object;
+
+        const Json* find(const std::string& key) const {
+            for (const auto& member : object) {
+                if (member.first == key) {
+                    return &member.second;
+                }
+            }
+            return nullptr;
+        }
+
+        // Member at a dot separated path such as "cpuFrameTime.p50"
+        const Json* path(const std::string& keys) const {
+            const Json* result = this;
+            std::string::size_type begin = 0;
+            while (result && begin <= keys.size()) {
+                std::string::size_type end = keys.find('.', begin);
+                if (end == std::string::npos) {
+                    end = keys.size();
+                }
+                result = result->find(keys.substr(begin, end - begin));
+                begin = end + 1;
+            }
+            return result;
+        }
+
+        bool isNumber() const {
+            return type == Type::Number;
+        }
+    };
+
+    class JsonParser {
+    public:
+        JsonParser(const std::string& text) : text(text) {}
+
+        Json parse() {
+            Json result = value();
+            skipSpace();
+            if (position != text.size()) {
+                fail("trailing characters");
+            }
+            return result;
+        }
+
+    private:
+        const std::string& text;
+        size_t position{ 0 };
+
+        [[noreturn]] void fail(const std::string& message) {
+            throw std::runtime_error("JSON " + message + " at offset " + std::to_string(position));
+        }
+
+        void skipSpace() {
+            while (position < text.size() && isspace((unsigned char)text[position])) {
+                ++position;
+            }
+        }
+
+        bool consume(char c) {
+            skipSpace();
+            if (position < text.size() && text[position] == c) {
+                ++position;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char c) {
+            if (!consume(c)) {
+                fail(std::string("expected '") + c + "'");
+            }
+        }
+
+        bool literal(const char* word) {
+            size_t length = strlen(word);
+            if (0 == text.compare(position, length, word)) {
+                position += length;
+                return true;
+            }
+            return false;
+        }
+
+        std::string string() {
+            expect('"');
+            std::string result;
+            while (position < text.size() && text[position] != '"') {
+                char c = text[position++];
+                if (c == '\\' && position < text.size()) {
+                    c = text[position++];
+                    switch (c) {
+                    case 'n': c = '\n'; break;
+                    case 't': c = '\t'; break;
+                    case 'r': c = '\r'; break;
+                    case 'b': c = '\b'; break;
+                    case 'f': c = '\f'; break;
+                    case 'u':
+                        // Only ever used for control characters by the writers in this repo
+                        c = (char)strtol(text.substr(position, 4).c_str(), nullptr, 16);
+                        position += 4;
+                        break;
+                    default: break;
+                    }
+                }
+                result += c;
+            }
+            expect('"');
+            return result;
+        }
+
+        Json value() {
+            Json result;
+            skipSpace();
+            if (position == text.size()) {
+                fail("unexpected end");
+            }
+            char c = text[position];
+            if (c == '{') {
+                result.type = Json::Type::Object;
+                ++position;
+                if (!consume('}')) {
+                    do {
+                        skipSpace();
+                        std::string key = string();
+                        expect(':');
+                        result.object.emplace_back(key, value());
+                    } while (consume(','));
+                    expect('}');
+                }
+            } else if (c == '[') {
+                result.type = Json::Type::Array;
+                ++position;
+                if (!consume(']')) {
+                    do {
+                        result.array.push_back(value());
+                    } while (consume(','));
+                    expect(']');
+                }
+            } else if (c == '"') {
+                result.type = Json::Type::String;
+                result.string = string();
+            } else if (literal("true")) {
+                result.type = Json::Type::Boolean;
+                result.boolean = true;
+            } else if (literal("false")) {
+                result.type = Json::Type::Boolean;
+            } else if (literal("null")) {
+            } else {
+                const char* begin = text.c_str() + position;
+                char* end = nullptr;
+                result.type = Json::Type::Number;
+                result.number = strtod(begin, &end);
+                if (end == begin) {
+                    fail("unexpected character");
+                }
+                position += end - begin;
+            }
+            return result;
+        }
+    };
+
+    bool readJson(const std::string& filename, Json& result) {
+        std::ifstream in(filename);
+        if (!in) {
+            return false;
+        }
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        try {
+            result = JsonParser(buffer.str()).parse();
+        } catch (const std::exception& e) {
+            std::cerr << filename << ": " << e.what() << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Compared relative to the baseline, lower is better
+    const char* const FRAME_TIME_METRICS[] = { "cpuFrameTime.p50", "cpuFrameTime.p95", "gpuFrameTime.p50", "gpuFrameTime.p95" };
+    // Compared exactly
+    const char* const HEAP_ALLOCATIONS = "heapAllocations";
+
+    struct Result {
+        std::string name;
+        bool skipped{ false };
+        bool failed{ false };
+        bool regressed{ false };
+        // No baseline value to compare any metric against
+        bool unbaselined{ false };
+        // Measured metrics, for updating the baseline
+        std::vector<std::pair<std::string, double>> metrics;
+    };
+
+    std::string exampleName(const std::string& executable) {
+        std::string::size_type slash = executable.find_last_of("/\\");
+        std::string name = slash == std::string::npos ? executable : executable.substr(slash + 1);
+        std::string::size_type dot = name.rfind('.');
+        return dot == std::string::npos ? name : name.substr(0, dot);
+    }
+
+    std::string shellQuote(const std::string& value) {
+#if defined(_WIN32)
+        return "\"" + value + "\"";
+#else
+        std::string result{ "'" };
+        for (char c : value) {
+            result += c == '\'' ? std::string("'\\''") : std::string(1, c);
+        }
+        return result + "'";
+#endif
+    }
+
+    void writeBaseline(const std::string& filename, const Json& previous, double defaultThreshold, const std::vector<Result>& results) {
+        using vkx::benchmark::quote;
+        std::ofstream out(filename);
+        if (!out) {
+            std::cerr << "Could not write " << filename << std::endl;
+            return;
+        }
+        out << "{\n  \"threshold\": " << defaultThreshold << ",\n  \"examples\": {";
+        const Json* previousExamples = previous.find("examples");
+        bool first = true;
+        auto writeEntry = [&](const std::string& name, const Json* entry, const std::vector<std::pair<std::string, double>>& metrics) {
+            out << (first ? "\n" : ",\n") << "    " << quote(name) << ": {";
+            first = false;
+            std::vector<std::pair<std::string, std::string>> members;
+            if (entry && entry->find("skip") && entry->find("skip")->boolean) {
+                members.emplace_back("skip", "true");
+            }
+            if (entry && entry->find("threshold") && entry->find("threshold")->isNumber()) {
+                std::stringstream value;
+                value << entry->find("threshold")->number;
+                members.emplace_back("threshold", value.str());
+            }
+            for (const auto& metric : metrics) {
+                std::stringstream value;
+                value << metric.second;
+                members.emplace_back(metric.first, value.str());
+            }
+            for (size_t i = 0; i < members.size(); ++i) {
+                out << (i ? ", " : " ") << quote(members[i].first) << ": " << members[i].second;
+            }
+            out << " }";
+        };
+        // Entries of examples that weren't run this time are kept as they were
+        if (previousExamples) {
+            for (const auto& member : previousExamples->object) {
+                auto result = std::find_if(results.begin(), results.end(), [&](const Result& r) { return r.name == member.first; });
+                if (result != results.end() && !result->skipped && !result->failed) {
+                    continue;
+                }
+                std::vector<std::pair<std::string, double>> metrics;
+                for (const auto& value : member.second.object) {
+                    if (value.first != "skip" && value.first != "threshold" && value.second.isNumber()) {
+                        metrics.emplace_back(value.first, value.second.number);
+                    }
+                }
+                writeEntry(member.first, &member.second, metrics);
+            }
+        }
+        for (const auto& result : results) {
+            if (!result.skipped && !result.failed) {
+                writeEntry(result.name, previousExamples ? previousExamples->find(result.name) : nullptr, result.metrics);
+            }
+        }
+        out << "\n  }\n}\n";
+        std::cout << "Updated " << filename << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string baselineFile;
+    std::string outputDir{ "." };
+    std::string frames{ "300" };
+    std::string warmup{ "60" };
+    double thresholdOverride = -1.0;
+    bool updateBaseline = false;
+    std::vector<std::string> executables;
+    for (int i = 1; i < argc; ++i) {
+        auto option = [&](const char* name) {
+            return 0 == strcmp(argv[i], name) && i + 1 < argc;
+        };
+        if (option("-baseline")) {
+            baselineFile = argv[++i];
+        } else if (option("-output")) {
+            outputDir = argv[++i];
+        } else if (option("-frames")) {
+            frames = argv[++i];
+        } else if (option("-warmup")) {
+            warmup = argv[++i];
+        } else if (option("-threshold")) {
+            thresholdOverride = atof(argv[++i]);
+        } else if (0 == strcmp(argv[i], "-update-baseline")) {
+            updateBaseline = true;
+        } else {
+            executables.push_back(argv[i]);
+        }
+    }
+
+    if (executables.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [-baseline <file>] [-output <dir>] [-frames N] [-warmup N] [-threshold F] [-update-baseline] <example> [...]" << std::endl;
+        return 1;
+    }
+
+    Json baseline;
+    if (!baselineFile.empty() && !readJson(baselineFile, baseline) && !updateBaseline) {
+        std::cerr << "Could not read baseline " << baselineFile << std::endl;
+        return 1;
+    }
+    const Json* baselineExamples = baseline.find("examples");
+    double defaultThreshold = 0.15;
+    if (baseline.find("threshold") && baseline.find("threshold")->isNumber()) {
+        defaultThreshold = baseline.find("threshold")->number;
+    }
+
+    std::vector<Result> results;
+    std::cout << std::fixed << std::setprecision(3);
+    for (const auto& executable : executables) {
+        Result result;
+        result.name = exampleName(executable);
+        const Json* expected = baselineExamples ? baselineExamples->find(result.name) : nullptr;
+        if (expected && expected->find("skip") && expected->find("skip")->boolean) {
+            result.skipped = true;
+            std::cout << result.name << ": skipped" << std::endl;
+            results.push_back(result);
+            continue;
+        }
+
+        const std::string report = outputDir + "/" + result.name + ".json";
+        remove(report.c_str());
+        const std::string command = shellQuote(executable) + " -headless -benchmark -benchmark-warmup " + warmup +
+            " -benchmark-frames " + frames + " -benchmark-output " + shellQuote(report);
+        std::cout << result.name << ": running" << std::endl;
+        int status = system(command.c_str());
+        Json measured;
+        if (status != 0 || !readJson(report, measured)) {
+            std::cout << result.name << ": FAILED, exit status " << status << std::endl;
+            result.failed = true;
+            results.push_back(result);
+            continue;
+        }
+
+        double threshold = defaultThreshold;
+        if (thresholdOverride >= 0.0) {
+            threshold = thresholdOverride;
+        } else if (expected && expected->find("threshold") && expected->find("threshold")->isNumber()) {
+            threshold = expected->find("threshold")->number;
+        }
+
+        bool compared = false;
+        for (const char* metric : FRAME_TIME_METRICS) {
+            const Json* value = measured.path(metric);
+            if (!value || !value->isNumber()) {
+                continue;
+            }
+            result.metrics.emplace_back(metric, value->number);
+            std::cout << "  " << std::left << std::setw(20) << metric << std::right << std::setw(10) << value->number << " ms";
+            const Json* reference = expected ? expected->find(metric) : nullptr;
+            if (reference && reference->isNumber() && reference->number > 0.0) {
+                compared = true;
+                double change = value->number / reference->number - 1.0;
+                bool regressed = change > threshold;
+                result.regressed |= regressed;
+                std::cout << "  baseline " << std::setw(10) << reference->number << " ms  " << std::showpos << std::setprecision(1)
+                    << change * 100.0 << "%" << std::noshowpos << std::setprecision(3) << (regressed ? "  REGRESSION" : "");
+            }
+            std::cout << std::endl;
+        }
+
+        const Json* allocations = measured.find(HEAP_ALLOCATIONS);
+        if (allocations && allocations->isNumber()) {
+            result.metrics.emplace_back(HEAP_ALLOCATIONS, allocations->number);
+            std::cout << "  " << std::left << std::setw(20) << HEAP_ALLOCATIONS << std::right << std::setw(10) << (uint64_t)allocations->number;
+            const Json* reference = expected ? expected->find(HEAP_ALLOCATIONS) : nullptr;
+            if (reference && reference->isNumber()) {
+                compared = true;
+                bool regressed = allocations->number > reference->number;
+                result.regressed |= regressed;
+                std::cout << "     baseline " << std::setw(10) << (uint64_t)reference->number << (regressed ? "  REGRESSION" : "");
+            }
+            std::cout << std::endl;
+        }
+        if (!compared) {
+            result.unbaselined = true;
+            std::cout << "  no baseline" << (updateBaseline ? "" : ", FAILED") << std::endl;
+        }
+        results.push_back(result);
+    }
+
+    uint32_t failed = 0, regressed = 0, skipped = 0, unbaselined = 0;
+    for (const auto& result : results) {
+        failed += result.failed ? 1 : 0;
+        regressed += result.regressed ? 1 : 0;
+        skipped += result.skipped ? 1 : 0;
+        unbaselined += result.unbaselined ? 1 : 0;
+    }
+    std::cout << results.size() << " examples: " << failed << " failed, " << regressed << " regressed, " << skipped << " skipped, "
+        << unbaselined << " without baseline" << std::endl;
+
+    if (updateBaseline) {
+        if (baselineFile.empty()) {
+            std::cerr << "-update-baseline needs -baseline" << std::endl;
+            return 1;
+        }
+        writeBaseline(baselineFile, baseline, defaultThreshold, results);
+        return failed ? 1 : 0;
+    }
+    return (failed || regressed || unbaselined) ? 1 : 0;
+}